@@ -0,0 +1,160 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Comparison of cached contour cells with single pass contours.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+
+#ifdef USE_GDAL
+#include "gdal.h"
+#include "cpl_vsi.h"
+
+/*
+** Writes a smooth Float32 GeoTIFF to /vsimem/, contours it in a single
+** pass and with the contour cache in small cells, and compares the number
+** of lines and their total length.  Contours stitched across the cell
+** boundaries must give the same lines GDAL draws on the whole window.
+** Exits with 1 if they differ.
+*/
+
+#define TST_RASTER "/vsimem/contourtst.tif"
+#define TST_SIZE 300
+
+static int createRaster(void)
+{
+  GDALDriverH hDriver = GDALGetDriverByName("GTiff");
+  GDALDatasetH hDS;
+  double adfGeoTransform[6] = { 0.0, 1.0, 0.0, TST_SIZE, 0.0, -1.0 };
+  float *pafData;
+  int x, y;
+  CPLErr eErr;
+
+  if(hDriver == NULL)
+    return MS_FAILURE;
+  hDS = GDALCreate(hDriver, TST_RASTER, TST_SIZE, TST_SIZE, 1, GDT_Float32, NULL);
+  if(hDS == NULL)
+    return MS_FAILURE;
+  GDALSetGeoTransform(hDS, adfGeoTransform);
+
+  pafData = (float *) msSmallMalloc(sizeof(float) * TST_SIZE * TST_SIZE);
+  for(y = 0; y < TST_SIZE; y++)
+    for(x = 0; x < TST_SIZE; x++)
+      pafData[y * TST_SIZE + x] = (float) (50.0 * sin(x / 23.0) * cos(y / 31.0) + x * 0.1);
+  eErr = GDALRasterIO(GDALGetRasterBand(hDS, 1), GF_Write, 0, 0, TST_SIZE, TST_SIZE,
+                      pafData, TST_SIZE, TST_SIZE, GDT_Float32, 0, 0);
+  free(pafData);
+  GDALClose(hDS);
+
+  return eErr == CE_None ? MS_SUCCESS : MS_FAILURE;
+}
+
+static int readContours(const char *cache, int *pnLines, double *pdfLength)
+{
+  char mapfile[1024];
+  mapObj *map;
+  layerObj *layer;
+  shapeObj shape;
+  int i, j, status;
+
+  snprintf(mapfile, sizeof(mapfile),
+           "MAP SIZE %d %d EXTENT 0 0 %d %d "
+           "LAYER NAME \"c\" TYPE LINE STATUS ON CONNECTIONTYPE CONTOUR DATA \"" TST_RASTER "\" "
+           "PROCESSING \"CONTOUR_INTERVAL=10\" %s END END",
+           TST_SIZE, TST_SIZE, TST_SIZE, TST_SIZE, cache);
+  map = msLoadMapFromString(mapfile, NULL);
+  if(map == NULL)
+    return MS_FAILURE;
+  layer = GET_LAYER(map, 0);
+
+  *pnLines = 0;
+  *pdfLength = 0.0;
+  status = msLayerOpen(layer);
+  if(status == MS_SUCCESS)
+    status = msLayerWhichItems(layer, MS_FALSE, NULL);
+  if(status == MS_SUCCESS)
+    status = msLayerWhichShapes(layer, map->extent, MS_FALSE);
+  if(status == MS_SUCCESS) {
+    msInitShape(&shape);
+    while((status = msLayerNextShape(layer, &shape)) == MS_SUCCESS) {
+      for(i = 0; i < shape.numlines; i++) {
+        for(j = 1; j < shape.line[i].numpoints; j++)
+          *pdfLength += msDistancePointToPoint(shape.line[i].point + j - 1, shape.line[i].point + j);
+        (*pnLines)++;
+      }
+      msFreeShape(&shape);
+    }
+    if(status == MS_DONE)
+      status = MS_SUCCESS;
+  }
+  msLayerClose(layer);
+  msFreeMap(map);
+  return status;
+}
+
+int main(int argc, char *argv[])
+{
+  int nSingle, nCells;
+  double dfSingle, dfCells;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  msGDALInitialize();
+  if(createRaster() != MS_SUCCESS) {
+    printf("could not create %s\n", TST_RASTER);
+    msCleanup();
+    return 1;
+  }
+
+  if(readContours("", &nSingle, &dfSingle) != MS_SUCCESS ||
+      readContours("PROCESSING \"CONTOUR_CACHE=ON\" PROCESSING \"CONTOUR_CELL_SIZE=16\"",
+                   &nCells, &dfCells) != MS_SUCCESS) {
+    msWriteError(stderr);
+    VSIUnlink(TST_RASTER);
+    msCleanup();
+    return 1;
+  }
+  VSIUnlink(TST_RASTER);
+  msCleanup();
+
+  printf("single pass: %d lines, length %.6f\n", nSingle, dfSingle);
+  printf("cells:       %d lines, length %.6f\n", nCells, dfCells);
+  if(nSingle == 0 || nSingle != nCells || fabs(dfSingle - dfCells) > 1e-6 * dfSingle)
+    return 1;
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("contourtst requires GDAL support\n");
+  return 0;
+}
+
+#endif /* USE_GDAL */
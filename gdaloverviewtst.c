@@ -0,0 +1,185 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Pixel comparison test of the GDAL overview reads of raster draws.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+
+#ifdef USE_GDAL
+#include "gdal.h"
+#include "cpl_vsi.h"
+
+/*
+** Writes a GeoTIFF with a nearest neighbour overview to /vsimem/, draws
+** it at a few extents that are not aligned on the overview pixels, once
+** letting GDAL pick the overview and once forcing it with the
+** OVERVIEW_LEVEL=1 processing option, and compares the pixels of both
+** images.  Exits with 1 if any pixel differs.  Needs GDAL 2.0 or later,
+** OVERVIEW_LEVEL is ignored before.
+*/
+
+#define TST_RASTER "/vsimem/gdaloverviewtst.tif"
+#define TST_SIZE 512
+
+static int createRaster(void)
+{
+  GDALDriverH hDriver = GDALGetDriverByName("GTiff");
+  GDALDatasetH hDS;
+  double adfGeoTransform[6] = { 0.0, 1.0, 0.0, TST_SIZE, 0.0, -1.0 };
+  int anOverviews[1] = { 2 };
+  GByte *pabyData;
+  int x, y;
+
+  if(hDriver == NULL)
+    return MS_FAILURE;
+  hDS = GDALCreate(hDriver, TST_RASTER, TST_SIZE, TST_SIZE, 1, GDT_Byte, NULL);
+  if(hDS == NULL)
+    return MS_FAILURE;
+  GDALSetGeoTransform(hDS, adfGeoTransform);
+
+  /* neighbouring pixels all differ, so a one pixel shift shows */
+  pabyData = (GByte *) msSmallMalloc(TST_SIZE * TST_SIZE);
+  for(y = 0; y < TST_SIZE; y++)
+    for(x = 0; x < TST_SIZE; x++)
+      pabyData[y * TST_SIZE + x] = (GByte) ((x * 7 + y * 31) & 0xff);
+  if(GDALRasterIO(GDALGetRasterBand(hDS, 1), GF_Write, 0, 0, TST_SIZE, TST_SIZE,
+                  pabyData, TST_SIZE, TST_SIZE, GDT_Byte, 0, 0) != CE_None
+      || GDALBuildOverviews(hDS, "NEAREST", 1, anOverviews, 0, NULL, NULL, NULL) != CE_None) {
+    free(pabyData);
+    GDALClose(hDS);
+    return MS_FAILURE;
+  }
+  free(pabyData);
+  GDALClose(hDS);
+
+  return MS_SUCCESS;
+}
+
+static imageObj *drawRaster(rectObj extent, const char *level, mapObj **map)
+{
+  char mapfile[1024];
+
+  snprintf(mapfile, sizeof(mapfile),
+           "MAP SIZE 100 100 EXTENT %.15g %.15g %.15g %.15g "
+           "OUTPUTFORMAT NAME \"png\" DRIVER \"AGG/PNG\" IMAGEMODE RGB END "
+           "LAYER NAME \"r\" TYPE RASTER STATUS ON DATA \"" TST_RASTER "\" "
+           "%s%s%s END END",
+           extent.minx, extent.miny, extent.maxx, extent.maxy,
+           level ? "PROCESSING \"OVERVIEW_LEVEL=" : "", level ? level : "", level ? "\"" : "");
+
+  *map = msLoadMapFromString(mapfile, NULL);
+  if(*map == NULL)
+    return NULL;
+  return msDrawMap(*map, MS_FALSE);
+}
+
+static int comparePixels(imageObj *a, imageObj *b, int *pnDiffering)
+{
+  rasterBufferObj ra, rb;
+  int x, y;
+
+  if(MS_IMAGE_RENDERER(a)->getRasterBufferHandle(a, &ra) != MS_SUCCESS ||
+      MS_IMAGE_RENDERER(b)->getRasterBufferHandle(b, &rb) != MS_SUCCESS)
+    return MS_FAILURE;
+
+  *pnDiffering = 0;
+  for(y = 0; y < (int) ra.height; y++) {
+    for(x = 0; x < (int) ra.width; x++) {
+      unsigned char *pa = ra.data.rgba.r + y * ra.data.rgba.row_step + x * ra.data.rgba.pixel_step;
+      unsigned char *pb = rb.data.rgba.r + y * rb.data.rgba.row_step + x * rb.data.rgba.pixel_step;
+      if(*pa != *pb)
+        (*pnDiffering)++;
+    }
+  }
+  return MS_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  /* about twice the overview resolution, at odd offsets */
+  static const double offsets[][2] = { { 0, 0 }, { 1, 1 }, { 3.3, 5.7 }, { 17.5, 2.25 }, { 101, 33 } };
+  int i, failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  msGDALInitialize();
+  if(createRaster() != MS_SUCCESS) {
+    printf("could not create %s\n", TST_RASTER);
+    msCleanup();
+    return 1;
+  }
+
+  for(i = 0; i < (int) (sizeof(offsets) / sizeof(offsets[0])); i++) {
+    rectObj extent;
+    imageObj *byGDAL, *forced;
+    mapObj *map1 = NULL, *map2 = NULL;
+    int nDiffering = -1;
+
+    extent.minx = offsets[i][0];
+    extent.miny = offsets[i][1];
+    extent.maxx = extent.minx + 205;
+    extent.maxy = extent.miny + 205;
+
+    byGDAL = drawRaster(extent, NULL, &map1);
+    forced = drawRaster(extent, "1", &map2);
+    if(byGDAL == NULL || forced == NULL || comparePixels(byGDAL, forced, &nDiffering) != MS_SUCCESS) {
+      msWriteError(stderr);
+      failures++;
+    } else {
+      printf("extent %g %g %g %g: %d pixels differ\n",
+             extent.minx, extent.miny, extent.maxx, extent.maxy, nDiffering);
+      if(nDiffering != 0)
+        failures++;
+    }
+    if(byGDAL) msFreeImage(byGDAL);
+    if(forced) msFreeImage(forced);
+    if(map1) msFreeMap(map1);
+    if(map2) msFreeMap(map2);
+  }
+
+  VSIUnlink(TST_RASTER);
+  VSIUnlink(TST_RASTER ".ovr");
+  msCleanup();
+
+  if(failures) {
+    printf("%d extent(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("gdaloverviewtst requires GDAL support\n");
+  return 0;
+}
+
+#endif /* USE_GDAL */
@@ -281,7 +281,7 @@ int msHitTestMap(mapObj *map, map_hittest *hittest) {
     return MS_FAILURE;
   }
   for(i=0; i<map->numlayers; i++) {
-    layerObj *lp = map->layers[i];
+    layerObj *lp = GET_LAYER(map, i);
     status = msHitTestLayer(map,lp,&hittest->layerhits[i]);
     if(status != MS_SUCCESS) {
       return MS_FAILURE;
@@ -0,0 +1,202 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Commandline benchmark of the raster output formats on tiles.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+/*
+** Encodes 256x256 tiles of a synthetic map and of a synthetic photo, or of
+** a PNG given on the command line, with each of the raster output formats
+** and reports the average time and size per tile.
+*/
+
+#define TILE_SIZE 256
+
+typedef struct {
+  const char *name;
+  const char *driver;
+  const char *options[4]; /* key, value pairs */
+} formatEntry;
+
+static formatEntry formats[] = {
+  {"png", "AGG/PNG", {NULL}},
+  {"png COMPRESSION=FAST", "AGG/PNG", {"COMPRESSION", "FAST", NULL}},
+  {"png COMPRESSION=9", "AGG/PNG", {"COMPRESSION", "9", NULL}},
+  {"png8", "AGG/PNG8", {NULL}},
+  {"jpeg", "AGG/JPEG", {NULL}},
+#ifdef USE_WEBP
+  {"webp", "AGG/WEBP", {NULL}},
+  {"webp METHOD=0", "AGG/WEBP", {"METHOD", "0", NULL}},
+  {"webp LOSSLESS=YES", "AGG/WEBP", {"LOSSLESS", "YES", NULL}},
+  {"webp lossless METHOD=0", "AGG/WEBP", {"LOSSLESS", "YES", "METHOD", "0"}},
+#endif
+  {NULL, NULL, {NULL}}
+};
+
+static void init_rgba(rasterBufferObj *rb, int width, int height)
+{
+  memset(rb, 0, sizeof(rasterBufferObj));
+  rb->type = MS_BUFFER_BYTE_RGBA;
+  rb->width = width;
+  rb->height = height;
+  rb->data.rgba.pixel_step = 4;
+  rb->data.rgba.row_step = width * 4;
+  rb->data.rgba.pixels = (unsigned char*)msSmallCalloc(width*height, 4);
+  rb->data.rgba.b = rb->data.rgba.pixels;
+  rb->data.rgba.g = rb->data.rgba.pixels + 1;
+  rb->data.rgba.r = rb->data.rgba.pixels + 2;
+}
+
+/* flat areas and antialiased roads */
+static void make_map(rasterBufferObj *rb)
+{
+  int x, y;
+  for(y=0; y<rb->height; y++) {
+    for(x=0; x<rb->width; x++) {
+      rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + y*rb->data.rgba.row_step) + x;
+      int zone = ((x/97) + (y/61)*3) % 9;
+      int road = abs((x + 2*y) % 211 - 105);
+      p->r = 40 + zone*23;
+      p->g = 200 - zone*17;
+      p->b = 90 + zone*11;
+      p->a = 255;
+      if(road < 4) {
+        int v = 255 - road*50;
+        p->r = (p->r*(255-v) + 250*v)/255;
+        p->g = (p->g*(255-v) + 220*v)/255;
+        p->b = (p->b*(255-v) + 60*v)/255;
+      }
+    }
+  }
+}
+
+/* smooth gradients with some noise */
+static void make_photo(rasterBufferObj *rb)
+{
+  int x, y;
+  srand(2);
+  for(y=0; y<rb->height; y++) {
+    for(x=0; x<rb->width; x++) {
+      rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + y*rb->data.rgba.row_step) + x;
+      double v = 0.5 + 0.25*sin(x/37.0) * cos(y/23.0) + 0.2*sin((x+y)/71.0);
+      int n = rand() % 24 - 12;
+      p->r = MS_MAX(0, MS_MIN(255, (int)(v*180) + n + x/20));
+      p->g = MS_MAX(0, MS_MIN(255, (int)(v*210) + n));
+      p->b = MS_MAX(0, MS_MIN(255, (int)(v*140) + n + y/25));
+      p->a = 255;
+    }
+  }
+}
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+static int bench(const char *name, rasterBufferObj *image)
+{
+  rasterBufferObj tile;
+  int ntiles = (image->width/TILE_SIZE) * (image->height/TILE_SIZE);
+  int f;
+
+  if(ntiles == 0) {
+    fprintf(stderr, "%s is smaller than a tile\n", name);
+    return 1;
+  }
+  printf("%s, %d tiles of %dx%d\n", name, ntiles, TILE_SIZE, TILE_SIZE);
+
+  for(f=0; formats[f].name; f++) {
+    outputFormatObj *format = msCreateDefaultOutputFormat(NULL, formats[f].driver, "bench");
+    struct mstimeval start;
+    double seconds = 0;
+    size_t bytes = 0;
+    int i, x, y;
+
+    if(!format) {
+      msWriteError(stderr);
+      return 1;
+    }
+    for(i=0; i<4 && formats[f].options[i]; i+=2)
+      msSetOutputFormatOption(format, formats[f].options[i], formats[f].options[i+1]);
+
+    init_rgba(&tile, TILE_SIZE, TILE_SIZE);
+    for(y=0; y+TILE_SIZE<=image->height; y+=TILE_SIZE) {
+      for(x=0; x+TILE_SIZE<=image->width; x+=TILE_SIZE) {
+        bufferObj buffer;
+        int row;
+        /* copy each time, quantization modifies the pixels */
+        for(row=0; row<TILE_SIZE; row++)
+          memcpy(tile.data.rgba.pixels + row*tile.data.rgba.row_step,
+                 image->data.rgba.pixels + (y+row)*image->data.rgba.row_step + x*4, TILE_SIZE*4);
+        msBufferInit(&buffer);
+        msGettimeofday(&start, NULL);
+        if(msSaveRasterBufferToBuffer(&tile, &buffer, format) != MS_SUCCESS) {
+          msWriteError(stderr);
+          return 1;
+        }
+        seconds += elapsed(&start);
+        bytes += buffer.size;
+        msBufferFree(&buffer);
+      }
+    }
+    printf("  %-24s %8.3f ms %9.0f bytes per tile\n", formats[f].name,
+           1000 * seconds / ntiles, (double)bytes / ntiles);
+    free(tile.data.rgba.pixels);
+    msFreeOutputFormat(format);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  rasterBufferObj image;
+  int status = 0;
+
+  if(argc > 1) {
+    if(msLoadMSRasterBufferFromFile(argv[1], &image) != MS_SUCCESS) {
+      msWriteError(stderr);
+      return 1;
+    }
+    image.data.rgba.a = NULL;
+    status = bench(argv[1], &image);
+    free(image.data.rgba.pixels);
+    return status;
+  }
+
+  init_rgba(&image, 8*TILE_SIZE, 8*TILE_SIZE);
+  make_map(&image);
+  status |= bench("map", &image);
+  make_photo(&image);
+  status |= bench("photo", &image);
+  free(image.data.rgba.pixels);
+
+  msCleanup();
+  return status;
+}
@@ -27,57 +27,249 @@
  *****************************************************************************/
 
 #include "mapserver.h"
+#include "mapthread.h"
+#include "maptime.h"
 #include <float.h>
-#ifdef USE_GDAL
 
-#include "gdal.h"
-#include "cpl_string.h"
+/************************************************************************/
+/* ==================================================================== */
+/*      Density surface smoothing.                                      */
+/*                                                                      */
+/*      MS_KERNELDENSITY_GAUSSIAN is the exact separable convolution     */
+/*      with a gaussian of sigma radius/3, truncated at the radius.     */
+/*      MS_KERNELDENSITY_BOX approximates it with three successive box  */
+/*      blurs computed with running sums, so the cost does not depend   */
+/*      on the radius.  The passes are written so that the inner loops  */
+/*      run over contiguous pixels and can be vectorized by the         */
+/*      compiler, and are split in bands of rows or columns over        */
+/*      nThreads threads.                                               */
+/* ==================================================================== */
+/************************************************************************/
+
+typedef struct {
+  float *src;
+  float *dst;
+  int width;
+  int height;
+  int radius; /* of the gaussian or the box */
+  const float *kernel;
+  double *accum; /* running column sums of the vertical box pass */
+  int nTasks;
+} kernelDensityBlurInfo;
+
+/* the rows or columns [*start,*end) of the task iTask over size */
+static void msKernelDensityTaskRange(int size, int nTasks, int iTask, int *start, int *end)
+{
+  *start = (int)(((long)size * iTask) / nTasks);
+  *end = (int)(((long)size * (iTask+1)) / nTasks);
+}
+
+/************************************************************************/
+/*                   msKernelDensityGaussianRowTask()                   */
+/************************************************************************/
+
+static void msKernelDensityGaussianRowTask(void *pData, int iTask)
+{
+  kernelDensityBlurInfo *info = (kernelDensityBlurInfo*)pData;
+  int length = info->radius*2+1, n = info->width - 2*info->radius;
+  int i, x, y, ystart, yend;
+
+  msKernelDensityTaskRange(info->height, info->nTasks, iTask, &ystart, &yend);
+  for(y=ystart; y<yend; y++) {
+    const float *src_row = info->src + (size_t)info->width*y;
+    float *dst_row = info->dst + (size_t)info->width*y;
+
+    memset(dst_row, 0, info->width*sizeof(float));
+    if(n <= 0)
+      continue;
+    /* dst_row[radius+x] = sum(src_row[x+i] * kernel[i]), summed in order */
+    for(i=0; i<length; i++) {
+      const float k = info->kernel[i];
+      const float *s = src_row + i;
+      float *d = dst_row + info->radius;
+      for(x=0; x<n; x++)
+        d[x] += s[x] * k;
+    }
+  }
+}
+
+/************************************************************************/
+/*                  msKernelDensityGaussianColumnTask()                 */
+/************************************************************************/
+
+static void msKernelDensityGaussianColumnTask(void *pData, int iTask)
+{
+  kernelDensityBlurInfo *info = (kernelDensityBlurInfo*)pData;
+  int length = info->radius*2+1, width = info->width;
+  int i, x, y, ystart, yend;
+
+  msKernelDensityTaskRange(info->height - 2*info->radius, info->nTasks, iTask, &ystart, &yend);
+  for(y=ystart+info->radius; y<yend+info->radius; y++) {
+    float *d = info->dst + (size_t)width*y;
+
+    memset(d, 0, width*sizeof(float));
+    for(i=0; i<length; i++) {
+      const float k = info->kernel[i];
+      const float *s = info->src + (size_t)width*(y+i-info->radius);
+      for(x=0; x<width; x++)
+        d[x] += s[x] * k;
+    }
+  }
+}
+
+/************************************************************************/
+/*                  msKernelDensityBoxHorizontalTask()                  */
+/*                                                                      */
+/*      Box average of width 2*radius+1 along the rows, with zeros      */
+/*      outside of the grid.                                            */
+/************************************************************************/
+
+static void msKernelDensityBoxHorizontalTask(void *pData, int iTask)
+{
+  kernelDensityBlurInfo *info = (kernelDensityBlurInfo*)pData;
+  int r = info->radius, width = info->width;
+  double scale = 1.0 / (2*r+1);
+  int x, y, ystart, yend;
+
+  msKernelDensityTaskRange(info->height, info->nTasks, iTask, &ystart, &yend);
+  for(y=ystart; y<yend; y++) {
+    const float *s = info->src + (size_t)width*y;
+    float *d = info->dst + (size_t)width*y;
+    double accum = 0;
+
+    for(x=0; x<=r && x<width; x++)
+      accum += s[x];
+    for(x=0; x<width; x++) {
+      d[x] = accum * scale;
+      if(x+r+1 < width)
+        accum += s[x+r+1];
+      if(x-r >= 0)
+        accum -= s[x-r];
+    }
+  }
+}
+
+/************************************************************************/
+/*                   msKernelDensityBoxVerticalTask()                   */
+/*                                                                      */
+/*      Same along the columns, a band of columns per task, keeping     */
+/*      running sums for a whole row segment at once.                   */
+/************************************************************************/
+
+static void msKernelDensityBoxVerticalTask(void *pData, int iTask)
+{
+  kernelDensityBlurInfo *info = (kernelDensityBlurInfo*)pData;
+  int r = info->radius, width = info->width, height = info->height;
+  double scale = 1.0 / (2*r+1);
+  int x, y, xstart, xend, n;
+  double *accum;
+
+  msKernelDensityTaskRange(width, info->nTasks, iTask, &xstart, &xend);
+  n = xend - xstart;
+  accum = info->accum + xstart;
+  memset(accum, 0, n*sizeof(double));
+
+  for(y=0; y<=r && y<height; y++) {
+    const float *s = info->src + (size_t)width*y + xstart;
+    for(x=0; x<n; x++)
+      accum[x] += s[x];
+  }
+  for(y=0; y<height; y++) {
+    float *d = info->dst + (size_t)width*y + xstart;
+    for(x=0; x<n; x++)
+      d[x] = accum[x] * scale;
+    if(y+r+1 < height) {
+      const float *s = info->src + (size_t)width*(y+r+1) + xstart;
+      for(x=0; x<n; x++)
+        accum[x] += s[x];
+    }
+    if(y-r >= 0) {
+      const float *s = info->src + (size_t)width*(y-r) + xstart;
+      for(x=0; x<n; x++)
+        accum[x] -= s[x];
+    }
+  }
+}
+
+/************************************************************************/
+/*                        msKernelDensityBlur()                         */
+/*                                                                      */
+/*      Smooth the width x height grid of sample values in place.  The  */
+/*      border of radius pixels is only meaningful with the box         */
+/*      method, the callers ignore it.                                  */
+/************************************************************************/
+
+void msKernelDensityBlur(float *values, int width, int height, int radius,
+                         int method, int nThreads)
+{
+  float *tmp = (float*)msSmallMalloc((size_t)width*height*sizeof(float));
+  kernelDensityBlurInfo info;
+
+  info.width = width;
+  info.height = height;
+  info.accum = NULL;
+  info.kernel = NULL;
+  nThreads = MS_MAX(1, MS_MIN(nThreads, height));
+
+  if(method == MS_KERNELDENSITY_BOX) {
+    /* box sizes whose three passes have the variance of the gaussian */
+    double sigma = radius/3.0;
+    int pass, m, wl = (int)floor(sqrt(12.0*sigma*sigma/3 + 1));
+
+    if(wl % 2 == 0) wl--;
+    if(wl < 1) wl = 1;
+    m = MS_NINT((12.0*sigma*sigma - 3.0*wl*wl - 12.0*wl - 9.0) / (-4.0*wl - 4.0));
+
+    info.accum = (double*)msSmallMalloc(width*sizeof(double));
+    for(pass=0; pass<3; pass++) {
+      info.radius = ((pass < m ? wl : wl+2) - 1) / 2;
+
+      info.src = values;
+      info.dst = tmp;
+      info.nTasks = nThreads;
+      msThreadRunTasks(nThreads, info.nTasks, msKernelDensityBoxHorizontalTask, &info);
+
+      info.src = tmp;
+      info.dst = values;
+      info.nTasks = MS_MAX(1, MS_MIN(nThreads, width/16));
+      msThreadRunTasks(nThreads, info.nTasks, msKernelDensityBoxVerticalTask, &info);
+    }
+    free(info.accum);
+  } else {
+    int i, length = radius*2+1;
+    float *kernel = (float*)msSmallMalloc(length*sizeof(float));
+    float sigma = radius/3.0;
+    float a = 1.0 / sqrt(2.0*M_PI*sigma*sigma);
+    float den = 2.0*sigma*sigma;
+
+    for(i=0; i<length; i++) {
+      float x = i - radius;
+      kernel[i] = a * exp(-(x*x) / den);
+    }
+    info.kernel = kernel;
+    info.radius = radius;
+    info.nTasks = nThreads;
+
+    info.src = values;
+    info.dst = tmp;
+    msThreadRunTasks(nThreads, info.nTasks, msKernelDensityGaussianRowTask, &info);
+
+    /* the border rows keep the raw samples, as they always did */
+    if(height > 2*radius) {
+      info.src = tmp;
+      info.dst = values;
+      msThreadRunTasks(nThreads, info.nTasks, msKernelDensityGaussianColumnTask, &info);
+    }
+    free(kernel);
+  }
 
-void gaussian_blur(float *values, int width, int height, int radius) {
-  float *tmp = (float*)msSmallMalloc(width*height*sizeof(float));
-  int length = radius*2+1;
-  float *kernel = (float*)msSmallMalloc(length*sizeof(float));
-  float sigma=radius/3.0;
-	float a=1.0/ sqrt(2.0*M_PI*sigma*sigma);
-	float den=2.0*sigma*sigma;
-	int i,x,y;
-
-	for (i=0; i<length; i++) {
-	  float x=i - radius;
-	  float v=a * exp(-(x*x) / den);
-	  kernel[i]=v;
-	}
-	memset(tmp,0,width*height*sizeof(float));
-
-	for(y=0; y<height; y++) {
-		float* src_row=values + width*y;
-		float* dst_row=tmp + width*y;
-
-		for(x=radius; x<width-radius; x++) {
-			float accum=0;
-			for(i=0; i<length; i++) {
-				accum+=src_row[x+i-radius] * kernel[i];
-			}
-			dst_row[x]=accum;
-		}
-	}
-
-	for(x=0; x<width; x++) {
-		float* src_col=tmp+x;
-		float* dst_col=values+x;
-
-		for(y=radius; y<height-radius; y++) {
-			float accum=0;
-			for (i=0; i<length; i++) {
-				accum+=src_col[width*(y+i-radius)] * kernel[i];
-			}
-			dst_col[y*width]=accum;
-		}
-	}
   free(tmp);
-  free(kernel);
 }
 
+#ifdef USE_GDAL
+
+#include "gdal.h"
+#include "cpl_string.h"
 
 int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kerneldensity_layer, void **hDSvoid, void **cleanup_ptr) {
 
@@ -95,6 +287,7 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
   GDALDatasetH hDS;
   const char *pszProcessing;
   int *classgroup = NULL;
+  int method = MS_KERNELDENSITY_GAUSSIAN;
   
   assert(kerneldensity_layer->connectiontype == MS_KERNELDENSITY);
   *cleanup_ptr = NULL;
@@ -115,6 +308,15 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
   else
     expand_searchrect = 0;
 
+  pszProcessing = msLayerGetProcessingKey( kerneldensity_layer, "KERNELDENSITY_METHOD" );
+  if(pszProcessing && !strcasecmp(pszProcessing,"BOX"))
+    method = MS_KERNELDENSITY_BOX;
+  else if(pszProcessing && strcasecmp(pszProcessing,"GAUSSIAN")) {
+    msSetError(MS_MISCERR, "Unsupported KERNELDENSITY_METHOD \"%s\", expected GAUSSIAN or BOX", "msComputeKernelDensityDataset()",
+               pszProcessing);
+    return MS_FAILURE;
+  }
+
   pszProcessing = msLayerGetProcessingKey( kerneldensity_layer, "KERNELDENSITY_NORMALIZATION" );
   if(!pszProcessing || !strcasecmp(pszProcessing,"AUTO"))
     normalization_scale = 0.0;
@@ -218,7 +420,7 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
                   layer->class[c]->styles[s]->minscaledenom,
                   layer->class[c]->styles[s]->maxscaledenom)) {
             if(layer->class[c]->styles[s]->bindings[MS_STYLE_BINDING_SIZE].index != -1) {
-              weight = atof(shape.values[layer->class[c]->styles[s]->bindings[MS_STYLE_BINDING_SIZE].index]);
+              weight = msShapeGetValueAsDouble(&shape, layer->class[c]->styles[s]->bindings[MS_STYLE_BINDING_SIZE].index);
             } else {
               weight = layer->class[c]->styles[s]->size;
             }
@@ -256,7 +458,22 @@ int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *kernel
 
 
   if(have_sample) { /* no use applying the filtering kernel if we have no samples */
-    gaussian_blur(values,im_width, im_height, radius);
+    int nThreads = msGetWorkerThreadCount(map, kerneldensity_layer);
+    struct mstimeval starttime = {0}, endtime = {0};
+
+    if(kerneldensity_layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING)
+      msGettimeofday(&starttime, NULL);
+
+    msKernelDensityBlur(values, im_width, im_height, radius, method, nThreads);
+
+    if(kerneldensity_layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING) {
+      msGettimeofday(&endtime, NULL);
+      msDebug("msComputeKernelDensityDataset(%s): %s blur of radius %d on %dx%d pixels, %d threads, took %.3fs\n",
+              kerneldensity_layer->name, method == MS_KERNELDENSITY_BOX ? "box" : "gaussian",
+              radius, im_width, im_height, nThreads,
+              (endtime.tv_sec+endtime.tv_usec/1.0e6)-
+              (starttime.tv_sec+starttime.tv_usec/1.0e6) );
+    }
 
     if(normalization_scale == 0.0) {   /* auto normalization */
       for (j=radius; j<im_height-radius; j++) {
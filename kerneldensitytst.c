@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Commandline benchmark of the kernel density smoothing methods.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 2014 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+#include <float.h>
+
+/*
+** Runs msKernelDensityBlur() with both methods on a grid of random
+** samples and compares them, for speed and for the 0-255 values they end
+** up as, with the straightforward convolution kernel density layers used
+** to be drawn with.
+*/
+
+/* the original, one pixel at a time, implementation */
+static void reference_blur(float *values, int width, int height, int radius)
+{
+  float *tmp = (float*)msSmallCalloc(width*height, sizeof(float));
+  int length = radius*2+1;
+  float *kernel = (float*)msSmallMalloc(length*sizeof(float));
+  float sigma = radius/3.0;
+  float a = 1.0 / sqrt(2.0*M_PI*sigma*sigma);
+  float den = 2.0*sigma*sigma;
+  int i, x, y;
+
+  for(i=0; i<length; i++) {
+    float x = i - radius;
+    kernel[i] = a * exp(-(x*x) / den);
+  }
+
+  for(y=0; y<height; y++) {
+    float *src_row = values + width*y;
+    float *dst_row = tmp + width*y;
+    for(x=radius; x<width-radius; x++) {
+      float accum = 0;
+      for(i=0; i<length; i++)
+        accum += src_row[x+i-radius] * kernel[i];
+      dst_row[x] = accum;
+    }
+  }
+
+  for(x=0; x<width; x++) {
+    float *src_col = tmp+x;
+    float *dst_col = values+x;
+    for(y=radius; y<height-radius; y++) {
+      float accum = 0;
+      for(i=0; i<length; i++)
+        accum += src_col[width*(y+i-radius)] * kernel[i];
+      dst_col[y*width] = accum;
+    }
+  }
+  free(tmp);
+  free(kernel);
+}
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+/* scale the interior the way msComputeKernelDensityDataset() does */
+static void to_bytes(const float *values, unsigned char *bytes, int width, int height, int radius)
+{
+  float valmin = FLT_MAX, valmax = FLT_MIN;
+  int i, j;
+
+  for(j=radius; j<height-radius; j++) {
+    for(i=radius; i<width-radius; i++) {
+      float val = values[j*width + i];
+      if(val > 0 && val > valmax) valmax = val;
+      if(val > 0 && val < valmin) valmin = val;
+    }
+  }
+  for(j=radius; j<height-radius; j++) {
+    for(i=radius; i<width-radius; i++) {
+      int v = 255 * ((values[j*width + i] - valmin) / valmax);
+      bytes[j*width + i] = MS_MAX(0, MS_MIN(255, v));
+    }
+  }
+}
+
+static void compare(const char *name, const unsigned char *ref, const unsigned char *test,
+                    int width, int height, int radius, double seconds, double ref_seconds)
+{
+  int i, j, maxdiff = 0, ndiff = 0;
+  double sumsq = 0;
+
+  for(j=radius; j<height-radius; j++) {
+    for(i=radius; i<width-radius; i++) {
+      int diff = abs(ref[j*width+i] - test[j*width+i]);
+      maxdiff = MS_MAX(maxdiff, diff);
+      ndiff += (diff != 0);
+      sumsq += diff*diff;
+    }
+  }
+  printf("%-24s %8.3fs  x%-6.1f max diff %3d  rms %.3f  %d pixels differ\n",
+         name, seconds, ref_seconds / seconds, maxdiff,
+         sqrt(sumsq / ((double)(width-2*radius)*(height-2*radius))), ndiff);
+}
+
+int main(int argc, char *argv[])
+{
+  int width = 2048, height = 2048, radius = 50, samples = 20000, threads = 4;
+  float *input, *values;
+  unsigned char *ref, *test;
+  struct mstimeval start;
+  double ref_seconds, seconds;
+  int i;
+
+  if(argc > 1 && strcmp(argv[1], "-h") == 0) {
+    printf("Usage: kerneldensitytst [width height radius samples threads]\n");
+    return 0;
+  }
+  if(argc > 5) {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+    radius = atoi(argv[3]);
+    samples = atoi(argv[4]);
+    threads = atoi(argv[5]);
+  }
+  if(width <= 2*radius || height <= 2*radius || radius < 1) {
+    fprintf(stderr, "The grid must be larger than twice the radius.\n");
+    return 1;
+  }
+
+  input = (float*)msSmallCalloc(width*height, sizeof(float));
+  values = (float*)msSmallMalloc(width*height*sizeof(float));
+  ref = (unsigned char*)msSmallCalloc(width*height, 1);
+  test = (unsigned char*)msSmallCalloc(width*height, 1);
+
+  /* clustered samples with a few weights, like a point layer */
+  srand(1);
+  for(i=0; i<samples; i++) {
+    int cx = (i % 7) * width / 7 + width / 14, cy = (i % 5) * height / 5 + height / 10;
+    int x = cx + (rand() % (width/4)) - width/8;
+    int y = cy + (rand() % (height/4)) - height/8;
+    if(x >= 0 && y >= 0 && x < width && y < height)
+      input[y*width + x] += 1 + rand() % 3;
+  }
+
+  printf("%dx%d grid, radius %d, %d samples\n", width, height, radius, samples);
+
+  memcpy(values, input, width*height*sizeof(float));
+  msGettimeofday(&start, NULL);
+  reference_blur(values, width, height, radius);
+  ref_seconds = elapsed(&start);
+  to_bytes(values, ref, width, height, radius);
+  compare("reference", ref, ref, width, height, radius, ref_seconds, ref_seconds);
+
+  memcpy(values, input, width*height*sizeof(float));
+  msGettimeofday(&start, NULL);
+  msKernelDensityBlur(values, width, height, radius, MS_KERNELDENSITY_GAUSSIAN, 1);
+  seconds = elapsed(&start);
+  to_bytes(values, test, width, height, radius);
+  compare("gaussian, 1 thread", ref, test, width, height, radius, seconds, ref_seconds);
+
+  memcpy(values, input, width*height*sizeof(float));
+  msGettimeofday(&start, NULL);
+  msKernelDensityBlur(values, width, height, radius, MS_KERNELDENSITY_GAUSSIAN, threads);
+  seconds = elapsed(&start);
+  to_bytes(values, test, width, height, radius);
+  compare("gaussian, threaded", ref, test, width, height, radius, seconds, ref_seconds);
+
+  memcpy(values, input, width*height*sizeof(float));
+  msGettimeofday(&start, NULL);
+  msKernelDensityBlur(values, width, height, radius, MS_KERNELDENSITY_BOX, 1);
+  seconds = elapsed(&start);
+  to_bytes(values, test, width, height, radius);
+  compare("box, 1 thread", ref, test, width, height, radius, seconds, ref_seconds);
+
+  memcpy(values, input, width*height*sizeof(float));
+  msGettimeofday(&start, NULL);
+  msKernelDensityBlur(values, width, height, radius, MS_KERNELDENSITY_BOX, threads);
+  seconds = elapsed(&start);
+  to_bytes(values, test, width, height, radius);
+  compare("box, threaded", ref, test, width, height, radius, seconds, ref_seconds);
+
+  free(input);
+  free(values);
+  free(ref);
+  free(test);
+  return 0;
+}
@@ -0,0 +1,271 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Checks that MS_LAZY_LAYERS loads the same map as an eager load.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "mapserv.h"
+
+/*
+** Writes a mapfile with CONFIG "MS_LAZY_LAYERS" "ON" and the same mapfile
+** without it to the current directory, then checks that msSaveMap() writes
+** the same map for both, that classgroup and %key% substitutions reach
+** lazy layers (also through an INCLUDE), and that a parse error in a lazy
+** layer fails msDrawMap() once the layer is drawn. Exits with 1 if a check
+** fails. The files written are removed unless a check failed.
+*/
+
+#define LAZY_MAPFILE "lazylayertst_lazy.map"
+#define EAGER_MAPFILE "lazylayertst_eager.map"
+#define BROKEN_MAPFILE "lazylayertst_broken.map"
+#define INCLUDE_FILE "lazylayertst_include.map"
+#define SAVED_LAZY "lazylayertst_saved_lazy.map"
+#define SAVED_EAGER "lazylayertst_saved_eager.map"
+
+static int writeMapfile(const char *filename, const char *lazy, int broken)
+{
+  FILE *fp;
+
+  if((fp = fopen(filename, "w")) == NULL) {
+    perror(filename);
+    return 1;
+  }
+  fprintf(fp, "MAP NAME \"lazy\" EXTENT 0 0 100 100 SIZE 50 50 IMAGETYPE \"png\"\n"
+          "  CONFIG \"MS_ERRORFILE\" \"stderr\"\n"
+          "  CONFIG \"MS_LAZY_LAYERS\" \"%s\"\n"
+          "  WEB VALIDATION \"kind\" \"^[a-z]+$\" END END\n", lazy);
+  /* neither the group nor the tag of the second class are in this file */
+  fprintf(fp, "  LAYER NAME \"roads\" TYPE LINE STATUS ON\n"
+          "    FEATURE POINTS 10 10 90 90 END END\n"
+          "    CLASS NAME \"day\" GROUP \"day\" STYLE COLOR 0 0 255 WIDTH 2 END END\n"
+          "    CLASS\n"
+          "      INCLUDE \"" INCLUDE_FILE "\"\n"
+          "    END\n"
+          "  END\n");
+  fprintf(fp, "  LAYER NAME \"points\" TYPE POINT STATUS ON\n"
+          "    FEATURE POINTS 50 50 END END\n"
+          "    CLASS TITLE \"%%kind%% points\" STYLE COLOR 255 0 0 SIZE 3 END END\n"
+          "  END\n");
+  fprintf(fp, "  LAYER NAME \"off\" TYPE POINT STATUS OFF MAXSCALEDENOM 1000\n"
+          "    METADATA \"wms_title\" \"off\" END\n"
+          "    CLASS STYLE COLOR 0 255 0 END END\n"
+          "  END\n");
+  if(broken)
+    fprintf(fp, "  LAYER NAME \"broken\" TYPE POINT STATUS ON\n"
+            "    FEATURE POINTS 50 50 END END\n"
+            "    CLASS STYLE COLOUR 255 0 0 END END\n"
+            "  END\n");
+  fprintf(fp, "END\n");
+  fclose(fp);
+  return 0;
+}
+
+static int writeInclude(void)
+{
+  FILE *fp;
+
+  if((fp = fopen(INCLUDE_FILE, "w")) == NULL) {
+    perror(INCLUDE_FILE);
+    return 1;
+  }
+  fprintf(fp, "NAME \"night\" GROUP \"night\" TEXT \"%%kind%%\"\n"
+          "STYLE COLOR 0 0 128 WIDTH 2 END\n");
+  fclose(fp);
+  return 0;
+}
+
+static char *readFile(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  char *buffer;
+  long size;
+
+  if(fp == NULL)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buffer = (char *) msSmallMalloc(size + 1);
+  buffer[fread(buffer, 1, size, fp)] = '\0';
+  fclose(fp);
+  return buffer;
+}
+
+/* msSaveMap() materializes the lazy layers, the output must match the eager load */
+static int checkSave(void)
+{
+  mapObj *lazy, *eager;
+  char *saved_lazy = NULL, *saved_eager = NULL;
+  int i, numlazy = 0, failures = 0;
+
+  if((lazy = msLoadMap(LAZY_MAPFILE, NULL)) == NULL || (eager = msLoadMap(EAGER_MAPFILE, NULL)) == NULL) {
+    msWriteError(stderr);
+    if(lazy)
+      msFreeMap(lazy);
+    return 1;
+  }
+
+  for(i = 0; i < lazy->numlayers; i++)
+    if(GET_LAYER_HEADER(lazy, i)->lazysource)
+      numlazy++;
+  if(numlazy != lazy->numlayers) {
+    printf("%d of %d layers loaded lazily\n", numlazy, lazy->numlayers);
+    failures++;
+  }
+  if(!GET_LAYER_HEADER(lazy, 0)->lazyinclude || GET_LAYER_HEADER(lazy, 1)->lazyinclude) {
+    printf("INCLUDE in a lazy layer not detected\n");
+    failures++;
+  }
+
+  msSetConfigOption(lazy, "MS_LAZY_LAYERS", "OFF"); /* the one difference between the mapfiles */
+  if(msSaveMap(lazy, SAVED_LAZY) == 0 && msSaveMap(eager, SAVED_EAGER) == 0) {
+    saved_lazy = readFile(SAVED_LAZY);
+    saved_eager = readFile(SAVED_EAGER);
+  }
+  if(saved_lazy == NULL || saved_eager == NULL) {
+    msWriteError(stderr);
+    failures++;
+  } else if(strcmp(saved_lazy, saved_eager) != 0) {
+    printf("msSaveMap() output of the lazy load differs, see %s and %s\n", SAVED_LAZY, SAVED_EAGER);
+    failures++;
+  } else
+    printf("lazy load saves the same map\n");
+
+  msFree(saved_lazy);
+  msFree(saved_eager);
+  msFreeMap(lazy);
+  msFreeMap(eager);
+  return failures;
+}
+
+/* the classgroup and substitution shortcuts for lazy layers must not miss INCLUDEs */
+static int checkRequest(void)
+{
+  mapservObj *mapserv = msAllocMapServObj();
+  cgiRequestObj *request = mapserv->request;
+  layerObj *roads, *points;
+  int failures = 0;
+
+  request->ParamNames[0] = msStrdup("map");
+  request->ParamValues[0] = msStrdup(LAZY_MAPFILE);
+  request->ParamNames[1] = msStrdup("classgroup");
+  request->ParamValues[1] = msStrdup("night");
+  request->ParamNames[2] = msStrdup("kind");
+  request->ParamValues[2] = msStrdup("river");
+  request->NumParams = 3;
+
+  if((mapserv->map = msCGILoadMap(mapserv)) == NULL) {
+    msWriteError(stderr);
+    msFreeMapServObj(mapserv);
+    return 1;
+  }
+
+  roads = GET_LAYER(mapserv->map, 0);
+  points = GET_LAYER(mapserv->map, 1);
+  if(roads->classgroup == NULL || strcmp(roads->classgroup, "night") != 0) {
+    printf("classgroup not set on a lazy layer\n");
+    failures++;
+  }
+  if(roads->numclasses != 2 || roads->class[1]->text.string == NULL ||
+      strcmp(roads->class[1]->text.string, "river") != 0) {
+    printf("%%kind%% not substituted in an INCLUDE of a lazy layer\n");
+    failures++;
+  }
+  if(points->numclasses != 1 || points->class[0]->title == NULL ||
+      strcmp(points->class[0]->title, "river points") != 0) {
+    printf("%%kind%% not substituted in a lazy layer\n");
+    failures++;
+  }
+  if(GET_LAYER_HEADER(mapserv->map, 2)->lazysource == NULL) {
+    printf("layer without tags loaded by the substitutions\n");
+    failures++;
+  }
+  if(failures == 0)
+    printf("classgroup and substitutions applied to lazy layers\n");
+
+  msFreeMapServObj(mapserv);
+  return failures;
+}
+
+/* a parse error is reported once the broken layer is drawn */
+static int checkError(void)
+{
+  mapObj *map;
+  imageObj *image;
+  int failures = 0;
+
+  if((map = msLoadMap(BROKEN_MAPFILE, NULL)) == NULL) {
+    msWriteError(stderr);
+    return 1;
+  }
+  image = msDrawMap(map, MS_FALSE);
+  if(image) {
+    printf("msDrawMap() succeeded with a broken lazy layer\n");
+    msFreeImage(image);
+    failures++;
+  }
+  if(!GET_LAYER_HEADER(map, 3)->lazyerror || GET_LAYER_HEADER(map, 3)->status != MS_OFF) {
+    printf("lazyerror not set on the broken layer\n");
+    failures++;
+  }
+  if(failures == 0)
+    printf("broken lazy layer fails msDrawMap()\n");
+  msResetErrorList();
+  msFreeMap(map);
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  if(writeInclude() || writeMapfile(LAZY_MAPFILE, "ON", MS_FALSE) ||
+      writeMapfile(EAGER_MAPFILE, "OFF", MS_FALSE) || writeMapfile(BROKEN_MAPFILE, "ON", MS_TRUE))
+    return 1;
+
+  failures += checkSave();
+  failures += checkRequest();
+  failures += checkError();
+
+  msCleanup();
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  unlink(LAZY_MAPFILE);
+  unlink(EAGER_MAPFILE);
+  unlink(BROKEN_MAPFILE);
+  unlink(INCLUDE_FILE);
+  unlink(SAVED_LAZY);
+  unlink(SAVED_EAGER);
+  return 0;
+}
@@ -0,0 +1,294 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Arena allocator for request scoped temporary allocations.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** An arena hands out memory by bumping a pointer in large blocks and gives
+** it all back at once in msArenaReset() or msArenaDestroy(), so the many
+** small objects of a request that all die together cost no malloc()/free()
+** pair each.
+**
+** Each map owns a root arena (msMapGetArena(), created on first use and
+** released by msFreeMap(), i.e. at the end of the mapserv request). Shorter
+** lived scopes use child arenas created with msArenaCreate(parent): the
+** label cache has one that lives until the cache is cleared, and a vector
+** layer being drawn has one that is emptied after every feature. Blocks of a
+** child go back to the root's free list on reset, so after the first few
+** features a request no longer calls malloc() for these objects at all.
+**
+** All functions accept a NULL arena and then fall back to the regular heap,
+** which is what callers get when the MS_ARENA config option is set to OFF.
+** An arena is not thread safe; it belongs to a single mapObj, which is
+** never used by several threads at once.
+*/
+
+#include "mapserver.h"
+
+#define MS_ARENA_BLOCKSIZE (64*1024)
+#define MS_ARENA_ALIGN 16
+#define MS_ARENA_ROUND(n) (((n) + MS_ARENA_ALIGN - 1) & ~((size_t)MS_ARENA_ALIGN - 1))
+
+typedef struct arenaBlockObj {
+  struct arenaBlockObj *next;
+  size_t size; /* usable bytes after the header */
+  size_t used;
+} arenaBlockObj;
+
+#define MS_ARENA_HEADER MS_ARENA_ROUND(sizeof(arenaBlockObj))
+#define MS_ARENA_DATA(block) ((char *)(block) + MS_ARENA_HEADER)
+
+struct arenaObj {
+  arenaBlockObj *blocks; /* block being filled first */
+  arenaBlockObj *freeblocks; /* root arena only: emptied blocks of standard size */
+  arenaObj *parent;
+
+  /* statistics, children add theirs to the parent when reset or destroyed */
+  unsigned long numallocs;
+  unsigned long numbytes;
+  unsigned long numblocks; /* blocks obtained with malloc() */
+};
+
+static arenaObj *rootArena(arenaObj *arena)
+{
+  while(arena->parent)
+    arena = arena->parent;
+  return arena;
+}
+
+static arenaBlockObj *newBlock(arenaObj *arena, size_t size)
+{
+  arenaObj *root = rootArena(arena);
+  arenaBlockObj *block;
+
+  if(size <= MS_ARENA_BLOCKSIZE && root->freeblocks) {
+    block = root->freeblocks;
+    root->freeblocks = block->next;
+  } else {
+    size = MS_MAX(size, MS_ARENA_BLOCKSIZE);
+    block = (arenaBlockObj *) msSmallMalloc(MS_ARENA_HEADER + size);
+    block->size = size;
+    arena->numblocks++;
+  }
+  block->used = 0;
+  return block;
+}
+
+static void releaseBlocks(arenaObj *arena)
+{
+  arenaObj *root = rootArena(arena);
+  arenaBlockObj *block, *next;
+
+  for(block = arena->blocks; block; block = next) {
+    next = block->next;
+    if(block->size == MS_ARENA_BLOCKSIZE && root != arena) {
+      block->next = root->freeblocks;
+      root->freeblocks = block;
+    } else {
+      free(block);
+    }
+  }
+  arena->blocks = NULL;
+
+  if(root == arena) {
+    for(block = arena->freeblocks; block; block = next) {
+      next = block->next;
+      free(block);
+    }
+    arena->freeblocks = NULL;
+  }
+}
+
+static void foldStatistics(arenaObj *arena)
+{
+  if(arena->parent) {
+    arena->parent->numallocs += arena->numallocs;
+    arena->parent->numbytes += arena->numbytes;
+    arena->parent->numblocks += arena->numblocks;
+    arena->numallocs = arena->numbytes = arena->numblocks = 0;
+  }
+}
+
+/*
+** Creates a child arena of parent, taking its blocks from and returning them
+** to the root arena. Returns NULL when parent is NULL, so a child of a
+** disabled arena is disabled as well and the heap is used instead.
+*/
+arenaObj *msArenaCreate(arenaObj *parent)
+{
+  arenaObj *arena;
+
+  if(parent == NULL)
+    return NULL;
+  arena = (arenaObj *) msSmallCalloc(1, sizeof(arenaObj));
+  arena->parent = parent;
+  return arena;
+}
+
+void *msArenaAlloc(arenaObj *arena, size_t size)
+{
+  arenaBlockObj *block;
+  void *ptr;
+
+  if(arena == NULL)
+    return msSmallMalloc(size);
+
+  size = MS_ARENA_ROUND(MS_MAX(size, 1));
+  block = arena->blocks;
+  if(block == NULL || block->size - block->used < size) {
+    block = newBlock(arena, size);
+    if(arena->blocks && size > MS_ARENA_BLOCKSIZE) {
+      /* keep filling the current block, the big one is already full */
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    } else {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+  }
+  ptr = MS_ARENA_DATA(block) + block->used;
+  block->used += size;
+
+  arena->numallocs++;
+  arena->numbytes += size;
+  return ptr;
+}
+
+void *msArenaCalloc(arenaObj *arena, size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  if(arena == NULL)
+    return msSmallCalloc(nmemb, size);
+  ptr = msArenaAlloc(arena, nmemb * size);
+  memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+char *msArenaStrdup(arenaObj *arena, const char *str)
+{
+  size_t len;
+  char *dup;
+
+  if(arena == NULL)
+    return msStrdup(str);
+  len = strlen(str) + 1;
+  dup = (char *) msArenaAlloc(arena, len);
+  memcpy(dup, str, len);
+  return dup;
+}
+
+/*
+** Releases a pointer obtained from msArenaAlloc() with the same arena.
+** Memory owned by the arena is only reclaimed by msArenaReset(); anything
+** else (heap memory, e.g. allocated while the arena was disabled) is freed.
+*/
+void msArenaFree(arenaObj *arena, void *ptr)
+{
+  arenaBlockObj *block;
+
+  if(ptr == NULL)
+    return;
+  if(arena) {
+    for(block = arena->blocks; block; block = block->next) {
+      if((char *)ptr >= MS_ARENA_DATA(block) && (char *)ptr < MS_ARENA_DATA(block) + block->size)
+        return;
+    }
+  }
+  free(ptr);
+}
+
+/* Releases everything allocated from arena, which stays usable. */
+void msArenaReset(arenaObj *arena)
+{
+  if(arena == NULL)
+    return;
+
+  if(arena->parent) {
+    /* keep one block so that a per-feature arena does not cycle through the free list */
+    arenaBlockObj *keep = arena->blocks;
+    if(keep && keep->size == MS_ARENA_BLOCKSIZE) {
+      arena->blocks = keep->next;
+      releaseBlocks(arena);
+      keep->next = NULL;
+      keep->used = 0;
+      arena->blocks = keep;
+    } else {
+      releaseBlocks(arena);
+    }
+  } else {
+    /* a root arena keeps its blocks for reuse */
+    arenaBlockObj *block, *next;
+    for(block = arena->blocks; block; block = next) {
+      next = block->next;
+      if(block->size == MS_ARENA_BLOCKSIZE) {
+        block->next = arena->freeblocks;
+        arena->freeblocks = block;
+      } else {
+        free(block);
+      }
+    }
+    arena->blocks = NULL;
+  }
+  foldStatistics(arena);
+}
+
+void msArenaDestroy(arenaObj *arena)
+{
+  if(arena == NULL)
+    return;
+  releaseBlocks(arena);
+  foldStatistics(arena);
+  free(arena);
+}
+
+/*
+** Returns the root arena of map, creating it on first use, or NULL when
+** arenas are disabled with CONFIG "MS_ARENA" "OFF".
+*/
+arenaObj *msMapGetArena(mapObj *map)
+{
+  if(map == NULL)
+    return NULL;
+  if(map->arena == NULL && msTestConfigOption(map, "MS_ARENA", MS_TRUE))
+    map->arena = (arenaObj *) msSmallCalloc(1, sizeof(arenaObj));
+  return map->arena;
+}
+
+/* Called by msFreeMap(), after every child arena has been destroyed. */
+void msMapFreeArena(mapObj *map)
+{
+  arenaObj *arena = map->arena;
+
+  if(arena == NULL)
+    return;
+  if(map->debug >= MS_DEBUGLEVEL_TUNING || msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_TUNING)
+    msDebug("msMapFreeArena(): %lu allocations, %lu bytes served from %lu blocks of %d bytes\n",
+            arena->numallocs, arena->numbytes, arena->numblocks, MS_ARENA_BLOCKSIZE);
+  msArenaDestroy(arena);
+  map->arena = NULL;
+}
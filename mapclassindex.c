@@ -0,0 +1,518 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Lookup tables resolving the class of a shape without testing
+ *           every class expression in turn.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** msShapeGetClass() returns the first class whose expression matches a
+** shape, which means evaluating up to every class expression of the layer
+** for every feature. When msLayerWhichItems() has resolved the item indexes
+** of a layer with many classes, the classes that are simple tests of one
+** attribute are indexed instead:
+**
+**   - MS_STRING expressions on the CLASSITEM (exact or case insensitive) and
+**     MS_LIST expressions, through hash tables keyed on the attribute value.
+**     msEvalExpression() matches the items of a list but the last one as
+**     prefixes of the value, so those go into a table probed with the
+**     prefixes of the value.
+**   - MS_EXPRESSION expressions that only compare one numeric attribute with
+**     literals, e.g. ([pop] >= 1000 and [pop] < 5000), through the set of
+**     classes matching each interval between the literals, found by binary
+**     search.
+**
+** The lookup returns the indexed classes matching the shape; the other
+** classes (regular expressions, general expressions, ...) are returned as a
+** separate list that still has to be evaluated. msShapeGetClass() walks both
+** in class order, applying the scale and minfeaturesize limits as before, so
+** the first match is the same class as without the index.
+**
+** PROCESSING "CLASS_INDEX=OFF" disables the index for a layer.
+*/
+
+#include "mapserver.h"
+
+#include <math.h>
+
+/* layers with fewer classes are not worth indexing */
+#define MS_CLASSINDEX_MIN_CLASSES 8
+
+typedef struct classIndexKey {
+  char *key;
+  int length;
+  int *classes; /* ascending */
+  int numclasses;
+  struct classIndexKey *next;
+} classIndexKey;
+
+typedef struct {
+  classIndexKey **buckets;
+  int numbuckets; /* power of two */
+  int numkeys;
+} classIndexTable;
+
+typedef struct {
+  int numclasses; /* layer->numclasses at build time */
+  int classitemindex;
+
+  classIndexTable exact; /* MS_STRING, last item of MS_LIST */
+  classIndexTable icase; /* case insensitive MS_STRING, lower cased keys */
+  classIndexTable prefix; /* other MS_LIST items */
+  int *prefixlengths; /* ascending */
+  int numprefixlengths;
+
+  int rangeitemindex; /* -1 if no range classes */
+  double *bounds; /* ascending */
+  int numbounds;
+  int **regions; /* classes matching (-inf,b0), b0, (b0,b1), ..., (bn,inf), NaN */
+  int *numregionclasses;
+
+  int *generic; /* classes that are always evaluated */
+  int numgeneric;
+
+  /* the same restricted to layer->classgroup */
+  char *ingroup;
+  int groupcount; /* -1 if the layer has no classgroup */
+  int *groupgeneric;
+  int numgroupgeneric;
+} classIndexObj;
+
+static unsigned int hashKey(const char *key, int length)
+{
+  unsigned int hash = 2166136261U;
+  int i;
+
+  for(i=0; i<length; i++) {
+    hash ^= (unsigned char) key[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static classIndexKey *findKey(classIndexTable *table, const char *key, int length)
+{
+  classIndexKey *entry;
+
+  if(table->numkeys == 0) return NULL;
+  for(entry = table->buckets[hashKey(key, length) & (table->numbuckets-1)]; entry; entry = entry->next) {
+    if(entry->length == length && memcmp(entry->key, key, length) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+static void insertKey(classIndexTable *table, const char *key, int iclass)
+{
+  int length = strlen(key), i;
+  classIndexKey *entry = findKey(table, key, length);
+
+  if(!entry) {
+    if(table->numkeys >= table->numbuckets) { /* grow */
+      int numbuckets = table->numbuckets ? table->numbuckets * 4 : 64;
+      classIndexKey **buckets = (classIndexKey **) msSmallCalloc(numbuckets, sizeof(classIndexKey *));
+      for(i=0; i<table->numbuckets; i++) {
+        while(table->buckets[i]) {
+          classIndexKey *moved = table->buckets[i];
+          unsigned int slot = hashKey(moved->key, moved->length) & (numbuckets-1);
+          table->buckets[i] = moved->next;
+          moved->next = buckets[slot];
+          buckets[slot] = moved;
+        }
+      }
+      free(table->buckets);
+      table->buckets = buckets;
+      table->numbuckets = numbuckets;
+    }
+    entry = (classIndexKey *) msSmallCalloc(1, sizeof(classIndexKey));
+    entry->key = msStrdup(key);
+    entry->length = length;
+    entry->next = table->buckets[hashKey(key, length) & (table->numbuckets-1)];
+    table->buckets[hashKey(key, length) & (table->numbuckets-1)] = entry;
+    table->numkeys++;
+  }
+
+  /* classes are inserted in order, a list can repeat a value */
+  if(entry->numclasses > 0 && entry->classes[entry->numclasses-1] == iclass) return;
+  entry->classes = (int *) msSmallRealloc(entry->classes, sizeof(int) * (entry->numclasses + 1));
+  entry->classes[entry->numclasses++] = iclass;
+}
+
+static void freeTable(classIndexTable *table)
+{
+  int i;
+
+  for(i=0; i<table->numbuckets; i++) {
+    while(table->buckets[i]) {
+      classIndexKey *entry = table->buckets[i];
+      table->buckets[i] = entry->next;
+      free(entry->key);
+      free(entry->classes);
+      free(entry);
+    }
+  }
+  free(table->buckets);
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+  double da = *(const double *) a, db = *(const double *) b;
+  return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+static void appendClass(int **list, int *count, int iclass)
+{
+  *list = (int *) msSmallRealloc(*list, sizeof(int) * (*count + 1));
+  (*list)[(*count)++] = iclass;
+}
+
+/* MS_LIST: returns MS_FALSE if an empty item makes the class match anything */
+static int indexList(classIndexObj *index, const char *list, int iclass)
+{
+  const char *start, *end;
+  char *item;
+  int i;
+
+  for(start = list; (end = strchr(start, ',')) != NULL; start = end+1) {
+    if(end == start) return MS_FALSE;
+  }
+
+  for(start = list; (end = strchr(start, ',')) != NULL; start = end+1) {
+    item = msSmallMalloc(end - start + 1);
+    strlcpy(item, start, end - start + 1);
+    insertKey(&(index->prefix), item, iclass);
+    free(item);
+
+    for(i=0; i<index->numprefixlengths && index->prefixlengths[i] < end - start; i++);
+    if(i == index->numprefixlengths || index->prefixlengths[i] != end - start) {
+      index->prefixlengths = (int *) msSmallRealloc(index->prefixlengths, sizeof(int) * (index->numprefixlengths + 1));
+      memmove(index->prefixlengths + i + 1, index->prefixlengths + i, sizeof(int) * (index->numprefixlengths - i));
+      index->prefixlengths[i] = end - start;
+      index->numprefixlengths++;
+    }
+  }
+  insertKey(&(index->exact), start, iclass);
+  return MS_TRUE;
+}
+
+/*
+** Precomputes, for every interval between the literals of the range
+** classes, which of them match a value in that interval.
+*/
+static void indexRanges(classIndexObj *index, layerObj *layer, int *classes, int numclasses, double *constants, int numconstants)
+{
+  int i, j, n = 0, numregions;
+
+  qsort(constants, numconstants, sizeof(double), compareDoubles);
+  for(i=0; i<numconstants; i++) {
+    if(n == 0 || constants[i] != constants[n-1])
+      constants[n++] = constants[i];
+  }
+  index->bounds = constants;
+  index->numbounds = n;
+
+  numregions = 2*n + 2;
+  index->regions = (int **) msSmallCalloc(numregions, sizeof(int *));
+  index->numregionclasses = (int *) msSmallCalloc(numregions, sizeof(int));
+
+  for(i=0; i<numregions; i++) {
+    double value;
+
+    if(i == numregions-1)
+      value = NAN;
+    else if(n == 0)
+      value = 0;
+    else if(i == 0)
+      value = -HUGE_VAL;
+    else if(i == numregions-2)
+      value = HUGE_VAL;
+    else if(i % 2 == 1)
+      value = constants[i/2];
+    else
+      value = constants[i/2-1]/2 + constants[i/2]/2; /* empty if the bounds are adjacent doubles, never looked up then */
+
+    for(j=0; j<numclasses; j++) {
+      if(msEvalNumericExpression(&(layer->class[classes[j]]->expression), value) == MS_TRUE)
+        appendClass(&(index->regions[i]), &(index->numregionclasses[i]), classes[j]);
+    }
+  }
+}
+
+void msLayerFreeClassIndex(layerObj *layer)
+{
+  classIndexObj *index = (classIndexObj *) layer->classindex;
+  int i;
+
+  if(!index) return;
+
+  freeTable(&(index->exact));
+  freeTable(&(index->icase));
+  freeTable(&(index->prefix));
+  free(index->prefixlengths);
+  free(index->bounds);
+  if(index->regions) {
+    for(i=0; i<2*index->numbounds+2; i++)
+      free(index->regions[i]);
+    free(index->regions);
+  }
+  free(index->numregionclasses);
+  free(index->generic);
+  free(index->ingroup);
+  free(index->groupgeneric);
+  free(index);
+  layer->classindex = NULL;
+}
+
+/*
+** Builds the class index of a layer, called by msLayerWhichItems() once the
+** item indexes of CLASSITEM and of the class expressions are known.
+*/
+void msLayerBuildClassIndex(layerObj *layer)
+{
+  classIndexObj *index;
+  int i, j, indexed, numindexed = 0;
+  int *rangeitems, *rangeclasses = NULL, numrangeclasses = 0, best = -1, bestcount = 0;
+  double **rangeconstants, *constants = NULL;
+  int *numrangeconstants, numconstants = 0;
+  const char *value;
+
+  msLayerFreeClassIndex(layer);
+
+  if(layer->numclasses < MS_CLASSINDEX_MIN_CLASSES) return;
+  if((value = msLayerGetProcessingKey(layer, "CLASS_INDEX")) != NULL && strcasecmp(value, "OFF") == 0) return;
+
+  index = (classIndexObj *) msSmallCalloc(1, sizeof(classIndexObj));
+  index->numclasses = layer->numclasses;
+  index->classitemindex = layer->classitemindex;
+  index->rangeitemindex = -1;
+  index->groupcount = -1;
+
+  rangeitems = (int *) msSmallMalloc(sizeof(int) * layer->numclasses);
+  rangeconstants = (double **) msSmallCalloc(layer->numclasses, sizeof(double *));
+  numrangeconstants = (int *) msSmallCalloc(layer->numclasses, sizeof(int));
+
+  for(i=0; i<layer->numclasses; i++) {
+    expressionObj *expression = &(layer->class[i]->expression);
+
+    indexed = MS_FALSE;
+    rangeitems[i] = -1;
+
+    /* empty and native expressions always match, cheaply */
+    if(!MS_STRING_IS_NULL_OR_EMPTY(expression->string) && expression->native_string == NULL) {
+      if(expression->type == MS_STRING && layer->classitemindex >= 0) {
+        if(expression->flags & MS_EXP_INSENSITIVE) {
+          char *key = msStrdup(expression->string);
+          msStringToLower(key);
+          insertKey(&(index->icase), key, i);
+          free(key);
+        } else
+          insertKey(&(index->exact), expression->string, i);
+        indexed = MS_TRUE;
+      } else if(expression->type == MS_LIST && layer->classitemindex >= 0) {
+        indexed = indexList(index, expression->string, i);
+      } else if(expression->type == MS_EXPRESSION) {
+        rangeitems[i] = msGetNumericExpressionItem(expression, &(rangeconstants[i]), &(numrangeconstants[i]));
+      }
+    }
+
+    if(indexed) numindexed++;
+    else if(rangeitems[i] < 0) appendClass(&(index->generic), &(index->numgeneric), i);
+  }
+
+  /* range classes on the attribute most of them test, the others are evaluated */
+  for(i=0; i<layer->numclasses; i++) {
+    int count = 0;
+    if(rangeitems[i] < 0) continue;
+    for(j=i; j<layer->numclasses; j++)
+      if(rangeitems[j] == rangeitems[i]) count++;
+    if(count > bestcount) {
+      best = rangeitems[i];
+      bestcount = count;
+    }
+  }
+  for(i=0; i<layer->numclasses; i++) {
+    if(rangeitems[i] < 0) continue;
+    if(rangeitems[i] == best) {
+      appendClass(&rangeclasses, &numrangeclasses, i);
+      constants = (double *) msSmallRealloc(constants, sizeof(double) * (numconstants + numrangeconstants[i] + 1));
+      memcpy(constants + numconstants, rangeconstants[i], sizeof(double) * numrangeconstants[i]);
+      numconstants += numrangeconstants[i];
+    } else {
+      /* keep the generic list in class order */
+      for(j=index->numgeneric; j>0 && index->generic[j-1] > i; j--);
+      appendClass(&(index->generic), &(index->numgeneric), i);
+      memmove(index->generic + j + 1, index->generic + j, sizeof(int) * (index->numgeneric - j - 1));
+      index->generic[j] = i;
+    }
+  }
+  if(numrangeclasses > 0) {
+    index->rangeitemindex = best;
+    indexRanges(index, layer, rangeclasses, numrangeclasses, constants, numconstants);
+    numindexed += numrangeclasses;
+  } else
+    free(constants);
+
+  for(i=0; i<layer->numclasses; i++)
+    free(rangeconstants[i]);
+  free(rangeconstants);
+  free(numrangeconstants);
+  free(rangeitems);
+  free(rangeclasses);
+
+  if(numindexed == 0) {
+    layer->classindex = index;
+    msLayerFreeClassIndex(layer);
+    return;
+  }
+
+  /* msAllocateValidClassGroups() */
+  if(layer->classgroup) {
+    index->ingroup = (char *) msSmallCalloc(layer->numclasses, 1);
+    index->groupcount = 0;
+    for(i=0; i<layer->numclasses; i++) {
+      if(layer->class[i]->group && strcasecmp(layer->class[i]->group, layer->classgroup) == 0) {
+        index->ingroup[i] = 1;
+        index->groupcount++;
+      }
+    }
+    for(i=0; i<index->numgeneric; i++) {
+      if(index->ingroup[index->generic[i]])
+        appendClass(&(index->groupgeneric), &(index->numgroupgeneric), index->generic[i]);
+    }
+  }
+
+  if(layer->debug >= MS_DEBUGLEVEL_VV)
+    msDebug("msLayerBuildClassIndex(): layer %s, %d of %d classes indexed.\n", layer->name ? layer->name : "", numindexed, layer->numclasses);
+
+  layer->classindex = index;
+}
+
+static int addMatches(int *matches, int nmatches, int maxmatches, const int *classes, int numclasses, const char *ingroup)
+{
+  int i;
+
+  for(i=0; i<numclasses; i++) {
+    if(ingroup && !ingroup[classes[i]]) continue;
+    if(nmatches == maxmatches) return -1;
+    matches[nmatches++] = classes[i];
+  }
+  return nmatches;
+}
+
+/*
+** Looks up the indexed classes matching a shape, in class order, into
+** matches. The classes that still have to be evaluated are returned in
+** generic. classgroup and numclasses are the msShapeGetClass() arguments.
+** Returns the number of matches, or -1 if the index can't be used for this
+** call (msShapeGetClass() then tests every class).
+*/
+int msLayerGetClassIndexCandidates(layerObj *layer, shapeObj *shape, int *classgroup, int numclasses,
+                                   int *matches, int maxmatches, const int **generic, int *numgeneric)
+{
+  classIndexObj *index = (classIndexObj *) layer->classindex;
+  const char *ingroup = NULL;
+  classIndexKey *entry;
+  int i, j, nmatches = 0;
+
+  if(!index || index->numclasses != layer->numclasses) return -1;
+
+  if(classgroup) {
+    if(index->groupcount != numclasses) return -1; /* not from msAllocateValidClassGroups() */
+    ingroup = index->ingroup;
+    *generic = index->groupgeneric;
+    *numgeneric = index->numgroupgeneric;
+  } else {
+    if(numclasses != layer->numclasses) return -1;
+    *generic = index->generic;
+    *numgeneric = index->numgeneric;
+  }
+
+  if(index->exact.numkeys > 0 || index->icase.numkeys > 0 || index->prefix.numkeys > 0) {
+    const char *value;
+    int length;
+
+    /* msEvalExpression() sets an error in these cases, let it */
+    if(layer->classitemindex != index->classitemindex || index->classitemindex >= layer->numitems || index->classitemindex >= shape->numvalues)
+      return -1;
+    value = shape->values[index->classitemindex];
+    length = strlen(value);
+
+    if((entry = findKey(&(index->exact), value, length)) != NULL)
+      if((nmatches = addMatches(matches, nmatches, maxmatches, entry->classes, entry->numclasses, ingroup)) < 0) return -1;
+
+    if(index->icase.numkeys > 0) {
+      char *key = msStrdup(value);
+      msStringToLower(key);
+      entry = findKey(&(index->icase), key, length);
+      free(key);
+      if(entry && (nmatches = addMatches(matches, nmatches, maxmatches, entry->classes, entry->numclasses, ingroup)) < 0) return -1;
+    }
+
+    for(i=0; i<index->numprefixlengths && index->prefixlengths[i] <= length; i++) {
+      if((entry = findKey(&(index->prefix), value, index->prefixlengths[i])) != NULL)
+        if((nmatches = addMatches(matches, nmatches, maxmatches, entry->classes, entry->numclasses, ingroup)) < 0) return -1;
+    }
+  }
+
+  if(index->rangeitemindex >= 0) {
+    double value;
+    int region, lo, hi;
+
+    if(index->rangeitemindex >= shape->numvalues) return -1;
+    value = msShapeGetValueAsDouble(shape, index->rangeitemindex);
+
+    if(isnan(value))
+      region = 2*index->numbounds + 1;
+    else {
+      /* lo = number of bounds below value */
+      lo = 0;
+      hi = index->numbounds;
+      while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(index->bounds[mid] < value) lo = mid + 1;
+        else hi = mid;
+      }
+      if(lo < index->numbounds && index->bounds[lo] == value)
+        region = 2*lo + 1;
+      else
+        region = 2*lo;
+    }
+    if((nmatches = addMatches(matches, nmatches, maxmatches, index->regions[region], index->numregionclasses[region], ingroup)) < 0) return -1;
+  }
+
+  /* the sources are each in class order, merge them and drop duplicates */
+  for(i=1; i<nmatches; i++) {
+    int m = matches[i];
+    for(j=i; j>0 && matches[j-1] > m; j--)
+      matches[j] = matches[j-1];
+    matches[j] = m;
+  }
+  for(i=0, j=0; i<nmatches; i++) {
+    if(j == 0 || matches[j-1] != matches[i])
+      matches[j++] = matches[i];
+  }
+  return j;
+}
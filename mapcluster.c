@@ -514,6 +514,7 @@ static void InitShapeAttributes(layerObj* layer, clusterInfo* base)
       base->shape.values[i] = msStrdup("1"); /* initial count */
     }
   }
+  msShapeResetValueCache(&base->shape);
 }
 
 /* update the shape attributes (aggregate) */
@@ -561,6 +562,8 @@ static void UpdateShapeAttributes(layerObj* layer, clusterInfo* base, clusterInf
       }
     }
   }
+  msShapeResetValueCache(&base->shape);
+  msShapeResetValueCache(&current->shape);
 }
 
 static int BuildFeatureAttributes(layerObj* layer, msClusterLayerInfo* layerinfo, shapeObj* shape)
@@ -592,6 +595,7 @@ static int BuildFeatureAttributes(layerObj* layer, msClusterLayerInfo* layerinfo
 
   shape->values = values;
   shape->numvalues = layer->numitems;
+  msShapeResetValueCache(shape);
 
   return MS_SUCCESS;
 }
@@ -1462,12 +1466,12 @@ int msClusterLayerOpen(layerObj *layer)
     return MS_FAILURE;
   }
 
-  if (layer->map->layers[layerIndex]->type != MS_LAYER_POINT) {
+  if (GET_LAYER(layer->map, layerIndex)->type != MS_LAYER_POINT) {
     msSetError(MS_MISCERR, "Only point layers are supported for cluster data source: %s", "msClusterLayerOpen()", layer->name);
     return MS_FAILURE;
   }
 
-  if (msCopyLayer(&layerinfo->srcLayer, layer->map->layers[layerIndex]) != MS_SUCCESS)
+  if (msCopyLayer(&layerinfo->srcLayer, GET_LAYER(layer->map, layerIndex)) != MS_SUCCESS)
     return(MS_FAILURE);
 #else
   /* hook the vtable to this driver, will be restored in LayerClose*/
@@ -0,0 +1,135 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Commandline utility writing precompiled mapfiles.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+/*
+** Writes the compiled form of a mapfile (see mapfilecompile.c), which must be
+** named like a mapfile, ending in .map by default. With -t the
+** result is checked: the text and compiled mapfiles are both loaded and
+** written back with msSaveMap(), and must give identical output.
+*/
+
+static void PrintUsage()
+{
+  printf("Usage: mapcompile [-t] mapfile compiled_mapfile\n");
+  printf("  -t    check that the compiled mapfile loads to the same map, and time both loads\n");
+  printf("compiled_mapfile is loaded like any mapfile, so it needs a name matching\n");
+  printf("MS_MAPFILE_PATTERN, by default a .map extension.\n");
+}
+
+static double loadAndSave(char *mapfile, char *savefile, int iterations)
+{
+  struct mstimeval start, end;
+  mapObj *map = NULL;
+  int i;
+
+  msGettimeofday(&start, NULL);
+  for(i=0; i<iterations; i++) {
+    if(map)
+      msFreeMap(map);
+    map = msLoadMap(mapfile, NULL);
+    if(map == NULL)
+      return -1;
+  }
+  msGettimeofday(&end, NULL);
+
+  if(msSaveMap(map, savefile) != MS_SUCCESS) {
+    msFreeMap(map);
+    return -1;
+  }
+  msFreeMap(map);
+  return ((end.tv_sec+end.tv_usec/1.0e6) - (start.tv_sec+start.tv_usec/1.0e6)) / iterations;
+}
+
+static int sameFiles(const char *file1, const char *file2)
+{
+  FILE *fp1 = fopen(file1, "rb"), *fp2 = fopen(file2, "rb");
+  int c1 = 0, c2 = 0;
+
+  if(fp1 && fp2) {
+    do {
+      c1 = getc(fp1);
+      c2 = getc(fp2);
+    } while(c1 == c2 && c1 != EOF);
+  }
+  if(fp1) fclose(fp1);
+  if(fp2) fclose(fp2);
+  return fp1 && fp2 && c1 == c2;
+}
+
+int main(int argc, char *argv[])
+{
+  int check = MS_FALSE, status = 0;
+  char *textsave, *compiledsave;
+  double texttime, compiledtime;
+
+  if(argc == 4 && strcmp(argv[1], "-t") == 0) {
+    check = MS_TRUE;
+    argv++;
+  } else if(argc != 3) {
+    PrintUsage();
+    return 1;
+  }
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  if(msCompileMapfile(argv[1], argv[2]) != MS_SUCCESS) {
+    msWriteError(stderr);
+    msCleanup();
+    return 1;
+  }
+
+  if(check) {
+    textsave = msTmpFile(NULL, NULL, NULL, "map");
+    compiledsave = msTmpFile(NULL, NULL, NULL, "map");
+
+    texttime = loadAndSave(argv[1], textsave, 10);
+    compiledtime = loadAndSave(argv[2], compiledsave, 10);
+    if(texttime < 0 || compiledtime < 0) {
+      msWriteError(stderr);
+      status = 1;
+    } else if(!sameFiles(textsave, compiledsave)) {
+      printf("FAILED: %s and %s differ\n", textsave, compiledsave);
+      status = 1;
+    } else {
+      printf("OK: text load %.4fs, compiled load %.4fs\n", texttime, compiledtime);
+      unlink(textsave);
+      unlink(compiledsave);
+    }
+    msFree(textsave);
+    msFree(compiledsave);
+  }
+
+  msCleanup();
+  return status;
+}
@@ -0,0 +1,191 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Round trip test of compiled mapfiles.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+
+/*
+** Writes a mapfile using INCLUDE, comments, expressions and regexes,
+** compiles it with msCompileMapfile() and compares what msSaveMap() writes
+** for the text and the compiled mapfile.  Also checks that a truncated
+** compiled mapfile and compiling a compiled one are refused.  Exits with 1
+** on any failure.
+*/
+
+#define TEXT_MAPFILE "mapcompiletst.map"
+#define INCLUDE_MAPFILE "mapcompiletst_include.map"
+#define COMPILED_MAPFILE "mapcompiletst_compiled.map"
+#define RECOMPILED_MAPFILE "mapcompiletst_recompiled.map"
+#define SAVED_TEXT "mapcompiletst_text_saved.map"
+#define SAVED_COMPILED "mapcompiletst_compiled_saved.map"
+
+static const char *textMapfile =
+  "# comment\n"
+  "MAP\n"
+  "  NAME \"compiled\"\n"
+  "  EXTENT -180 -90 180 90 # trailing comment\n"
+  "  SIZE 400 300\n"
+  "  IMAGECOLOR 255 255 255\n"
+  "  INCLUDE \"" INCLUDE_MAPFILE "\"\n"
+  "  OUTPUTFORMAT NAME \"png\" DRIVER \"AGG/PNG\" IMAGEMODE RGBA END\n"
+  "  LAYER\n"
+  "    NAME 'points' TYPE POINT STATUS ON\n"
+  "    DATA \"tests/point.shp\"\n"
+  "    FILTER ([FID] > 1 AND \"[NAME]\" ~* 'a.c')\n"
+  "    VALIDATION \"qstring\" \"^[a-z]+$\" END\n"
+  "    CLASS\n"
+  "      NAME \"Big\" EXPRESSION /^B/i\n"
+  "      STYLE COLOR 255 0 0 SIZE [SIZE] END\n"
+  "      TEXT (tostring([FID],'%03d'))\n"
+  "    END\n"
+  "    CLASS EXPRESSION {1,2,3} STYLE COLOR \"#00ff0080\" END END\n"
+  "  END\n"
+  "END\n";
+
+static const char *includeMapfile =
+  "WEB\n"
+  "  METADATA\n"
+  "    \"wms_title\" \"Compiled \\\"quoted\\\"\"\n"
+  "    'ows_enable_request' '*'\n"
+  "  END\n"
+  "END\n";
+
+static int writeFile(const char *filename, const char *text, size_t size)
+{
+  FILE *fp = fopen(filename, "wb");
+
+  if(fp == NULL)
+    return MS_FAILURE;
+  if(fwrite(text, 1, size, fp) != size) {
+    fclose(fp);
+    return MS_FAILURE;
+  }
+  return fclose(fp) == 0 ? MS_SUCCESS : MS_FAILURE;
+}
+
+static char *readFile(const char *filename, long *size)
+{
+  FILE *fp = fopen(filename, "rb");
+  char *buffer;
+
+  if(fp == NULL)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buffer = (char *) msSmallMalloc(*size + 1);
+  buffer[fread(buffer, 1, *size, fp)] = '\0';
+  fclose(fp);
+  return buffer;
+}
+
+static char *loadAndSave(char *mapfile, char *savefile)
+{
+  mapObj *map = msLoadMap(mapfile, NULL);
+  long size;
+
+  if(map == NULL)
+    return NULL;
+  if(msSaveMap(map, savefile) != 0) {
+    msFreeMap(map);
+    return NULL;
+  }
+  msFreeMap(map);
+  return readFile(savefile, &size);
+}
+
+int main(int argc, char *argv[])
+{
+  char *text = NULL, *compiled = NULL, *binary;
+  mapObj *map;
+  long size;
+  int failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  if(writeFile(TEXT_MAPFILE, textMapfile, strlen(textMapfile)) != MS_SUCCESS ||
+      writeFile(INCLUDE_MAPFILE, includeMapfile, strlen(includeMapfile)) != MS_SUCCESS) {
+    printf("could not write %s\n", TEXT_MAPFILE);
+    msCleanup();
+    return 1;
+  }
+
+  /* the round trip */
+  if(msCompileMapfile(TEXT_MAPFILE, COMPILED_MAPFILE) != MS_SUCCESS ||
+      (text = loadAndSave(TEXT_MAPFILE, SAVED_TEXT)) == NULL ||
+      (compiled = loadAndSave(COMPILED_MAPFILE, SAVED_COMPILED)) == NULL) {
+    msWriteError(stderr);
+    failures++;
+  } else if(strcmp(text, compiled) != 0) {
+    printf("%s and %s differ\n", SAVED_TEXT, SAVED_COMPILED);
+    failures++;
+  } else {
+    printf("compiled mapfile loads to the same map\n");
+  }
+  msFree(text);
+  msFree(compiled);
+  msResetErrorList();
+
+  /* a compiled mapfile can't be compiled again */
+  if(msCompileMapfile(COMPILED_MAPFILE, RECOMPILED_MAPFILE) == MS_SUCCESS) {
+    printf("compiling %s again did not fail\n", COMPILED_MAPFILE);
+    failures++;
+  }
+  msResetErrorList();
+
+  /* nor can a truncated one be loaded */
+  binary = readFile(COMPILED_MAPFILE, &size);
+  if(binary == NULL || writeFile(COMPILED_MAPFILE, binary, size / 2) != MS_SUCCESS) {
+    printf("could not truncate %s\n", COMPILED_MAPFILE);
+    failures++;
+  } else if((map = msLoadMap(COMPILED_MAPFILE, NULL)) != NULL) {
+    printf("truncated %s loaded\n", COMPILED_MAPFILE);
+    msFreeMap(map);
+    failures++;
+  }
+  msFree(binary);
+  msResetErrorList();
+
+  if(failures == 0) {
+    unlink(TEXT_MAPFILE);
+    unlink(INCLUDE_MAPFILE);
+    unlink(COMPILED_MAPFILE);
+    unlink(RECOMPILED_MAPFILE);
+    unlink(SAVED_TEXT);
+    unlink(SAVED_COMPILED);
+  }
+  msCleanup();
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -41,6 +41,8 @@
 #include "mapthread.h"
 #include "cpl_string.h"
 
+#include <sys/stat.h>
+
 #define GEO_TRANS(tr,x,y)  ((tr)[0]+(tr)[1]*(x)+(tr)[2]*(y))
 
 extern int InvGeoTransform(double *gt_in, double *gt_out);
@@ -58,6 +60,15 @@ typedef struct {
   OGRDataSourceH hOGRDS;
   double cellsize;
 
+  /* contour cell cache, see msContourLayerGenerateFromCells() */
+  int use_cells;
+  char *path; /* of the original dataset, with its size and mtime */
+  long path_size, path_mtime;
+  int band;
+  double adfGeoTransform[6]; /* of the original dataset */
+  int grid_step_x, grid_step_y;
+  int src_xoff, src_yoff, src_xsize, src_ysize;
+
 } contourLayerInfo;
 
 
@@ -121,11 +132,182 @@ static void msContourLayerInfoFree(layerObj *layer)
     return;
 
   freeLayer(&clinfo->ogrLayer);
+  msFree(clinfo->path);
   free(clinfo);
 
   layer->layerinfo = NULL;
 }
 
+/************************************************************************/
+/* ==================================================================== */
+/*      Contour cell cache.                                             */
+/*                                                                      */
+/*      With PROCESSING "CONTOUR_CACHE=ON" the sampled grid of the      */
+/*      source raster is split in cells of CONTOUR_CELL_SIZE samples    */
+/*      (default 256) at each sampling step, and the contours of each   */
+/*      cell are kept in a process wide cache, so that map tiles only   */
+/*      contour the cells that no earlier request did.  Neighbouring   */
+/*      cells share their boundary row and column of samples, so the    */
+/*      contours of a request are stitched back into continuous lines   */
+/*      where they cross cell boundaries.  The cache is limited to      */
+/*      MS_CONTOUR_CACHE_SIZE bytes (default 16MB, 0 only shares cells  */
+/*      within a request), least recently used cells going first.      */
+/*      Only layers georeferenced with TRANSFORM ON use the cache.      */
+/* ==================================================================== */
+/************************************************************************/
+
+#define MS_CONTOUR_DEFAULT_CACHE_SIZE (16*1024*1024)
+#define MS_CONTOUR_DEFAULT_CELL_SIZE 256
+#define MS_CONTOUR_MAX_CELLS 1024
+
+typedef struct {
+  double level;
+  int numpoints;
+  double *xy; /* x,y pairs in samples of the sampled grid */
+} contourLineObj;
+
+typedef struct contourCellObj {
+  char *key;
+  int numlines;
+  contourLineObj *lines;
+  size_t size;
+
+  int refcount;
+  int cached;
+  unsigned int lastused;
+  struct contourCellObj *next;
+} contourCellObj;
+
+static contourCellObj *contourCellCache = NULL;
+static size_t contourCellCacheSize = 0;
+static unsigned int contourCellCacheClock = 0;
+
+static int msContourCacheEnabled(layerObj *layer)
+{
+  const char *value = CSLFetchNameValue(layer->processing, "CONTOUR_CACHE");
+  return value != NULL && (EQUAL(value, "ON") || EQUAL(value, "YES") || EQUAL(value, "TRUE"));
+}
+
+static int msContourGetCellSize(layerObj *layer)
+{
+  const char *value = CSLFetchNameValue(layer->processing, "CONTOUR_CELL_SIZE");
+  return value ? MAX(16, atoi(value)) : MS_CONTOUR_DEFAULT_CELL_SIZE;
+}
+
+/* Range of the cells covering the window to contour. */
+static int msContourGetCells(contourLayerInfo *clinfo, int cellSize,
+                             int *cx0, int *cy0, int *cx1, int *cy1)
+{
+  *cx0 = clinfo->src_xoff / clinfo->grid_step_x / cellSize;
+  *cy0 = clinfo->src_yoff / clinfo->grid_step_y / cellSize;
+  *cx1 = (clinfo->src_xoff + clinfo->src_xsize - 1) / clinfo->grid_step_x / cellSize;
+  *cy1 = (clinfo->src_yoff + clinfo->src_ysize - 1) / clinfo->grid_step_y / cellSize;
+  return (*cx1 - *cx0 + 1) * (*cy1 - *cy0 + 1);
+}
+
+static void msContourFreeCell(contourCellObj *cell)
+{
+  int i;
+
+  for (i=0; i<cell->numlines; ++i)
+    free(cell->lines[i].xy);
+  free(cell->lines);
+  free(cell->key);
+  free(cell);
+}
+
+/* Drop the least recently used unused cells till the cache holds at most
+   nMaxSize bytes. Called with TLOCK_CONTOURCACHE held. */
+static void msContourTrimCellCache(size_t nMaxSize)
+{
+  while (contourCellCacheSize > nMaxSize) {
+    contourCellObj **link, **oldest = NULL, *cell;
+
+    for (link = &contourCellCache; *link; link = &((*link)->next)) {
+      if ((*link)->refcount == 0 &&
+          (oldest == NULL || (*link)->lastused < (*oldest)->lastused))
+        oldest = link;
+    }
+    if (oldest == NULL) /* everything is in use */
+      return;
+
+    cell = *oldest;
+    *oldest = cell->next;
+    contourCellCacheSize -= cell->size;
+    msContourFreeCell(cell);
+  }
+}
+
+/* Returns the cached cell of key with a reference, or NULL */
+static contourCellObj *msContourAcquireCell(const char *key)
+{
+  contourCellObj *cell;
+
+  msAcquireLock(TLOCK_CONTOURCACHE);
+  for (cell = contourCellCache; cell; cell = cell->next) {
+    if (strcmp(cell->key, key) == 0) {
+      cell->refcount++;
+      cell->lastused = ++contourCellCacheClock;
+      break;
+    }
+  }
+  msReleaseLock(TLOCK_CONTOURCACHE);
+
+  return cell;
+}
+
+/* Adds a new cell, holding a reference, to the cache if it fits. Returns
+   the cell to use, which is the cached one if another thread was first. */
+static contourCellObj *msContourStoreCell(contourCellObj *cell, size_t nMaxSize)
+{
+  contourCellObj *cached;
+
+  cell->refcount = 1;
+  if (cell->size > nMaxSize)
+    return cell;
+
+  msAcquireLock(TLOCK_CONTOURCACHE);
+  for (cached = contourCellCache; cached; cached = cached->next) {
+    if (strcmp(cached->key, cell->key) == 0) {
+      cached->refcount++;
+      cached->lastused = ++contourCellCacheClock;
+      msReleaseLock(TLOCK_CONTOURCACHE);
+      msContourFreeCell(cell);
+      return cached;
+    }
+  }
+
+  msContourTrimCellCache(nMaxSize - cell->size);
+  cell->cached = MS_TRUE;
+  cell->lastused = ++contourCellCacheClock;
+  cell->next = contourCellCache;
+  contourCellCache = cell;
+  contourCellCacheSize += cell->size;
+  msReleaseLock(TLOCK_CONTOURCACHE);
+
+  return cell;
+}
+
+static void msContourReleaseCell(contourCellObj *cell)
+{
+  int cached;
+
+  msAcquireLock(TLOCK_CONTOURCACHE);
+  cell->refcount--;
+  cached = cell->cached;
+  msReleaseLock(TLOCK_CONTOURCACHE);
+
+  if (!cached)
+    msContourFreeCell(cell);
+}
+
+void msContourCacheCleanup(void)
+{
+  msAcquireLock(TLOCK_CONTOURCACHE);
+  msContourTrimCellCache(0);
+  msReleaseLock(TLOCK_CONTOURCACHE);
+}
+
 static int msContourLayerReadRaster(layerObj *layer, rectObj rect)
 {
   mapObj *map = layer->map;  
@@ -153,6 +335,8 @@ static int msContourLayerReadRaster(layerObj *layer, rectObj rect)
     return MS_FAILURE;    
   }
 
+  clinfo->use_cells = MS_FALSE;
+
   bands = CSLTokenizeStringComplex(
                CSLFetchNameValue(layer->processing,"BANDS"), " ,", FALSE, FALSE );
   if (CSLCount(bands) > 0) {
@@ -382,6 +566,39 @@ static int msContourLayerReadRaster(layerObj *layer, rectObj rect)
       msDebug( "msContourLayerReadRaster(): src=%d,%d,%d,%d, dst=%d,%d,%d,%d\n",
                src_xoff, src_yoff, src_xsize, src_ysize,
                0, 0, dst_xsize, dst_ysize );
+
+    /*
+     * With the contour cache the window is read and contoured cell by
+     * cell, by msContourLayerGenerateFromCells(), only for the cells
+     * that are not in the cache yet.  Windows covering more than
+     * MS_CONTOUR_MAX_CELLS cells are contoured in a single pass instead.
+     */
+    if (msContourCacheEnabled(layer)) {
+      char buf[64];
+      int cx0, cy0, cx1, cy1, ncells;
+
+      clinfo->band = band;
+      memcpy(clinfo->adfGeoTransform, adfGeoTransform, sizeof(adfGeoTransform));
+      clinfo->grid_step_x = virtual_grid_step_x;
+      clinfo->grid_step_y = virtual_grid_step_y;
+      clinfo->src_xoff = src_xoff;
+      clinfo->src_yoff = src_yoff;
+      clinfo->src_xsize = src_xsize;
+      clinfo->src_ysize = src_ysize;
+
+      ncells = msContourGetCells(clinfo, msContourGetCellSize(layer), &cx0, &cy0, &cx1, &cy1);
+      if (ncells > MS_CONTOUR_MAX_CELLS) {
+        if (layer->debug)
+          msDebug("msContourLayerReadRaster(): %d contour cells, more than %d, not using the contour cache.\n",
+                  ncells, MS_CONTOUR_MAX_CELLS);
+      } else {
+        clinfo->use_cells = MS_TRUE;
+        clinfo->cellsize = MAX(dst_cellsize_x, dst_cellsize_y);
+        sprintf(buf, "%lf", clinfo->cellsize);
+        msInsertHashTable(&layer->metadata, "__data_cellsize__", buf);
+        return MS_SUCCESS;
+      }
+    }
   } else {
     src_xoff = 0;
     src_yoff = 0;
@@ -504,6 +721,506 @@ static char* msContourGetOption(layerObj *layer, const char *name)
   return value;
 }
 
+/************************************************************************/
+/*                        Contour cell generation                       */
+/************************************************************************/
+
+typedef struct {
+  contourCellObj *cell;
+  int cx, cy;
+  double *buffer;
+  GDALDatasetH hDS;
+  OGRDataSourceH hOGRDS;
+  OGRLayerH hLayer; /* NULL if the cell has less than 2x2 samples */
+  double clip[4]; /* minx, miny, maxx, maxy kept of the lines, in samples of the cell */
+  char *error;
+} contourCellJobObj;
+
+typedef struct {
+  contourCellJobObj *jobs;
+  double interval;
+  int levelCount;
+  double *levels;
+} contourCellBatchObj;
+
+/* Read the samples of a cell, its boundary row and column included, and
+   set up the datasets GDALContourGenerate() works with. */
+static int msContourReadCell(layerObj *layer, contourCellJobObj *job, int cellSize)
+{
+  contourLayerInfo *clinfo = (contourLayerInfo *) layer->layerinfo;
+  GDALRasterBandH hBand = GDALGetRasterBand(clinfo->hOrigDS, clinfo->band);
+  OGRSFDriverH hDriver;
+  OGRFieldDefnH hFld;
+  char pointer[64], memDSPointer[128];
+  double adfIdentity[6] = { 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+  int xoff = job->cx * cellSize * clinfo->grid_step_x;
+  int yoff = job->cy * cellSize * clinfo->grid_step_y;
+  int xsize, ysize;
+  CPLErr eErr;
+
+  xsize = MIN(cellSize+1, (GDALGetRasterXSize(clinfo->hOrigDS) - xoff) / clinfo->grid_step_x);
+  ysize = MIN(cellSize+1, (GDALGetRasterYSize(clinfo->hOrigDS) - yoff) / clinfo->grid_step_y);
+  if (xsize < 2 || ysize < 2)
+    return MS_SUCCESS;
+
+  /*
+   * GDAL extends the contours half a sample past the outer sample centres
+   * (at i+0.5 in the identity geotransform below).  Where a neighbouring
+   * cell is contoured too, cut the lines at the shared row or column of
+   * samples so both cells end them on the same points.  The extension is
+   * kept on the edges of the raster, as GDAL draws it on the whole raster.
+   */
+  job->clip[0] = (job->cx > 0) ? 0.5 : -HUGE_VAL;
+  job->clip[1] = (job->cy > 0) ? 0.5 : -HUGE_VAL;
+  job->clip[2] = ((GDALGetRasterXSize(clinfo->hOrigDS) - xoff) / clinfo->grid_step_x - cellSize >= 2) ?
+                 xsize - 0.5 : HUGE_VAL;
+  job->clip[3] = ((GDALGetRasterYSize(clinfo->hOrigDS) - yoff) / clinfo->grid_step_y - cellSize >= 2) ?
+                 ysize - 0.5 : HUGE_VAL;
+
+  job->buffer = (double *) malloc(sizeof(double) * xsize * ysize);
+  if (job->buffer == NULL) {
+    msSetError(MS_MEMERR, "Malloc(): Out of memory.", "msContourReadCell()");
+    return MS_FAILURE;
+  }
+
+  eErr = GDALRasterIO(hBand, GF_Read, xoff, yoff,
+                      xsize * clinfo->grid_step_x, ysize * clinfo->grid_step_y,
+                      job->buffer, xsize, ysize, GDT_Float64, 0, 0);
+  if (eErr != CE_None) {
+    msSetError(MS_IOERR, "GDALRasterIO() failed: %s",
+               "msContourReadCell()", CPLGetLastErrorMsg());
+    return MS_FAILURE;
+  }
+
+  memset(pointer, 0, sizeof(pointer));
+  CPLPrintPointer(pointer, job->buffer, sizeof(pointer));
+  sprintf(memDSPointer,"MEM:::DATAPOINTER=%s,PIXELS=%d,LINES=%d,BANDS=1,DATATYPE=Float64",
+          pointer, xsize, ysize);
+  job->hDS = GDALOpen(memDSPointer, GA_ReadOnly);
+  if (job->hDS == NULL) {
+    msSetError(MS_IMGERR, "Unable to open GDAL Memory dataset.", "msContourReadCell()");
+    return MS_FAILURE;
+  }
+  /* contour in sample coordinates of the cell */
+  GDALSetGeoTransform(job->hDS, adfIdentity);
+
+  hDriver = OGRGetDriverByName("Memory");
+  if (hDriver == NULL) {
+    msSetError(MS_OGRERR, "Unable to get OGR driver 'Memory'.", "msContourReadCell()");
+    return MS_FAILURE;
+  }
+  job->hOGRDS = OGR_Dr_CreateDataSource(hDriver, "", NULL);
+  if (job->hOGRDS == NULL) {
+    msSetError(MS_OGRERR, "Unable to create OGR DataSource.", "msContourReadCell()");
+    return MS_FAILURE;
+  }
+  job->hLayer = OGR_DS_CreateLayer(job->hOGRDS, "contour", NULL, wkbLineString, NULL);
+
+  hFld = OGR_Fld_Create("ID", OFTInteger);
+  OGR_L_CreateField(job->hLayer, hFld, FALSE);
+  OGR_Fld_Destroy(hFld);
+  hFld = OGR_Fld_Create("ELEV", OFTReal);
+  OGR_L_CreateField(job->hLayer, hFld, FALSE);
+  OGR_Fld_Destroy(hFld);
+
+  return MS_SUCCESS;
+}
+
+static void msContourCellTask(void *pData, int iTask)
+{
+  contourCellBatchObj *batch = (contourCellBatchObj *) pData;
+  contourCellJobObj *job = batch->jobs + iTask;
+  CPLErr eErr;
+
+  if (job->hLayer == NULL)
+    return;
+
+  eErr = GDALContourGenerate(GDALGetRasterBand(job->hDS, 1),
+                             batch->interval, 0.0,
+                             batch->levelCount, batch->levels,
+                             FALSE, 0.0, job->hLayer, 0, 1, NULL, NULL);
+  if (eErr != CE_None)
+    job->error = msStrdup(CPLGetLastErrorMsg());
+}
+
+/* Clip the segment p0-p1 to the clip box of the job (Liang-Barsky), the
+   kept part is from t0 to t1 along the segment. */
+static int msContourClipSegment(const double *clip, const double *p0, const double *p1,
+                                double *t0, double *t1)
+{
+  double d[2], p, q, r;
+  int i;
+
+  d[0] = p1[0] - p0[0];
+  d[1] = p1[1] - p0[1];
+  *t0 = 0.0;
+  *t1 = 1.0;
+  for (i=0; i<4; ++i) {
+    p = (i < 2) ? -d[i] : d[i-2];
+    q = (i < 2) ? p0[i] - clip[i] : clip[i] - p0[i-2];
+    if (p == 0.0) {
+      if (q < 0.0)
+        return MS_FALSE;
+      continue;
+    }
+    r = q / p;
+    if (p < 0.0) {
+      if (r > *t1) return MS_FALSE;
+      if (r > *t0) *t0 = r;
+    } else {
+      if (r < *t0) return MS_FALSE;
+      if (r < *t1) *t1 = r;
+    }
+  }
+  return MS_TRUE;
+}
+
+/* Add the point x,y of the cell to line, in sampled grid coordinates. */
+static void msContourAddLinePoint(contourLineObj *line, int *maxpoints,
+                                  const contourCellJobObj *job, int cellSize,
+                                  double x, double y)
+{
+  if (line->numpoints == *maxpoints) {
+    *maxpoints = MAX(16, *maxpoints*2);
+    line->xy = (double *) msSmallRealloc(line->xy, sizeof(double) * 2 * (*maxpoints));
+  }
+  line->xy[2*line->numpoints] = x + job->cx * cellSize;
+  line->xy[2*line->numpoints+1] = y + job->cy * cellSize;
+  line->numpoints++;
+}
+
+/* Move the contours of a cell from OGR to the cell, in sampled grid
+   coordinates, split into the pieces that lie in its clip box. */
+static void msContourCollectCell(contourCellJobObj *job, int cellSize)
+{
+  contourCellObj *cell = job->cell;
+  OGRFeatureH hFeat;
+  contourLineObj *line = NULL;
+  int maxlines = 0, maxpoints = 0;
+
+  cell->size = sizeof(contourCellObj) + strlen(cell->key) + 1;
+  if (job->hLayer == NULL)
+    return;
+
+#define END_PIECE() do { \
+    if (line && line->numpoints >= 2) { \
+      line->xy = (double *) msSmallRealloc(line->xy, sizeof(double) * 2 * line->numpoints); \
+      cell->size += sizeof(contourLineObj) + sizeof(double) * 2 * line->numpoints; \
+    } else if (line) { \
+      free(line->xy); \
+      cell->numlines--; \
+    } \
+    line = NULL; \
+  } while (0)
+
+  OGR_L_ResetReading(job->hLayer);
+  while ((hFeat = OGR_L_GetNextFeature(job->hLayer)) != NULL) {
+    OGRGeometryH hGeom = OGR_F_GetGeometryRef(hFeat);
+    double level = OGR_F_GetFieldAsDouble(hFeat, 1);
+    int i, n = hGeom ? OGR_G_GetPointCount(hGeom) : 0;
+
+    for (i=0; i+1<n; ++i) {
+      double p0[2], p1[2], t0, t1;
+
+      p0[0] = OGR_G_GetX(hGeom, i);
+      p0[1] = OGR_G_GetY(hGeom, i);
+      p1[0] = OGR_G_GetX(hGeom, i+1);
+      p1[1] = OGR_G_GetY(hGeom, i+1);
+
+      /* segments that only touch the box end the piece */
+      if (!msContourClipSegment(job->clip, p0, p1, &t0, &t1) ||
+          (t1 <= t0 && (p0[0] != p1[0] || p0[1] != p1[1]))) {
+        END_PIECE();
+        continue;
+      }
+      if (line && t0 > 0.0)
+        END_PIECE();
+      if (line == NULL) {
+        if (cell->numlines == maxlines) {
+          maxlines = MAX(16, maxlines*2);
+          cell->lines = (contourLineObj *) msSmallRealloc(cell->lines, sizeof(contourLineObj)*maxlines);
+        }
+        line = cell->lines + cell->numlines++;
+        line->level = level;
+        line->numpoints = 0;
+        line->xy = NULL;
+        maxpoints = 0;
+        /* keep the vertices exact, they are matched with the other cells */
+        if (t0 > 0.0)
+          msContourAddLinePoint(line, &maxpoints, job, cellSize,
+                                p0[0] + t0*(p1[0]-p0[0]), p0[1] + t0*(p1[1]-p0[1]));
+        else
+          msContourAddLinePoint(line, &maxpoints, job, cellSize, p0[0], p0[1]);
+      }
+      if (t1 < 1.0) {
+        msContourAddLinePoint(line, &maxpoints, job, cellSize,
+                              p0[0] + t1*(p1[0]-p0[0]), p0[1] + t1*(p1[1]-p0[1]));
+        END_PIECE();
+      } else
+        msContourAddLinePoint(line, &maxpoints, job, cellSize, p1[0], p1[1]);
+    }
+    END_PIECE();
+    OGR_F_Destroy(hFeat);
+  }
+#undef END_PIECE
+}
+
+static void msContourFreeCellJob(contourCellJobObj *job)
+{
+  if (job->hOGRDS)
+    OGR_DS_Destroy(job->hOGRDS);
+  if (job->hDS)
+    GDALClose(job->hDS);
+  free(job->buffer);
+  msFree(job->error);
+}
+
+/************************************************************************/
+/*                          Contour stitching                           */
+/*                                                                      */
+/*      The lines of neighbouring cells end on the same points of       */
+/*      their shared boundary.  Ends are matched through a hash of      */
+/*      their level and position rounded to 1e-6 samples, and only      */
+/*      joined where exactly two ends meet.                             */
+/************************************************************************/
+
+typedef struct {
+  double level, qx, qy;
+  int count;
+  int ends[2]; /* line*2 + 0 for its first point, 1 for its last */
+} contourEndObj;
+
+static int msContourFindEnd(contourEndObj *table, unsigned int mask, double level, double x, double y)
+{
+  double key[3];
+  const unsigned char *bytes = (const unsigned char *) key;
+  unsigned int h = 2166136261U, k;
+
+  key[0] = level;
+  key[1] = floor(x*1e6+0.5);
+  key[2] = floor(y*1e6+0.5);
+  for (k=0; k<sizeof(key); ++k)
+    h = (h ^ bytes[k]) * 16777619U;
+
+  for (h &= mask; table[h].count > 0; h = (h+1) & mask) {
+    if (table[h].level == key[0] && table[h].qx == key[1] && table[h].qy == key[2])
+      return h;
+  }
+  table[h].level = key[0];
+  table[h].qx = key[1];
+  table[h].qy = key[2];
+  return h;
+}
+
+static int msContourEmitLines(layerObj *layer, OGRLayerH hLayer, int idField, int elevField,
+                              contourCellObj **cells, int ncells)
+{
+  contourLayerInfo *clinfo = (contourLayerInfo *) layer->layerinfo;
+  double *gt = clinfo->adfGeoTransform;
+  double sx = clinfo->grid_step_x, sy = clinfo->grid_step_y;
+  const contourLineObj **lines;
+  contourEndObj *table;
+  int *endEntry, *used;
+  unsigned int size = 16;
+  int nlines = 0, i, j, id = 0, status = MS_SUCCESS;
+
+  for (i=0; i<ncells; ++i)
+    nlines += cells[i]->numlines;
+  if (nlines == 0)
+    return MS_SUCCESS;
+
+  lines = (const contourLineObj **) msSmallMalloc(sizeof(contourLineObj*) * nlines);
+  for (i=0, nlines=0; i<ncells; ++i)
+    for (j=0; j<cells[i]->numlines; ++j)
+      lines[nlines++] = cells[i]->lines + j;
+
+  while (size < (unsigned int)nlines*4)
+    size *= 2;
+  table = (contourEndObj *) msSmallCalloc(size, sizeof(contourEndObj));
+  endEntry = (int *) msSmallMalloc(sizeof(int) * 2 * nlines);
+  used = (int *) msSmallCalloc(nlines, sizeof(int));
+
+  for (i=0; i<nlines; ++i) {
+    for (j=0; j<2; ++j) {
+      const double *pt = lines[i]->xy + (j ? 2*(lines[i]->numpoints-1) : 0);
+      int e = msContourFindEnd(table, size-1, lines[i]->level, pt[0], pt[1]);
+      if (table[e].count < 2)
+        table[e].ends[table[e].count] = i*2 + j;
+      table[e].count++;
+      endEntry[i*2+j] = e;
+    }
+  }
+
+#define PARTNER(end) (table[endEntry[end]].count != 2 ? -1 : \
+                      table[endEntry[end]].ends[0] == (end) ? table[endEntry[end]].ends[1] : \
+                      table[endEntry[end]].ends[0])
+
+  for (i=0; i<nlines && status == MS_SUCCESS; ++i) {
+    int head = i, enter = 0, steps, cur, other;
+    OGRFeatureH hFeat;
+    OGRGeometryH hGeom;
+
+    if (used[i])
+      continue;
+
+    /* walk back to the first line of the chain */
+    for (steps=0; steps<nlines; ++steps) {
+      other = PARTNER(head*2 + enter);
+      if (other < 0 || other/2 == i || used[other/2])
+        break;
+      head = other/2;
+      enter = 1 - other%2;
+    }
+
+    hGeom = OGR_G_CreateGeometry(wkbLineString);
+    for (cur = head*2 + enter; cur >= 0 && !used[cur/2]; ) {
+      const contourLineObj *line = lines[cur/2];
+      int k, first = OGR_G_GetPointCount(hGeom) > 0 ? 1 : 0;
+
+      used[cur/2] = MS_TRUE;
+      for (k=first; k<line->numpoints; ++k) {
+        const double *pt = line->xy + 2*(cur%2 ? line->numpoints-1-k : k);
+        double px = pt[0]*sx, py = pt[1]*sy;
+        OGR_G_AddPoint_2D(hGeom, GEO_TRANS(gt,px,py), GEO_TRANS(gt+3,px,py));
+      }
+      other = PARTNER(cur ^ 1);
+      cur = other;
+    }
+
+    hFeat = OGR_F_Create(OGR_L_GetLayerDefn(hLayer));
+    OGR_F_SetFieldInteger(hFeat, idField, id++);
+    if (elevField >= 0)
+      OGR_F_SetFieldDouble(hFeat, elevField, lines[head]->level);
+    OGR_F_SetGeometryDirectly(hFeat, hGeom);
+    if (OGR_L_CreateFeature(hLayer, hFeat) != OGRERR_NONE) {
+      msSetError(MS_OGRERR, "Unable to add contour: %s",
+                 "msContourEmitLines()", CPLGetLastErrorMsg());
+      status = MS_FAILURE;
+    }
+    OGR_F_Destroy(hFeat);
+  }
+#undef PARTNER
+
+  free(lines);
+  free(table);
+  free(endEntry);
+  free(used);
+  return status;
+}
+
+/************************************************************************/
+/*                   msContourLayerGenerateFromCells()                  */
+/*                                                                      */
+/*      Fill hLayer with the contours of the cells covering the         */
+/*      window computed by msContourLayerReadRaster(), contouring the   */
+/*      cells missing from the cache on the worker threads.             */
+/************************************************************************/
+
+static int msContourLayerGenerateFromCells(layerObj *layer, OGRLayerH hLayer,
+                                           int idField, int elevField,
+                                           double interval, int levelCount, double *levels)
+{
+  contourLayerInfo *clinfo = (contourLayerInfo *) layer->layerinfo;
+  int cellSize = msContourGetCellSize(layer);
+  size_t nMaxSize = MS_CONTOUR_DEFAULT_CACHE_SIZE;
+  int cx0, cy0, cx1, cy1, ncells, njobs = 0, i, status = MS_SUCCESS;
+  contourCellObj **cells;
+  contourCellJobObj *jobs;
+  contourCellBatchObj batch;
+  char *levelsKey = NULL, *key, buf[64];
+  const char *value;
+  size_t keySize;
+
+  value = msGetConfigOption(layer->map, "MS_CONTOUR_CACHE_SIZE");
+  if (value)
+    nMaxSize = (size_t) MAX(0, atol(value));
+
+  ncells = msContourGetCells(clinfo, cellSize, &cx0, &cy0, &cx1, &cy1);
+
+  /* everything the contours of a cell depend on */
+  snprintf(buf, sizeof(buf), "%.17g", interval);
+  levelsKey = msStringConcatenate(levelsKey, buf);
+  for (i=0; i<levelCount; ++i) {
+    snprintf(buf, sizeof(buf), ",%.17g", levels[i]);
+    levelsKey = msStringConcatenate(levelsKey, buf);
+  }
+  keySize = strlen(clinfo->path) + strlen(levelsKey) + 160;
+
+  cells = (contourCellObj **) msSmallCalloc(ncells, sizeof(contourCellObj*));
+  jobs = (contourCellJobObj *) msSmallCalloc(ncells, sizeof(contourCellJobObj));
+
+  for (i=0; i<ncells && status == MS_SUCCESS; ++i) {
+    int cx = cx0 + i % (cx1-cx0+1), cy = cy0 + i / (cx1-cx0+1);
+
+    key = (char *) msSmallMalloc(keySize);
+    snprintf(key, keySize, "%s|%ld|%ld|%d|%s|%d|%d|%d|%d|%d",
+             clinfo->path, clinfo->path_size, clinfo->path_mtime, clinfo->band,
+             levelsKey, clinfo->grid_step_x, clinfo->grid_step_y, cellSize, cx, cy);
+
+    cells[i] = msContourAcquireCell(key);
+    if (cells[i] != NULL) {
+      free(key);
+      continue;
+    }
+
+    jobs[njobs].cell = (contourCellObj *) msSmallCalloc(1, sizeof(contourCellObj));
+    jobs[njobs].cell->key = key;
+    jobs[njobs].cx = cx;
+    jobs[njobs].cy = cy;
+    status = msContourReadCell(layer, jobs + njobs, cellSize);
+    njobs++;
+  }
+
+  if (layer->debug)
+    msDebug("msContourLayerGenerateFromCells(%s): %d cells, %d from the cache.\n",
+            layer->name, ncells, ncells - njobs);
+
+  if (status == MS_SUCCESS && njobs > 0) {
+    batch.jobs = jobs;
+    batch.interval = interval;
+    batch.levelCount = levelCount;
+    batch.levels = levels;
+    msThreadRunTasks(MIN(njobs, msGetWorkerThreadCount(layer->map, layer)), njobs,
+                     msContourCellTask, &batch);
+
+    for (i=0; i<njobs && status == MS_SUCCESS; ++i) {
+      if (jobs[i].error) {
+        msSetError(MS_IOERR, "GDALContourGenerate() failed: %s",
+                   "msContourLayerGenerateFromCells()", jobs[i].error);
+        status = MS_FAILURE;
+      }
+    }
+  }
+
+  /* hand the new cells to the cache */
+  for (i=0, njobs=0; i<ncells; ++i) {
+    contourCellJobObj *job = jobs + njobs;
+
+    if (cells[i] != NULL || job->cell == NULL)
+      continue;
+    if (status == MS_SUCCESS) {
+      msContourCollectCell(job, cellSize);
+      cells[i] = msContourStoreCell(job->cell, nMaxSize);
+    } else
+      msContourFreeCell(job->cell);
+    msContourFreeCellJob(job);
+    njobs++;
+  }
+
+  if (status == MS_SUCCESS)
+    status = msContourEmitLines(layer, hLayer, idField, elevField, cells, ncells);
+
+  for (i=0; i<ncells; ++i) {
+    if (cells[i])
+      msContourReleaseCell(cells[i]);
+  }
+  free(cells);
+  free(jobs);
+  msFree(levelsKey);
+
+  return status;
+}
+
 static int msContourLayerGenerateContour(layerObj *layer)
 {
   OGRSFDriverH hDriver;
@@ -526,12 +1243,13 @@ static int msContourLayerGenerateContour(layerObj *layer)
     return MS_FAILURE;
   }
 
-  if (!clinfo->hDS) { /* no overlap */
+  if (!clinfo->hDS && !clinfo->use_cells) { /* no overlap */
     return MS_SUCCESS;
   }
   
-  hBand = GDALGetRasterBand(clinfo->hDS, 1);
-  if (hBand == NULL)
+  if (!clinfo->use_cells)
+    hBand = GDALGetRasterBand(clinfo->hDS, 1);
+  if (hBand == NULL && !clinfo->use_cells)
   {
     msSetError(MS_IMGERR,
                "Band %d does not exist on dataset.",
@@ -595,6 +1313,23 @@ static int msContourLayerGenerateContour(layerObj *layer)
     CSLDestroy(levelsTmp);
     free(option);
   }
+
+  if (clinfo->use_cells) {
+    OGRFeatureDefnH hDefn = OGR_L_GetLayerDefn(hLayer);
+
+    if (msContourLayerGenerateFromCells(layer, hLayer,
+                                        OGR_FD_GetFieldIndex(hDefn, "ID"),
+                                        (elevItem == NULL) ? -1 :
+                                        OGR_FD_GetFieldIndex(hDefn, elevItem),
+                                        interval, levelCount, levels) != MS_SUCCESS) {
+      OGR_DS_Destroy(clinfo->hOGRDS);
+      clinfo->hOGRDS = NULL;
+      return MS_FAILURE;
+    }
+
+    msConnPoolRegister(&clinfo->ogrLayer, clinfo->hOGRDS, msContourOGRCloseConnection);
+    return MS_SUCCESS;
+  }
     
   eErr = GDALContourGenerate( hBand, interval, 0.0,
                               levelCount, levels,
@@ -645,6 +1380,17 @@ int msContourLayerOpen(layerObj *layer)
   msTryBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, layer->data);
   decrypted_path = msDecryptStringTokens(layer->map, szPath);
 
+  msFree(clinfo->path);
+  clinfo->path = msStrdup(szPath);
+  clinfo->path_size = clinfo->path_mtime = 0;
+  if (decrypted_path) {
+    struct stat st;
+    if (stat(decrypted_path, &st) == 0) {
+      clinfo->path_size = (long) st.st_size;
+      clinfo->path_mtime = (long) st.st_mtime;
+    }
+  }
+
   msAcquireLock(TLOCK_GDAL);
   if (decrypted_path) {
     clinfo->hOrigDS = GDALOpen(decrypted_path, GA_ReadOnly);
@@ -906,5 +1652,9 @@ int msContourLayerInitializeVirtualTable(layerObj *layer)
   msSetError(MS_MISCERR, "Contour Layer needs GDAL support, but it it not compiled in", "msContourLayerInitializeVirtualTable()");
   return MS_FAILURE;
 }
+
+void msContourCacheCleanup(void)
+{
+}
 #endif
 
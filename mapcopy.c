@@ -1019,8 +1019,11 @@ int msCopyLayer(layerObj *dst, layerObj *src)
   MS_COPYSTELEM(mingeowidth);
   MS_COPYSTELEM(maxgeowidth);
 
+  MS_COPYSTELEM(minfeaturesize);
+
   MS_COPYSTELEM(sizeunits);
   MS_COPYSTELEM(maxfeatures);
+  MS_COPYSTELEM(startindex);
 
   MS_COPYCOLOR(&(dst->offsite), &(src->offsite));
 
@@ -1079,6 +1082,24 @@ int msCopyLayer(layerObj *dst, layerObj *src)
   MS_COPYSTRING(dst->styleitem, src->styleitem);
   MS_COPYSTELEM(styleitemindex);
 
+  MS_COPYSTRING(dst->bandsitem, src->bandsitem);
+  MS_COPYSTELEM(bandsitemindex);
+
+  MS_COPYSTRING(dst->utfitem, src->utfitem);
+  MS_COPYSTELEM(utfitemindex);
+
+  return_value = msCopyExpression(&(dst->utfdata), &(src->utfdata));
+  if (return_value != MS_SUCCESS) {
+    msSetError(MS_MEMERR, "Failed to copy utfdata.", "msCopyLayer()");
+    return MS_FAILURE;
+  }
+
+  return_value = msCopyExpression(&(dst->_geomtransform), &(src->_geomtransform));
+  if (return_value != MS_SUCCESS) {
+    msSetError(MS_MEMERR, "Failed to copy geomtransform.", "msCopyLayer()");
+    return MS_FAILURE;
+  }
+
   MS_COPYSTRING(dst->requires, src->requires);
   MS_COPYSTRING(dst->labelrequires, src->labelrequires);
 
@@ -1086,6 +1107,7 @@ int msCopyLayer(layerObj *dst, layerObj *src)
     msCopyHashTable(&(dst->metadata), &(src->metadata));
   }
   msCopyHashTable(&dst->validation,&src->validation);
+  msCopyHashTable(&dst->bindvals,&src->bindvals);
 
   MS_COPYSTELEM(dump);
   MS_COPYSTELEM(debug);
@@ -1107,9 +1129,18 @@ int msCopyLayer(layerObj *dst, layerObj *src)
 
   MS_COPYRECT(&(dst->extent), &(src->extent));
 
+  if (src->sortBy.nProperties > 0)
+    msLayerSetSort(dst, &(src->sortBy));
+
   MS_COPYSTRING(dst->classgroup, src->classgroup);
   MS_COPYSTRING(dst->mask, src->mask);
 
+  /* a lazy layer stays lazy, see msLoadLazyLayer() */
+  MS_COPYSTRING(dst->lazysource, src->lazysource);
+  MS_COPYSTELEM(lazyline);
+  MS_COPYSTELEM(lazyerror);
+  MS_COPYSTELEM(lazyinclude);
+
   if (src->grid) {
     if (dst->grid) {
       freeGrid(dst->grid);
@@ -1151,9 +1182,9 @@ int msCopyMap(mapObj *dst, mapObj *src)
   for (i = 0; i < src->numlayers; i++) {
     if (msGrowMapLayers(dst) == NULL)
       return MS_FAILURE;
-    initLayer((GET_LAYER(dst, i)), dst);
+    initLayer((GET_LAYER_HEADER(dst, i)), dst);
 
-    return_value = msCopyLayer((GET_LAYER(dst, i)), (GET_LAYER(src, i)));
+    return_value = msCopyLayer((GET_LAYER_HEADER(dst, i)), (GET_LAYER_HEADER(src, i)));
     if (return_value != MS_SUCCESS) {
       msSetError(MS_MEMERR, "Failed to copy layer.", "msCopyMap()");
       return MS_FAILURE;
@@ -1179,6 +1210,8 @@ int msCopyMap(mapObj *dst, mapObj *src)
   MS_COPYSTELEM(imagequality);
 
   MS_COPYRECT(&(dst->extent), &(src->extent));
+  MS_COPYSTELEM(gt);
+  MS_COPYRECT(&(dst->saved_extent), &(src->saved_extent));
 
   MS_COPYSTELEM(cellsize);
   MS_COPYSTELEM(units);
@@ -0,0 +1,215 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Checks that msCopyMap() clones everything a mapfile sets.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+
+/*
+** Loads a mapfile, clones it with msCopyMap() and compares what msSaveMap()
+** writes for both, then checks the layer members the writer leaves out.
+** Uses tests/test.map (with PROJ support) and a synthetic map setting the
+** less common layer members, or the mapfiles given on the command line.  Exits with 1 if a
+** clone differs from its map.
+*/
+
+#define SAVED_MAP "mapcopytst_map.map"
+#define SAVED_CLONE "mapcopytst_clone.map"
+
+static char synthetic[] =
+  "MAP NAME \"copy\" EXTENT 0 0 100 100 SIZE 300 200 ANGLE 30\n"
+  "  CONFIG \"MS_ERRORFILE\" \"stderr\"\n"
+  "  SYMBOL NAME \"circle\" TYPE ELLIPSE POINTS 1 1 END FILLED TRUE END\n"
+  "  OUTPUTFORMAT NAME \"png8\" DRIVER \"AGG/PNG8\" IMAGEMODE RGB FORMATOPTION \"QUANTIZE_FORCE=ON\" END\n"
+  "  QUERYMAP STATUS ON STYLE HILITE COLOR 255 0 0 END\n"
+  "  REFERENCE STATUS OFF IMAGE \"tests/home.png\" EXTENT 0 0 100 100 SIZE 50 50 COLOR -1 -1 -1 OUTLINECOLOR 255 0 0 END\n"
+  "  LAYER NAME \"lines\" GROUP \"g\" TYPE LINE STATUS ON\n"
+  "    MINFEATURESIZE 3 GEOMTRANSFORM (simplify([shape], 2))\n"
+  "    UTFITEM \"id\" UTFDATA \"{\\\"id\\\":\\\"[id]\\\"}\"\n"
+  "    CLASSITEM \"kind\" LABELITEM \"label\" FILTER ([kind] > 1)\n"
+  "    MAXSCALEDENOM 100000 MINSCALEDENOM 10 SIZEUNITS METERS TOLERANCE 4 TOLERANCEUNITS PIXELS\n"
+  "    PROCESSING \"CLOSE_CONNECTION=DEFER\" PROCESSING \"ITEMS=kind,label\"\n"
+  "    METADATA \"wms_title\" \"lines\" END VALIDATION \"kind\" \"^[0-9]+$\" END\n"
+  "    SCALETOKEN NAME \"%res%\" VALUES \"0\" \"low\" \"5000\" \"high\" END END\n"
+  "    JOIN NAME \"j\" TABLE \"j.csv\" FROM \"kind\" TO \"0\" TYPE ONE-TO-ONE END\n"
+  "    COMPOSITE OPACITY 70 COMPOP \"multiply\" END\n"
+  "    FEATURE POINTS 1 1 50 50 END ITEMS \"2;a\" END\n"
+  "    CLASS NAME \"c\" EXPRESSION ([kind] = 2)\n"
+  "      STYLE COLOR 0 0 255 WIDTH 2 GEOMTRANSFORM \"vertices\" SYMBOL \"circle\" SIZE 5 END\n"
+  "      LABEL SIZE 8 TYPE BITMAP COLOR 0 0 0 POSITION AUTO\n"
+  "        STYLE GEOMTRANSFORM \"labelpoly\" COLOR 255 255 255 END END\n"
+  "      TEXT ([label])\n"
+  "    END\n"
+  "  END\n"
+  "  LAYER NAME \"grid\" TYPE LINE STATUS ON\n"
+  "    GRID LABELFORMAT \"DD\" MAXARCS 10 MAXINTERVAL 10 MAXSUBDIVIDE 2 END\n"
+  "    CLASS STYLE COLOR 128 128 128 END END\n"
+  "  END\n"
+  "END";
+
+static char *readFile(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  char *buffer;
+  long size;
+
+  if(fp == NULL)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buffer = (char *) msSmallMalloc(size + 1);
+  buffer[fread(buffer, 1, size, fp)] = '\0';
+  fclose(fp);
+  return buffer;
+}
+
+static int checkLayer(layerObj *a, layerObj *b)
+{
+  int i, failures = 0;
+
+#define CHECK(cond, what) do { if(!(cond)) { printf("layer %s: %s not copied\n", a->name, what); failures++; } } while(0)
+#define SAMESTRING(x, y) (((x) == NULL && (y) == NULL) || ((x) && (y) && strcmp((x), (y)) == 0))
+
+  CHECK(SAMESTRING(a->bandsitem, b->bandsitem), "BANDSITEM");
+  CHECK(SAMESTRING(a->utfitem, b->utfitem), "UTFITEM");
+  CHECK(SAMESTRING(a->utfdata.string, b->utfdata.string) && a->utfdata.type == b->utfdata.type, "UTFDATA");
+  CHECK(a->startindex == b->startindex, "startindex");
+  CHECK(a->bindvals.numitems == b->bindvals.numitems, "bindvals");
+  CHECK(a->sortBy.nProperties == b->sortBy.nProperties, "sortBy");
+  for(i = 0; i < a->sortBy.nProperties && i < b->sortBy.nProperties; i++)
+    CHECK(SAMESTRING(a->sortBy.properties[i].item, b->sortBy.properties[i].item) &&
+          a->sortBy.properties[i].sortOrder == b->sortBy.properties[i].sortOrder, "sortBy");
+  CHECK(a->compositer == NULL || (b->compositer && a->compositer->opacity == b->compositer->opacity &&
+                                  a->compositer->comp_op == b->compositer->comp_op), "COMPOSITE");
+
+#undef SAMESTRING
+#undef CHECK
+  return failures;
+}
+
+static int checkClone(mapObj *map, const char *name)
+{
+  mapObj *clone = msNewMapObj();
+  char *saved = NULL, *cloned = NULL;
+  int i, failures = 0;
+
+  if(clone == NULL || msCopyMap(clone, map) != MS_SUCCESS) {
+    msWriteError(stderr);
+    if(clone)
+      msFreeMap(clone);
+    return 1;
+  }
+
+  if(msSaveMap(map, SAVED_MAP) == 0 && msSaveMap(clone, SAVED_CLONE) == 0) {
+    saved = readFile(SAVED_MAP);
+    cloned = readFile(SAVED_CLONE);
+  }
+  if(saved == NULL || cloned == NULL) {
+    msWriteError(stderr);
+    failures++;
+  } else if(strcmp(saved, cloned) != 0) {
+    printf("%s: msSaveMap() output of the clone differs, see %s and %s\n", name, SAVED_MAP, SAVED_CLONE);
+    failures++;
+  }
+
+  for(i = 0; i < map->numlayers; i++)
+    failures += checkLayer(GET_LAYER(map, i), GET_LAYER(clone, i));
+
+  if(failures == 0) {
+    unlink(SAVED_MAP);
+    unlink(SAVED_CLONE);
+    printf("%s: clone identical\n", name);
+  }
+  msFree(saved);
+  msFree(cloned);
+  msFreeMap(clone);
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  mapObj *map;
+  layerObj *layer;
+  sortByProperties sortProperty;
+  sortByClause sortBy;
+  int i, failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  if(argc > 1) {
+    for(i = 1; i < argc; i++) {
+      if((map = msLoadMap(argv[i], NULL)) == NULL) {
+        msWriteError(stderr);
+        failures++;
+        continue;
+      }
+      failures += checkClone(map, argv[i]);
+      msFreeMap(map);
+    }
+  } else {
+#ifdef USE_PROJ
+    if((map = msLoadMap("tests/test.map", NULL)) == NULL) {
+      msWriteError(stderr);
+      failures++;
+    } else {
+      failures += checkClone(map, "tests/test.map");
+      msFreeMap(map);
+    }
+#else
+    printf("tests/test.map: skipped, requires PROJ support\n");
+#endif
+
+    if((map = msLoadMapFromString(synthetic, NULL)) == NULL) {
+      msWriteError(stderr);
+      failures++;
+    } else {
+      /* set at run time, by the tile index code, WFS and the query code */
+      layer = GET_LAYER(map, 0);
+      layer->bandsitem = msStrdup("bands");
+      layer->startindex = 5;
+      msInsertHashTable(&layer->bindvals, "1", "value");
+      sortProperty.item = "kind";
+      sortProperty.sortOrder = SORT_DESC;
+      sortBy.properties = &sortProperty;
+      sortBy.nProperties = 1;
+      msLayerSetSort(layer, &sortBy);
+      failures += checkClone(map, "synthetic map");
+      msFreeMap(map);
+    }
+  }
+
+  msCleanup();
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -36,6 +36,33 @@
 #include "mapows.h"
 
 
+/* We will need a cellsize that represents a real georeferenced */
+/* coordinate cellsize here, so compute it from saved extents.   */
+static double getGeoCellsize(mapObj *map)
+{
+  double geo_cellsize = map->cellsize;
+  if( map->gt.need_geotransform == MS_TRUE ) {
+    double cellsize_x = (map->saved_extent.maxx - map->saved_extent.minx)
+                        / map->width;
+    double cellsize_y = (map->saved_extent.maxy - map->saved_extent.miny)
+                        / map->height;
+
+    geo_cellsize = sqrt(cellsize_x*cellsize_x + cellsize_y*cellsize_y)
+                   / sqrt(2.0);
+  }
+  return geo_cellsize;
+}
+
+static void computeLayerScaleFactor(mapObj *map, layerObj *layer, double geo_cellsize)
+{
+  if(layer->sizeunits != MS_PIXELS)
+    layer->scalefactor = (msInchesPerUnit(layer->sizeunits,0)/msInchesPerUnit(map->units,0)) / geo_cellsize;
+  else if(layer->symbolscaledenom > 0 && map->scaledenom > 0)
+    layer->scalefactor = layer->symbolscaledenom/map->scaledenom*map->resolution/map->defresolution;
+  else
+    layer->scalefactor = map->resolution/map->defresolution;
+}
+
 /* msPrepareImage()
  *
  * Returns a new imageObj ready for rendering the current map.
@@ -59,9 +86,9 @@ imageObj *msPrepareImage(mapObj *map, int allow_nonsquare)
 
   /* clear any previously created mask layer images */
   for(i=0; i<map->numlayers; i++) {
-    if(GET_LAYER(map, i)->maskimage) {
-      msFreeImage(GET_LAYER(map, i)->maskimage);
-      GET_LAYER(map, i)->maskimage = NULL;
+    if(GET_LAYER_HEADER(map, i)->maskimage) {
+      msFreeImage(GET_LAYER_HEADER(map, i)->maskimage);
+      GET_LAYER_HEADER(map, i)->maskimage = NULL;
     }
   }
 
@@ -148,28 +175,13 @@ imageObj *msPrepareImage(mapObj *map, int allow_nonsquare)
   if( map->gt.need_geotransform )
     msMapSetFakedExtent( map );
 
-  /* We will need a cellsize that represents a real georeferenced */
-  /* coordinate cellsize here, so compute it from saved extents.   */
-
-  geo_cellsize = map->cellsize;
-  if( map->gt.need_geotransform == MS_TRUE ) {
-    double cellsize_x = (map->saved_extent.maxx - map->saved_extent.minx)
-                        / map->width;
-    double cellsize_y = (map->saved_extent.maxy - map->saved_extent.miny)
-                        / map->height;
-
-    geo_cellsize = sqrt(cellsize_x*cellsize_x + cellsize_y*cellsize_y)
-                   / sqrt(2.0);
-  }
+  geo_cellsize = getGeoCellsize(map);
 
-  /* compute layer scale factors now */
+  /* compute layer scale factors now, lazy layers that are off get theirs if used as a mask */
   for(i=0; i<map->numlayers; i++) {
-    if(GET_LAYER(map, i)->sizeunits != MS_PIXELS)
-      GET_LAYER(map, i)->scalefactor = (msInchesPerUnit(GET_LAYER(map, i)->sizeunits,0)/msInchesPerUnit(map->units,0)) / geo_cellsize;
-    else if(GET_LAYER(map, i)->symbolscaledenom > 0 && map->scaledenom > 0)
-      GET_LAYER(map, i)->scalefactor = GET_LAYER(map, i)->symbolscaledenom/map->scaledenom*map->resolution/map->defresolution;
-    else
-      GET_LAYER(map, i)->scalefactor = map->resolution/map->defresolution;
+    if(MS_LAZY_LAYER_IS_OFF(map, i))
+      continue;
+    computeLayerScaleFactor(map, GET_LAYER(map, i), geo_cellsize);
   }
 
   image->refpt.x = MS_MAP2IMAGE_X_IC_DBL(0, map->extent.minx, 1.0/map->cellsize);
@@ -255,7 +267,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
    */
   numOWSLayers=0;
   for(i=0; i<map->numlayers; i++) {
-    if(map->layerorder[i] != -1 &&
+    if(map->layerorder[i] != -1 && !MS_LAZY_LAYER_IS_OFF(map, map->layerorder[i]) &&
         msLayerIsVisible(map, GET_LAYER(map,map->layerorder[i])))
       numOWSLayers++;
   }
@@ -275,7 +287,8 @@ imageObj *msDrawMap(mapObj *map, int querymap)
     /* Pre-download all WMS/WFS layers in parallel before starting to draw map */
     lastconnectiontype = MS_SHAPEFILE;
     for(i=0; numOWSLayers && i<map->numlayers; i++) {
-      if(map->layerorder[i] == -1 || !msLayerIsVisible(map, GET_LAYER(map,map->layerorder[i])))
+      if(map->layerorder[i] == -1 || MS_LAZY_LAYER_IS_OFF(map, map->layerorder[i]) ||
+          !msLayerIsVisible(map, GET_LAYER(map,map->layerorder[i])))
         continue;
 
       lp = GET_LAYER(map,map->layerorder[i]);
@@ -292,7 +305,8 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 #endif
 
 #ifdef USE_WFS_LYR
-      if(lp->connectiontype == MS_WFS) {
+      /* layers using the feature cache download on a cache miss only */
+      if(lp->connectiontype == MS_WFS && !msFeatureCacheEnabled(lp)) {
         if(msPrepareWFSLayerRequest(map->layerorder[i], map, lp, pasOWSReqInfo, &numOWSRequests) == MS_FAILURE) {
           msFreeWmsParamsObj(&sLastWMSParams);
           msFreeImage(image);
@@ -328,11 +342,23 @@ imageObj *msDrawMap(mapObj *map, int querymap)
   /* OK, now we can start drawing */
   for(i=0; i<map->numlayers; i++) {
 
-    if(map->layerorder[i] != -1) {
+    if(map->layerorder[i] != -1 && !MS_LAZY_LAYER_IS_OFF(map, map->layerorder[i])) {
       char *force_draw_label_cache = NULL;
 
       lp = (GET_LAYER(map,  map->layerorder[i]));
 
+      if(lp->lazyerror) { /* see msLoadLazyLayer() */
+        msSetError(MS_IMGERR, "Failed to draw layer named '%s'.", "msDrawMap()", lp->name);
+        msFreeImage(image);
+#if defined(USE_WMS_LYR) || defined(USE_WFS_LYR)
+        if (pasOWSReqInfo) {
+          msHTTPFreeRequestObj(pasOWSReqInfo, numOWSRequests);
+          msFree(pasOWSReqInfo);
+        }
+#endif /* USE_WMS_LYR || USE_WFS_LYR */
+        return(NULL);
+      }
+
       if(lp->postlabelcache) /* wait to draw */
         continue;
 
@@ -469,6 +495,7 @@ imageObj *msDrawMap(mapObj *map, int querymap)
 
   for(i=0; i<map->numlayers; i++) { /* for each layer, check for postlabelcache layers */
 
+    if(MS_LAZY_LAYER_IS_OFF(map, map->layerorder[i])) continue;
     lp = (GET_LAYER(map, map->layerorder[i]));
 
     if(!lp->postlabelcache) continue;
@@ -659,6 +686,11 @@ int msDrawLayer(mapObj *map, layerObj *layer, imageObj *image)
   const char *alternativeFomatString = NULL;
   layerObj *maskLayer = NULL;
 
+  if(layer->lazyerror) { /* see msLoadLazyLayer() */
+    msSetError(MS_IMGERR, "Layer (%s) failed to load.", "msDrawLayer()", layer->name?layer->name:"");
+    return MS_FAILURE;
+  }
+
   if(!msLayerIsVisible(map, layer))
     return MS_SUCCESS;
 
@@ -683,6 +715,8 @@ int msDrawLayer(mapObj *map, layerObj *layer, imageObj *image)
                  layer->name,layer->mask);
       return (MS_FAILURE);
     }
+    if(MS_LAZY_LAYER_IS_OFF(map, maskLayerIdx)) /* skipped by msPrepareImage() */
+      computeLayerScaleFactor(map, GET_LAYER(map, maskLayerIdx), getGeoCellsize(map));
     maskLayer = GET_LAYER(map, maskLayerIdx);
     if(!maskLayer->maskimage) {
       int i;
@@ -960,19 +994,23 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
   if(layer->minfeaturesize > 0)
     minfeaturesize = Pix2LayerGeoref(map, layer, layer->minfeaturesize);
 
+  /* scratch memory of msDrawShape(), released after each feature */
+  layer->arena = msArenaCreate(msMapGetArena(map));
+
   while((status = msLayerNextShape(layer, &shape)) == MS_SUCCESS) {
+    msArenaReset(layer->arena);
 
     /* Check if the shape size is ok to be drawn */
     if((shape.type == MS_SHAPE_LINE || shape.type == MS_SHAPE_POLYGON) && (minfeaturesize > 0) && (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE)) {
       if(layer->debug >= MS_DEBUGLEVEL_V)
         msDebug("msDrawVectorLayer(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-      msFreeShape(&shape);
+      msLayerRecycleShape(layer, &shape);
       continue;
     }
 
     shape.classindex = msShapeGetClass(layer, map, &shape, classgroup, nclasses);
     if((shape.classindex == -1) || (layer->class[shape.classindex]->status == MS_OFF)) {
-      msFreeShape(&shape);
+      msLayerRecycleShape(layer, &shape);
       continue;
     }
 
@@ -1061,7 +1099,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
     }
     
     if(shape.numlines == 0) { /* once clipped the shape didn't need to be drawn */
-      msFreeShape(&shape);
+      msLayerRecycleShape(layer, &shape);
       continue;
     }
 
@@ -1075,12 +1113,23 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image)
 
     maxnumstyles = MS_MAX(maxnumstyles, layer->class[shape.classindex]->numstyles);
 
-    msFreeShape(&shape);
+    msLayerRecycleShape(layer, &shape); /* keep the buffers for the next feature */
+  }
+
+  if(layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING) {
+    long reused, allocated;
+    msShapeRecycleStats(&shape, &reused, &allocated);
+    msDebug("msDrawVectorLayer(%s): %ld shape buffers reused, %ld allocated\n",
+            layer->name ? layer->name : "", reused, allocated);
   }
+  msFreeShape(&shape);
 
   if (classgroup)
     msFree(classgroup);
 
+  msArenaDestroy(layer->arena);
+  layer->arena = NULL;
+
   if(status != MS_DONE || retcode == MS_FAILURE) {
     msLayerClose(layer);
     if(shpcache) {
@@ -1172,7 +1221,7 @@ int msDrawQueryLayer(mapObj *map, layerObj *layer, imageObj *image)
   colorObj *colorbuffer = NULL;
   int *mindistancebuffer = NULL;
 
-  if(!layer->resultcache) return(msDrawLayer(map, layer, image));
+  if(!layer->resultcache || layer->lazyerror) return(msDrawLayer(map, layer, image));
 
   if(!msLayerIsVisible(map, layer)) return(MS_SUCCESS); /* not an error, just nothing to do */
 
@@ -1615,6 +1664,7 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
       labelObj *label = layer->class[c]->labels[l];
       textSymbolObj ts;
       char *annotext;
+      arenaObj *tsarena;
       if(!msGetLabelStatus(map,layer,shape,label)) {
         continue;
       }
@@ -1624,7 +1674,9 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
       initTextSymbol(&ts);
       msPopulateTextSymbolForLabelAndString(&ts,label,annotext,layer->scalefactor,image->resolutionfactor, layer->labelcache);
       
-      
+      /* label cache entries live until the cache is cleared, the others are only drawn */
+      tsarena = layer->labelcache ? msGetLabelCacheArena(map) : layer->arena;
+
       if (label->anglemode == MS_FOLLOW) { /* bug #1620 implementation */
         struct label_follow_result lfr;
         
@@ -1645,7 +1697,7 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
         }
         free(lfr.follow_labels);
         for(i=0; i<lfr.lar.num_label_points; i++) {
-          textSymbolObj *ts_auto = msSmallMalloc(sizeof(textSymbolObj));
+          textSymbolObj *ts_auto = msArenaAlloc(tsarena, sizeof(textSymbolObj));
           initTextSymbol(ts_auto);
           msCopyTextSymbol(ts_auto,&ts);
           ts_auto->rotation = lfr.lar.angles[i];
@@ -1659,7 +1711,7 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
           } else {
             ret = msDrawTextSymbol(map,image,lfr.lar.label_points[i],ts_auto);
             freeTextSymbol(ts_auto);
-            free(ts_auto); /* TODO RFC98: could we not re-use the original ts instead of duplicating into ts_auto ?
+            msArenaFree(tsarena, ts_auto); /* TODO RFC98: could we not re-use the original ts instead of duplicating into ts_auto ?
                             * we cannot for now, as the rendering code will modify the glyph positions to apply
                             * the labelpoint and rotation offsets */
             if(UNLIKELY(MS_FAILURE == ret)) goto line_cleanup;
@@ -1678,7 +1730,7 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
           label->angle -= map->gt.rotation_angle; /* apply rotation angle */
 
         for(i=0; i<lar.num_label_points; i++) {
-          textSymbolObj *ts_auto = msSmallMalloc(sizeof(textSymbolObj));
+          textSymbolObj *ts_auto = msArenaAlloc(tsarena, sizeof(textSymbolObj));
           initTextSymbol(ts_auto);
           msCopyTextSymbol(ts_auto,&ts);
           ts_auto->rotation = lar.angles[i];
@@ -1688,7 +1740,7 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
               free(lar.angles);
               free(lar.label_points);
               freeTextSymbol(ts_auto);
-              free(ts_auto);
+              msArenaFree(tsarena, ts_auto);
               goto line_cleanup;
             }
           } else {
@@ -1698,13 +1750,13 @@ int lineLayerDrawShape(mapObj *map, imageObj *image, layerObj *layer, shapeObj *
                 free(lar.angles);
                 free(lar.label_points);
                 freeTextSymbol(ts_auto);
-                free(ts_auto);
+                msArenaFree(tsarena, ts_auto);
                 goto line_cleanup;
               }
             }
             ret = msDrawTextSymbol(map,image,lar.label_points[i],ts_auto);
             freeTextSymbol(ts_auto);
-            free(ts_auto); /* TODO RFC98: could we not re-use the original ts instead of duplicating into ts_auto ?
+            msArenaFree(tsarena, ts_auto); /* TODO RFC98: could we not re-use the original ts instead of duplicating into ts_auto ?
                             * we cannot for now, as the rendering code will modify the glyph positions to apply
                             * the labelpoint and rotation offsets */
             ts_auto = NULL;
@@ -1916,7 +1968,7 @@ int msDrawShape(mapObj *map, layerObj *layer, shapeObj *shape, imageObj *image,
          - the calls to msClipXXXRect will discard the original lineObjs, whereas
            we have just copied them because they where needed. These two functions
            could be changed so they are instructed not to free the original lineObjs. */
-      unclipped_shape = (shapeObj *) msSmallMalloc(sizeof (shapeObj));
+      unclipped_shape = (shapeObj *) msArenaAlloc(layer->arena, sizeof (shapeObj));
       msInitShape(unclipped_shape);
       msCopyShape(shape, unclipped_shape);
       if(shape->type == MS_SHAPE_POLYGON) {
@@ -2006,7 +2058,7 @@ draw_shape_cleanup:
   msDrawEndShape(map,layer,image,shape);
   if(unclipped_shape != shape) {
     msFreeShape(unclipped_shape);
-    msFree(unclipped_shape);
+    msArenaFree(layer->arena, unclipped_shape);
   }
   return ret;
 }
@@ -2048,7 +2100,8 @@ int msDrawPoint(mapObj *map, layerObj *layer, pointObj *point, imageObj *image,
           }
       }
       if(labeltext) {
-        textSymbolObj *ts = msSmallMalloc(sizeof(textSymbolObj));
+        arenaObj *tsarena = layer->labelcache ? msGetLabelCacheArena(map) : layer->arena;
+        textSymbolObj *ts = msArenaAlloc(tsarena, sizeof(textSymbolObj));
         initTextSymbol(ts);
         msPopulateTextSymbolForLabelAndString(ts, label, msStrdup(labeltext), layer->scalefactor, image->resolutionfactor, layer->labelcache);
         if(layer->labelcache) {
@@ -2058,7 +2111,7 @@ int msDrawPoint(mapObj *map, layerObj *layer, pointObj *point, imageObj *image,
         } else {
           ret = msDrawTextSymbol(map,image,*point,ts);
           freeTextSymbol(ts);
-          free(ts); 
+          msArenaFree(tsarena, ts);
           if(UNLIKELY(ret == MS_FAILURE)) return MS_FAILURE;
         }
       }
@@ -2263,9 +2316,9 @@ void offsetAndTest(mapObj *map, labelCacheMemberObj *cachePtr, double ox, double
 
 
   /* the current offset is ok */
-  cachePtr->leaderbbox = msSmallMalloc(sizeof(rectObj));
-  cachePtr->leaderline = msSmallMalloc(sizeof(lineObj));
-  cachePtr->leaderline->point = msSmallMalloc(2 * sizeof(pointObj));
+  cachePtr->leaderbbox = msArenaAlloc(msGetLabelCacheArena(map), sizeof(rectObj));
+  cachePtr->leaderline = msArenaAlloc(msGetLabelCacheArena(map), sizeof(lineObj));
+  cachePtr->leaderline->point = msArenaAlloc(msGetLabelCacheArena(map), 2 * sizeof(pointObj));
   cachePtr->leaderline->numpoints = 2;
   cachePtr->leaderline->point[0] = cachePtr->point;
   cachePtr->leaderline->point[1] = leaderpt;
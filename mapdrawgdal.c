@@ -56,6 +56,12 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
                 int dst_xsize, int dst_ysize,
                 int *pbHaveRGBNoData,
                 int *pnNoData1, int *pnNoData2, int *pnNoData3 );
+static CPLErr
+msGDALReadWindow( GDALDatasetH hDS, layerObj *layer,
+                  int *band_numbers, int band_count,
+                  int src_xoff, int src_yoff, int src_xsize, int src_ysize,
+                  void *pBuffer, int dst_xsize, int dst_ysize,
+                  GDALDataType eType );
 static int
 msDrawRasterLayerGDAL_RawMode(
   mapObj *map, layerObj *layer, imageObj *image, GDALDatasetH hDS,
@@ -105,6 +111,7 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
   GDALRasterBandH hBand1=NULL, hBand2=NULL, hBand3=NULL, hBandAlpha=NULL;
   int bHaveRGBNoData = FALSE;
   int nNoData1=-1,nNoData2=-1,nNoData3=-1;
+  int nMaskFlags = 0, bUseMaskBand = FALSE;
   rasterBufferObj *mask_rb = NULL;
   if(layer->mask) {
     int ret;
@@ -617,10 +624,23 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
       }
     }
   }
+  /*
+   * If there is no alpha band, but we have a dataset level mask, it will
+   * be loaded after the bands to function as our alpha.
+   */
+  if( hBandAlpha == NULL ) {
+    nMaskFlags = GDALGetMaskFlags(hBand1);
+
+    bUseMaskBand = (CSLFetchNameValue( layer->processing, "BANDS" ) == NULL ) &&
+                   (nMaskFlags & GMF_PER_DATASET) != 0 &&
+                   (nMaskFlags & (GMF_NODATA|GMF_ALL_VALID)) == 0;
+  }
+
   /*
    * Allocate imagery buffers.
    */
-  pabyRaw1 = (unsigned char *) malloc(dst_xsize * dst_ysize * band_count);
+  pabyRaw1 = (unsigned char *)
+             msGDALAcquireReadBuffer(dst_xsize * dst_ysize * (band_count + bUseMaskBand));
   if( pabyRaw1 == NULL ) {
     msSetError(MS_MEMERR, "Allocating work image of size %dx%dx%d failed.",
                "msDrawRasterLayerGDAL()", dst_xsize, dst_ysize, band_count );
@@ -647,7 +667,7 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
                       pabyRaw1, dst_xsize, dst_ysize,
                       &bHaveRGBNoData,
                       &nNoData1, &nNoData2, &nNoData3 ) == -1 ) {
-    free( pabyRaw1 );
+    msGDALReleaseReadBuffer( pabyRaw1 );
     return -1;
   }
 
@@ -659,58 +679,41 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
   /*      load it as massage it so it will function as our alpha for      */
   /*      transparency purposes.                                          */
   /* -------------------------------------------------------------------- */
-  if( hBandAlpha == NULL ) {
-    int nMaskFlags = GDALGetMaskFlags(hBand1);
+  if( bUseMaskBand ) {
+    CPLErr eErr;
 
-    if( (CSLFetchNameValue( layer->processing, "BANDS" ) == NULL ) &&
-        (nMaskFlags & GMF_PER_DATASET) != 0 &&
-        (nMaskFlags & (GMF_NODATA|GMF_ALL_VALID)) == 0 ) {
-      CPLErr eErr;
-
-      if( layer->debug )
-        msDebug( "msDrawGDAL(): using GDAL mask band for alpha.\n" );
-
-      band_count++;
-
-      pabyRaw1 = (unsigned char *)
-                 realloc(pabyRaw1,dst_xsize * dst_ysize * band_count);
+    if( layer->debug )
+      msDebug( "msDrawGDAL(): using GDAL mask band for alpha.\n" );
 
-      if( pabyRaw1 == NULL ) {
-        msSetError(MS_MEMERR,
-                   "Allocating work image of size %dx%dx%d failed.",
-                   "msDrawRasterLayerGDAL()",
-                   dst_xsize, dst_ysize, band_count );
-        return -1;
-      }
+    band_count++;
 
-      if( hBand2 != NULL ) {
-        pabyRaw2 = pabyRaw1 + dst_xsize * dst_ysize * 1;
-        pabyRaw3 = pabyRaw1 + dst_xsize * dst_ysize * 2;
-        pabyRawAlpha = pabyRaw1 + dst_xsize * dst_ysize * 3;
-      } else {
-        pabyRawAlpha = pabyRaw1 + dst_xsize * dst_ysize * 1;
-      }
+    if( hBand2 != NULL ) {
+      pabyRaw2 = pabyRaw1 + dst_xsize * dst_ysize * 1;
+      pabyRaw3 = pabyRaw1 + dst_xsize * dst_ysize * 2;
+      pabyRawAlpha = pabyRaw1 + dst_xsize * dst_ysize * 3;
+    } else {
+      pabyRawAlpha = pabyRaw1 + dst_xsize * dst_ysize * 1;
+    }
 
-      hBandAlpha = GDALGetMaskBand(hBand1);
+    hBandAlpha = GDALGetMaskBand(hBand1);
 
-      eErr = GDALRasterIO( hBandAlpha, GF_Read,
-                           src_xoff, src_yoff, src_xsize, src_ysize,
-                           pabyRawAlpha, dst_xsize, dst_ysize, GDT_Byte, 0,0);
+    eErr = GDALRasterIO( hBandAlpha, GF_Read,
+                         src_xoff, src_yoff, src_xsize, src_ysize,
+                         pabyRawAlpha, dst_xsize, dst_ysize, GDT_Byte, 0,0);
 
-      if( eErr != CE_None ) {
-        msSetError( MS_IOERR, "GDALRasterIO() failed: %s",
-                    "drawGDAL()", CPLGetLastErrorMsg() );
-        free( pabyRaw1 );
-        return -1;
-      }
+    if( eErr != CE_None ) {
+      msSetError( MS_IOERR, "GDALRasterIO() failed: %s",
+                  "drawGDAL()", CPLGetLastErrorMsg() );
+      msGDALReleaseReadBuffer( pabyRaw1 );
+      return -1;
+    }
 
-      /* In case the mask is not an alpha channel, expand values of 1 to 255, */
-      /* so we can deal as it was an alpha band afterwards */
-      if ((nMaskFlags & GMF_ALPHA) == 0) {
-        for(i=0; i<dst_xsize * dst_ysize; i++)
-          if (pabyRawAlpha[i])
-            pabyRawAlpha[i] = 255;
-      }
+    /* In case the mask is not an alpha channel, expand values of 1 to 255, */
+    /* so we can deal as it was an alpha band afterwards */
+    if ((nMaskFlags & GMF_ALPHA) == 0) {
+      for(i=0; i<dst_xsize * dst_ysize; i++)
+        if (pabyRawAlpha[i])
+          pabyRawAlpha[i] = 255;
     }
   }
 
@@ -833,7 +836,7 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
   */
 
   msFree( mask_rb );
-  free( pabyRaw1 );
+  msGDALReleaseReadBuffer( pabyRaw1 );
 
   if( hColorMap != NULL )
     GDALDestroyColorTable( hColorMap );
@@ -1083,6 +1086,155 @@ static int ApplyLUT( int iColorIndex, layerObj *layer,
   return 0;
 }
 
+/************************************************************************/
+/*                         msGDALReportRead()                           */
+/*                                                                      */
+/*      TUNING report of the bytes a read delivers and an estimate of   */
+/*      the blocks it touches.  The window is given in pixels of        */
+/*      hReadBand, the overview (or full resolution band) read.         */
+/************************************************************************/
+
+static void
+msGDALReportRead( layerObj *layer, GDALRasterBandH hReadBand, int band_count,
+                  int xoff, int yoff, int xsize, int ysize,
+                  GDALDataType eType, int iOverview )
+
+{
+  int nBlockXSize = 0, nBlockYSize = 0;
+  double dfBlocks, dfBytes;
+  char szLevel[32];
+
+  GDALGetBlockSize( hReadBand, &nBlockXSize, &nBlockYSize );
+  if( nBlockXSize <= 0 || nBlockYSize <= 0 || xsize <= 0 || ysize <= 0 )
+    return;
+
+  /* one block per band and position, pixel interleaved files share them */
+  dfBlocks = (double) ((xoff + xsize - 1) / nBlockXSize - xoff / nBlockXSize + 1)
+             * ((yoff + ysize - 1) / nBlockYSize - yoff / nBlockYSize + 1) * band_count;
+  dfBytes = (double) xsize * ysize * band_count * (GDALGetDataTypeSize(eType)/8);
+
+  if( iOverview >= 0 )
+    snprintf( szLevel, sizeof(szLevel), "overview %d", iOverview+1 );
+  else
+    strlcpy( szLevel, "full resolution", sizeof(szLevel) );
+
+  msDebug( "msGDALReadWindow(%s): %.0f bytes read from %s (%dx%d, blocks of %dx%d), about %.0f blocks touched.\n",
+           layer->name, dfBytes, szLevel,
+           GDALGetRasterBandXSize( hReadBand ), GDALGetRasterBandYSize( hReadBand ),
+           nBlockXSize, nBlockYSize, dfBlocks );
+}
+
+/************************************************************************/
+/*                          msGDALReadWindow()                          */
+/*                                                                      */
+/*      Read a source window of some bands into a band interleaved      */
+/*      buffer of dst_xsize by dst_ysize pixels.  GDAL picks the        */
+/*      overview level matching the decimation, so only the blocks of   */
+/*      that level get decoded.  OVERVIEW_LEVEL=n forces the n-th       */
+/*      overview (GDAL 2.0 or later), the window is then converted to   */
+/*      the overview without rounding, the way GDAL does it, so the     */
+/*      pixels are sampled at the same place as with any other level.   */
+/************************************************************************/
+
+static CPLErr
+msGDALReadWindow( GDALDatasetH hDS, layerObj *layer,
+                  int *band_numbers, int band_count,
+                  int src_xoff, int src_yoff, int src_xsize, int src_ysize,
+                  void *pBuffer, int dst_xsize, int dst_ysize,
+                  GDALDataType eType )
+
+{
+  GDALRasterBandH hBand = GDALGetRasterBand( hDS, band_numbers[0] );
+  int bTuning = (layer->debug >= MS_DEBUGLEVEL_TUNING || (layer->map && layer->map->debug >= MS_DEBUGLEVEL_TUNING));
+#if defined(GDAL_VERSION_MAJOR) && GDAL_VERSION_MAJOR >= 2
+  const char *pszLevel = CSLFetchNameValue( layer->processing, "OVERVIEW_LEVEL" );
+  int iOverview = pszLevel ? atoi(pszLevel) - 1 : -1;
+
+  if( iOverview >= 0 && iOverview < GDALGetOverviewCount( hBand ) ) {
+    GDALRasterBandH hOverview = GDALGetOverview( hBand, iOverview );
+    GDALRasterIOExtraArg sExtraArg;
+    int ovr_xsize = GDALGetRasterBandXSize( hOverview );
+    int ovr_ysize = GDALGetRasterBandYSize( hOverview );
+    double dfXRes = (double) GDALGetRasterBandXSize( hBand ) / ovr_xsize;
+    double dfYRes = (double) GDALGetRasterBandYSize( hBand ) / ovr_ysize;
+    int read_xoff, read_yoff, read_xsize, read_ysize, iBand;
+    CPLErr eErr = CE_None;
+
+    /* the exact window, and the whole pixels covering it */
+    INIT_RASTERIO_EXTRA_ARG( sExtraArg );
+    sExtraArg.bFloatingPointWindowValidity = TRUE;
+    sExtraArg.dfXOff = src_xoff / dfXRes;
+    sExtraArg.dfYOff = src_yoff / dfYRes;
+    sExtraArg.dfXSize = src_xsize / dfXRes;
+    sExtraArg.dfYSize = src_ysize / dfYRes;
+
+    read_xoff = (int) sExtraArg.dfXOff;
+    read_yoff = (int) sExtraArg.dfYOff;
+    read_xsize = MIN( ovr_xsize, (int) ceil( sExtraArg.dfXOff + sExtraArg.dfXSize - 1e-10 ) ) - read_xoff;
+    read_ysize = MIN( ovr_ysize, (int) ceil( sExtraArg.dfYOff + sExtraArg.dfYSize - 1e-10 ) ) - read_yoff;
+    read_xsize = MAX( 1, read_xsize );
+    read_ysize = MAX( 1, read_ysize );
+
+    if( bTuning ) {
+      msDebug( "msGDALReadWindow(%s): %d band(s), window %g,%g,%g,%g of overview %d into %dx%d.\n",
+               layer->name, band_count, sExtraArg.dfXOff, sExtraArg.dfYOff,
+               sExtraArg.dfXSize, sExtraArg.dfYSize, iOverview+1, dst_xsize, dst_ysize );
+      msGDALReportRead( layer, hOverview, band_count, read_xoff, read_yoff,
+                        read_xsize, read_ysize, eType, iOverview );
+    }
+
+    for( iBand = 0; iBand < band_count && eErr == CE_None; iBand++ ) {
+      GDALRasterBandH hReadBand =
+        GDALGetOverview( GDALGetRasterBand( hDS, band_numbers[iBand] ), iOverview );
+
+      if( hReadBand == NULL
+          || GDALGetRasterBandXSize( hReadBand ) != ovr_xsize
+          || GDALGetRasterBandYSize( hReadBand ) != ovr_ysize )
+        break; /* bands with differing overviews, let GDAL sort it out */
+
+      eErr = GDALRasterIOEx( hReadBand, GF_Read,
+                             read_xoff, read_yoff, read_xsize, read_ysize,
+                             ((GByte *) pBuffer) + (size_t) iBand * dst_xsize * dst_ysize
+                             * (GDALGetDataTypeSize(eType)/8),
+                             dst_xsize, dst_ysize, eType, 0, 0, &sExtraArg );
+    }
+
+    if( iBand == band_count || eErr != CE_None )
+      return eErr;
+  }
+#endif
+
+  if( bTuning && hBand != NULL ) {
+    /* GDAL reads the overview with the largest decimation that is at */
+    /* most about the requested one, the report assumes the same. */
+    GDALRasterBandH hReadBand = hBand;
+    double dfBest = 1.0, dfFactor = MIN( (double) src_xsize / dst_xsize, (double) src_ysize / dst_ysize );
+    int i, iReadOverview = -1;
+
+    for( i = 0; i < GDALGetOverviewCount( hBand ); i++ ) {
+      GDALRasterBandH hCandidate = GDALGetOverview( hBand, i );
+      double dfOvFactor;
+      if( hCandidate == NULL || GDALGetRasterBandXSize( hCandidate ) <= 0 )
+        continue;
+      dfOvFactor = (double) GDALGetRasterBandXSize( hBand ) / GDALGetRasterBandXSize( hCandidate );
+      if( dfOvFactor > dfBest && dfOvFactor <= dfFactor * 1.2 ) {
+        dfBest = dfOvFactor;
+        hReadBand = hCandidate;
+        iReadOverview = i;
+      }
+    }
+    msGDALReportRead( layer, hReadBand, band_count,
+                      (int) (src_xoff / dfBest), (int) (src_yoff / dfBest),
+                      MAX( 1, (int) ceil( src_xsize / dfBest ) ), MAX( 1, (int) ceil( src_ysize / dfBest ) ),
+                      eType, iReadOverview );
+  }
+
+  return GDALDatasetRasterIO( hDS, GF_Read,
+                              src_xoff, src_yoff, src_xsize, src_ysize,
+                              pBuffer, dst_xsize, dst_ysize, eType,
+                              band_count, band_numbers, 0, 0, 0 );
+}
+
 /************************************************************************/
 /*                           LoadGDALImages()                           */
 /*                                                                      */
@@ -1138,12 +1290,10 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
       && CSLFetchNameValue( layer->processing, "SCALE_2" ) == NULL
       && CSLFetchNameValue( layer->processing, "SCALE_3" ) == NULL
       && CSLFetchNameValue( layer->processing, "SCALE_4" ) == NULL ) {
-    eErr = GDALDatasetRasterIO( hDS, GF_Read,
-                                src_xoff, src_yoff, src_xsize, src_ysize,
-                                pabyWholeBuffer,
-                                dst_xsize, dst_ysize, GDT_Byte,
-                                band_count, band_numbers,
-                                0,0,0);
+    eErr = msGDALReadWindow( hDS, layer, band_numbers, band_count,
+                             src_xoff, src_yoff, src_xsize, src_ysize,
+                             pabyWholeBuffer,
+                             dst_xsize, dst_ysize, GDT_Byte );
 
     if( eErr != CE_None ) {
       msSetError( MS_IOERR,
@@ -1183,7 +1333,7 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
   /*      interleaved).                                                   */
   /* -------------------------------------------------------------------- */
   pafWholeRawData =
-    (float *) malloc(sizeof(float) * dst_xsize * dst_ysize * band_count );
+    (float *) msGDALAcquireReadBuffer(sizeof(float) * dst_xsize * dst_ysize * band_count );
 
   if( pafWholeRawData == NULL ) {
     msSetError(MS_MEMERR,
@@ -1193,19 +1343,17 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
     return -1;
   }
 
-  eErr = GDALDatasetRasterIO(
-           hDS, GF_Read,
+  eErr = msGDALReadWindow(
+           hDS, layer, band_numbers, band_count,
            src_xoff, src_yoff, src_xsize, src_ysize,
-           pafWholeRawData, dst_xsize, dst_ysize, GDT_Float32,
-           band_count, band_numbers,
-           0, 0, 0 );
+           pafWholeRawData, dst_xsize, dst_ysize, GDT_Float32 );
 
   if( eErr != CE_None ) {
     msSetError( MS_IOERR, "GDALDatasetRasterIO() failed: %s",
                 "drawGDAL()",
                 CPLGetLastErrorMsg() );
 
-    free( pafWholeRawData );
+    msGDALReleaseReadBuffer( pafWholeRawData );
     return -1;
   }
 
@@ -1237,7 +1385,7 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
           && EQUAL(papszTokens[0],"AUTO") ) {
         dfScaleMin = dfScaleMax = 0.0;
       } else if( CSLCount(papszTokens) != 2 ) {
-        free( pafWholeRawData );
+        msGDALReleaseReadBuffer( pafWholeRawData );
         msSetError( MS_MISCERR,
                     "SCALE PROCESSING option unparsable for layer %s.",
                     "msDrawGDAL()",
@@ -1296,12 +1444,10 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
     for( i = 0; i < nPixelCount; i++ ) {
       float fScaledValue = (float) ((pafRawData[i]-dfScaleMin)*dfScaleRatio);
 
-      if( fScaledValue < 0.0 )
-        pabyBuffer[i] = 0;
-      else if( fScaledValue > 255.0 )
-        pabyBuffer[i] = 255;
-      else
-        pabyBuffer[i] = (int) fScaledValue;
+      /* clamp with selects rather than branches so the loop vectorizes */
+      fScaledValue = (fScaledValue > 0.0f) ? fScaledValue : 0.0f;
+      fScaledValue = (fScaledValue < 255.0f) ? fScaledValue : 255.0f;
+      pabyBuffer[i] = (GByte) fScaledValue;
     }
 
     /* -------------------------------------------------------------------- */
@@ -1322,12 +1468,12 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
     result_code = ApplyLUT( iColorIndex+1, layer,
                             pabyBuffer, dst_xsize, dst_ysize );;
     if( result_code == -1 ) {
-      free( pafWholeRawData );
+      msGDALReleaseReadBuffer( pafWholeRawData );
       return result_code;
     }
   }
 
-  free( pafWholeRawData );
+  msGDALReleaseReadBuffer( pafWholeRawData );
 
   return result_code;
 }
@@ -1338,7 +1484,8 @@ LoadGDALImages( GDALDatasetH hDS, int band_numbers[4], int band_count,
 /*                                                                      */
 /*      Cover function that tries GDALGetGeoTransform(), a world        */
 /*      file or OWS extents.  It is assumed that TLOCK_GDAL is held     */
-/*      before this function is called.                                 */
+/*      before this function is called, or that hDS came from           */
+/*      msGDALOpenDatasetExclusive().                                   */
 /************************************************************************/
 
 int msGetGDALGeoTransform( GDALDatasetH hDS, mapObj *map, layerObj *layer,
@@ -1499,7 +1646,7 @@ msDrawRasterLayerGDAL_RawMode(
   void *pBuffer;
   GDALDataType eDataType;
   int *band_list, band_count;
-  int  i, j, k, band;
+  int  i, j, k, band, nWordSize;
   CPLErr eErr;
   float *f_nodatas = NULL;
   unsigned char *b_nodatas = NULL;
@@ -1597,8 +1744,8 @@ msDrawRasterLayerGDAL_RawMode(
   /* -------------------------------------------------------------------- */
   /*      Allocate buffer, and read data into it.                         */
   /* -------------------------------------------------------------------- */
-  pBuffer = malloc(dst_xsize * dst_ysize * image->format->bands
-                   * (GDALGetDataTypeSize(eDataType)/8) );
+  pBuffer = msGDALAcquireReadBuffer(dst_xsize * dst_ysize * image->format->bands
+                                    * (GDALGetDataTypeSize(eDataType)/8) );
   if( pBuffer == NULL ) {
     msSetError(MS_MEMERR,
                "Allocating work image of size %dx%d failed.",
@@ -1606,17 +1753,15 @@ msDrawRasterLayerGDAL_RawMode(
     return -1;
   }
 
-  eErr = GDALDatasetRasterIO( hDS, GF_Read,
-                              src_xoff, src_yoff, src_xsize, src_ysize,
-                              pBuffer, dst_xsize, dst_ysize, eDataType,
-                              image->format->bands, band_list,
-                              0, 0, 0 );
+  eErr = msGDALReadWindow( hDS, layer, band_list, image->format->bands,
+                           src_xoff, src_yoff, src_xsize, src_ysize,
+                           pBuffer, dst_xsize, dst_ysize, eDataType );
   free( band_list );
 
   if( eErr != CE_None ) {
     msSetError( MS_IOERR, "GDALRasterIO() failed: %s",
                 "msDrawRasterLayerGDAL_RawMode()", CPLGetLastErrorMsg() );
-    free( pBuffer );
+    msGDALReleaseReadBuffer( pBuffer );
     free( f_nodatas );
     return -1;
   }
@@ -1624,9 +1769,27 @@ msDrawRasterLayerGDAL_RawMode(
   /* -------------------------------------------------------------------- */
   /*      Transfer the data to the imageObj.                              */
   /* -------------------------------------------------------------------- */
+  nWordSize = GDALGetDataTypeSize(eDataType)/8;
   k = 0;
   for( band = 0; band < image->format->bands; band++ ) {
     for( i = dst_yoff; i < dst_yoff + dst_ysize; i++ ) {
+      /* nothing to skip: copy the row in one go */
+      if( f_nodatas == NULL && mask_rb == NULL ) {
+        size_t off = dst_xoff + (size_t) i * image->width
+                     + (size_t) band*image->width*image->height;
+
+        memcpy( ((GByte *) image->img.raw_byte) + off * nWordSize,
+                ((GByte *) pBuffer) + (size_t) k * nWordSize,
+                (size_t) dst_xsize * nWordSize );
+        k += dst_xsize;
+
+        for( j = dst_xoff; band == 0 && j < dst_xoff + dst_xsize; j++ ) {
+          int off_mask = j + i * image->width;
+          MS_SET_BIT(image->img_mask,off_mask);
+        }
+        continue;
+      }
+
       if( image->format->imagemode == MS_IMAGEMODE_INT16 ) {
         for( j = dst_xoff; j < dst_xoff + dst_xsize; j++ ) {
           int off = j + i * image->width
@@ -1677,12 +1840,332 @@ msDrawRasterLayerGDAL_RawMode(
   }
 
   msFree( mask_rb );
-  free( pBuffer );
+  msGDALReleaseReadBuffer( pBuffer );
   free( f_nodatas );
 
   return 0;
 }
 
+/************************************************************************/
+/*                     16bit classification tables                      */
+/*                                                                      */
+/*      Finding the color of each of up to 65536 buckets means          */
+/*      evaluating the class expressions that many times, which         */
+/*      usually costs more than drawing the pixels.  The table is       */
+/*      kept on the layer, and reused for as long as the classes and    */
+/*      the bucket values stay the same.  Integer data scaled to one    */
+/*      bucket per value grows the table to cover the value range of    */
+/*      each new block, so the tiles of a mosaic end up sharing it.     */
+/************************************************************************/
+
+#define MS_CLASSTABLE_MAX_BUCKETS 65536
+
+typedef struct {
+  unsigned int nSignature;  /* of the classes the table was built from */
+  double dfScaleMin;        /* the value bucket 0 starts at */
+  double dfScaleRatio;      /* buckets per unit */
+  int nBucketCount;
+  rgbaPixel *pasColors;     /* nBucketCount+1 entries, entry 0 is transparent */
+  rgbaPixel *pasPMColors;   /* the same, premultiplied by alpha */
+} classTableObj;
+
+static unsigned int HashClassTableBytes( unsigned int nHash, const void *pData, size_t nBytes )
+{
+  const unsigned char *pabyData = (const unsigned char *) pData;
+  size_t i;
+
+  for( i = 0; i < nBytes; i++ )
+    nHash = (nHash ^ pabyData[i]) * 16777619U;
+  return nHash;
+}
+
+static unsigned int HashClassTableString( unsigned int nHash, const char *pszString )
+{
+  if( pszString == NULL )
+    return HashClassTableBytes( nHash, "\377", 1 );
+  return HashClassTableBytes( nHash, pszString, strlen(pszString)+1 );
+}
+
+/* everything of the classes the bucket colors depend on */
+static unsigned int GetClassTableSignature( layerObj *layer )
+{
+  unsigned int nHash = 2166136261U;
+  int i, s;
+
+  nHash = HashClassTableString( nHash, layer->classgroup );
+  nHash = HashClassTableBytes( nHash, &layer->numclasses, sizeof(int) );
+  for( i = 0; i < layer->numclasses; i++ ) {
+    classObj *class = layer->class[i];
+
+    nHash = HashClassTableString( nHash, class->group );
+    nHash = HashClassTableString( nHash, class->expression.string );
+    nHash = HashClassTableBytes( nHash, &class->expression.type, sizeof(int) );
+    nHash = HashClassTableBytes( nHash, &class->numstyles, sizeof(int) );
+    for( s = 0; s < class->numstyles; s++ ) {
+      styleObj *style = class->styles[s];
+
+      /* the color of a color range is rewritten for every bucket */
+      if( MS_VALID_COLOR(style->mincolor) && MS_VALID_COLOR(style->maxcolor) ) {
+        nHash = HashClassTableBytes( nHash, &style->mincolor, sizeof(colorObj) );
+        nHash = HashClassTableBytes( nHash, &style->maxcolor, sizeof(colorObj) );
+        nHash = HashClassTableBytes( nHash, &style->minvalue, sizeof(double) );
+        nHash = HashClassTableBytes( nHash, &style->maxvalue, sizeof(double) );
+      } else
+        nHash = HashClassTableBytes( nHash, &style->color, sizeof(colorObj) );
+      nHash = HashClassTableBytes( nHash, &style->opacity, sizeof(int) );
+    }
+  }
+
+  return nHash;
+}
+
+/************************************************************************/
+/*                        FillClassTableEntries()                       */
+/*                                                                      */
+/*      Classify the value of buckets iFirst to iLast-1.                */
+/************************************************************************/
+
+static void FillClassTableEntries( layerObj *layer, classTableObj *table,
+                                   int iFirst, int iLast )
+
+{
+  int i;
+
+  for( i = iFirst; i < iLast; i++ ) {
+    rgbaPixel *psColor = table->pasColors + i + 1;
+    rgbaPixel *psPMColor = table->pasPMColors + i + 1;
+    double dfOriginalValue, dfAlpha;
+    int c;
+
+    memset( psColor, 0, sizeof(rgbaPixel) );
+
+    dfOriginalValue = (i+0.5) / table->dfScaleRatio + table->dfScaleMin;
+
+    c = msGetClass_FloatRGB(layer, (float) dfOriginalValue, -1, -1, -1);
+    if( c != -1 ) {
+      int s;
+
+      /* change colour based on colour range? */
+      for(s=0; s<layer->class[c]->numstyles; s++) {
+        if( MS_VALID_COLOR(layer->class[c]->styles[s]->mincolor)
+            && MS_VALID_COLOR(layer->class[c]->styles[s]->maxcolor) )
+          msValueToRange(layer->class[c]->styles[s],dfOriginalValue, MS_COLORSPACE_RGB);
+      }
+      if( MS_TRANSPARENT_COLOR(layer->class[c]->styles[0]->color) ) {
+        /* leave it transparent */
+      } else if( MS_VALID_COLOR(layer->class[c]->styles[0]->color)) {
+        /* use class color */
+        psColor->r = layer->class[c]->styles[0]->color.red;
+        psColor->g = layer->class[c]->styles[0]->color.green;
+        psColor->b = layer->class[c]->styles[0]->color.blue;
+        psColor->a = (255*layer->class[c]->styles[0]->opacity / 100);
+      }
+    }
+
+    /* premultiplied the way RB_SET_PIXEL() does it */
+    dfAlpha = psColor->a / 255.0;
+    psPMColor->r = psColor->r * dfAlpha;
+    psPMColor->g = psColor->g * dfAlpha;
+    psPMColor->b = psColor->b * dfAlpha;
+    psPMColor->a = psColor->a;
+  }
+}
+
+/************************************************************************/
+/*                           GetClassTable()                            */
+/*                                                                      */
+/*      Return the classification table of the layer for buckets        */
+/*      starting at dfScaleMin, building or growing it as needed.       */
+/*      *pnOffset is set to the table bucket of the first requested     */
+/*      bucket.                                                         */
+/************************************************************************/
+
+static classTableObj *GetClassTable( layerObj *layer, double dfScaleMin,
+                                     double dfScaleRatio, int nBucketCount,
+                                     int *pnOffset )
+
+{
+  classTableObj *table = (classTableObj *) layer->classtableinfo;
+  unsigned int nSignature = GetClassTableSignature( layer );
+  int iFirst = 0, iLast = nBucketCount;
+
+  *pnOffset = 0;
+
+  if( table != NULL && table->nSignature == nSignature
+      && table->dfScaleRatio == dfScaleRatio ) {
+    double dfOffset = (dfScaleMin - table->dfScaleMin) * dfScaleRatio;
+
+    if( dfOffset == 0.0 && nBucketCount <= table->nBucketCount )
+      return table;
+
+    /*
+     * One bucket per unit: buckets of the same value are the same
+     * whatever the range, so a table of a neighbouring range can be
+     * grown to cover this one as well.
+     */
+    if( dfScaleRatio == 1.0 && dfOffset == floor(dfOffset)
+        && fabs(dfOffset) < MS_CLASSTABLE_MAX_BUCKETS ) {
+      int nOffset = (int) dfOffset;
+
+      iFirst = MS_MIN( 0, nOffset );
+      iLast = MS_MAX( table->nBucketCount, nOffset + nBucketCount );
+      if( iLast - iFirst <= MS_CLASSTABLE_MAX_BUCKETS ) {
+        classTableObj *grown;
+
+        *pnOffset = nOffset - iFirst;
+        if( iFirst == 0 && iLast == table->nBucketCount )
+          return table;
+
+        grown = (classTableObj *) msSmallMalloc( sizeof(classTableObj) );
+        grown->nSignature = nSignature;
+        grown->dfScaleMin = table->dfScaleMin + iFirst;
+        grown->dfScaleRatio = dfScaleRatio;
+        grown->nBucketCount = iLast - iFirst;
+        grown->pasColors = (rgbaPixel *)
+                           msSmallCalloc( grown->nBucketCount+1, sizeof(rgbaPixel) );
+        grown->pasPMColors = (rgbaPixel *)
+                             msSmallCalloc( grown->nBucketCount+1, sizeof(rgbaPixel) );
+        memcpy( grown->pasColors + 1 - iFirst, table->pasColors + 1,
+                table->nBucketCount * sizeof(rgbaPixel) );
+        memcpy( grown->pasPMColors + 1 - iFirst, table->pasPMColors + 1,
+                table->nBucketCount * sizeof(rgbaPixel) );
+
+        FillClassTableEntries( layer, grown, 0, -iFirst );
+        FillClassTableEntries( layer, grown, table->nBucketCount - iFirst,
+                               grown->nBucketCount );
+
+        if( layer->debug > 0 )
+          msDebug( "msDrawRasterGDAL_16BitClassification(%s): "
+                   "classification table grown from %d to %d buckets.\n",
+                   layer->name, table->nBucketCount, grown->nBucketCount );
+
+        msGDALFreeClassTable( layer );
+        layer->classtableinfo = grown;
+        return grown;
+      }
+      *pnOffset = 0;
+    }
+  }
+
+  msGDALFreeClassTable( layer );
+
+  table = (classTableObj *) msSmallMalloc( sizeof(classTableObj) );
+  table->nSignature = nSignature;
+  table->dfScaleMin = dfScaleMin;
+  table->dfScaleRatio = dfScaleRatio;
+  table->nBucketCount = nBucketCount;
+  table->pasColors = (rgbaPixel *) msSmallCalloc( nBucketCount+1, sizeof(rgbaPixel) );
+  table->pasPMColors = (rgbaPixel *) msSmallCalloc( nBucketCount+1, sizeof(rgbaPixel) );
+  FillClassTableEntries( layer, table, 0, nBucketCount );
+
+  if( layer->debug > 0 )
+    msDebug( "msDrawRasterGDAL_16BitClassification(%s): "
+             "classification table of %d buckets built.\n",
+             layer->name, nBucketCount );
+
+  layer->classtableinfo = table;
+  return table;
+}
+
+/************************************************************************/
+/*                        msGDALFreeClassTable()                        */
+/************************************************************************/
+
+void msGDALFreeClassTable( layerObj *layer )
+
+{
+  classTableObj *table = (classTableObj *) layer->classtableinfo;
+
+  if( table == NULL )
+    return;
+
+  free( table->pasColors );
+  free( table->pasPMColors );
+  free( table );
+  layer->classtableinfo = NULL;
+}
+
+/************************************************************************/
+/*                          ClassifyRowsTask()                          */
+/*                                                                      */
+/*      Draw one band of rows of a 16bit classification.  The bucket    */
+/*      of each pixel is found first, in a loop without branches the    */
+/*      compiler can vectorize, nodata and out of range pixels going    */
+/*      to the transparent entry 0 of the table.                        */
+/************************************************************************/
+
+typedef struct {
+  rasterBufferObj *rb;
+  rasterBufferObj *mask_rb;
+  const float *pafRawData;
+  const rgbaPixel *pasColors; /* premultiplied if rb has an alpha channel */
+  double dfScaleMin, dfScaleRatio;
+  int nBucketCount, nOffset;
+  int bGotNoData;
+  float fNoDataValue;
+  int dst_xoff, dst_yoff, dst_xsize, dst_ysize;
+  int nRowsPerTask;
+} classifyRowsObj;
+
+static void ClassifyRowsTask( void *pData, int iTask )
+
+{
+  classifyRowsObj *job = (classifyRowsObj *) pData;
+  rasterBufferObj *rb = job->rb;
+  rasterBufferObj *mask_rb = job->mask_rb;
+  const double dfScaleMin = job->dfScaleMin, dfScaleRatio = job->dfScaleRatio;
+  const double dfMaxBucket = job->nBucketCount + 1;
+  const int nBucketCount = job->nBucketCount, nEntryOffset = job->nOffset + 1;
+  const float fNoDataValue = job->fNoDataValue;
+  int iFirstRow = iTask * job->nRowsPerTask;
+  int iLastRow = MS_MIN( iFirstRow + job->nRowsPerTask, job->dst_ysize );
+  int *panEntry = (int *) msSmallMalloc( sizeof(int) * job->dst_xsize );
+  int i, j;
+
+  for( i = iFirstRow; i < iLastRow; i++ ) {
+    const float *pafRow = job->pafRawData + (size_t) i * job->dst_xsize;
+    int y = job->dst_yoff + i;
+
+    for( j = 0; j < job->dst_xsize; j++ ) {
+      /*
+       * The funny +1/-1 is to avoid odd rounding around zero.
+       * We could use floor() but sometimes it is expensive.  The
+       * clamping keeps the conversion defined, NaN included.
+       */
+      double dfBucket = (pafRow[j] - dfScaleMin) * dfScaleRatio + 1;
+      int iBucket;
+
+      dfBucket = (dfBucket >= 0.0) ? dfBucket : 0.0;
+      dfBucket = (dfBucket <= dfMaxBucket) ? dfBucket : dfMaxBucket;
+      iBucket = (int) dfBucket - 1;
+      panEntry[j] = (iBucket >= 0 && iBucket < nBucketCount) ? iBucket + nEntryOffset : 0;
+    }
+
+    if( job->bGotNoData ) {
+      for( j = 0; j < job->dst_xsize; j++ )
+        panEntry[j] = (pafRow[j] == fNoDataValue) ? 0 : panEntry[j];
+    }
+
+    for( j = 0; j < job->dst_xsize; j++ ) {
+      const rgbaPixel *psColor = job->pasColors + panEntry[j];
+      int x = job->dst_xoff + j, off;
+
+      /* currently we never have partial alpha so keep simple */
+      if( psColor->a == 0 || SKIP_MASK(x,y) )
+        continue;
+
+      off = x * rb->data.rgba.pixel_step + y * rb->data.rgba.row_step;
+      rb->data.rgba.r[off] = psColor->r;
+      rb->data.rgba.g[off] = psColor->g;
+      rb->data.rgba.b[off] = psColor->b;
+      if( rb->data.rgba.a )
+        rb->data.rgba.a[off] = psColor->a;
+    }
+  }
+
+  free( panEntry );
+}
+
 /************************************************************************/
 /*              msDrawRasterLayerGDAL_16BitClassifcation()              */
 /*                                                                      */
@@ -1710,8 +2193,9 @@ msDrawRasterLayerGDAL_16BitClassification(
   float fDataMin=0.0, fDataMax=255.0, fNoDataValue;
   const char *pszScaleInfo;
   const char *pszBuckets;
-  int  *cmap, c, j, k, bGotNoData = FALSE, bGotFirstValue;
-  unsigned char *rb_cmap[4];
+  int  bGotNoData = FALSE, bGotFirstValue, nThreads;
+  classTableObj *table;
+  classifyRowsObj job;
   CPLErr eErr;
   rasterBufferObj *mask_rb = NULL;
   if(layer->mask) {
@@ -1729,7 +2213,7 @@ msDrawRasterLayerGDAL_16BitClassification(
   /*      Read the requested data in one gulp into a floating point       */
   /*      buffer.                                                         */
   /* ==================================================================== */
-  pafRawData = (float *) malloc(sizeof(float) * dst_xsize * dst_ysize );
+  pafRawData = (float *) msGDALAcquireReadBuffer(sizeof(float) * dst_xsize * dst_ysize );
   if( pafRawData == NULL ) {
     msSetError( MS_MEMERR, "Out of memory allocating working buffer.",
                 "msDrawRasterLayerGDAL_16BitClassification()" );
@@ -1741,7 +2225,7 @@ msDrawRasterLayerGDAL_16BitClassification(
                        pafRawData, dst_xsize, dst_ysize, GDT_Float32, 0, 0 );
 
   if( eErr != CE_None ) {
-    free( pafRawData );
+    msGDALReleaseReadBuffer( pafRawData );
     msSetError( MS_IOERR, "GDALRasterIO() failed: %s",
                 "msDrawRasterLayerGDAL_16BitClassification()",
                 CPLGetLastErrorMsg() );
@@ -1788,7 +2272,7 @@ msDrawRasterLayerGDAL_16BitClassification(
         && EQUAL(papszTokens[0],"AUTO") ) {
       dfScaleMin = dfScaleMax = 0.0;
     } else if( CSLCount(papszTokens) != 2 ) {
-      free( pafRawData );
+      msGDALReleaseReadBuffer( pafRawData );
       msSetError( MS_MISCERR,
                   "SCALE PROCESSING option unparsable for layer %s.",
                   "msDrawGDAL()",
@@ -1837,7 +2321,7 @@ msDrawRasterLayerGDAL_16BitClassification(
   } else {
     nBucketCount = atoi(pszBuckets);
     if( nBucketCount < 2 ) {
-      free( pafRawData );
+      msGDALReleaseReadBuffer( pafRawData );
       msSetError( MS_MISCERR,
                   "SCALE_BUCKETS PROCESSING option is not a value of 2 or more: %s.",
                   "msDrawRasterLayerGDAL_16BitClassification()",
@@ -1860,96 +2344,46 @@ msDrawRasterLayerGDAL_16BitClassification(
              layer->name, nBucketCount, dfScaleMin, dfScaleMax );
 
   /* ==================================================================== */
-  /*      Compute classification lookup table.                            */
+  /*      Fetch the classification lookup table.                          */
   /* ==================================================================== */
-
-  cmap = (int *) msSmallCalloc(sizeof(int),nBucketCount);
-  rb_cmap[0] = (unsigned char *) msSmallCalloc(1,nBucketCount);
-  rb_cmap[1] = (unsigned char *) msSmallCalloc(1,nBucketCount);
-  rb_cmap[2] = (unsigned char *) msSmallCalloc(1,nBucketCount);
-  rb_cmap[3] = (unsigned char *) msSmallCalloc(1,nBucketCount);
-
-  for(i=0; i < nBucketCount; i++) {
-    double dfOriginalValue;
-
-    cmap[i] = -1;
-
-    dfOriginalValue = (i+0.5) / dfScaleRatio + dfScaleMin;
-
-    c = msGetClass_FloatRGB(layer, (float) dfOriginalValue, -1, -1, -1);
-    if( c != -1 ) {
-      int s;
-
-      /* change colour based on colour range? */
-      for(s=0; s<layer->class[c]->numstyles; s++) {
-        if( MS_VALID_COLOR(layer->class[c]->styles[s]->mincolor)
-            && MS_VALID_COLOR(layer->class[c]->styles[s]->maxcolor) )
-          msValueToRange(layer->class[c]->styles[s],dfOriginalValue, MS_COLORSPACE_RGB);
-      }
-      if( MS_TRANSPARENT_COLOR(layer->class[c]->styles[0]->color) ) {
-        /* leave it transparent */
-      } else if( MS_VALID_COLOR(layer->class[c]->styles[0]->color)) {
-        /* use class color */
-        rb_cmap[0][i] = layer->class[c]->styles[0]->color.red;
-        rb_cmap[1][i] = layer->class[c]->styles[0]->color.green;
-        rb_cmap[2][i] = layer->class[c]->styles[0]->color.blue;
-        rb_cmap[3][i] = (255*layer->class[c]->styles[0]->opacity / 100);
-      }
-    }
-  }
+  table = GetClassTable( layer, dfScaleMin, dfScaleRatio, nBucketCount,
+                         &job.nOffset );
 
   /* ==================================================================== */
-  /*      Now process the data, applying to the working imageObj.         */
+  /*      Now process the data, applying to the working imageObj, in      */
+  /*      bands of rows on the worker threads.                            */
   /* ==================================================================== */
-  k = 0;
-
-  for( i = dst_yoff; i < dst_yoff + dst_ysize; i++ ) {
-    for( j = dst_xoff; j < dst_xoff + dst_xsize; j++ ) {
-      float fRawValue = pafRawData[k++];
-      int   iMapIndex;
-
-      /*
-       * Skip nodata pixels ... no processing.
-       */
-      if( bGotNoData && fRawValue == fNoDataValue ) {
-        continue;
-      }
-
-      if(SKIP_MASK(j,i))
-        continue;
-
-      /*
-       * The funny +1/-1 is to avoid odd rounding around zero.
-       * We could use floor() but sometimes it is expensive.
-       */
-      iMapIndex = (int) ((fRawValue - dfScaleMin) * dfScaleRatio+1)-1;
+  job.rb = rb;
+  job.mask_rb = mask_rb;
+  job.pafRawData = pafRawData;
+  job.pasColors = rb->data.rgba.a ? table->pasPMColors : table->pasColors;
+  job.dfScaleMin = dfScaleMin;
+  job.dfScaleRatio = dfScaleRatio;
+  job.nBucketCount = nBucketCount;
+  job.bGotNoData = bGotNoData;
+  job.fNoDataValue = fNoDataValue;
+  job.dst_xoff = dst_xoff;
+  job.dst_yoff = dst_yoff;
+  job.dst_xsize = dst_xsize;
+  job.dst_ysize = dst_ysize;
+
+  nThreads = msGetWorkerThreadCount( map, layer );
+  if( nPixelCount < 256*256 )
+    nThreads = 1;
+  if( nThreads > 1 )
+    job.nRowsPerTask = MS_MAX( 16, (dst_ysize + nThreads*4 - 1) / (nThreads*4) );
+  else
+    job.nRowsPerTask = MS_MAX( 1, dst_ysize );
 
-      if( iMapIndex >= nBucketCount || iMapIndex < 0 ) {
-        continue;
-      }
-      /* currently we never have partial alpha so keep simple */
-      if( rb_cmap[3][iMapIndex] > 0 )
-        RB_SET_PIXEL( rb, j, i,
-                      rb_cmap[0][iMapIndex],
-                      rb_cmap[1][iMapIndex],
-                      rb_cmap[2][iMapIndex],
-                      rb_cmap[3][iMapIndex] );
-    }
-  }
+  msThreadRunTasks( nThreads, (dst_ysize + job.nRowsPerTask - 1) / job.nRowsPerTask,
+                    ClassifyRowsTask, &job );
 
   /* -------------------------------------------------------------------- */
   /*      Cleanup                                                         */
   /* -------------------------------------------------------------------- */
-  free( pafRawData );
-  free( cmap );
-  free( rb_cmap[0] );
-  free( rb_cmap[1] );
-  free( rb_cmap[2] );
-  free( rb_cmap[3] );
+  msGDALReleaseReadBuffer( pafRawData );
   msFree( mask_rb );
 
-  assert( k == dst_xsize * dst_ysize );
-
   return 0;
 }
 
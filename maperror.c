@@ -530,6 +530,9 @@ char *msGetVersion()
 #if (defined USE_JPEG)
   strcat(version, " OUTPUT=JPEG");
 #endif
+#ifdef USE_WEBP
+  strcat(version, " OUTPUT=WEBP");
+#endif
 #ifdef USE_KML
   strcat(version, " OUTPUT=KML");
 #endif
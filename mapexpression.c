@@ -0,0 +1,1079 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Compiled evaluation of logical (MS_EXPRESSION) expressions.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** msTokenizeExpression() turns an MS_EXPRESSION into a token list once, but
+** msEvalExpression() used to hand that list to the bison parser (yyparse in
+** mapparser.y) for every shape, re-doing the grammar work and allocating a
+** copy of every string literal each time. Here the token list is compiled,
+** once, into a typed tree that mirrors the grammar rules with the attribute
+** indexes resolved, literal regular expressions compiled and literal IN
+** lists split (and converted to numbers where needed). Evaluating it is a
+** walk of that tree.
+**
+** The compiler only accepts what it can evaluate exactly like mapparser.y:
+** anything else (geometry producing functions, [map_cellsize], syntax the
+** grammar would reject, ...) leaves expression->program NULL and the
+** caller keeps using yyparse(). Errors at evaluation time (division by zero,
+** an unparsable time attribute, a failing GEOS predicate) also make the
+** evaluation return MS_FAILURE without a result; the caller then re-runs
+** yyparse() so the error reported is the one it always was.
+**
+** The grammar evaluates both sides of AND and OR, so an error on the right
+** side is reported even when the left side decides the result. The tree
+** only short circuits when the right side cannot fail.
+*/
+
+#include "mapserver.h"
+#include "maptime.h"
+#include "mapparser.h" /* for the IN token, the lexer returns it as is */
+
+enum exprNodeType { EXPR_BOOLEAN, EXPR_NUMBER, EXPR_STRING, EXPR_TIME, EXPR_SHAPE };
+
+enum exprNodeOp {
+  /* leaves */
+  EXPR_LITERAL, EXPR_BINDING,
+  /* boolean */
+  EXPR_OR, EXPR_AND, EXPR_NOT,
+  EXPR_EQ, EXPR_NE, EXPR_GT, EXPR_LT, EXPR_GE, EXPR_LE, EXPR_IEQ,
+  EXPR_RE, EXPR_IRE, EXPR_IN,
+  EXPR_INTERSECTS, EXPR_DISJOINT, EXPR_TOUCHES, EXPR_OVERLAPS, EXPR_CROSSES,
+  EXPR_WITHIN, EXPR_CONTAINS, EXPR_EQUALS, EXPR_DWITHIN, EXPR_BEYOND,
+  /* number */
+  EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_MOD, EXPR_NEG, EXPR_POW,
+  EXPR_LENGTH, EXPR_AREA, EXPR_ROUND,
+  /* string */
+  EXPR_CONCAT, EXPR_TOSTRING, EXPR_COMMIFY, EXPR_UPPER, EXPR_LOWER,
+  EXPR_INITCAP, EXPR_FIRSTCAP
+};
+
+typedef struct exprNode {
+  int op;
+  int type; /* exprNodeType of the value */
+  int safe; /* MS_TRUE if evaluating this can't fail */
+  struct exprNode *args[3];
+
+  /* leaves */
+  int intval;
+  double dblval;
+  const char *strval; /* owned by the token list */
+  struct tm tmval;
+  shapeObj *shpval;
+  int index; /* item index of attribute bindings, -1 for [shape] */
+
+  /* RE and IRE with a literal pattern */
+  ms_regex_t regex;
+  int regex_status; /* -1: not precompiled, 0: compiled, >0: regcomp() failed */
+
+  /* IN with a literal list */
+  char **list;
+  double *numlist;
+  int numlist_items;
+} exprNode;
+
+typedef struct {
+  tokenListNodeObjPtr token; /* lookahead */
+  int failed;
+} exprCompiler;
+
+typedef struct {
+  char *str;
+  int owned;
+} exprString;
+
+/************************************************************************/
+/*                           compilation                                */
+/************************************************************************/
+
+static void freeExprNode(exprNode *node)
+{
+  int i;
+
+  if(!node) return;
+  for(i=0; i<3; i++)
+    freeExprNode(node->args[i]);
+  if(node->regex_status == 0)
+    ms_regfree(&(node->regex));
+  else if(node->regex_status > 0)
+    free(node->regex.sys_regex); /* regcomp() failed, only the wrapper is left */
+  if(node->list)
+    msFreeCharArray(node->list, node->numlist_items);
+  msFree(node->numlist);
+  free(node);
+}
+
+static exprNode *newExprNode(int op, int type, exprNode *a, exprNode *b, exprNode *c)
+{
+  exprNode *node = (exprNode *) msSmallCalloc(1, sizeof(exprNode));
+
+  node->op = op;
+  node->type = type;
+  node->args[0] = a;
+  node->args[1] = b;
+  node->args[2] = c;
+  node->regex_status = -1;
+  node->safe = (!a || a->safe) && (!b || b->safe) && (!c || c->safe);
+  return node;
+}
+
+static int peekToken(exprCompiler *c)
+{
+  return c->token ? c->token->token : 0;
+}
+
+static int acceptToken(exprCompiler *c, int token)
+{
+  if(c->token && c->token->token == token) {
+    c->token = c->token->next;
+    return MS_TRUE;
+  }
+  return MS_FALSE;
+}
+
+/* bails out of a rule, releasing the nodes it had built */
+static exprNode *rejectExpr(exprCompiler *c, exprNode *a, exprNode *b, exprNode *d)
+{
+  freeExprNode(a);
+  freeExprNode(b);
+  freeExprNode(d);
+  c->failed = MS_TRUE;
+  return NULL;
+}
+
+static exprNode *compileOr(exprCompiler *c);
+
+/* '(' args ')' of a function call, checking the type of each argument */
+static int compileArgs(exprCompiler *c, exprNode **args, const int *types, int n)
+{
+  int i;
+
+  if(!acceptToken(c, '(')) return MS_FAILURE;
+  for(i=0; i<n; i++) {
+    if(i > 0 && !acceptToken(c, ',')) return MS_FAILURE;
+    args[i] = compileOr(c);
+    if(!args[i] || args[i]->type != types[i]) return MS_FAILURE;
+  }
+  if(!acceptToken(c, ')')) return MS_FAILURE;
+  return MS_SUCCESS;
+}
+
+static exprNode *compileFunction(exprCompiler *c, int token)
+{
+  static const int str1[] = { EXPR_STRING };
+  static const int shp1[] = { EXPR_SHAPE };
+  static const int num2[] = { EXPR_NUMBER, EXPR_NUMBER };
+  static const int numstr[] = { EXPR_NUMBER, EXPR_STRING };
+  static const int shp2[] = { EXPR_SHAPE, EXPR_SHAPE };
+  static const int shp2num[] = { EXPR_SHAPE, EXPR_SHAPE, EXPR_NUMBER };
+  exprNode *args[3] = { NULL, NULL, NULL }, *node;
+  const int *types;
+  int op, type, n;
+
+  switch(token) {
+    case MS_TOKEN_FUNCTION_LENGTH: op = EXPR_LENGTH; type = EXPR_NUMBER; types = str1; n = 1; break;
+    case MS_TOKEN_FUNCTION_AREA: op = EXPR_AREA; type = EXPR_NUMBER; types = shp1; n = 1; break;
+    case MS_TOKEN_FUNCTION_ROUND: op = EXPR_ROUND; type = EXPR_NUMBER; types = num2; n = 2; break;
+    case MS_TOKEN_FUNCTION_TOSTRING: op = EXPR_TOSTRING; type = EXPR_STRING; types = numstr; n = 2; break;
+    case MS_TOKEN_FUNCTION_COMMIFY: op = EXPR_COMMIFY; type = EXPR_STRING; types = str1; n = 1; break;
+    case MS_TOKEN_FUNCTION_UPPER: op = EXPR_UPPER; type = EXPR_STRING; types = str1; n = 1; break;
+    case MS_TOKEN_FUNCTION_LOWER: op = EXPR_LOWER; type = EXPR_STRING; types = str1; n = 1; break;
+    case MS_TOKEN_FUNCTION_INITCAP: op = EXPR_INITCAP; type = EXPR_STRING; types = str1; n = 1; break;
+    case MS_TOKEN_FUNCTION_FIRSTCAP: op = EXPR_FIRSTCAP; type = EXPR_STRING; types = str1; n = 1; break;
+    case MS_TOKEN_COMPARISON_INTERSECTS: op = EXPR_INTERSECTS; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_DISJOINT: op = EXPR_DISJOINT; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_TOUCHES: op = EXPR_TOUCHES; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_OVERLAPS: op = EXPR_OVERLAPS; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_CROSSES: op = EXPR_CROSSES; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_WITHIN: op = EXPR_WITHIN; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_CONTAINS: op = EXPR_CONTAINS; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_EQUALS: op = EXPR_EQUALS; type = EXPR_BOOLEAN; types = shp2; n = 2; break;
+    case MS_TOKEN_COMPARISON_DWITHIN: op = EXPR_DWITHIN; type = EXPR_BOOLEAN; types = shp2num; n = 3; break;
+    case MS_TOKEN_COMPARISON_BEYOND: op = EXPR_BEYOND; type = EXPR_BOOLEAN; types = shp2num; n = 3; break;
+    default:
+      /* geometry producing functions, javascript(), ... are left to yyparse() */
+      return rejectExpr(c, NULL, NULL, NULL);
+  }
+
+  if(compileArgs(c, args, types, n) != MS_SUCCESS)
+    return rejectExpr(c, args[0], args[1], args[2]);
+  node = newExprNode(op, type, args[0], args[1], args[2]);
+  if(op == EXPR_AREA || type == EXPR_BOOLEAN) /* non polygon area, GEOS errors */
+    node->safe = MS_FALSE;
+  return node;
+}
+
+static exprNode *compilePrimary(exprCompiler *c)
+{
+  tokenListNodeObjPtr token = c->token;
+  exprNode *node;
+
+  if(!token) return rejectExpr(c, NULL, NULL, NULL);
+  c->token = token->next;
+
+  switch(token->token) {
+    case MS_TOKEN_LITERAL_BOOLEAN:
+      node = newExprNode(EXPR_LITERAL, EXPR_BOOLEAN, NULL, NULL, NULL);
+      node->intval = token->tokenval.dblval;
+      return node;
+    case MS_TOKEN_LITERAL_NUMBER:
+      node = newExprNode(EXPR_LITERAL, EXPR_NUMBER, NULL, NULL, NULL);
+      node->dblval = token->tokenval.dblval;
+      return node;
+    case MS_TOKEN_LITERAL_STRING:
+      node = newExprNode(EXPR_LITERAL, EXPR_STRING, NULL, NULL, NULL);
+      node->strval = token->tokenval.strval;
+      return node;
+    case MS_TOKEN_LITERAL_TIME:
+      node = newExprNode(EXPR_LITERAL, EXPR_TIME, NULL, NULL, NULL);
+      node->tmval = token->tokenval.tmval;
+      return node;
+    case MS_TOKEN_LITERAL_SHAPE:
+      node = newExprNode(EXPR_LITERAL, EXPR_SHAPE, NULL, NULL, NULL);
+      node->shpval = token->tokenval.shpval;
+      return node;
+    case MS_TOKEN_BINDING_DOUBLE:
+    case MS_TOKEN_BINDING_INTEGER:
+    case MS_TOKEN_BINDING_STRING:
+    case MS_TOKEN_BINDING_TIME:
+      if(token->tokenval.bindval.index < 0) /* tokenized without an item list */
+        return rejectExpr(c, NULL, NULL, NULL);
+      node = newExprNode(EXPR_BINDING, EXPR_NUMBER, NULL, NULL, NULL);
+      node->index = token->tokenval.bindval.index;
+      if(token->token == MS_TOKEN_BINDING_STRING)
+        node->type = EXPR_STRING;
+      else if(token->token == MS_TOKEN_BINDING_TIME) {
+        node->type = EXPR_TIME;
+        node->safe = MS_FALSE; /* the value may not parse */
+      }
+      return node;
+    case MS_TOKEN_BINDING_SHAPE:
+      node = newExprNode(EXPR_BINDING, EXPR_SHAPE, NULL, NULL, NULL);
+      node->index = -1;
+      return node;
+    case '(':
+      node = compileOr(c);
+      if(!node) return NULL;
+      if(!acceptToken(c, ')')) return rejectExpr(c, node, NULL, NULL);
+      return node;
+    default:
+      return compileFunction(c, token->token);
+  }
+}
+
+/* '^' is right associative and binds tighter than unary minus */
+static exprNode *compileUnary(exprCompiler *c);
+
+static exprNode *compilePower(exprCompiler *c)
+{
+  exprNode *left, *right;
+
+  if(!(left = compilePrimary(c))) return NULL;
+  if(!acceptToken(c, '^')) return left;
+  if(!(right = compileUnary(c))) return rejectExpr(c, left, NULL, NULL);
+  if(left->type != EXPR_NUMBER || right->type != EXPR_NUMBER)
+    return rejectExpr(c, left, right, NULL);
+  return newExprNode(EXPR_POW, EXPR_NUMBER, left, right, NULL);
+}
+
+static exprNode *compileUnary(exprCompiler *c)
+{
+  exprNode *operand;
+
+  if(!acceptToken(c, '-')) return compilePower(c);
+  if(!(operand = compileUnary(c))) return NULL;
+  if(operand->type != EXPR_NUMBER) return rejectExpr(c, operand, NULL, NULL);
+  return newExprNode(EXPR_NEG, EXPR_NUMBER, operand, NULL, NULL);
+}
+
+static exprNode *compileMultiplicative(exprCompiler *c)
+{
+  exprNode *left, *right, *node;
+  int token, op;
+
+  if(!(left = compileUnary(c))) return NULL;
+  while((token = peekToken(c)) == '*' || token == '/' || token == '%') {
+    c->token = c->token->next;
+    if(!(right = compileUnary(c))) return rejectExpr(c, left, NULL, NULL);
+    if(left->type != EXPR_NUMBER || right->type != EXPR_NUMBER)
+      return rejectExpr(c, left, right, NULL);
+    op = (token == '*') ? EXPR_MUL : (token == '/') ? EXPR_DIV : EXPR_MOD;
+    node = newExprNode(op, EXPR_NUMBER, left, right, NULL);
+    if(op != EXPR_MUL) node->safe = MS_FALSE; /* division by zero */
+    left = node;
+  }
+  return left;
+}
+
+static exprNode *compileAdditive(exprCompiler *c)
+{
+  exprNode *left, *right;
+  int token;
+
+  if(!(left = compileMultiplicative(c))) return NULL;
+  while((token = peekToken(c)) == '+' || token == '-') {
+    c->token = c->token->next;
+    if(!(right = compileMultiplicative(c))) return rejectExpr(c, left, NULL, NULL);
+    if(token == '+' && left->type == EXPR_STRING && right->type == EXPR_STRING)
+      left = newExprNode(EXPR_CONCAT, EXPR_STRING, left, right, NULL);
+    else if(left->type == EXPR_NUMBER && right->type == EXPR_NUMBER)
+      left = newExprNode(token == '+' ? EXPR_ADD : EXPR_SUB, EXPR_NUMBER, left, right, NULL);
+    else
+      return rejectExpr(c, left, right, NULL);
+  }
+  return left;
+}
+
+/* infix spatial predicates, e.g. [shape] intersects fromText('...') */
+static exprNode *compileSpatial(exprCompiler *c)
+{
+  exprNode *left, *right, *node;
+  int op;
+
+  if(!(left = compileAdditive(c))) return NULL;
+  for(;;) {
+    switch(peekToken(c)) {
+      case MS_TOKEN_COMPARISON_INTERSECTS: op = EXPR_INTERSECTS; break;
+      case MS_TOKEN_COMPARISON_DISJOINT: op = EXPR_DISJOINT; break;
+      case MS_TOKEN_COMPARISON_TOUCHES: op = EXPR_TOUCHES; break;
+      case MS_TOKEN_COMPARISON_OVERLAPS: op = EXPR_OVERLAPS; break;
+      case MS_TOKEN_COMPARISON_CROSSES: op = EXPR_CROSSES; break;
+      case MS_TOKEN_COMPARISON_WITHIN: op = EXPR_WITHIN; break;
+      case MS_TOKEN_COMPARISON_CONTAINS: op = EXPR_CONTAINS; break;
+      case MS_TOKEN_COMPARISON_EQUALS:
+      case MS_TOKEN_COMPARISON_BEYOND:
+      case MS_TOKEN_COMPARISON_DWITHIN:
+        return rejectExpr(c, left, NULL, NULL); /* only valid as functions */
+      default:
+        return left;
+    }
+    c->token = c->token->next;
+    if(!(right = compileAdditive(c))) return rejectExpr(c, left, NULL, NULL);
+    if(left->type != EXPR_SHAPE || right->type != EXPR_SHAPE)
+      return rejectExpr(c, left, right, NULL);
+    node = newExprNode(op, EXPR_BOOLEAN, left, right, NULL);
+    node->safe = MS_FALSE;
+    left = node;
+  }
+}
+
+/* splits a literal IN list once, the way the grammar does for every shape */
+static void compileList(exprNode *node)
+{
+  const char *list = node->args[1]->strval, *delim;
+  int i, n = 1;
+
+  /* not msStringSplit(), empty items between two commas count */
+  for(delim = list; (delim = strchr(delim, ',')) != NULL; delim++)
+    n++;
+  node->list = (char **) msSmallMalloc(sizeof(char *) * n);
+  node->numlist_items = n;
+  for(i=0; i<n; i++) {
+    delim = strchr(list, ',');
+    if(!delim) delim = list + strlen(list);
+    node->list[i] = (char *) msSmallMalloc(delim - list + 1);
+    strlcpy(node->list[i], list, delim - list + 1);
+    list = delim + 1;
+  }
+  if(node->args[0]->type == EXPR_NUMBER) {
+    node->numlist = (double *) msSmallMalloc(sizeof(double) * n);
+    for(i=0; i<n; i++)
+      node->numlist[i] = atof(node->list[i]);
+  }
+}
+
+static exprNode *compileComparison(exprCompiler *c)
+{
+  exprNode *left, *right, *node;
+  int token, op, ok;
+
+  if(!(left = compileSpatial(c))) return NULL;
+  for(;;) {
+    switch((token = peekToken(c))) {
+      case MS_TOKEN_COMPARISON_EQ: op = EXPR_EQ; break;
+      case MS_TOKEN_COMPARISON_NE: op = EXPR_NE; break;
+      case MS_TOKEN_COMPARISON_GT: op = EXPR_GT; break;
+      case MS_TOKEN_COMPARISON_LT: op = EXPR_LT; break;
+      case MS_TOKEN_COMPARISON_GE: op = EXPR_GE; break;
+      case MS_TOKEN_COMPARISON_LE: op = EXPR_LE; break;
+      case MS_TOKEN_COMPARISON_IEQ: op = EXPR_IEQ; break;
+      case MS_TOKEN_COMPARISON_RE: op = EXPR_RE; break;
+      case MS_TOKEN_COMPARISON_IRE: op = EXPR_IRE; break;
+      case IN: op = EXPR_IN; break;
+      default:
+        return left;
+    }
+    c->token = c->token->next;
+    if(!(right = compileSpatial(c))) return rejectExpr(c, left, NULL, NULL);
+
+    /* the operand types mapparser.y has a rule for */
+    switch(op) {
+      case EXPR_EQ:
+        ok = (left->type == right->type);
+        break;
+      case EXPR_RE:
+      case EXPR_IRE:
+        ok = (left->type == EXPR_STRING && right->type == EXPR_STRING);
+        break;
+      case EXPR_IN:
+        ok = ((left->type == EXPR_STRING || left->type == EXPR_NUMBER) && right->type == EXPR_STRING);
+        break;
+      default:
+        ok = (left->type == right->type && (left->type == EXPR_NUMBER || left->type == EXPR_STRING || left->type == EXPR_TIME));
+        break;
+    }
+    if(!ok) return rejectExpr(c, left, right, NULL);
+
+    node = newExprNode(op, EXPR_BOOLEAN, left, right, NULL);
+    if(op == EXPR_EQ && left->type == EXPR_SHAPE)
+      node->safe = MS_FALSE;
+    if((op == EXPR_RE || op == EXPR_IRE) && right->op == EXPR_LITERAL)
+      node->regex_status = ms_regcomp(&(node->regex), right->strval, MS_REG_EXTENDED|MS_REG_NOSUB|(op == EXPR_IRE ? MS_REG_ICASE : 0)) ? 1 : 0;
+    if(op == EXPR_IN && right->op == EXPR_LITERAL)
+      compileList(node);
+    left = node;
+  }
+}
+
+static exprNode *compileNot(exprCompiler *c)
+{
+  exprNode *operand;
+
+  if(!acceptToken(c, MS_TOKEN_LOGICAL_NOT)) return compileComparison(c);
+  if(!(operand = compileNot(c))) return NULL;
+  if(operand->type != EXPR_BOOLEAN && operand->type != EXPR_NUMBER)
+    return rejectExpr(c, operand, NULL, NULL);
+  return newExprNode(EXPR_NOT, EXPR_BOOLEAN, operand, NULL, NULL);
+}
+
+static exprNode *compileAnd(exprCompiler *c)
+{
+  exprNode *left, *right;
+
+  if(!(left = compileNot(c))) return NULL;
+  while(acceptToken(c, MS_TOKEN_LOGICAL_AND)) {
+    if(!(right = compileNot(c))) return rejectExpr(c, left, NULL, NULL);
+    if((left->type != EXPR_BOOLEAN && left->type != EXPR_NUMBER) ||
+        (right->type != EXPR_BOOLEAN && right->type != EXPR_NUMBER))
+      return rejectExpr(c, left, right, NULL);
+    left = newExprNode(EXPR_AND, EXPR_BOOLEAN, left, right, NULL);
+  }
+  return left;
+}
+
+static exprNode *compileOr(exprCompiler *c)
+{
+  exprNode *left, *right;
+
+  if(!(left = compileAnd(c))) return NULL;
+  while(acceptToken(c, MS_TOKEN_LOGICAL_OR)) {
+    if(!(right = compileAnd(c))) return rejectExpr(c, left, NULL, NULL);
+    if((left->type != EXPR_BOOLEAN && left->type != EXPR_NUMBER) ||
+        (right->type != EXPR_BOOLEAN && right->type != EXPR_NUMBER))
+      return rejectExpr(c, left, right, NULL);
+    left = newExprNode(EXPR_OR, EXPR_BOOLEAN, left, right, NULL);
+  }
+  return left;
+}
+
+/*
+** Compiles the token list of an MS_EXPRESSION into expression->program.
+** Returns MS_SUCCESS if it did, MS_FAILURE if the expression has to go
+** through yyparse() (no error is set, that is not a problem).
+*/
+int msCompileExpression(expressionObj *expression)
+{
+  exprCompiler c;
+  exprNode *root;
+
+  msFreeCompiledExpression(expression);
+  if(expression->type != MS_EXPRESSION || !expression->tokens) return MS_FAILURE;
+
+  c.token = expression->tokens;
+  c.failed = MS_FALSE;
+  root = compileOr(&c);
+  if(!root) return MS_FAILURE;
+  if(c.failed || c.token != NULL || root->type == EXPR_SHAPE) {
+    freeExprNode(root);
+    return MS_FAILURE;
+  }
+
+  expression->program = root;
+  return MS_SUCCESS;
+}
+
+void msFreeCompiledExpression(expressionObj *expression)
+{
+  freeExprNode((exprNode *) expression->program);
+  expression->program = NULL;
+}
+
+/************************************************************************/
+/*                             evaluation                               */
+/************************************************************************/
+
+static int evalBoolean(exprNode *node, shapeObj *shape, int *value);
+static int evalNumber(exprNode *node, shapeObj *shape, double *value);
+static int evalString(exprNode *node, shapeObj *shape, exprString *value);
+
+static void releaseString(exprString *value)
+{
+  if(value->owned) free(value->str);
+  value->str = NULL;
+  value->owned = MS_FALSE;
+}
+
+/* makes sure a string can be modified in place */
+static void ownString(exprString *value)
+{
+  if(!value->owned) {
+    value->str = msStrdup(value->str);
+    value->owned = MS_TRUE;
+  }
+}
+
+static int evalTime(exprNode *node, shapeObj *shape, struct tm *value)
+{
+  if(node->op == EXPR_LITERAL) {
+    *value = node->tmval;
+    return MS_SUCCESS;
+  }
+  msTimeInit(value);
+  if(msParseTime(shape->values[node->index], value) != MS_TRUE)
+    return MS_FAILURE;
+  return MS_SUCCESS;
+}
+
+static int evalShape(exprNode *node, shapeObj *shape, shapeObj **value)
+{
+  *value = (node->op == EXPR_LITERAL) ? node->shpval : shape;
+  return MS_SUCCESS;
+}
+
+static int evalString(exprNode *node, shapeObj *shape, exprString *value)
+{
+  exprString s1, s2;
+  double n;
+
+  value->str = NULL;
+  value->owned = MS_FALSE;
+
+  switch(node->op) {
+    case EXPR_LITERAL:
+      value->str = (char *) node->strval;
+      return MS_SUCCESS;
+    case EXPR_BINDING:
+      value->str = shape->values[node->index];
+      return MS_SUCCESS;
+    case EXPR_CONCAT:
+      if(evalString(node->args[0], shape, &s1) != MS_SUCCESS) return MS_FAILURE;
+      if(evalString(node->args[1], shape, &s2) != MS_SUCCESS) {
+        releaseString(&s1);
+        return MS_FAILURE;
+      }
+      value->str = (char *) msSmallMalloc(strlen(s1.str) + strlen(s2.str) + 1);
+      value->owned = MS_TRUE;
+      strcpy(value->str, s1.str);
+      strcat(value->str, s2.str);
+      releaseString(&s1);
+      releaseString(&s2);
+      return MS_SUCCESS;
+    case EXPR_TOSTRING:
+      if(evalNumber(node->args[0], shape, &n) != MS_SUCCESS) return MS_FAILURE;
+      if(evalString(node->args[1], shape, &s1) != MS_SUCCESS) return MS_FAILURE;
+      value->str = (char *) msSmallMalloc(strlen(s1.str) + 64);
+      value->owned = MS_TRUE;
+      snprintf(value->str, strlen(s1.str) + 64, s1.str, n);
+      releaseString(&s1);
+      return MS_SUCCESS;
+    case EXPR_COMMIFY:
+    case EXPR_UPPER:
+    case EXPR_LOWER:
+    case EXPR_INITCAP:
+    case EXPR_FIRSTCAP:
+      if(evalString(node->args[0], shape, value) != MS_SUCCESS) return MS_FAILURE;
+      ownString(value);
+      if(node->op == EXPR_COMMIFY) value->str = msCommifyString(value->str);
+      else if(node->op == EXPR_UPPER) msStringToUpper(value->str);
+      else if(node->op == EXPR_LOWER) msStringToLower(value->str);
+      else if(node->op == EXPR_INITCAP) msStringInitCap(value->str);
+      else msStringFirstCap(value->str);
+      return MS_SUCCESS;
+  }
+  return MS_FAILURE;
+}
+
+static int evalNumber(exprNode *node, shapeObj *shape, double *value)
+{
+  double a, b;
+  exprString s;
+  shapeObj *shp;
+
+  switch(node->op) {
+    case EXPR_LITERAL:
+      *value = node->dblval;
+      return MS_SUCCESS;
+    case EXPR_BINDING:
+      *value = msShapeGetValueAsDouble(shape, node->index);
+      return MS_SUCCESS;
+    case EXPR_NEG: /* mapparser.y doesn't negate either */
+      return evalNumber(node->args[0], shape, value);
+    case EXPR_LENGTH:
+      if(evalString(node->args[0], shape, &s) != MS_SUCCESS) return MS_FAILURE;
+      *value = strlen(s.str);
+      releaseString(&s);
+      return MS_SUCCESS;
+    case EXPR_AREA:
+      evalShape(node->args[0], shape, &shp);
+      if(shp->type != MS_SHAPE_POLYGON) return MS_FAILURE;
+      *value = msGetPolygonArea(shp);
+      if(shp->scratch == MS_TRUE) msFreeShape(shp);
+      return MS_SUCCESS;
+  }
+
+  if(evalNumber(node->args[0], shape, &a) != MS_SUCCESS) return MS_FAILURE;
+  if(evalNumber(node->args[1], shape, &b) != MS_SUCCESS) return MS_FAILURE;
+  switch(node->op) {
+    case EXPR_ADD: *value = a + b; break;
+    case EXPR_SUB: *value = a - b; break;
+    case EXPR_MUL: *value = a * b; break;
+    case EXPR_DIV:
+      if(b == 0.0) return MS_FAILURE;
+      *value = a / b;
+      break;
+    case EXPR_MOD:
+      if((int)b == 0) return MS_FAILURE;
+      *value = (int)a % (int)b;
+      break;
+    case EXPR_POW: *value = pow(a, b); break;
+    case EXPR_ROUND: *value = (MS_NINT(a/b))*b; break;
+    default:
+      return MS_FAILURE;
+  }
+  return MS_SUCCESS;
+}
+
+/* truth value of an operand of AND, OR and NOT */
+static int evalCondition(exprNode *node, shapeObj *shape, int *value)
+{
+  double n;
+  int b;
+
+  if(node->type == EXPR_BOOLEAN) {
+    if(evalBoolean(node, shape, &b) != MS_SUCCESS) return MS_FAILURE;
+    *value = (b == MS_TRUE);
+  } else {
+    if(evalNumber(node, shape, &n) != MS_SUCCESS) return MS_FAILURE;
+    *value = (n != 0);
+  }
+  return MS_SUCCESS;
+}
+
+static int compareResult(int op, int cmp)
+{
+  switch(op) {
+    case EXPR_EQ:
+    case EXPR_IEQ: return (cmp == 0) ? MS_TRUE : MS_FALSE;
+    case EXPR_NE: return (cmp != 0) ? MS_TRUE : MS_FALSE;
+    case EXPR_GT: return (cmp > 0) ? MS_TRUE : MS_FALSE;
+    case EXPR_LT: return (cmp < 0) ? MS_TRUE : MS_FALSE;
+    case EXPR_GE: return (cmp >= 0) ? MS_TRUE : MS_FALSE;
+    case EXPR_LE: return (cmp <= 0) ? MS_TRUE : MS_FALSE;
+  }
+  return MS_FALSE;
+}
+
+static int evalMatch(exprNode *node, shapeObj *shape, int *value)
+{
+  exprString s1, s2;
+  ms_regex_t re;
+
+  if(evalString(node->args[0], shape, &s1) != MS_SUCCESS) return MS_FAILURE;
+  if(evalString(node->args[1], shape, &s2) != MS_SUCCESS) {
+    releaseString(&s1);
+    return MS_FAILURE;
+  }
+
+  *value = MS_FALSE;
+  if(MS_STRING_IS_NULL_OR_EMPTY(s1.str) == MS_FALSE) {
+    if(node->regex_status == 0) {
+      if(ms_regexec(&(node->regex), s1.str, 0, NULL, 0) == 0) *value = MS_TRUE;
+    } else if(node->regex_status < 0) {
+      if(ms_regcomp(&re, s2.str, MS_REG_EXTENDED|MS_REG_NOSUB|(node->op == EXPR_IRE ? MS_REG_ICASE : 0)) == 0) {
+        if(ms_regexec(&re, s1.str, 0, NULL, 0) == 0) *value = MS_TRUE;
+        ms_regfree(&re);
+      }
+    }
+  }
+
+  releaseString(&s1);
+  releaseString(&s2);
+  return MS_SUCCESS;
+}
+
+static int evalIn(exprNode *node, shapeObj *shape, int *value)
+{
+  exprString s, list;
+  double n = 0;
+  char *delim, *bufferp;
+  int i, numeric = (node->args[0]->type == EXPR_NUMBER);
+
+  s.str = NULL;
+  s.owned = MS_FALSE;
+  if(numeric) {
+    if(evalNumber(node->args[0], shape, &n) != MS_SUCCESS) return MS_FAILURE;
+  } else {
+    if(evalString(node->args[0], shape, &s) != MS_SUCCESS) return MS_FAILURE;
+  }
+
+  *value = MS_FALSE;
+  if(node->list) {
+    for(i=0; i<node->numlist_items && *value == MS_FALSE; i++) {
+      if(numeric ? (n == node->numlist[i]) : (strcmp(s.str, node->list[i]) == 0))
+        *value = MS_TRUE;
+    }
+  } else {
+    if(evalString(node->args[1], shape, &list) != MS_SUCCESS) {
+      releaseString(&s);
+      return MS_FAILURE;
+    }
+    ownString(&list);
+    bufferp = list.str;
+    while(*value == MS_FALSE && (delim = strchr(bufferp, ',')) != NULL) {
+      *delim = '\0';
+      if(numeric ? (n == atof(bufferp)) : (strcmp(s.str, bufferp) == 0))
+        *value = MS_TRUE;
+      bufferp = delim + 1;
+    }
+    if(*value == MS_FALSE && (numeric ? (n == atof(bufferp)) : (strcmp(s.str, bufferp) == 0)))
+      *value = MS_TRUE;
+    releaseString(&list);
+  }
+
+  releaseString(&s);
+  return MS_SUCCESS;
+}
+
+static int evalSpatial(exprNode *node, shapeObj *shape, int *value)
+{
+  shapeObj *s1, *s2;
+  double n = 0, d;
+  int rval = -1;
+
+  evalShape(node->args[0], shape, &s1);
+  evalShape(node->args[1], shape, &s2);
+  if(node->args[2] && evalNumber(node->args[2], shape, &n) != MS_SUCCESS) return MS_FAILURE;
+
+  switch(node->op) {
+    case EXPR_EQ:
+    case EXPR_EQUALS: rval = msGEOSEquals(s1, s2); break;
+    case EXPR_INTERSECTS: rval = msGEOSIntersects(s1, s2); break;
+    case EXPR_DISJOINT: rval = msGEOSDisjoint(s1, s2); break;
+    case EXPR_TOUCHES: rval = msGEOSTouches(s1, s2); break;
+    case EXPR_OVERLAPS: rval = msGEOSOverlaps(s1, s2); break;
+    case EXPR_CROSSES: rval = msGEOSCrosses(s1, s2); break;
+    case EXPR_WITHIN: rval = msGEOSWithin(s1, s2); break;
+    case EXPR_CONTAINS: rval = msGEOSContains(s1, s2); break;
+    case EXPR_DWITHIN:
+    case EXPR_BEYOND:
+      d = msGEOSDistance(s1, s2);
+      if(node->op == EXPR_DWITHIN)
+        rval = (d <= n) ? MS_TRUE : MS_FALSE;
+      else
+        rval = (d > n) ? MS_TRUE : MS_FALSE;
+      break;
+  }
+  if(s1->scratch == MS_TRUE) msFreeShape(s1);
+  if(s2->scratch == MS_TRUE) msFreeShape(s2);
+
+  if(rval == -1) return MS_FAILURE;
+  *value = rval;
+  return MS_SUCCESS;
+}
+
+static int evalBoolean(exprNode *node, shapeObj *shape, int *value)
+{
+  int a, b, cmp;
+  double n1, n2;
+  exprString s1, s2;
+  struct tm t1, t2;
+
+  switch(node->op) {
+    case EXPR_LITERAL:
+      *value = node->intval;
+      return MS_SUCCESS;
+
+    case EXPR_OR:
+    case EXPR_AND:
+      if(evalCondition(node->args[0], shape, &a) != MS_SUCCESS) return MS_FAILURE;
+      if(node->args[1]->safe && (node->op == EXPR_OR) == a) { /* decided, and the right side can't raise an error */
+        *value = a ? MS_TRUE : MS_FALSE;
+        return MS_SUCCESS;
+      }
+      if(evalCondition(node->args[1], shape, &b) != MS_SUCCESS) return MS_FAILURE;
+      if(node->op == EXPR_OR)
+        *value = (a || b) ? MS_TRUE : MS_FALSE;
+      else
+        *value = (a && b) ? MS_TRUE : MS_FALSE;
+      return MS_SUCCESS;
+
+    case EXPR_NOT:
+      if(node->args[0]->type == EXPR_BOOLEAN) {
+        if(evalBoolean(node->args[0], shape, &a) != MS_SUCCESS) return MS_FAILURE;
+        *value = !a;
+      } else {
+        if(evalNumber(node->args[0], shape, &n1) != MS_SUCCESS) return MS_FAILURE;
+        *value = !n1;
+      }
+      return MS_SUCCESS;
+
+    case EXPR_RE:
+    case EXPR_IRE:
+      return evalMatch(node, shape, value);
+
+    case EXPR_IN:
+      return evalIn(node, shape, value);
+
+    case EXPR_INTERSECTS:
+    case EXPR_DISJOINT:
+    case EXPR_TOUCHES:
+    case EXPR_OVERLAPS:
+    case EXPR_CROSSES:
+    case EXPR_WITHIN:
+    case EXPR_CONTAINS:
+    case EXPR_EQUALS:
+    case EXPR_DWITHIN:
+    case EXPR_BEYOND:
+      return evalSpatial(node, shape, value);
+  }
+
+  /* EQ, NE, GT, LT, GE, LE and IEQ, by operand type */
+  switch(node->args[0]->type) {
+    case EXPR_BOOLEAN: /* EQ only */
+      if(evalBoolean(node->args[0], shape, &a) != MS_SUCCESS) return MS_FAILURE;
+      if(evalBoolean(node->args[1], shape, &b) != MS_SUCCESS) return MS_FAILURE;
+      *value = (a == b) ? MS_TRUE : MS_FALSE;
+      return MS_SUCCESS;
+    case EXPR_NUMBER:
+      if(evalNumber(node->args[0], shape, &n1) != MS_SUCCESS) return MS_FAILURE;
+      if(evalNumber(node->args[1], shape, &n2) != MS_SUCCESS) return MS_FAILURE;
+      switch(node->op) {
+        case EXPR_EQ:
+        case EXPR_IEQ: *value = (n1 == n2) ? MS_TRUE : MS_FALSE; break;
+        case EXPR_NE: *value = (n1 != n2) ? MS_TRUE : MS_FALSE; break;
+        case EXPR_GT: *value = (n1 > n2) ? MS_TRUE : MS_FALSE; break;
+        case EXPR_LT: *value = (n1 < n2) ? MS_TRUE : MS_FALSE; break;
+        case EXPR_GE: *value = (n1 >= n2) ? MS_TRUE : MS_FALSE; break;
+        case EXPR_LE: *value = (n1 <= n2) ? MS_TRUE : MS_FALSE; break;
+        default: return MS_FAILURE;
+      }
+      return MS_SUCCESS;
+    case EXPR_STRING:
+      if(evalString(node->args[0], shape, &s1) != MS_SUCCESS) return MS_FAILURE;
+      if(evalString(node->args[1], shape, &s2) != MS_SUCCESS) {
+        releaseString(&s1);
+        return MS_FAILURE;
+      }
+      cmp = (node->op == EXPR_IEQ) ? strcasecmp(s1.str, s2.str) : strcmp(s1.str, s2.str);
+      *value = compareResult(node->op, cmp);
+      releaseString(&s1);
+      releaseString(&s2);
+      return MS_SUCCESS;
+    case EXPR_TIME:
+      if(evalTime(node->args[0], shape, &t1) != MS_SUCCESS) return MS_FAILURE;
+      if(evalTime(node->args[1], shape, &t2) != MS_SUCCESS) return MS_FAILURE;
+      *value = compareResult(node->op, msTimeCompare(&t1, &t2));
+      return MS_SUCCESS;
+    case EXPR_SHAPE: /* EQ only */
+      return evalSpatial(node, shape, value);
+  }
+  return MS_FAILURE;
+}
+
+/*
+** Evaluates a compiled expression as yyparse() would for MS_PARSE_TYPE_BOOLEAN.
+** Returns MS_FAILURE, without a result, if the evaluation ran into an error.
+*/
+int msEvalCompiledExpression(expressionObj *expression, shapeObj *shape, int *result)
+{
+  exprNode *root = (exprNode *) expression->program;
+  exprString s;
+  double n;
+
+  switch(root->type) {
+    case EXPR_BOOLEAN:
+      return evalBoolean(root, shape, result);
+    case EXPR_NUMBER:
+      if(evalNumber(root, shape, &n) != MS_SUCCESS) return MS_FAILURE;
+      *result = (n != 0) ? MS_TRUE : MS_FALSE;
+      return MS_SUCCESS;
+    case EXPR_STRING:
+      if(evalString(root, shape, &s) != MS_SUCCESS) return MS_FAILURE;
+      *result = s.str ? MS_TRUE : MS_FALSE;
+      releaseString(&s);
+      return MS_SUCCESS;
+  }
+  return MS_FAILURE;
+}
+
+/*
+** Evaluates a compiled expression as yyparse() would for MS_PARSE_TYPE_STRING.
+** The result is allocated. Returns MS_FAILURE if the evaluation ran into an
+** error.
+*/
+int msEvalCompiledTextExpression(expressionObj *expression, shapeObj *shape, char **result)
+{
+  exprNode *root = (exprNode *) expression->program;
+  exprString s;
+  double n;
+  int b;
+
+  switch(root->type) {
+    case EXPR_BOOLEAN:
+      if(evalBoolean(root, shape, &b) != MS_SUCCESS) return MS_FAILURE;
+      *result = msStrdup(b ? "true" : "false");
+      return MS_SUCCESS;
+    case EXPR_NUMBER:
+      if(evalNumber(root, shape, &n) != MS_SUCCESS) return MS_FAILURE;
+      *result = (char *) msSmallMalloc(64); /* large enough for a double */
+      snprintf(*result, 64, "%g", n);
+      return MS_SUCCESS;
+    case EXPR_STRING:
+      if(evalString(root, shape, &s) != MS_SUCCESS) return MS_FAILURE;
+      ownString(&s);
+      *result = s.str;
+      return MS_SUCCESS;
+  }
+  return MS_FAILURE;
+}
+
+/************************************************************************/
+/*                        numeric range analysis                        */
+/************************************************************************/
+
+/*
+** Checks that a compiled expression only compares one numeric attribute
+** with numeric literals, combined with AND, OR and NOT, e.g.
+** ([pop] >= 1000 and [pop] < 5000). The value of such an expression only
+** changes at the literals, which lets the class index (mapclassindex.c)
+** precompute it over the intervals between them.
+*/
+static int collectNumericRange(exprNode *node, int *index, double **constants, int *numconstants)
+{
+  int i;
+
+  switch(node->op) {
+    case EXPR_LITERAL:
+      return (node->type == EXPR_BOOLEAN);
+    case EXPR_AND:
+    case EXPR_OR:
+    case EXPR_NOT:
+      for(i=0; i<3 && node->args[i]; i++) {
+        if(node->args[i]->type != EXPR_BOOLEAN || !collectNumericRange(node->args[i], index, constants, numconstants))
+          return MS_FALSE;
+      }
+      return MS_TRUE;
+    case EXPR_EQ:
+    case EXPR_NE:
+    case EXPR_GT:
+    case EXPR_LT:
+    case EXPR_GE:
+    case EXPR_LE:
+    case EXPR_IEQ:
+      for(i=0; i<2; i++) {
+        exprNode *arg = node->args[i];
+        if(arg->type != EXPR_NUMBER) return MS_FALSE;
+        if(arg->op == EXPR_LITERAL) {
+          *constants = (double *) msSmallRealloc(*constants, sizeof(double) * (*numconstants + 1));
+          (*constants)[(*numconstants)++] = arg->dblval;
+        } else if(arg->op == EXPR_BINDING) {
+          if(*index != -1 && *index != arg->index) return MS_FALSE;
+          *index = arg->index;
+        } else
+          return MS_FALSE;
+      }
+      return MS_TRUE;
+  }
+  return MS_FALSE;
+}
+
+/*
+** Returns the item index of the attribute a range expression tests, or -1
+** if it isn't one. The literals it compares with are returned in an
+** allocated array (to be freed by the caller in both cases).
+*/
+int msGetNumericExpressionItem(expressionObj *expression, double **constants, int *numconstants)
+{
+  exprNode *root = (exprNode *) expression->program;
+  int index = -1;
+
+  *constants = NULL;
+  *numconstants = 0;
+  if(!root || root->type != EXPR_BOOLEAN) return -1;
+  if(!collectNumericRange(root, &index, constants, numconstants)) return -1;
+  return index;
+}
+
+static int evalNumericRange(exprNode *node, double value)
+{
+  double n1, n2;
+
+  switch(node->op) {
+    case EXPR_LITERAL:
+      return node->intval;
+    case EXPR_OR:
+      return (evalNumericRange(node->args[0], value) == MS_TRUE || evalNumericRange(node->args[1], value) == MS_TRUE) ? MS_TRUE : MS_FALSE;
+    case EXPR_AND:
+      return (evalNumericRange(node->args[0], value) == MS_TRUE && evalNumericRange(node->args[1], value) == MS_TRUE) ? MS_TRUE : MS_FALSE;
+    case EXPR_NOT:
+      return !evalNumericRange(node->args[0], value);
+  }
+
+  n1 = (node->args[0]->op == EXPR_LITERAL) ? node->args[0]->dblval : value;
+  n2 = (node->args[1]->op == EXPR_LITERAL) ? node->args[1]->dblval : value;
+  switch(node->op) {
+    case EXPR_EQ:
+    case EXPR_IEQ: return (n1 == n2) ? MS_TRUE : MS_FALSE;
+    case EXPR_NE: return (n1 != n2) ? MS_TRUE : MS_FALSE;
+    case EXPR_GT: return (n1 > n2) ? MS_TRUE : MS_FALSE;
+    case EXPR_LT: return (n1 < n2) ? MS_TRUE : MS_FALSE;
+    case EXPR_GE: return (n1 >= n2) ? MS_TRUE : MS_FALSE;
+    case EXPR_LE: return (n1 <= n2) ? MS_TRUE : MS_FALSE;
+  }
+  return MS_FALSE;
+}
+
+/*
+** Evaluates a range expression (see msGetNumericExpressionItem()) for the
+** given attribute value, the same as msEvalExpression() would for a shape
+** with that value.
+*/
+int msEvalNumericExpression(expressionObj *expression, double value)
+{
+  return evalNumericRange((exprNode *) expression->program, value);
+}
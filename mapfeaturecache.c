@@ -0,0 +1,757 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Shared feature cache for slow and remote vector layers.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** The feature cache keeps the decoded shapes returned by a layer driver for
+** a (layer, spatial cell, filter) key, so that repeated draws of overlapping
+** areas (typically map tiles) don't go back to the datasource. Entries live
+** in a size bounded memory mapped file (CONFIG MS_FEATURE_CACHE_FILE) shared
+** by all the processes that map it, e.g. every FastCGI worker of a server.
+**
+** A layer opts in with PROCESSING "FEATURE_CACHE=ON". Other layer options:
+**   FEATURE_CACHE_TTL=<seconds>         entry lifetime (default 300)
+**   FEATURE_CACHE_CELLSIZE=<layer units> quantization grid of the request
+**                                        rectangle (default: power of two
+**                                        just larger than the request)
+** Map level CONFIG options (or environment variables):
+**   MS_FEATURE_CACHE_FILE   path of the shared segment (default: a process
+**                           private anonymous mapping)
+**   MS_FEATURE_CACHE_SIZE   size of the segment in bytes (default 32MB)
+**   MS_FEATURE_CACHE_SLOTS  number of entries (default 256)
+**
+** Only draw requests (isQuery == MS_FALSE) are cached: the driver is asked for
+** the cell aligned superset of the request, which is fine for rendering but
+** would change query results.
+*/
+
+#include "mapserver.h"
+#include "mapthread.h"
+
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_FEATURE_CACHE 1
+#endif
+
+#define FC_MAGIC          0x4d534643 /* "MSFC" */
+#define FC_VERSION        1
+#define FC_DEFAULT_SIZE   (32*1024*1024)
+#define FC_DEFAULT_SLOTS  256
+#define FC_DEFAULT_TTL    300
+#define FC_PROBES         4
+
+#define FC_SLOT_EMPTY     0
+#define FC_SLOT_USED      1
+
+#define FC_MODE_NONE      0
+#define FC_MODE_HIT       1
+#define FC_MODE_RECORD    2
+
+typedef struct {
+  ms_uint32 magic;
+  ms_uint32 version;
+  ms_uint32 pointsize;   /* sizeof(pointObj) of the writers, Z/M builds differ */
+  ms_uint32 nslots;
+  ms_uint32 slotsize;    /* bytes of key + data available per slot */
+  ms_uint32 generation;  /* bumped by msFeatureCacheInvalidateAll() */
+  ms_uint32 hits;
+  ms_uint32 misses;
+} featureCacheHeader;
+
+typedef struct {
+  ms_uint32 state;
+  ms_uint32 layerhash;   /* hash of the layer identity, used for invalidation */
+  ms_uint32 generation;
+  ms_uint32 keylength;   /* including the terminating NUL */
+  ms_uint32 datalength;
+  ms_int32  expires;     /* time() based expiration */
+} featureCacheSlot;
+
+/* per layer iteration/recording state, hung off layer->featurecacheinfo */
+typedef struct {
+  int mode;
+  char *key;
+  ms_uint32 layerhash;
+  int ttl;
+
+  /* FC_MODE_HIT: private copy of the entry data */
+  unsigned char *data;
+  size_t datalength;
+  size_t offset;
+  int numshapes;
+  int nextshape;
+
+  /* FC_MODE_RECORD: serialized shapes returned by the driver */
+  bufferObj record;
+  int numrecorded;
+} featureCacheLayerInfo;
+
+#ifdef USE_FEATURE_CACHE
+static unsigned char *fc_segment = NULL;
+static size_t fc_segment_size = 0;
+static int fc_fd = -1;
+static int fc_init_done = MS_FALSE;
+#endif
+
+/************************************************************************/
+/*                           Hash helpers                               */
+/************************************************************************/
+
+static ms_uint32 fcHash(const char *s)
+{
+  ms_uint32 h = 2166136261U; /* FNV-1a */
+  while(*s) {
+    h ^= (unsigned char)*s++;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static void fcAppendKey(bufferObj *key, const char *label, const char *value)
+{
+  msBufferAppend(key, (void*)label, strlen(label));
+  msBufferAppend(key, "=", 1);
+  if(value)
+    msBufferAppend(key, (void*)value, strlen(value));
+  msBufferAppend(key, "|", 1);
+}
+
+/* identity of the layer's datasource, shared by all its cache entries */
+static char *fcLayerIdentity(layerObj *layer)
+{
+  bufferObj id;
+  char num[32];
+
+  msBufferInit(&id);
+  fcAppendKey(&id, "name", layer->name);
+  snprintf(num, sizeof(num), "%d", layer->connectiontype);
+  fcAppendKey(&id, "type", num);
+  fcAppendKey(&id, "connection", layer->connection);
+  fcAppendKey(&id, "data", layer->data);
+  msBufferAppend(&id, "", 1);
+  return (char*)id.data;
+}
+
+/************************************************************************/
+/*                         Serialization                                */
+/************************************************************************/
+
+static void fcWriteInt(bufferObj *buf, ms_int32 v)
+{
+  msBufferAppend(buf, &v, sizeof(v));
+}
+
+static void fcWriteString(bufferObj *buf, const char *s)
+{
+  ms_int32 len = s ? (ms_int32)strlen(s) : -1;
+  fcWriteInt(buf, len);
+  if(len > 0)
+    msBufferAppend(buf, (void*)s, len);
+}
+
+static void fcSerializeShape(bufferObj *buf, shapeObj *shape)
+{
+  int i;
+  double index = (double)shape->index;
+
+  fcWriteInt(buf, shape->type);
+  fcWriteInt(buf, shape->numlines);
+  fcWriteInt(buf, shape->numvalues);
+  fcWriteInt(buf, shape->tileindex);
+  msBufferAppend(buf, &index, sizeof(index));
+  msBufferAppend(buf, &shape->bounds, sizeof(rectObj));
+  for(i=0; i<shape->numvalues; i++)
+    fcWriteString(buf, shape->values[i]);
+  for(i=0; i<shape->numlines; i++) {
+    fcWriteInt(buf, shape->line[i].numpoints);
+    if(shape->line[i].numpoints > 0)
+      msBufferAppend(buf, shape->line[i].point, sizeof(pointObj)*shape->line[i].numpoints);
+  }
+}
+
+/* read helpers check bounds so that a corrupt entry can't overrun */
+static int fcRead(featureCacheLayerInfo *fci, void *dst, size_t n)
+{
+  if(fci->offset + n > fci->datalength) return MS_FAILURE;
+  memcpy(dst, fci->data + fci->offset, n);
+  fci->offset += n;
+  return MS_SUCCESS;
+}
+
+static int fcDeserializeShape(featureCacheLayerInfo *fci, shapeObj *shape)
+{
+  ms_int32 type, numlines, numvalues, tileindex, len;
+  double index;
+  int i;
+
+  if(fcRead(fci, &type, sizeof(type)) != MS_SUCCESS ||
+      fcRead(fci, &numlines, sizeof(numlines)) != MS_SUCCESS ||
+      fcRead(fci, &numvalues, sizeof(numvalues)) != MS_SUCCESS ||
+      fcRead(fci, &tileindex, sizeof(tileindex)) != MS_SUCCESS ||
+      fcRead(fci, &index, sizeof(index)) != MS_SUCCESS ||
+      fcRead(fci, &shape->bounds, sizeof(rectObj)) != MS_SUCCESS)
+    return MS_FAILURE;
+
+  if(numlines < 0 || numvalues < 0)
+    return MS_FAILURE;
+
+  shape->type = type;
+  shape->tileindex = tileindex;
+  shape->index = (long)index;
+
+  if(numvalues > 0) {
+    shape->values = (char**)msSmallCalloc(numvalues, sizeof(char*));
+    shape->numvalues = numvalues;
+    for(i=0; i<numvalues; i++) {
+      if(fcRead(fci, &len, sizeof(len)) != MS_SUCCESS)
+        return MS_FAILURE;
+      if(len < 0) len = 0;
+      if(fci->offset + len > fci->datalength)
+        return MS_FAILURE;
+      shape->values[i] = (char*)msSmallMalloc(len+1);
+      memcpy(shape->values[i], fci->data + fci->offset, len);
+      shape->values[i][len] = '\0';
+      fci->offset += len;
+    }
+  }
+
+  if(numlines > 0) {
+    shape->line = (lineObj*)msSmallCalloc(numlines, sizeof(lineObj));
+    shape->numlines = numlines;
+    for(i=0; i<numlines; i++) {
+      if(fcRead(fci, &len, sizeof(len)) != MS_SUCCESS || len < 0)
+        return MS_FAILURE;
+      shape->line[i].numpoints = len;
+      if(len > 0) {
+        shape->line[i].point = (pointObj*)msSmallMalloc(sizeof(pointObj)*len);
+        if(fcRead(fci, shape->line[i].point, sizeof(pointObj)*len) != MS_SUCCESS)
+          return MS_FAILURE;
+      }
+    }
+  }
+
+  return MS_SUCCESS;
+}
+
+/************************************************************************/
+/*                        Shared segment                                */
+/************************************************************************/
+
+#ifdef USE_FEATURE_CACHE
+
+static const char *fcConfig(mapObj *map, const char *key)
+{
+  const char *value = map ? msGetConfigOption(map, key) : NULL;
+  if(!value)
+    value = getenv(key);
+  return value;
+}
+
+/* inter-process lock on the segment file, the thread lock is held already */
+static void fcFileLock(int type)
+{
+  struct flock fl;
+
+  if(fc_fd < 0) return;
+  memset(&fl, 0, sizeof(fl));
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  while(fcntl(fc_fd, F_SETLKW, &fl) == -1 && errno == EINTR);
+}
+
+static featureCacheHeader *fcHeader(void)
+{
+  return (featureCacheHeader*)fc_segment;
+}
+
+static featureCacheSlot *fcSlot(ms_uint32 i)
+{
+  featureCacheHeader *hdr = fcHeader();
+  return (featureCacheSlot*)(fc_segment + sizeof(featureCacheHeader) +
+                             (size_t)i * (sizeof(featureCacheSlot) + hdr->slotsize));
+}
+
+static unsigned char *fcSlotData(featureCacheSlot *slot)
+{
+  return (unsigned char*)slot + sizeof(featureCacheSlot);
+}
+
+static void fcFormatSegment(ms_uint32 nslots)
+{
+  featureCacheHeader *hdr = fcHeader();
+
+  memset(fc_segment, 0, fc_segment_size);
+  hdr->magic = FC_MAGIC;
+  hdr->version = FC_VERSION;
+  hdr->pointsize = sizeof(pointObj);
+  hdr->nslots = nslots;
+  hdr->slotsize = (ms_uint32)((fc_segment_size - sizeof(featureCacheHeader)) / nslots - sizeof(featureCacheSlot));
+}
+
+/*
+** Map the shared segment on first use. Called with TLOCK_FEATURECACHE held.
+** Returns MS_SUCCESS if the cache is usable.
+*/
+static int fcInit(mapObj *map)
+{
+  const char *filename, *value;
+  size_t size = FC_DEFAULT_SIZE;
+  ms_uint32 nslots = FC_DEFAULT_SLOTS;
+  featureCacheHeader *hdr;
+
+  if(fc_init_done)
+    return fc_segment ? MS_SUCCESS : MS_FAILURE;
+  fc_init_done = MS_TRUE;
+
+  if((value = fcConfig(map, "MS_FEATURE_CACHE_SIZE")) != NULL && atol(value) > 0)
+    size = (size_t)atol(value);
+  if((value = fcConfig(map, "MS_FEATURE_CACHE_SLOTS")) != NULL && atoi(value) > 0)
+    nslots = (ms_uint32)atoi(value);
+  if(size < sizeof(featureCacheHeader) + nslots * (sizeof(featureCacheSlot) + 1024)) {
+    msDebug("msFeatureCache: MS_FEATURE_CACHE_SIZE too small for %u slots, cache disabled.\n", nslots);
+    return MS_FAILURE;
+  }
+
+  filename = fcConfig(map, "MS_FEATURE_CACHE_FILE");
+  if(filename) {
+    struct stat st;
+
+    fc_fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if(fc_fd < 0) {
+      msDebug("msFeatureCache: cannot open %s, cache disabled.\n", filename);
+      return MS_FAILURE;
+    }
+    fcFileLock(F_WRLCK);
+    if(fstat(fc_fd, &st) != 0 || ((size_t)st.st_size != size && ftruncate(fc_fd, size) != 0)) {
+      fcFileLock(F_UNLCK);
+      close(fc_fd);
+      fc_fd = -1;
+      msDebug("msFeatureCache: cannot size %s, cache disabled.\n", filename);
+      return MS_FAILURE;
+    }
+    fc_segment = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fc_fd, 0);
+  } else {
+    fc_segment = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if(fc_segment == MAP_FAILED) {
+    fc_segment = NULL;
+    if(fc_fd >= 0) {
+      fcFileLock(F_UNLCK);
+      close(fc_fd);
+      fc_fd = -1;
+    }
+    msDebug("msFeatureCache: mmap() failed, cache disabled.\n");
+    return MS_FAILURE;
+  }
+  fc_segment_size = size;
+
+  /* (re)format a new or incompatible segment */
+  hdr = fcHeader();
+  if(hdr->magic != FC_MAGIC || hdr->version != FC_VERSION ||
+      hdr->pointsize != sizeof(pointObj) || hdr->nslots != nslots)
+    fcFormatSegment(nslots);
+
+  if(fc_fd >= 0)
+    fcFileLock(F_UNLCK);
+
+  return MS_SUCCESS;
+}
+
+/* copy the entry for key out of the segment, returns MS_TRUE on hit */
+static int fcLookup(const char *key, featureCacheLayerInfo *fci)
+{
+  featureCacheHeader *hdr = fcHeader();
+  ms_uint32 h = fcHash(key), keylength = strlen(key)+1, i;
+  time_t now = time(NULL);
+  int found = MS_FALSE;
+
+  fcFileLock(F_RDLCK);
+  for(i=0; i<FC_PROBES && i<hdr->nslots; i++) {
+    featureCacheSlot *slot = fcSlot((h+i) % hdr->nslots);
+    if(slot->state == FC_SLOT_USED && slot->generation == hdr->generation &&
+        slot->expires >= now && slot->keylength == keylength &&
+        memcmp(fcSlotData(slot), key, keylength) == 0) {
+      fci->datalength = slot->datalength;
+      fci->data = (unsigned char*)msSmallMalloc(slot->datalength ? slot->datalength : 1);
+      memcpy(fci->data, fcSlotData(slot) + keylength, slot->datalength);
+      found = MS_TRUE;
+      break;
+    }
+  }
+  /* statistics are advisory, we don't need the write lock for them */
+  if(found) hdr->hits++;
+  else hdr->misses++;
+  fcFileLock(F_UNLCK);
+
+  return found;
+}
+
+static int fcStore(const char *key, ms_uint32 layerhash, int ttl, unsigned char *data, size_t datalength)
+{
+  featureCacheHeader *hdr = fcHeader();
+  featureCacheSlot *slot, *victim = NULL;
+  ms_uint32 h = fcHash(key), keylength = strlen(key)+1, i;
+  time_t now = time(NULL);
+
+  if(keylength + datalength > hdr->slotsize)
+    return MS_FAILURE;
+
+  fcFileLock(F_WRLCK);
+  /* reuse the slot of the same key, else an empty/stale one, else the oldest */
+  for(i=0; i<FC_PROBES && i<hdr->nslots; i++) {
+    slot = fcSlot((h+i) % hdr->nslots);
+    if(slot->state == FC_SLOT_USED && slot->keylength == keylength &&
+        memcmp(fcSlotData(slot), key, keylength) == 0) {
+      victim = slot;
+      break;
+    }
+    if(slot->state != FC_SLOT_USED || slot->generation != hdr->generation || slot->expires < now) {
+      if(!victim || victim->state == FC_SLOT_USED) victim = slot;
+    } else if(!victim || (victim->state == FC_SLOT_USED && slot->expires < victim->expires)) {
+      victim = slot;
+    }
+  }
+
+  victim->state = FC_SLOT_EMPTY;
+  memcpy(fcSlotData(victim), key, keylength);
+  if(datalength)
+    memcpy(fcSlotData(victim) + keylength, data, datalength);
+  victim->keylength = keylength;
+  victim->datalength = (ms_uint32)datalength;
+  victim->layerhash = layerhash;
+  victim->generation = hdr->generation;
+  victim->expires = (ms_int32)(now + ttl);
+  victim->state = FC_SLOT_USED;
+  fcFileLock(F_UNLCK);
+
+  return MS_SUCCESS;
+}
+
+#endif /* USE_FEATURE_CACHE */
+
+/************************************************************************/
+/*                         Layer interface                              */
+/************************************************************************/
+
+/*
+** Returns MS_TRUE if the layer asked for feature caching.
+*/
+int msFeatureCacheEnabled(layerObj *layer)
+{
+#ifdef USE_FEATURE_CACHE
+  const char *value = msLayerGetProcessingKey(layer, "FEATURE_CACHE");
+  return (value && (strcasecmp(value, "ON") == 0 || strcasecmp(value, "TRUE") == 0 || strcmp(value, "1") == 0));
+#else
+  return MS_FALSE;
+#endif
+}
+
+static void fcFreeLayerInfo(featureCacheLayerInfo *fci)
+{
+  if(!fci) return;
+  msFree(fci->key);
+  msFree(fci->data);
+  msBufferFree(&fci->record);
+  msFree(fci);
+}
+
+/*
+** Snap the search rectangle outwards to the cache grid so that overlapping
+** requests resolve to the same key.
+*/
+static void fcSnapRect(layerObj *layer, rectObj *rect)
+{
+  const char *value = msLayerGetProcessingKey(layer, "FEATURE_CACHE_CELLSIZE");
+  double cellsize = 0;
+
+  if(value)
+    cellsize = atof(value);
+  if(cellsize <= 0) {
+    double size = MS_MAX(rect->maxx - rect->minx, rect->maxy - rect->miny);
+    if(size <= 0) return;
+    cellsize = pow(2.0, ceil(log(size)/log(2.0)));
+  }
+
+  rect->minx = floor(rect->minx / cellsize) * cellsize;
+  rect->miny = floor(rect->miny / cellsize) * cellsize;
+  rect->maxx = ceil(rect->maxx / cellsize) * cellsize;
+  rect->maxy = ceil(rect->maxy / cellsize) * cellsize;
+}
+
+static char *fcBuildKey(layerObj *layer, rectObj *rect)
+{
+  bufferObj key;
+  char num[128], *identity;
+  int i;
+
+  msBufferInit(&key);
+  identity = fcLayerIdentity(layer);
+  msBufferAppend(&key, identity, strlen(identity));
+  msFree(identity);
+
+  snprintf(num, sizeof(num), "%.17g,%.17g,%.17g,%.17g", rect->minx, rect->miny, rect->maxx, rect->maxy);
+  fcAppendKey(&key, "cell", num);
+  for(i=0; i<layer->numitems; i++)
+    fcAppendKey(&key, "item", layer->items[i]);
+  fcAppendKey(&key, "filter", layer->filter.string);
+  fcAppendKey(&key, "native_filter", layer->filter.native_string);
+  fcAppendKey(&key, "filteritem", layer->filteritem);
+  for(i=0; i<layer->numprocessing; i++)
+    fcAppendKey(&key, "processing", layer->processing[i]);
+  snprintf(num, sizeof(num), "%d,%d", layer->maxfeatures, layer->startindex);
+  fcAppendKey(&key, "paging", num);
+  /* e.g. server side generalization, clipping or quantization */
+  if(layer->map && msLayerDependsOnScale(layer)) {
+    snprintf(num, sizeof(num), "%.17g", layer->map->cellsize);
+    fcAppendKey(&key, "cellsize", num);
+  }
+  msBufferAppend(&key, "", 1);
+
+  return (char*)key.data;
+}
+
+/*
+** Look up the draw request rect of a layer in the cache. On a hit the layer
+** will be served from the cache by msFeatureCacheNextShape(), *status gets the
+** msLayerWhichShapes() return value and MS_TRUE is returned. On a miss *rect
+** is snapped to the cache grid, recording is set up for the shapes returned by
+** the driver, and MS_FALSE is returned so the driver query is run.
+*/
+int msFeatureCacheWhichShapes(layerObj *layer, rectObj *rect, int *status)
+{
+#ifdef USE_FEATURE_CACHE
+  featureCacheLayerInfo *fci;
+  const char *value;
+  char *identity;
+  int hit;
+
+  msFeatureCacheLayerClose(layer);
+
+  msAcquireLock(TLOCK_FEATURECACHE);
+  if(fcInit(layer->map) != MS_SUCCESS) {
+    msReleaseLock(TLOCK_FEATURECACHE);
+    return MS_FALSE;
+  }
+
+  fci = (featureCacheLayerInfo*)msSmallCalloc(1, sizeof(featureCacheLayerInfo));
+  msBufferInit(&fci->record);
+  fci->ttl = FC_DEFAULT_TTL;
+  if((value = msLayerGetProcessingKey(layer, "FEATURE_CACHE_TTL")) != NULL)
+    fci->ttl = atoi(value);
+  identity = fcLayerIdentity(layer);
+  fci->layerhash = fcHash(identity);
+  msFree(identity);
+
+  fcSnapRect(layer, rect);
+  fci->key = fcBuildKey(layer, rect);
+
+  hit = fcLookup(fci->key, fci);
+  msReleaseLock(TLOCK_FEATURECACHE);
+
+  layer->featurecacheinfo = fci;
+
+  if(hit) {
+    ms_int32 numshapes = 0;
+    fci->mode = FC_MODE_HIT;
+    fci->offset = 0;
+    if(fcRead(fci, &numshapes, sizeof(numshapes)) != MS_SUCCESS || numshapes < 0) {
+      msFeatureCacheLayerClose(layer);
+      return MS_FALSE;
+    }
+    fci->numshapes = numshapes;
+    fci->nextshape = 0;
+    if(layer->debug >= MS_DEBUGLEVEL_V)
+      msDebug("msFeatureCacheWhichShapes(%s): hit, %d shapes.\n", layer->name ? layer->name : "", numshapes);
+    *status = (numshapes > 0) ? MS_SUCCESS : MS_DONE;
+    return MS_TRUE;
+  }
+
+  if(layer->debug >= MS_DEBUGLEVEL_V)
+    msDebug("msFeatureCacheWhichShapes(%s): miss.\n", layer->name ? layer->name : "");
+  fci->mode = FC_MODE_RECORD;
+  fcWriteInt(&fci->record, 0); /* shape count, patched on store */
+  return MS_FALSE;
+#else
+  return MS_FALSE;
+#endif
+}
+
+/*
+** Store what has been recorded for the current key. Called when the driver
+** reports the end of the result set.
+*/
+void msFeatureCacheStore(layerObj *layer)
+{
+#ifdef USE_FEATURE_CACHE
+  featureCacheLayerInfo *fci = (featureCacheLayerInfo*)layer->featurecacheinfo;
+  ms_int32 numshapes;
+
+  if(!fci || fci->mode != FC_MODE_RECORD)
+    return;
+
+  numshapes = fci->numrecorded;
+  memcpy(fci->record.data, &numshapes, sizeof(numshapes));
+
+  msAcquireLock(TLOCK_FEATURECACHE);
+  if(fcStore(fci->key, fci->layerhash, fci->ttl, fci->record.data, fci->record.size) != MS_SUCCESS) {
+    if(layer->debug >= MS_DEBUGLEVEL_V)
+      msDebug("msFeatureCacheStore(%s): %d shapes (%u bytes) don't fit in a cache slot.\n",
+              layer->name ? layer->name : "", numshapes, (unsigned int)fci->record.size);
+  }
+  msReleaseLock(TLOCK_FEATURECACHE);
+
+  /* recording is over, further NextShape calls go to the driver untouched */
+  fci->mode = FC_MODE_NONE;
+#endif
+}
+
+/*
+** msLayerNextShape() replacement for layers with an active cache state: serves
+** cached shapes on a hit, or records driver shapes on a miss.
+*/
+int msFeatureCacheNextShape(layerObj *layer, shapeObj *shape)
+{
+  featureCacheLayerInfo *fci = (featureCacheLayerInfo*)layer->featurecacheinfo;
+  int rv;
+
+  if(fci && fci->mode == FC_MODE_HIT) {
+    if(fci->nextshape >= fci->numshapes)
+      return MS_DONE;
+    msInitShape(shape);
+    if(fcDeserializeShape(fci, shape) != MS_SUCCESS) {
+      msFreeShape(shape);
+      msSetError(MS_MISCERR, "Corrupt feature cache entry for layer %s.", "msFeatureCacheNextShape()", layer->name ? layer->name : "");
+      return MS_FAILURE;
+    }
+    shape->resultindex = fci->nextshape++;
+    return MS_SUCCESS;
+  }
+
+  rv = layer->vtable->LayerNextShape(layer, shape);
+
+  if(fci && fci->mode == FC_MODE_RECORD) {
+    if(rv == MS_SUCCESS) {
+      fcSerializeShape(&fci->record, shape);
+      fci->numrecorded++;
+    } else if(rv == MS_DONE) {
+      msFeatureCacheStore(layer);
+    } else {
+      fci->mode = FC_MODE_NONE;
+    }
+  }
+
+  return rv;
+}
+
+/*
+** Release the per layer cache state (called from msLayerClose()). A partially
+** recorded result set is dropped.
+*/
+void msFeatureCacheLayerClose(layerObj *layer)
+{
+  fcFreeLayerInfo((featureCacheLayerInfo*)layer->featurecacheinfo);
+  layer->featurecacheinfo = NULL;
+}
+
+/*
+** Invalidation hooks: drop every entry of a layer, or of the whole cache.
+*/
+int msFeatureCacheInvalidate(layerObj *layer)
+{
+#ifdef USE_FEATURE_CACHE
+  featureCacheHeader *hdr;
+  char *identity;
+  ms_uint32 layerhash, i;
+
+  msAcquireLock(TLOCK_FEATURECACHE);
+  if(fcInit(layer->map) != MS_SUCCESS) {
+    msReleaseLock(TLOCK_FEATURECACHE);
+    return MS_FAILURE;
+  }
+
+  identity = fcLayerIdentity(layer);
+  layerhash = fcHash(identity);
+  msFree(identity);
+
+  hdr = fcHeader();
+  fcFileLock(F_WRLCK);
+  for(i=0; i<hdr->nslots; i++) {
+    featureCacheSlot *slot = fcSlot(i);
+    if(slot->state == FC_SLOT_USED && slot->layerhash == layerhash)
+      slot->state = FC_SLOT_EMPTY;
+  }
+  fcFileLock(F_UNLCK);
+  msReleaseLock(TLOCK_FEATURECACHE);
+#endif
+  return MS_SUCCESS;
+}
+
+void msFeatureCacheInvalidateAll(mapObj *map)
+{
+#ifdef USE_FEATURE_CACHE
+  msAcquireLock(TLOCK_FEATURECACHE);
+  if(fcInit(map) == MS_SUCCESS) {
+    fcFileLock(F_WRLCK);
+    fcHeader()->generation++;
+    fcFileLock(F_UNLCK);
+  }
+  msReleaseLock(TLOCK_FEATURECACHE);
+#endif
+}
+
+void msFeatureCacheCleanup(void)
+{
+#ifdef USE_FEATURE_CACHE
+  msAcquireLock(TLOCK_FEATURECACHE);
+  if(fc_segment) {
+    featureCacheHeader *hdr = fcHeader();
+    if(msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_TUNING)
+      msDebug("msFeatureCacheCleanup(): %u hits, %u misses.\n", hdr->hits, hdr->misses);
+    munmap(fc_segment, fc_segment_size);
+    fc_segment = NULL;
+    fc_segment_size = 0;
+  }
+  if(fc_fd >= 0) {
+    close(fc_fd);
+    fc_fd = -1;
+  }
+  fc_init_done = MS_FALSE;
+  msReleaseLock(TLOCK_FEATURECACHE);
+#endif
+}
@@ -49,7 +49,10 @@
 
 
 extern int msyylex(void);
-extern void msyyrestart(FILE *);
+extern void msyyscanfile(FILE *);
+extern void msyyfreefiles(void);
+extern long msyyfileoffset(void);
+extern char *msyyfiletext(long start, long end);
 extern int msyylex_destroy(void);
 
 extern double msyynumber;
@@ -60,9 +63,13 @@ extern int msyysource;
 extern int msyystate;
 extern char *msyystring;
 extern char *msyybasepath;
+extern char **msyyincludes;
+extern int msyynumincludes;
+extern int msyytrackincludes;
 extern int msyyreturncomments;
 extern char *msyystring_buffer;
 extern char msyystring_icase;
+extern char *msyytext;
 
 extern int loadSymbol(symbolObj *s, char *symbolpath); /* in mapsymbol.c */
 extern void writeSymbol(symbolObj *s, FILE *stream); /* in mapsymbol.c */
@@ -360,9 +367,9 @@ int msGetLayerIndex(mapObj *map, const char *name)
   if(!name) return(-1);
 
   for(i=0; i<map->numlayers; i++) {
-    if(!GET_LAYER(map, i)->name) /* skip it */
+    if(!GET_LAYER_HEADER(map, i)->name) /* skip it */
       continue;
-    if(strcmp(name, GET_LAYER(map, i)->name) == 0)
+    if(strcmp(name, GET_LAYER_HEADER(map, i)->name) == 0)
       return(i);
   }
   return(-1);
@@ -1119,6 +1126,7 @@ int msInitProjection(projectionObj *p)
   p->numargs = 0;
   p->args = NULL;
   p->wellknownprojection = wkp_none;
+  p->normalized = NULL;
 #ifdef USE_PROJ
   p->proj = NULL;
   p->args = (char **)malloc(MS_MAXPROJARGS*sizeof(char *));
@@ -1132,9 +1140,14 @@ int msInitProjection(projectionObj *p)
 
 void msFreeProjection(projectionObj *p)
 {
+  msFree(p->normalized);
+  p->normalized = NULL;
 #ifdef USE_PROJ
   if(p->proj) {
-    pj_free(p->proj);
+#ifdef USE_PROJ_CACHE
+    if(!msProjectionCacheRelease(p->proj))
+#endif
+      pj_free(p->proj);
     p->proj = NULL;
   }
 #if PJ_VERSION >= 480
@@ -1303,8 +1316,13 @@ int msProcessProjection(projectionObj *p)
     /*WMS 1.3.0: AUTO2:auto_crs_id,factor,lon0,lat0*/
     return _msProcessAutoProjection(p);
   }
+  msFree(p->normalized);
+  p->normalized = NULL;
+
   msAcquireLock( TLOCK_PROJ );
-#if PJ_VERSION < 480
+#if defined(USE_PROJ_CACHE)
+  if( !(p->proj = msProjectionCacheAcquire(p->numargs, p->args)) ) {
+#elif PJ_VERSION < 480
   if( !(p->proj = pj_init(p->numargs, p->args)) ) {
 #else
   p->proj_ctx = pj_ctx_alloc();
@@ -2161,6 +2179,7 @@ void msInitExpression(expressionObj *exp)
   exp->compiled = MS_FALSE;
   exp->flags = 0;
   exp->tokens = exp->curtoken = NULL;
+  exp->program = NULL;
 }
 
 void msFreeExpressionTokens(expressionObj *exp)
@@ -2170,6 +2189,8 @@ void msFreeExpressionTokens(expressionObj *exp)
 
   if(!exp) return;
 
+  msFreeCompiledExpression(exp);
+
   if(exp->tokens) {
     node = exp->tokens;
     while (node != NULL) {
@@ -3799,6 +3820,14 @@ int initLayer(layerObj *layer, mapObj *map)
 
   layer->layerinfo = NULL;
   layer->wfslayerinfo = NULL;
+  layer->featurecacheinfo = NULL;
+  layer->classtableinfo = NULL;
+  layer->classindex = NULL;
+  layer->arena = NULL;
+  layer->lazysource = NULL;
+  layer->lazyline = 0;
+  layer->lazyerror = MS_FALSE;
+  layer->lazyinclude = MS_FALSE;
 
   layer->items = NULL;
   layer->iteminfo = NULL;
@@ -3890,6 +3919,12 @@ int freeLayer(layerObj *layer)
   if(msLayerIsOpen(layer))
     msLayerClose(layer);
 
+#if defined(USE_GDAL)
+  msGDALFreeClassTable(layer);
+#endif
+  msLayerFreeClassIndex(layer);
+  msFree(layer->lazysource);
+
   msFree(layer->name);
   msFree(layer->encoding);
   msFree(layer->group);
@@ -4662,6 +4697,187 @@ int loadLayer(layerObj *layer, mapObj *map)
   } /* next token */
 }
 
+/*
+** Lazy layers, enabled with CONFIG "MS_LAZY_LAYERS" "ON" ahead of the first
+** LAYER: msLoadMap() only skims each LAYER block of the mapfile, keeping the
+** settings used to select layers (NAME, GROUP, STATUS, EXTENT, scale limits,
+** REQUIRES and LABELREQUIRES) and a copy of the block's text. The rest is
+** parsed by msLoadLazyLayer() when the layer is first accessed through
+** GET_LAYER(), so a request pays for the layers it uses only.
+*/
+#define MS_LAZY_LAYER_MAXDEPTH 16
+
+/* blocks holding nothing but values up to their END */
+static int isLazyValueBlock(int token)
+{
+  return (token == METADATA || token == VALIDATION || token == BINDVALS || token == PROJECTION ||
+          token == POINTS || token == PATTERN || token == VALUES);
+}
+
+static int isLazyBlock(int token)
+{
+  switch(token) {
+    case(CLASS):
+    case(CLUSTER):
+    case(COMPOSITE):
+    case(FEATURE):
+    case(GRID):
+    case(JOIN):
+    case(LABEL):
+    case(LEADER):
+    case(SCALETOKEN):
+    case(STYLE):
+      return MS_TRUE;
+  }
+  return isLazyValueBlock(token);
+}
+
+/*
+** Reads the LAYER block up to its END like loadLayer() would, nested blocks
+** are only matched up. start is the mapfile offset following LAYER.
+*/
+static int skimLayer(layerObj *layer, long start)
+{
+  int blocks[MS_LAZY_LAYER_MAXDEPTH];
+  int depth = 0, lineno = msyylineno;
+  int token;
+  long end;
+
+  for(;;) {
+    token = msyylex();
+    if(token == EOF) {
+      msSetError(MS_EOFERR, NULL, "loadLayer()");
+      return(-1);
+    }
+    if(token == -1) return(-1); /* INCLUDE failed, error already set */
+    if(msyyfileoffset() < 0)
+      layer->lazyinclude = MS_TRUE; /* token read from an INCLUDE file */
+    if(token == MS_EXPRESSION && msyytext[0] == '(')
+      continue; /* not BINDVALS, which has the same value */
+
+    if(depth > 0) {
+      /* loaders skip their own keyword, for string loads */
+      if(token == END)
+        depth--;
+      else if(!isLazyValueBlock(blocks[depth-1]) && token != blocks[depth-1] && isLazyBlock(token)) {
+        if(depth == MS_LAZY_LAYER_MAXDEPTH) {
+          msSetError(MS_PARSEERR, "Blocks nested too deeply in layer (%s):(line %d)", "loadLayer()", layer->name?layer->name:"", msyylineno);
+          return(-1);
+        }
+        blocks[depth++] = token;
+      }
+      continue;
+    }
+
+    switch(token) {
+      case(END):
+        if((end = msyyfileoffset()) < 0) {
+          msSetError(MS_PARSEERR, "Layer (%s) ends in an INCLUDE file, which MS_LAZY_LAYERS does not support:(line %d)", "loadLayer()", layer->name?layer->name:"", msyylineno);
+          return(-1);
+        }
+        layer->lazysource = msyyfiletext(start, end);
+        layer->lazyline = lineno;
+        return(0);
+      case(EXTENT):
+        if(getDouble(&(layer->extent.minx)) == -1) return(-1);
+        if(getDouble(&(layer->extent.miny)) == -1) return(-1);
+        if(getDouble(&(layer->extent.maxx)) == -1) return(-1);
+        if(getDouble(&(layer->extent.maxy)) == -1) return(-1);
+        break;
+      case(GROUP):
+        if(getString(&layer->group) == MS_FAILURE) return(-1);
+        break;
+      case(LABELREQUIRES):
+        if(getString(&layer->labelrequires) == MS_FAILURE) return(-1);
+        break;
+      case(MAXSCALE):
+      case(MAXSCALEDENOM):
+        if(getDouble(&(layer->maxscaledenom)) == -1) return(-1);
+        break;
+      case(MINSCALE):
+      case(MINSCALEDENOM):
+        if(getDouble(&(layer->minscaledenom)) == -1) return(-1);
+        break;
+      case(NAME):
+        if(getString(&layer->name) == MS_FAILURE) return(-1);
+        break;
+      case(REQUIRES):
+        if(getString(&layer->requires) == MS_FAILURE) return(-1);
+        break;
+      case(STATUS):
+        if((layer->status = getSymbol(3, MS_ON,MS_OFF,MS_DEFAULT)) == -1) return(-1);
+        break;
+      default:
+        if(isLazyBlock(token))
+          blocks[depth++] = token;
+        break;
+    }
+  }
+}
+
+/*
+** Parses the rest of a layer that msLoadMap() loaded lazily. Settings made
+** to the layer since (e.g. its STATUS) are kept. On a parse error the error
+** is set, the layer is turned off and its lazyerror set: drawing or
+** querying the map fails with that error once it reaches the layer, like
+** msLoadMap() would have failed without MS_LAZY_LAYERS.
+*/
+layerObj *msLoadLazyLayer(mapObj *map, int nIndex)
+{
+  layerObj *layer = map->layers[nIndex];
+  struct mstimeval starttime, endtime;
+  char *source;
+  int i, status, debug;
+
+  debug = (map->debug >= MS_DEBUGLEVEL_TUNING || msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_TUNING);
+  if(debug)
+    msGettimeofday(&starttime, NULL);
+
+  msAcquireLock( TLOCK_PARSER );
+
+  source = layer->lazysource;
+  layer->lazysource = NULL;
+  status = layer->status;
+
+  msyystate = MS_TOKENIZE_STRING;
+  msyystring = source;
+  msyylex(); /* sets things up, but doesn't process any tokens */
+
+  msyylineno = layer->lazyline;
+  msyybasepath = map->mappath; /* for INCLUDEs */
+
+  if(loadLayer(layer, map) == -1) {
+    layer->lazyerror = MS_TRUE;
+  } else {
+    for(i=0; i<layer->numclasses; i++) {
+      if(classResolveSymbolNames(layer->class[i]) != MS_SUCCESS) {
+        layer->lazyerror = MS_TRUE;
+        break;
+      }
+    }
+  }
+
+  if(layer->lazyerror) {
+    msSetError(MS_MISCERR, "Failed to load layer (%s) starting at line %d.", "msLoadLazyLayer()",
+               layer->name?layer->name:"", layer->lazyline);
+    layer->status = MS_OFF;
+  } else
+    layer->status = status;
+
+  msyylex_destroy();
+  msReleaseLock( TLOCK_PARSER );
+  free(source);
+
+  if(debug) {
+    msGettimeofday(&endtime, NULL);
+    msDebug("msLoadLazyLayer(%s): %.3fs\n", layer->name?layer->name:"",
+            (endtime.tv_sec+endtime.tv_usec/1.0e6)-
+            (starttime.tv_sec+starttime.tv_usec/1.0e6) );
+  }
+
+  return layer;
+}
+
 int msUpdateLayerFromString(layerObj *layer, char *string, int url_string)
 {
   int i;
@@ -5944,7 +6160,10 @@ int initMap(mapObj *map)
     map->labelcache.slots[i].markers = NULL;
     map->labelcache.slots[i].markercachesize = 0;
     map->labelcache.slots[i].nummarkers = 0;
+    map->labelcache.slots[i].arena = NULL;
   }
+  map->labelcache.arena = NULL;
+  map->arena = NULL;
 
   map->fontset.filename = NULL;
   map->fontset.numfonts = 0;
@@ -6053,18 +6272,18 @@ int msFreeLabelCacheSlot(labelCacheSlotObj *cacheslot)
 
       for(j=0; j<cacheslot->labels[i].numtextsymbols; j++) {
         freeTextSymbol(cacheslot->labels[i].textsymbols[j]);
-        free(cacheslot->labels[i].textsymbols[j]);
+        msArenaFree(cacheslot->arena, cacheslot->labels[i].textsymbols[j]);
       }
-      msFree(cacheslot->labels[i].textsymbols);
+      msArenaFree(cacheslot->arena, cacheslot->labels[i].textsymbols);
 
 #ifdef include_deprecated
       for(j=0; j<cacheslot->labels[i].numstyles; j++) freeStyle(&(cacheslot->labels[i].styles[j]));
       msFree(cacheslot->labels[i].styles);
 #endif
       if(cacheslot->labels[i].leaderline) {
-        msFree(cacheslot->labels[i].leaderline->point);
-        msFree(cacheslot->labels[i].leaderline);
-        msFree(cacheslot->labels[i].leaderbbox);
+        msArenaFree(cacheslot->arena, cacheslot->labels[i].leaderline->point);
+        msArenaFree(cacheslot->arena, cacheslot->labels[i].leaderline);
+        msArenaFree(cacheslot->arena, cacheslot->labels[i].leaderbbox);
       }
     }
   }
@@ -6092,6 +6311,7 @@ int msFreeLabelCache(labelCacheObj *cache)
 
   cache->num_allocated_rendered_members = cache->num_rendered_members = 0;
   msFree(cache->rendered_text_symbols);
+  msArenaReset(cache->arena);
 
   return MS_SUCCESS;
 }
@@ -6125,6 +6345,7 @@ int msInitLabelCache(labelCacheObj *cache)
     if (msInitLabelCacheSlot(&(cache->slots[p])) != MS_SUCCESS)
       return MS_FAILURE;
   }
+  msArenaReset(cache->arena);
   cache->gutter = 0;
   cache->num_allocated_rendered_members = cache->num_rendered_members = 0;
   cache->rendered_text_symbols = NULL;
@@ -6282,6 +6503,10 @@ static int loadMapInternal(mapObj *map)
           fclose(msyyin);
           msyyin = NULL;
         }
+        msyyfreefiles();
+
+        /* a precompiled token stream ends here, the symbolset below is scanned */
+        msStopMapfileTokenStream();
 
         /*** Make config options current ***/
         msApplyMapConfigOptions( map );
@@ -6345,16 +6570,22 @@ static int loadMapInternal(mapObj *map)
         msFreeProjection(&map->latlon);
         if(loadProjection(&map->latlon) == -1) return MS_FAILURE;
         break;
-      case(LAYER):
+      case(LAYER): {
+        long start = -1;
         if(msGrowMapLayers(map) == NULL)
           return MS_FAILURE;
-        if(initLayer((GET_LAYER(map, map->numlayers)), map) == -1) return MS_FAILURE;
-        if(loadLayer((GET_LAYER(map, map->numlayers)), map) == -1) return MS_FAILURE;
-        GET_LAYER(map, map->numlayers)->index = map->numlayers; /* save the index */
+        if(initLayer((GET_LAYER_HEADER(map, map->numlayers)), map) == -1) return MS_FAILURE;
+        if(msTestConfigOption(map, "MS_LAZY_LAYERS", MS_FALSE))
+          start = msyyfileoffset(); /* -1 unless scanning the mapfile itself */
+        if(start >= 0) {
+          if(skimLayer(GET_LAYER_HEADER(map, map->numlayers), start) == -1) return MS_FAILURE;
+        } else if(loadLayer((GET_LAYER_HEADER(map, map->numlayers)), map) == -1) return MS_FAILURE;
+        GET_LAYER_HEADER(map, map->numlayers)->index = map->numlayers; /* save the index */
         /* Update the layer order list with the layer's index. */
         map->layerorder[map->numlayers] = map->numlayers;
         map->numlayers++;
-        break;
+      }
+      break;
       case(OUTPUTFORMAT):
         if(loadOutputFormat(map) == -1) return MS_FAILURE;
         break;
@@ -6515,8 +6746,18 @@ mapObj *msLoadMapFromString(char *buffer, char *new_mappath)
 ** Sets up file-based mapfile loading and calls loadMapInternal to do the work.
 */
 mapObj *msLoadMap(char *filename, char *new_mappath)
+{
+  return msLoadMapWithIncludes(filename, new_mappath, NULL, NULL);
+}
+
+/*
+** Same as msLoadMap() but also hands back the paths of the files pulled in
+** with INCLUDE, so callers can tell when a loaded map has gone stale.
+*/
+mapObj *msLoadMapWithIncludes(char *filename, char *new_mappath, char ***includes, int *numincludes)
 {
   mapObj *map;
+  int compiled = MS_FALSE;
   struct mstimeval starttime, endtime;
   char szPath[MS_MAXPATHLEN], szCWDPath[MS_MAXPATHLEN];
   int debuglevel;
@@ -6581,6 +6822,7 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
       msReleaseLock( TLOCK_PARSER );
       return NULL;
     }
+    compiled = msIsCompiledMapfile(msyyin); /* see mapfilecompile.c */
 #ifdef USE_XMLMAPFILE
   }
 #endif
@@ -6588,7 +6830,7 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
   msyystate = MS_TOKENIZE_FILE;
   msyylex(); /* sets things up, but doesn't process any tokens */
 
-  msyyrestart(msyyin); /* start at line begining, line 1 */
+  msyyscanfile(msyyin); /* start at line begining, line 1 */
   msyylineno = 1;
 
   /* If new_mappath is provided then use it, otherwise use the location */
@@ -6609,8 +6851,22 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
 
   msyybasepath = map->mappath; /* for INCLUDEs */
 
-  if(loadMapInternal(map) != MS_SUCCESS) {
+  if(includes) {
+    msyyincludes = NULL;
+    msyynumincludes = 0;
+    msyytrackincludes = MS_TRUE;
+  }
+
+  if((compiled && msStartCompiledMapfileReplay(filename) != MS_SUCCESS) ||
+      loadMapInternal(map) != MS_SUCCESS) {
+    msStopMapfileTokenStream();
     msFreeMap(map);
+    if(includes) {
+      msFreeCharArray(msyyincludes, msyynumincludes);
+      msyyincludes = NULL;
+      msyynumincludes = 0;
+      msyytrackincludes = MS_FALSE;
+    }
     msReleaseLock( TLOCK_PARSER );
     if( msyyin ) {
       fclose(msyyin);
@@ -6618,6 +6874,14 @@ mapObj *msLoadMap(char *filename, char *new_mappath)
     }
     return NULL;
   }
+
+  if(includes) {
+    *includes = msyyincludes;
+    *numincludes = msyynumincludes;
+    msyyincludes = NULL;
+    msyynumincludes = 0;
+    msyytrackincludes = MS_FALSE;
+  }
   msReleaseLock( TLOCK_PARSER );
 
   if (debuglevel >= MS_DEBUGLEVEL_TUNING) {
@@ -6720,6 +6984,16 @@ int msUpdateMapFromURL(mapObj *map, char *variable, char *string)
             return MS_FAILURE;
           }
 
+          if(GET_LAYER_HEADER(map, i)->lazysource) {
+            /* loading the layer needs the lexer, then skip back to where we were */
+            if(msLoadLazyLayer(map, i)->lazyerror) return MS_FAILURE;
+            msyystate = MS_TOKENIZE_URL_VARIABLE;
+            msyystring = variable;
+            msyylex(); /* MAP */
+            msyylex(); /* LAYER */
+            msyylex(); /* the layer name or index */
+          }
+
           /* make sure this layer can be modified */
           if(msLookupHashTable(&(GET_LAYER(map, i)->validation), "immutable"))
             return(MS_SUCCESS); /* fail silently */
@@ -6893,9 +7167,16 @@ static void layerSubstituteString(layerObj *layer, const char *from, const char
   }
 }
 
+/* a lazy layer without a % in its text (and INCLUDEs) has no %key% to substitute */
+static int lazyLayerHasNoTags(layerObj *layer)
+{
+  return (layer->lazysource && !layer->lazyinclude && strchr(layer->lazysource, '%') == NULL);
+}
+
 static void mapSubstituteString(mapObj *map, const char *from, const char *to) {
   int l;
   for(l=0;l<map->numlayers; l++) {
+    if(lazyLayerHasNoTags(GET_LAYER_HEADER(map, l))) continue;
     layerSubstituteString(GET_LAYER(map,l), from, to);
   }
   /* output formats (#3751) */
@@ -6992,7 +7273,10 @@ void msApplyDefaultSubstitutions(mapObj *map)
   }
 
   for(i=0; i<map->numlayers; i++) {
-    layerObj *layer = GET_LAYER(map, i);
+    layerObj *layer;
+
+    if(lazyLayerHasNoTags(GET_LAYER_HEADER(map, i))) continue;
+    layer = GET_LAYER(map, i);
 
     for(j=0; j<layer->numclasses; j++) {    /* class settings take precedence...  */
       classObj *class = GET_CLASS(map, i, j);
@@ -7025,7 +7309,9 @@ void msApplySubstitutions(mapObj *map, char **names, char **values, int npairs)
   char *tag;
   for(l=0; l<map->numlayers; l++) {
     int c;
-    layerObj *lp = GET_LAYER(map,l);
+    layerObj *lp;
+    if(lazyLayerHasNoTags(GET_LAYER_HEADER(map, l))) continue;
+    lp = GET_LAYER(map,l);
     for(c=0; c<lp->numclasses; c++) {
       classObj *cp = lp->class[c];
       key = NULL;
@@ -7132,7 +7418,7 @@ static char **tokenizeMapInternal(char *filename, int *ret_numtokens)
   msyylex();
   msyyreturncomments = 1; /* want all tokens, including comments */
 
-  msyyrestart(msyyin); /* start at line begining, line 1 */
+  msyyscanfile(msyyin); /* start at line begining, line 1 */
   msyylineno = 1;
 
   numtokens = 0;
@@ -7159,6 +7445,7 @@ static char **tokenizeMapInternal(char *filename, int *ret_numtokens)
     switch(msyylex()) {
       case(EOF): /* This is the normal way out... cleanup and exit */
         fclose(msyyin);
+        msyyfreefiles();
         *ret_numtokens = numtokens;
         return(tokens);
         break;
@@ -7244,8 +7531,9 @@ static int resolveSymbolNames(mapObj* map)
 {
   int i, j;
 
-  /* step through layers and classes to resolve symbol names */
+  /* step through layers and classes to resolve symbol names, lazy layers do it when loaded */
   for(i=0; i<map->numlayers; i++) {
+    if(GET_LAYER_HEADER(map, i)->lazysource) continue;
     for(j=0; j<GET_LAYER(map, i)->numclasses; j++) {
       if(classResolveSymbolNames(GET_LAYER(map, i)->class[j]) != MS_SUCCESS) return MS_FAILURE;
     }
@@ -0,0 +1,300 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Per process cache of parsed mapfiles for FastCGI workers.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** A long running mapserv (FastCGI, or an application calling msCGIHandler())
+** otherwise lexes and parses the whole mapfile, symbolset and fontset on
+** every request. With the MS_MAPFILE_CACHE environment variable set, the
+** first load of a mapfile is kept untouched in the process and each request
+** gets its own msCopyMap() clone of it, which it is free to modify (map_*
+** URL overrides, substitutions, context loading) and free as usual.
+**
+**   MS_MAPFILE_CACHE=ON    cache up to 16 mapfiles
+**   MS_MAPFILE_CACHE=<n>   cache up to n mapfiles, least recently used ones
+**                          are dropped first
+**
+** A cached map is reloaded as soon as the modification time, size or inode
+** of the mapfile, of any file it INCLUDEs, or of its SYMBOLSET or FONTSET
+** file changes, so editing a mapfile in place or replacing it with mv both
+** take effect on the next request.
+*/
+
+#include "mapserver.h"
+#include "mapthread.h"
+#include "maptime.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define MS_MAPFILE_CACHE_DEFAULT_ENTRIES 16
+
+typedef struct {
+  char *path;
+  int exists;
+  time_t mtime;
+  off_t size;
+  dev_t dev;
+  ino_t ino;
+} mapfileStampObj;
+
+typedef struct {
+  char *filename;
+  mapObj *map; /* pristine, never handed out */
+  mapfileStampObj *stamps;
+  int numstamps;
+  double loadtime;
+  int hits;
+  unsigned long lastused;
+} mapfileCacheEntryObj;
+
+static mapfileCacheEntryObj *mapfileCache = NULL;
+static int mapfileCacheNumEntries = 0;
+static unsigned long mapfileCacheRequests = 0;
+static unsigned long mapfileCacheHits = 0;
+
+static double elapsedSince(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+/* number of mapfiles to keep, 0 when the cache is disabled */
+static int getMapfileCacheSize(void)
+{
+  const char *value = getenv("MS_MAPFILE_CACHE");
+
+  if(value == NULL || *value == '\0')
+    return 0;
+  if(strcasecmp(value, "ON") == 0 || strcasecmp(value, "YES") == 0 || strcasecmp(value, "TRUE") == 0)
+    return MS_MAPFILE_CACHE_DEFAULT_ENTRIES;
+  return MS_MAX(0, atoi(value));
+}
+
+static void stampFile(mapfileStampObj *stamp)
+{
+  struct stat st;
+
+  if(stat(stamp->path, &st) != 0) {
+    stamp->exists = MS_FALSE;
+    return;
+  }
+  stamp->exists = MS_TRUE;
+  stamp->mtime = st.st_mtime;
+  stamp->size = st.st_size;
+  stamp->dev = st.st_dev;
+  stamp->ino = st.st_ino;
+}
+
+static int stampIsCurrent(const mapfileStampObj *stamp)
+{
+  mapfileStampObj now;
+
+  now.path = stamp->path;
+  stampFile(&now);
+  if(now.exists != stamp->exists)
+    return MS_FALSE;
+  if(!now.exists)
+    return MS_TRUE;
+  return now.mtime == stamp->mtime && now.size == stamp->size &&
+         now.dev == stamp->dev && now.ino == stamp->ino;
+}
+
+static void addStamp(mapfileCacheEntryObj *entry, const char *path)
+{
+  mapfileStampObj *stamp;
+
+  entry->stamps = (mapfileStampObj *) msSmallRealloc(entry->stamps, sizeof(mapfileStampObj) * (entry->numstamps+1));
+  stamp = entry->stamps + entry->numstamps++;
+  stamp->path = msStrdup(path);
+  stampFile(stamp);
+}
+
+static void freeEntry(mapfileCacheEntryObj *entry)
+{
+  int i;
+
+  for(i=0; i<entry->numstamps; i++)
+    msFree(entry->stamps[i].path);
+  msFree(entry->stamps);
+  msFree(entry->filename);
+  if(entry->map)
+    msFreeMap(entry->map);
+  memset(entry, 0, sizeof(mapfileCacheEntryObj));
+}
+
+static mapObj *cloneMap(mapObj *src)
+{
+  mapObj *map = msNewMapObj();
+
+  if(map == NULL)
+    return NULL;
+  if(msCopyMap(map, src) != MS_SUCCESS) {
+    msFreeMap(map);
+    return NULL;
+  }
+  /* process wide settings (GDAL config, PROJ_LIB, MS_ERRORFILE) may have been changed by another mapfile since */
+  msApplyMapConfigOptions(map);
+  return map;
+}
+
+/*
+** Loads filename into a new cache entry, recording the state of every file
+** the map was built from. Returns the entry or NULL on failure.
+*/
+static mapfileCacheEntryObj *loadEntry(mapfileCacheEntryObj *entry, char *filename)
+{
+  char **includes = NULL;
+  int numincludes = 0, i;
+  char szPath[MS_MAXPATHLEN];
+  struct mstimeval starttime;
+  mapObj *map;
+
+  msGettimeofday(&starttime, NULL);
+
+  /* stamp the mapfile before parsing it, so that an edit made while we parse invalidates the entry */
+  memset(entry, 0, sizeof(mapfileCacheEntryObj));
+  entry->filename = msStrdup(filename);
+  addStamp(entry, filename);
+
+  map = msLoadMapWithIncludes(filename, NULL, &includes, &numincludes);
+  if(map == NULL) {
+    freeEntry(entry);
+    return NULL;
+  }
+  entry->map = map;
+
+  for(i=0; i<numincludes; i++)
+    addStamp(entry, includes[i]);
+  msFreeCharArray(includes, numincludes);
+  if(map->symbolset.filename)
+    addStamp(entry, msBuildPath(szPath, map->mappath, map->symbolset.filename));
+  if(map->fontset.filename)
+    addStamp(entry, msBuildPath(szPath, map->mappath, map->fontset.filename));
+
+  entry->loadtime = elapsedSince(&starttime);
+  return entry;
+}
+
+/*
+** Drop-in replacement for msLoadMap(filename, NULL) for long running
+** processes: returns a map the caller owns and frees with msFreeMap(), taken
+** from the cache when MS_MAPFILE_CACHE is enabled.
+*/
+mapObj *msLoadMapFromCache(char *filename)
+{
+  int cachesize, i;
+  mapfileCacheEntryObj *entry = NULL;
+  struct mstimeval starttime;
+  mapObj *map;
+
+  cachesize = getMapfileCacheSize();
+  if(cachesize == 0 || filename == NULL)
+    return msLoadMap(filename, NULL);
+
+  msGettimeofday(&starttime, NULL);
+  msAcquireLock(TLOCK_MAPFILECACHE);
+
+  mapfileCacheRequests++;
+  for(i=0; i<mapfileCacheNumEntries; i++) {
+    if(strcmp(mapfileCache[i].filename, filename) == 0) {
+      entry = mapfileCache + i;
+      break;
+    }
+  }
+
+  if(entry) {
+    for(i=0; i<entry->numstamps; i++) {
+      if(!stampIsCurrent(entry->stamps + i)) {
+        if(msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_TUNING)
+          msDebug("msLoadMapFromCache(): %s changed, reloading %s\n", entry->stamps[i].path, filename);
+        freeEntry(entry);
+        *entry = mapfileCache[--mapfileCacheNumEntries];
+        entry = NULL;
+        break;
+      }
+    }
+  }
+
+  if(entry) {
+    mapfileCacheHits++;
+    entry->hits++;
+  } else {
+    mapfileCacheEntryObj loaded;
+
+    if(loadEntry(&loaded, filename) == NULL) {
+      msReleaseLock(TLOCK_MAPFILECACHE);
+      return NULL;
+    }
+    if(mapfileCacheNumEntries >= cachesize) { /* evict the least recently used map */
+      int lru = 0;
+      for(i=1; i<mapfileCacheNumEntries; i++)
+        if(mapfileCache[i].lastused < mapfileCache[lru].lastused)
+          lru = i;
+      freeEntry(mapfileCache + lru);
+      mapfileCache[lru] = mapfileCache[--mapfileCacheNumEntries];
+    }
+    mapfileCache = (mapfileCacheEntryObj *) msSmallRealloc(mapfileCache, sizeof(mapfileCacheEntryObj) * (mapfileCacheNumEntries+1));
+    entry = mapfileCache + mapfileCacheNumEntries++;
+    *entry = loaded;
+  }
+  entry->lastused = mapfileCacheRequests;
+
+  map = cloneMap(entry->map);
+
+  if(msGetGlobalDebugLevel() >= MS_DEBUGLEVEL_TUNING) {
+    if(entry->hits == 0)
+      msDebug("msLoadMapFromCache(): loaded %s in %.3fs, %lu/%lu requests served from cache\n",
+              filename, entry->loadtime, mapfileCacheHits, mapfileCacheRequests);
+    else
+      msDebug("msLoadMapFromCache(): cloned %s in %.3fs (load took %.3fs), %lu/%lu requests served from cache (%.1f%%)\n",
+              filename, elapsedSince(&starttime), entry->loadtime, mapfileCacheHits, mapfileCacheRequests,
+              100.0 * mapfileCacheHits / mapfileCacheRequests);
+  }
+
+  msReleaseLock(TLOCK_MAPFILECACHE);
+
+  if(map == NULL) /* the clone failed, fall back to a regular load */
+    return msLoadMap(filename, NULL);
+  return map;
+}
+
+void msMapfileCacheCleanup(void)
+{
+  int i;
+
+  msAcquireLock(TLOCK_MAPFILECACHE);
+  for(i=0; i<mapfileCacheNumEntries; i++)
+    freeEntry(mapfileCache + i);
+  msFree(mapfileCache);
+  mapfileCache = NULL;
+  mapfileCacheNumEntries = 0;
+  mapfileCacheRequests = mapfileCacheHits = 0;
+  msReleaseLock(TLOCK_MAPFILECACHE);
+}
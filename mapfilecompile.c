@@ -0,0 +1,336 @@
+/**********************************************************************
+ * $Id$
+ *
+ * Project:  MapServer
+ * Purpose:  Precompiled (pre-lexed) binary mapfiles.
+ * Author:   MapServer team.
+ *
+ **********************************************************************
+ * Copyright (c) 1996-2015 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+/*
+** A compiled mapfile holds the token stream the lexer produced for the MAP
+** block of a mapfile, INCLUDEs already expanded, together with the string,
+** number and line number of each token. msLoadMap() recognizes one by its
+** magic and replays the stream through the regular loaders, so no flex
+** scanning or include file handling happens and the result is exactly the
+** map the text mapfile gives. Compile with the mapcompile utility.
+**
+** The file is relocatable (offsets only, mapped read only) but tied to the
+** MapServer version and byte order that wrote it: token numbers are not
+** stable across releases, so such files are refused and must be rebuilt.
+** Relative paths resolve against the compiled file's directory like they
+** would for a text mapfile, and SYMBOLSET and FONTSET files are still read
+** from disk.
+**
+** Only the lexing is saved: parsing, expression and regex compilation and
+** everything else msLoadMap() does still happen on each load. The compiled
+** file goes through msLoadMap() like any mapfile, so its name must match
+** MS_MAPFILE_PATTERN, by default a ".map" extension.
+*/
+
+#include "mapserver.h"
+#include "mapfile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_MMAP 1
+#endif
+
+#define MS_COMPILED_MAPFILE_MAGIC     "MSMAPBIN"
+#define MS_COMPILED_MAPFILE_VERSION   1
+#define MS_COMPILED_MAPFILE_BYTEORDER 0x01020304
+
+typedef struct {
+  char magic[8];
+  ms_uint32 version;   /* of this layout */
+  ms_uint32 msversion; /* MS_VERSION_NUM of the writer */
+  ms_uint32 byteorder;
+  ms_uint32 numtokens;
+  ms_uint32 stringsize;
+  ms_uint32 reserved;
+} compiledMapfileHeader;
+
+typedef struct {
+  double number;
+  ms_int32 token;
+  ms_int32 lineno;
+  ms_uint32 string; /* offset in the string table */
+  ms_int32 icase;
+} compiledMapfileToken;
+
+extern int (*msyyreplayhook)(void);
+extern void (*msyyrecordhook)(int token);
+extern double msyynumber;
+extern int msyylineno;
+extern int msyysource;
+extern char *msyystring_buffer;
+extern int msyystring_buffer_size;
+extern int msyystring_icase;
+
+/* stream being recorded by msCompileMapfile(), or replayed by msLoadMap() */
+static compiledMapfileToken *tokens = NULL;
+static int numtokens = 0, maxtokens = 0;
+static char *strings = NULL;
+static size_t stringsize = 0, maxstringsize = 0;
+static int nexttoken = 0;
+static void *mapped = NULL;
+static size_t mappedsize = 0;
+
+static void recordToken(int token)
+{
+  size_t len = strlen(msyystring_buffer) + 1;
+  compiledMapfileToken *t;
+
+  if(numtokens == maxtokens) {
+    maxtokens = MS_MAX(1024, maxtokens*2);
+    tokens = (compiledMapfileToken *) msSmallRealloc(tokens, sizeof(compiledMapfileToken) * maxtokens);
+  }
+  if(stringsize + len > maxstringsize) {
+    maxstringsize = MS_MAX(stringsize + len, MS_MAX(16384, maxstringsize*2));
+    strings = (char *) msSmallRealloc(strings, maxstringsize);
+  }
+
+  t = tokens + numtokens++;
+  memset(t, 0, sizeof(compiledMapfileToken));
+  t->number = msyynumber;
+  t->token = token;
+  t->lineno = msyylineno;
+  t->string = (ms_uint32) stringsize;
+  t->icase = msyystring_icase;
+  memcpy(strings + stringsize, msyystring_buffer, len);
+  stringsize += len;
+}
+
+static int replayToken(void)
+{
+  const compiledMapfileToken *t;
+  size_t len;
+
+  if(nexttoken >= numtokens)
+    return EOF;
+  t = tokens + nexttoken++;
+  if(t->string >= stringsize) {
+    msSetError(MS_IOERR, "Corrupted compiled mapfile.", "msLoadMap()");
+    return -1;
+  }
+
+  len = strlen(strings + t->string);
+  if(msyystring_buffer == NULL || (int)len >= msyystring_buffer_size) {
+    msyystring_buffer_size = MS_MAX(256, len+1);
+    msyystring_buffer = (char *) msSmallRealloc(msyystring_buffer, msyystring_buffer_size);
+  }
+  memcpy(msyystring_buffer, strings + t->string, len+1);
+  msyynumber = t->number;
+  msyylineno = t->lineno;
+  msyystring_icase = t->icase;
+  return t->token;
+}
+
+/*
+** Stops recording or replaying. Called by the MAP block's END, as the
+** SYMBOLSET file loaded from there goes through the scanner again, and on
+** load failures.
+*/
+void msStopMapfileTokenStream(void)
+{
+  msyyrecordhook = NULL;
+  if(msyyreplayhook) {
+    msyyreplayhook = NULL;
+#ifdef USE_MMAP
+    munmap(mapped, mappedsize);
+#else
+    msFree(mapped);
+#endif
+    mapped = NULL;
+    tokens = NULL;
+    strings = NULL;
+    numtokens = 0;
+    stringsize = 0;
+  }
+}
+
+/*
+** Tells whether fp, positioned at the start of a mapfile, is a compiled one.
+** The position is left unchanged.
+*/
+int msIsCompiledMapfile(FILE *fp)
+{
+  char magic[8];
+  int compiled;
+
+  compiled = (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+              memcmp(magic, MS_COMPILED_MAPFILE_MAGIC, sizeof(magic)) == 0);
+  fseek(fp, 0, SEEK_SET);
+  return compiled;
+}
+
+/*
+** Maps a compiled mapfile and sets the lexer up to return its tokens. The
+** caller holds TLOCK_PARSER.
+*/
+int msStartCompiledMapfileReplay(const char *filename)
+{
+  compiledMapfileHeader *header;
+  struct stat st;
+  size_t tokensize;
+
+  if(stat(filename, &st) != 0 || (size_t)st.st_size < sizeof(compiledMapfileHeader)) {
+    msSetError(MS_IOERR, "(%s)", "msLoadMap()", filename);
+    return MS_FAILURE;
+  }
+  mappedsize = st.st_size;
+
+#ifdef USE_MMAP
+  {
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+      msSetError(MS_IOERR, "(%s)", "msLoadMap()", filename);
+      return MS_FAILURE;
+    }
+    mapped = mmap(NULL, mappedsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+      mapped = NULL;
+      msSetError(MS_IOERR, "Failed to map compiled mapfile (%s).", "msLoadMap()", filename);
+      return MS_FAILURE;
+    }
+  }
+#else
+  {
+    FILE *fp = fopen(filename, "rb");
+    if(fp == NULL) {
+      msSetError(MS_IOERR, "(%s)", "msLoadMap()", filename);
+      return MS_FAILURE;
+    }
+    mapped = msSmallMalloc(mappedsize);
+    if(fread(mapped, 1, mappedsize, fp) != mappedsize) {
+      fclose(fp);
+      msFree(mapped);
+      mapped = NULL;
+      msSetError(MS_IOERR, "(%s)", "msLoadMap()", filename);
+      return MS_FAILURE;
+    }
+    fclose(fp);
+  }
+#endif
+
+  /* from here on msStopMapfileTokenStream() releases the mapping */
+  msyyreplayhook = replayToken;
+
+  header = (compiledMapfileHeader *) mapped;
+  if(memcmp(header->magic, MS_COMPILED_MAPFILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MS_COMPILED_MAPFILE_VERSION || header->byteorder != MS_COMPILED_MAPFILE_BYTEORDER) {
+    msSetError(MS_IOERR, "%s is not a compiled mapfile this build can read.", "msLoadMap()", filename);
+    msStopMapfileTokenStream();
+    return MS_FAILURE;
+  }
+  if(header->msversion != MS_VERSION_NUM) {
+    msSetError(MS_IOERR, "%s was compiled by MapServer %d, recompile it with this version's mapcompile.",
+               "msLoadMap()", filename, (int)header->msversion);
+    msStopMapfileTokenStream();
+    return MS_FAILURE;
+  }
+  tokensize = (size_t)header->numtokens * sizeof(compiledMapfileToken);
+  if(sizeof(compiledMapfileHeader) + tokensize + header->stringsize != mappedsize ||
+      header->stringsize == 0 || ((char *)mapped)[mappedsize-1] != '\0') {
+    msSetError(MS_IOERR, "Corrupted compiled mapfile (%s).", "msLoadMap()", filename);
+    msStopMapfileTokenStream();
+    return MS_FAILURE;
+  }
+
+  tokens = (compiledMapfileToken *) ((char *)mapped + sizeof(compiledMapfileHeader));
+  numtokens = header->numtokens;
+  strings = (char *)mapped + sizeof(compiledMapfileHeader) + tokensize;
+  stringsize = header->stringsize;
+  nexttoken = 0;
+  msyysource = MS_FILE_TOKENS;
+
+  return MS_SUCCESS;
+}
+
+/*
+** Loads the text mapfile filename, recording its tokens, and writes them
+** to outfile. Meant for the mapcompile utility: recording isn't done under
+** the parser lock, so don't load maps from other threads meanwhile.
+*/
+int msCompileMapfile(char *filename, char *outfile)
+{
+  compiledMapfileHeader header;
+  mapObj *map;
+  FILE *fp;
+  int status = MS_SUCCESS;
+
+  if(msyyreplayhook || msyyrecordhook) {
+    msSetError(MS_MISCERR, "A mapfile is already being compiled.", "msCompileMapfile()");
+    return MS_FAILURE;
+  }
+
+  numtokens = maxtokens = 0;
+  stringsize = maxstringsize = 0;
+  msyyrecordhook = recordToken;
+  map = msLoadMap(filename, NULL);
+  msyyrecordhook = NULL;
+
+  if(map == NULL) {
+    status = MS_FAILURE;
+  } else if(numtokens == 0) {
+    msSetError(MS_MISCERR, "%s is already compiled.", "msCompileMapfile()", filename);
+    status = MS_FAILURE;
+  } else if((fp = fopen(outfile, "wb")) == NULL) {
+    msSetError(MS_IOERR, "(%s)", "msCompileMapfile()", outfile);
+    status = MS_FAILURE;
+  } else {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MS_COMPILED_MAPFILE_MAGIC, sizeof(header.magic));
+    header.version = MS_COMPILED_MAPFILE_VERSION;
+    header.msversion = MS_VERSION_NUM;
+    header.byteorder = MS_COMPILED_MAPFILE_BYTEORDER;
+    header.numtokens = numtokens;
+    header.stringsize = (ms_uint32) stringsize;
+
+    if(fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        (numtokens > 0 && fwrite(tokens, sizeof(compiledMapfileToken), numtokens, fp) != (size_t)numtokens) ||
+        fwrite(strings, 1, stringsize, fp) != stringsize) {
+      msSetError(MS_IOERR, "Failed writing %s.", "msCompileMapfile()", outfile);
+      status = MS_FAILURE;
+    }
+    if(fclose(fp) != 0 && status == MS_SUCCESS) {
+      msSetError(MS_IOERR, "Failed writing %s.", "msCompileMapfile()", outfile);
+      status = MS_FAILURE;
+    }
+  }
+
+  if(map)
+    msFreeMap(map);
+  msFree(tokens);
+  msFree(strings);
+  tokens = NULL;
+  strings = NULL;
+  numtokens = maxtokens = 0;
+  stringsize = maxstringsize = 0;
+  return status;
+}
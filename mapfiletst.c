@@ -0,0 +1,203 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Commandline benchmark of mapfile loading.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+/*
+** Loads a mapfile several times and reports the time per load, then checks
+** that what msSaveMap() writes loads back to the same map. Without a
+** mapfile on the command line a synthetic one with many classes and an
+** INCLUDE is written to the current directory and used. The files written
+** are removed at exit unless -keep is given.
+*/
+
+#define SYNTHETIC_MAPFILE "mapfiletst.map"
+#define SYNTHETIC_INCLUDE "mapfiletst_include.map"
+#define SAVED_MAPFILE1 "mapfiletst_saved1.map"
+#define SAVED_MAPFILE2 "mapfiletst_saved2.map"
+#define NUM_LOADS 5
+
+static int write_synthetic(const char *filename, int numclasses)
+{
+  FILE *fp;
+  int l, i;
+
+  if((fp = fopen(SYNTHETIC_INCLUDE, "w")) == NULL) {
+    perror(SYNTHETIC_INCLUDE);
+    return 1;
+  }
+  fprintf(fp, "  WEB\n    METADATA\n      \"wms_title\" \"synthetic\"\n"
+          "      \"wms_srs\" \"EPSG:4326 EPSG:3857\"\n    END\n  END\n");
+  fclose(fp);
+
+  if((fp = fopen(filename, "w")) == NULL) {
+    perror(filename);
+    return 1;
+  }
+  fprintf(fp, "MAP\n  NAME \"synthetic\"\n  EXTENT 0 0 100 100\n  SIZE 256 256\n"
+          "  IMAGETYPE png\n  INCLUDE \"%s\"\n", SYNTHETIC_INCLUDE);
+  for(l=0; l<4; l++) {
+    fprintf(fp, "  LAYER\n    NAME \"layer%d\"\n    TYPE POLYGON\n    STATUS ON\n"
+            "    DATA \"data%d\"\n    CLASSITEM \"CODE\"\n", l, l);
+    for(i=0; i<numclasses/4; i++) {
+      fprintf(fp, "    CLASS # %d\n      NAME \"class %d \\\"%d\\\"\"\n", i, i, l);
+      if(i % 2)
+        fprintf(fp, "      EXPRESSION ([VALUE] > %d AND \"[NAME]\" = \"n%d\")\n", i, i);
+      else
+        fprintf(fp, "      EXPRESSION \"%d\"\n", i);
+      fprintf(fp, "      STYLE\n        COLOR %d %d %d\n        OUTLINECOLOR 0 0 0\n"
+              "        WIDTH 1.5\n      END\n", i % 256, (i*7) % 256, (i*13) % 256);
+      fprintf(fp, "      LABEL\n        TEXT '[NAME]'\n        SIZE 8\n"
+              "        COLOR 10 20 30\n      END\n    END\n");
+    }
+    fprintf(fp, "  END\n");
+  }
+  fprintf(fp, "END\n");
+  fclose(fp);
+  return 0;
+}
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+static char *read_file(const char *filename, long *size)
+{
+  FILE *fp = fopen(filename, "rb");
+  char *data;
+
+  if(fp == NULL)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  data = (char *) msSmallMalloc(*size + 1);
+  *size = fread(data, 1, *size, fp);
+  fclose(fp);
+  return data;
+}
+
+/* saves map, loads what was saved and saves it again, both files must match */
+static int check_saved(mapObj *map)
+{
+  mapObj *saved;
+  char *data1, *data2;
+  long size1 = 0, size2 = 0;
+  int status;
+
+  if(msSaveMap(map, SAVED_MAPFILE1) != 0 ||
+      (saved = msLoadMap(SAVED_MAPFILE1, NULL)) == NULL) {
+    msWriteError(stderr);
+    return 1;
+  }
+  status = msSaveMap(saved, SAVED_MAPFILE2);
+  msFreeMap(saved);
+  if(status != 0) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  data1 = read_file(SAVED_MAPFILE1, &size1);
+  data2 = read_file(SAVED_MAPFILE2, &size2);
+  status = (data1 == NULL || data2 == NULL || size1 != size2 || memcmp(data1, data2, size1) != 0);
+  printf("msSaveMap() output, %ld bytes: %s\n", size1,
+         status ? "differs once loaded again" : "loads back unchanged");
+  msFree(data1);
+  msFree(data2);
+  return status;
+}
+
+static void remove_files(int synthetic)
+{
+  if(synthetic) {
+    unlink(SYNTHETIC_MAPFILE);
+    unlink(SYNTHETIC_INCLUDE);
+  }
+  unlink(SAVED_MAPFILE1);
+  unlink(SAVED_MAPFILE2);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *filename = NULL;
+  struct mstimeval start;
+  double seconds, best = 0, total = 0;
+  mapObj *map = NULL;
+  int i, status, numclasses = 40000, keep = MS_FALSE, synthetic = MS_FALSE;
+
+  for(i=1; i<argc; i++) {
+    if(strcmp(argv[i], "-keep") == 0)
+      keep = MS_TRUE;
+    else if(strcmp(argv[i], "-classes") == 0 && i+1 < argc)
+      numclasses = atoi(argv[++i]);
+    else if(argv[i][0] != '-')
+      filename = argv[i];
+    else {
+      printf("Usage: mapfiletst [-keep] [mapfile | -classes n]\n");
+      return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+    }
+  }
+  if(filename == NULL) {
+    filename = SYNTHETIC_MAPFILE;
+    synthetic = MS_TRUE;
+    if(write_synthetic(filename, numclasses) != 0) {
+      remove_files(MS_TRUE);
+      return 1;
+    }
+  }
+
+  for(i=0; i<NUM_LOADS; i++) {
+    if(map)
+      msFreeMap(map);
+    msGettimeofday(&start, NULL);
+    map = msLoadMap((char *) filename, NULL);
+    seconds = elapsed(&start);
+    if(map == NULL) {
+      msWriteError(stderr);
+      if(!keep)
+        remove_files(synthetic);
+      return 1;
+    }
+    total += seconds;
+    if(i == 0 || seconds < best)
+      best = seconds;
+  }
+  printf("%s: %d layers, msLoadMap() %.3f s best, %.3f s average of %d\n",
+         filename, map->numlayers, best, total / NUM_LOADS, NUM_LOADS);
+
+  status = check_saved(map);
+  msFreeMap(map);
+  msCleanup();
+  if(!keep)
+    remove_files(synthetic);
+  return status;
+}
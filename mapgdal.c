@@ -30,6 +30,7 @@
 #include "mapserver.h"
 #include "mapthread.h"
 #include <assert.h>
+#include <sys/stat.h>
 
 
 
@@ -63,6 +64,376 @@ void msGDALInitialize( void )
   }
 }
 
+/************************************************************************/
+/* ==================================================================== */
+/*      Process wide cache of the open raster datasets.                 */
+/*                                                                      */
+/*      Raster layers and tiles are opened through the cache for both   */
+/*      drawing and queries, so that the headers of the files are only  */
+/*      read once.  Tiles of a tile index are only kept open when the   */
+/*      layer asks for it, see msGDALCloseDataset().                    */
+/*      Datasets are keyed by their (decrypted) path, are               */
+/*      reopened if the file modification time or size changes, and     */
+/*      the least recently used ones are closed once there are more     */
+/*      than MS_GDAL_MAX_OPEN_DATASETS (default 64, 0 disables the      */
+/*      cache) open.  All the functions must be called with TLOCK_GDAL  */
+/*      held, which also serializes the use of the datasets, except     */
+/*      for the ones handed out by msGDALOpenDatasetExclusive() which   */
+/*      belong to the caller until closed.                              */
+/* ==================================================================== */
+/************************************************************************/
+
+#define MS_GDAL_DEFAULT_MAX_OPEN_DATASETS 64
+
+typedef struct gdalDatasetCacheEntryObj {
+  char *path;
+  GDALDatasetH hDS;
+  time_t mtime;
+  off_t size;
+  int stat_ok; /* the path is a local file we can check for changes */
+
+  int refcount;
+  int exclusive; /* in use outside of TLOCK_GDAL, don't share */
+  int stale; /* the file changed, close once unused */
+  unsigned int lastused;
+  struct gdalDatasetCacheEntryObj *next;
+} gdalDatasetCacheEntryObj;
+
+static gdalDatasetCacheEntryObj *gdalDatasetCache = NULL;
+static int gdalDatasetCacheCount = 0;
+static unsigned int gdalDatasetCacheClock = 0;
+
+static int gdalDatasetCacheHits = 0;
+static int gdalDatasetCacheMisses = 0;
+static int gdalDatasetCacheEvictions = 0;
+static int gdalDatasetCacheReopens = 0;
+
+/************************************************************************/
+/*                    msGDALFreeDatasetCacheEntry()                     */
+/************************************************************************/
+
+static void msGDALFreeDatasetCacheEntry( gdalDatasetCacheEntryObj *entry )
+
+{
+  GDALClose( entry->hDS );
+  msFree( entry->path );
+  msFree( entry );
+}
+
+/************************************************************************/
+/*                    msGDALUnlinkDatasetCacheEntry()                   */
+/************************************************************************/
+
+static void msGDALUnlinkDatasetCacheEntry( gdalDatasetCacheEntryObj *entry )
+
+{
+  gdalDatasetCacheEntryObj **link;
+
+  for( link = &gdalDatasetCache; *link; link = &((*link)->next) ) {
+    if( *link == entry ) {
+      *link = entry->next;
+      gdalDatasetCacheCount--;
+      return;
+    }
+  }
+}
+
+/************************************************************************/
+/*                       msGDALTrimDatasetCache()                       */
+/*                                                                      */
+/*      Close the least recently used unused datasets until at most     */
+/*      nMaxOpen are open.                                              */
+/************************************************************************/
+
+static void msGDALTrimDatasetCache( int nMaxOpen )
+
+{
+  while( gdalDatasetCacheCount > nMaxOpen ) {
+    gdalDatasetCacheEntryObj *entry, *oldest = NULL;
+
+    for( entry = gdalDatasetCache; entry; entry = entry->next ) {
+      if( entry->refcount == 0
+          && (oldest == NULL || entry->lastused < oldest->lastused) )
+        oldest = entry;
+    }
+
+    if( oldest == NULL ) /* everything is in use */
+      return;
+
+    msGDALUnlinkDatasetCacheEntry( oldest );
+    msGDALFreeDatasetCacheEntry( oldest );
+    gdalDatasetCacheEvictions++;
+  }
+}
+
+/************************************************************************/
+/*                        msGDALOpenDatasetEx()                         */
+/************************************************************************/
+
+static void *msGDALOpenDatasetEx( mapObj *map, const char *pszPath,
+                                  int bExclusive )
+
+{
+  gdalDatasetCacheEntryObj *entry;
+  GDALDatasetH hDS;
+  struct stat st;
+  int stat_ok, nMaxOpen = MS_GDAL_DEFAULT_MAX_OPEN_DATASETS;
+  const char *pszMaxOpen = msGetConfigOption( map, "MS_GDAL_MAX_OPEN_DATASETS" );
+
+  if( pszMaxOpen )
+    nMaxOpen = MS_MAX( 0, atoi(pszMaxOpen) );
+
+  stat_ok = (stat( pszPath, &st ) == 0);
+
+  for( entry = gdalDatasetCache; entry; entry = entry->next ) {
+    if( entry->stale || entry->exclusive
+        || (bExclusive && entry->refcount > 0)
+        || strcmp( entry->path, pszPath ) != 0 )
+      continue;
+
+    if( entry->stat_ok != stat_ok
+        || (stat_ok && (entry->mtime != st.st_mtime || entry->size != st.st_size)) ) {
+      /* the file changed since we opened it */
+      gdalDatasetCacheReopens++;
+      if( entry->refcount == 0 ) {
+        msGDALUnlinkDatasetCacheEntry( entry );
+        msGDALFreeDatasetCacheEntry( entry );
+      } else
+        entry->stale = MS_TRUE;
+      break;
+    }
+
+    gdalDatasetCacheHits++;
+    entry->refcount++;
+    entry->exclusive = bExclusive;
+    entry->lastused = ++gdalDatasetCacheClock;
+    return entry->hDS;
+  }
+
+  gdalDatasetCacheMisses++;
+
+  hDS = GDALOpen( pszPath, GA_ReadOnly );
+  if( hDS == NULL || nMaxOpen == 0 )
+    return hDS;
+
+  /* make room for the new dataset */
+  msGDALTrimDatasetCache( nMaxOpen-1 );
+
+  entry = (gdalDatasetCacheEntryObj *) msSmallCalloc( 1, sizeof(gdalDatasetCacheEntryObj) );
+  entry->path = msStrdup( pszPath );
+  entry->hDS = hDS;
+  entry->stat_ok = stat_ok;
+  if( stat_ok ) {
+    entry->mtime = st.st_mtime;
+    entry->size = st.st_size;
+  }
+  entry->refcount = 1;
+  entry->exclusive = bExclusive;
+  entry->lastused = ++gdalDatasetCacheClock;
+  entry->next = gdalDatasetCache;
+  gdalDatasetCache = entry;
+  gdalDatasetCacheCount++;
+
+  return hDS;
+}
+
+/************************************************************************/
+/*                         msGDALOpenDataset()                          */
+/*                                                                      */
+/*      Returns an open read only dataset for pszPath, from the cache   */
+/*      if possible.  It has to be handed back with                     */
+/*      msGDALCloseDataset().  Returns NULL, with the GDAL error set,   */
+/*      if the dataset can't be opened.                                 */
+/************************************************************************/
+
+void *msGDALOpenDataset( mapObj *map, const char *pszPath )
+
+{
+  return msGDALOpenDatasetEx( map, pszPath, MS_FALSE );
+}
+
+/************************************************************************/
+/*                     msGDALOpenDatasetExclusive()                     */
+/*                                                                      */
+/*      Same as msGDALOpenDataset(), but the dataset is not shared      */
+/*      with anybody else until handed back, so that it can be read     */
+/*      without holding TLOCK_GDAL.  The lock is still needed around    */
+/*      this call and msGDALCloseDataset().                             */
+/************************************************************************/
+
+void *msGDALOpenDatasetExclusive( mapObj *map, const char *pszPath )
+
+{
+  return msGDALOpenDatasetEx( map, pszPath, MS_TRUE );
+}
+
+/************************************************************************/
+/*                         msGDALCloseDataset()                         */
+/*                                                                      */
+/*      Hands back a dataset from msGDALOpenDataset().  It is kept      */
+/*      open if the layer CLOSE_CONNECTION processing option is DEFER.  */
+/*      Without the option single file layers are kept open and the     */
+/*      tiles of tile index layers are closed, as there may be many.    */
+/************************************************************************/
+
+void msGDALCloseDataset( layerObj *layer, void *hDS )
+
+{
+  gdalDatasetCacheEntryObj *entry;
+  const char *close_connection = msLayerGetProcessingKey( layer, "CLOSE_CONNECTION" );
+  int bKeepOpen;
+
+  if( close_connection != NULL )
+    bKeepOpen = (strcasecmp(close_connection,"DEFER") == 0);
+  else
+    bKeepOpen = (layer->tileindex == NULL);
+
+  for( entry = gdalDatasetCache; entry; entry = entry->next ) {
+    if( entry->hDS == hDS )
+      break;
+  }
+
+  if( entry == NULL ) { /* not cached */
+    GDALClose( hDS );
+    return;
+  }
+
+  entry->refcount--;
+  entry->exclusive = MS_FALSE;
+  if( entry->refcount == 0 && (entry->stale || !bKeepOpen) ) {
+    msGDALUnlinkDatasetCacheEntry( entry );
+    msGDALFreeDatasetCacheEntry( entry );
+  }
+}
+
+/************************************************************************/
+/*                       msGDALCloseDatasetCache()                      */
+/*                                                                      */
+/*      Close all the cached datasets, the ones still in use are left   */
+/*      alone.                                                          */
+/************************************************************************/
+
+void msGDALCloseDatasetCache( void )
+
+{
+  gdalDatasetCacheEntryObj *entry, *next;
+
+  for( entry = gdalDatasetCache; entry; entry = next ) {
+    next = entry->next;
+    if( entry->refcount == 0 ) {
+      msGDALUnlinkDatasetCacheEntry( entry );
+      msGDALFreeDatasetCacheEntry( entry );
+    }
+  }
+}
+
+/************************************************************************/
+/*                     msGDALDebugDatasetCache()                        */
+/************************************************************************/
+
+void msGDALDebugDatasetCache( layerObj *layer, const char *pszCaller )
+
+{
+  if( layer->debug >= MS_DEBUGLEVEL_TUNING || (layer->map && layer->map->debug >= MS_DEBUGLEVEL_TUNING) )
+    msDebug( "%s(%s): GDAL dataset cache: %d open, %d hits, %d misses, "
+             "%d evictions, %d reopened after a change.\n",
+             pszCaller, layer->name, gdalDatasetCacheCount,
+             gdalDatasetCacheHits, gdalDatasetCacheMisses,
+             gdalDatasetCacheEvictions, gdalDatasetCacheReopens );
+}
+
+/************************************************************************/
+/* ==================================================================== */
+/*      Reusable raster read buffers.                                   */
+/*                                                                      */
+/*      The GDAL draw path reads every file or tile into work buffers   */
+/*      of a few megabytes, which the allocator usually maps and        */
+/*      unmaps on every request.  A couple of them are kept around      */
+/*      for reuse instead, under their own lock since tiles may be      */
+/*      drawn on several threads.                                       */
+/* ==================================================================== */
+/************************************************************************/
+
+#define MS_GDAL_READ_BUFFERS 2
+#define MS_GDAL_MAX_KEPT_READ_BUFFER (64*1024*1024)
+
+typedef struct {
+  void *data;
+  size_t size;
+  int used;
+} gdalReadBufferObj;
+
+static gdalReadBufferObj gdalReadBuffers[MS_GDAL_READ_BUFFERS];
+
+/************************************************************************/
+/*                      msGDALAcquireReadBuffer()                       */
+/*                                                                      */
+/*      Returns a buffer of at least nBytes, or NULL if it can't be     */
+/*      allocated.  Its content is undefined.                           */
+/************************************************************************/
+
+void *msGDALAcquireReadBuffer( size_t nBytes )
+
+{
+  int i;
+  void *pBuffer = NULL;
+
+  msAcquireLock( TLOCK_GDALBUFFER );
+  for( i = 0; i < MS_GDAL_READ_BUFFERS; i++ ) {
+    gdalReadBufferObj *buffer = gdalReadBuffers + i;
+
+    if( buffer->used )
+      continue;
+
+    if( buffer->size < nBytes ) {
+      free( buffer->data );
+      buffer->size = 0;
+      if( (buffer->data = malloc( nBytes )) == NULL )
+        break;
+      buffer->size = nBytes;
+    }
+    buffer->used = MS_TRUE;
+    pBuffer = buffer->data;
+    break;
+  }
+  msReleaseLock( TLOCK_GDALBUFFER );
+
+  if( i == MS_GDAL_READ_BUFFERS )
+    pBuffer = malloc( nBytes );
+
+  return pBuffer;
+}
+
+/************************************************************************/
+/*                      msGDALReleaseReadBuffer()                       */
+/************************************************************************/
+
+void msGDALReleaseReadBuffer( void *pBuffer )
+
+{
+  int i;
+
+  msAcquireLock( TLOCK_GDALBUFFER );
+  for( i = 0; i < MS_GDAL_READ_BUFFERS; i++ ) {
+    gdalReadBufferObj *buffer = gdalReadBuffers + i;
+
+    if( !buffer->used || buffer->data != pBuffer )
+      continue;
+
+    buffer->used = MS_FALSE;
+    if( buffer->size > MS_GDAL_MAX_KEPT_READ_BUFFER ) {
+      free( buffer->data );
+      buffer->data = NULL;
+      buffer->size = 0;
+    }
+    break;
+  }
+  msReleaseLock( TLOCK_GDALBUFFER );
+
+  if( i == MS_GDAL_READ_BUFFERS )
+    free( pBuffer );
+}
+
 /************************************************************************/
 /*                           msGDALCleanup()                            */
 /************************************************************************/
@@ -74,6 +445,18 @@ void msGDALCleanup( void )
     int iRepeat = 5;
     msAcquireLock( TLOCK_GDAL );
 
+    msGDALCloseDatasetCache();
+
+    {
+      int i;
+      for( i = 0; i < MS_GDAL_READ_BUFFERS; i++ ) {
+        free( gdalReadBuffers[i].data );
+        gdalReadBuffers[i].data = NULL;
+        gdalReadBuffers[i].size = 0;
+        gdalReadBuffers[i].used = MS_FALSE;
+      }
+    }
+
 #if GDAL_RELEASE_DATE > 20101207
     {
       /*
@@ -29,6 +29,7 @@
 
 #include "mapserver.h"
 #include <png.h>
+#include <zlib.h>
 #include <setjmp.h>
 #include <assert.h>
 #include <jpeglib.h>
@@ -38,6 +39,10 @@
 #include <gif_lib.h>
 #endif
 
+#ifdef USE_WEBP
+#include <webp/encode.h>
+#endif
+
 
 
 typedef struct _streamInfo {
@@ -206,9 +211,11 @@ int saveAsJPEG(mapObj *map, rasterBufferObj *rb, streamInfo *info,
     cinfo.optimize_coding = TRUE;
 
   if( arithmetic || optimized ) {
-    if (map == NULL || msGetConfigOption(map, "JPEGMEM") == NULL) {
+    if ((map == NULL || msGetConfigOption(map, "JPEGMEM") == NULL) &&
+        cinfo.mem->max_memory_to_use > 0) {
       /* If the user doesn't provide a value for JPEGMEM, we want to be sure */
       /* that at least the image size will be used before creating the temporary file */
+      /* (0 means no limit, which a limit of the image size would only reduce) */
       cinfo.mem->max_memory_to_use =
         MS_MAX(cinfo.mem->max_memory_to_use, cinfo.input_components * rb->width * rb->height);
     }
@@ -305,7 +312,441 @@ int remapPaletteForPNG(rasterBufferObj *rb, rgbPixel *rgb, unsigned char *a, int
   return MS_SUCCESS;
 }
 
-int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression)
+/*
+** Multi-threaded PNG encoding.
+**
+** libpng deflates the whole image on the calling thread, which dominates the
+** time taken to write large (print) images.  Instead, the filtered rows are
+** split in strips that are deflated independently as raw deflate streams,
+** each primed with the last 32K of the rows before it and ended with a sync
+** flush, so they can simply be concatenated behind a zlib header and
+** followed by the combined adler32 (the way pigz does it).  Each strip is
+** written out as its own IDAT chunk as soon as its batch is done.
+**
+** The deflate states and work buffers are kept in a small pool so that
+** successive requests of a FastCGI process do not set them up again.
+*/
+
+#define MS_PNG_STRIP_BYTES (256*1024)
+#define MS_PNG_DICT_BYTES 32768
+#define MS_PNG_ENCODERS 8
+#define MS_PNG_MAX_KEPT_BUFFER (16*1024*1024)
+
+typedef struct {
+  z_stream strm;
+  int initialized; /* strm is set up for level */
+  int level;
+  unsigned char *raw;
+  size_t rawsize;
+  unsigned char *out;
+  size_t outsize;
+  int used;
+} pngEncoderObj;
+
+static pngEncoderObj pngEncoders[MS_PNG_ENCODERS];
+
+static void releasePNGEncoder(pngEncoderObj *enc);
+
+static void freePNGEncoderBuffers(pngEncoderObj *enc)
+{
+  free(enc->raw);
+  free(enc->out);
+  enc->raw = enc->out = NULL;
+  enc->rawsize = enc->outsize = 0;
+}
+
+/*
+** Returns an encoder whose stream is set up for the given compression level,
+** or NULL if zlib fails to initialize.
+*/
+static pngEncoderObj* acquirePNGEncoder(int level)
+{
+  pngEncoderObj *enc = NULL;
+  int i;
+
+  msAcquireLock(TLOCK_PNGENCODER);
+  for(i=0; i<MS_PNG_ENCODERS; i++) {
+    if(!pngEncoders[i].used) {
+      enc = &pngEncoders[i];
+      enc->used = MS_TRUE;
+      break;
+    }
+  }
+  msReleaseLock(TLOCK_PNGENCODER);
+
+  if(!enc && (enc = (pngEncoderObj*)calloc(1,sizeof(pngEncoderObj))) == NULL)
+    return NULL;
+
+  if(enc->initialized && enc->level != level) {
+    deflateEnd(&enc->strm);
+    enc->initialized = MS_FALSE;
+  }
+  if(!enc->initialized) {
+    memset(&enc->strm,0,sizeof(z_stream));
+    if(deflateInit2(&enc->strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+      enc->initialized = MS_TRUE;
+      enc->level = level;
+    }
+  }
+  if(!enc->initialized) {
+    releasePNGEncoder(enc);
+    return NULL;
+  }
+  return enc;
+}
+
+static void releasePNGEncoder(pngEncoderObj *enc)
+{
+  if(enc >= pngEncoders && enc < pngEncoders + MS_PNG_ENCODERS) {
+    msAcquireLock(TLOCK_PNGENCODER);
+    if(enc->rawsize > MS_PNG_MAX_KEPT_BUFFER || enc->outsize > MS_PNG_MAX_KEPT_BUFFER)
+      freePNGEncoderBuffers(enc);
+    enc->used = MS_FALSE;
+    msReleaseLock(TLOCK_PNGENCODER);
+  } else {
+    if(enc->initialized)
+      deflateEnd(&enc->strm);
+    freePNGEncoderBuffers(enc);
+    free(enc);
+  }
+}
+
+/*
+** Frees the pooled PNG encoders, called from msCleanup().
+*/
+void msPNGEncoderCleanup()
+{
+  int i;
+  msAcquireLock(TLOCK_PNGENCODER);
+  for(i=0; i<MS_PNG_ENCODERS; i++) {
+    if(pngEncoders[i].initialized)
+      deflateEnd(&pngEncoders[i].strm);
+    freePNGEncoderBuffers(&pngEncoders[i]);
+    memset(&pngEncoders[i],0,sizeof(pngEncoderObj));
+  }
+  msReleaseLock(TLOCK_PNGENCODER);
+}
+
+static int reservePNGBuffer(unsigned char **buf, size_t *size, size_t needed)
+{
+  if(*size < needed) {
+    unsigned char *newbuf = (unsigned char*)realloc(*buf, needed);
+    if(!newbuf)
+      return MS_FAILURE;
+    *buf = newbuf;
+    *size = needed;
+  }
+  return MS_SUCCESS;
+}
+
+/*
+** Writes one row of an RGB(A) buffer as plain RGB or non-premultiplied RGBA
+** bytes, as PNG and WebP want them.
+*/
+static void packRGBARow(rasterBufferObj *rb, int row, unsigned char *out)
+{
+  unsigned char *r,*g,*b;
+  int col;
+
+  r=rb->data.rgba.r+row*rb->data.rgba.row_step;
+  g=rb->data.rgba.g+row*rb->data.rgba.row_step;
+  b=rb->data.rgba.b+row*rb->data.rgba.row_step;
+  if(rb->data.rgba.a) {
+    unsigned char *a=rb->data.rgba.a+row*rb->data.rgba.row_step;
+    for(col=0; col<rb->width; col++) {
+      if(*a) {
+        double da = *a/255.0;
+        out[0] = *r/da;
+        out[1] = *g/da;
+        out[2] = *b/da;
+        out[3] = *a;
+      } else {
+        out[0] = out[1] = out[2] = out[3] = 0;
+      }
+      out+=4;
+      a+=rb->data.rgba.pixel_step;
+      r+=rb->data.rgba.pixel_step;
+      g+=rb->data.rgba.pixel_step;
+      b+=rb->data.rgba.pixel_step;
+    }
+  } else {
+    for(col=0; col<rb->width; col++) {
+      out[0] = *r;
+      out[1] = *g;
+      out[2] = *b;
+      out+=3;
+      r+=rb->data.rgba.pixel_step;
+      g+=rb->data.rgba.pixel_step;
+      b+=rb->data.rgba.pixel_step;
+    }
+  }
+}
+
+/*
+** Writes one row as it is stored in the PNG data stream, i.e. preceded by
+** its filter type, which is either "none" or "sub" (PNG_FILTER_SUB) as set
+** up for libpng in the other writers.
+*/
+static void packRowForPNG(rasterBufferObj *rb, int row, int sample_depth, int filter,
+                          unsigned char *out)
+{
+  int col, bpp, rowbytes;
+
+  *(out++) = (filter == PNG_FILTER_SUB) ? PNG_FILTER_VALUE_SUB : PNG_FILTER_VALUE_NONE;
+  if(rb->type == MS_BUFFER_BYTE_PALETTE) {
+    unsigned char *src = rb->data.palette.pixels + row*rb->width;
+    if(sample_depth == 8) {
+      memcpy(out, src, rb->width);
+    } else {
+      int per_byte = 8 / sample_depth;
+      memset(out, 0, (rb->width*sample_depth+7)/8);
+      for(col=0; col<rb->width; col++)
+        out[col/per_byte] |= src[col] << (8 - sample_depth*(col%per_byte+1));
+    }
+    bpp = 1;
+    rowbytes = (rb->width*sample_depth+7)/8;
+  } else {
+    packRGBARow(rb, row, out);
+    bpp = rb->data.rgba.a ? 4 : 3;
+    rowbytes = rb->width * bpp;
+  }
+
+  if(filter == PNG_FILTER_SUB) {
+    for(col=rowbytes-1; col>=bpp; col--)
+      out[col] -= out[col-bpp];
+  }
+}
+
+typedef struct {
+  rasterBufferObj *rb;
+  int sample_depth;
+  int filter;
+  size_t rowbytes; /* including the filter type byte */
+  int rows_per_strip;
+  int nstrips;
+  int first_strip; /* of the current batch */
+  pngEncoderObj **encoders; /* one per strip of a batch */
+  size_t *rawlen;
+  size_t *outlen;
+  uLong *adler;
+  int failed;
+} pngStripsObj;
+
+/*
+** Deflates one strip into the encoder's output buffer, leaving 2 bytes
+** in front of it for the zlib header and 4 behind it for the adler32.
+*/
+static void deflatePNGStrip(void *data, int iTask)
+{
+  pngStripsObj *strips = (pngStripsObj*)data;
+  pngEncoderObj *enc = strips->encoders[iTask];
+  int strip = strips->first_strip + iTask;
+  int last = (strip == strips->nstrips-1);
+  int row0 = strip * strips->rows_per_strip;
+  int row1 = MS_MIN(row0 + strips->rows_per_strip, strips->rb->height);
+  int dictrows = 0, row;
+  size_t dictlen, rawlen;
+  unsigned char *p;
+
+  if(strip > 0)
+    dictrows = MS_MIN(row0, (int)((MS_PNG_DICT_BYTES + strips->rowbytes - 1) / strips->rowbytes));
+  dictlen = dictrows * strips->rowbytes;
+  rawlen = (row1 - row0) * strips->rowbytes;
+
+  if(reservePNGBuffer(&enc->raw, &enc->rawsize, dictlen + rawlen) != MS_SUCCESS) {
+    strips->failed = MS_TRUE;
+    return;
+  }
+  for(row = row0 - dictrows, p = enc->raw; row < row1; row++, p += strips->rowbytes)
+    packRowForPNG(strips->rb, row, strips->sample_depth, strips->filter, p);
+
+  if(deflateReset(&enc->strm) != Z_OK ||
+      reservePNGBuffer(&enc->out, &enc->outsize, 2 + deflateBound(&enc->strm, rawlen) + 16 + 4) != MS_SUCCESS) {
+    strips->failed = MS_TRUE;
+    return;
+  }
+  if(dictlen > 0) {
+    size_t len = MS_MIN(dictlen, MS_PNG_DICT_BYTES);
+    deflateSetDictionary(&enc->strm, enc->raw + dictlen - len, len);
+  }
+  enc->strm.next_in = enc->raw + dictlen;
+  enc->strm.avail_in = rawlen;
+  enc->strm.next_out = enc->out + 2;
+  enc->strm.avail_out = enc->outsize - 2 - 4;
+  if(deflate(&enc->strm, last ? Z_FINISH : Z_SYNC_FLUSH) != (last ? Z_STREAM_END : Z_OK) ||
+      enc->strm.avail_in != 0 || enc->strm.avail_out == 0) {
+    strips->failed = MS_TRUE;
+    return;
+  }
+  strips->rawlen[iTask] = rawlen;
+  strips->outlen[iTask] = enc->outsize - 2 - 4 - enc->strm.avail_out;
+  strips->adler[iTask] = adler32(adler32(0, NULL, 0), enc->raw + dictlen, rawlen);
+}
+
+static void writeImageData(streamInfo *info, unsigned char *data, size_t length)
+{
+  if(length == 0)
+    return;
+  if(info->fp)
+    msIO_fwrite(data,length,1,info->fp);
+  else
+    msBufferAppend(info->buffer,data,length);
+}
+
+static void putPNGUInt32(unsigned char *p, unsigned long v)
+{
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+static void writePNGChunk(streamInfo *info, const char *type, unsigned char *data, size_t length)
+{
+  unsigned char header[8], crc[4];
+  uLong chunk_crc;
+  putPNGUInt32(header, length);
+  memcpy(header+4, type, 4);
+  chunk_crc = crc32(crc32(0, NULL, 0), header+4, 4);
+  if(length > 0)
+    chunk_crc = crc32(chunk_crc, data, length);
+  putPNGUInt32(crc, chunk_crc);
+  writeImageData(info, header, 8);
+  writeImageData(info, data, length);
+  writeImageData(info, crc, 4);
+}
+
+/*
+** Writes a palette or RGB(A) buffer as PNG, deflating strips of rows on
+** nThreads threads.  The result decodes to the same pixels libpng would
+** have written, and is only a little larger since every strip sees the
+** rows before it.
+*/
+static int savePNGInStrips(rasterBufferObj *rb, streamInfo *info, int compression, int filter,
+                           int nThreads)
+{
+  static unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char ihdr[13];
+  pngStripsObj strips;
+  pngEncoderObj *encoders[MS_MAX_WORKER_THREADS];
+  size_t rawlen[MS_MAX_WORKER_THREADS], outlen[MS_MAX_WORKER_THREADS];
+  uLong adler[MS_MAX_WORKER_THREADS], total_adler = 0;
+  int color_type, level_flags, i, nacquired, status = MS_SUCCESS;
+  unsigned int zheader;
+
+  memset(&strips,0,sizeof(pngStripsObj));
+  strips.rb = rb;
+  strips.filter = filter;
+  if(rb->type == MS_BUFFER_BYTE_PALETTE) {
+    color_type = PNG_COLOR_TYPE_PALETTE;
+    if (rb->data.palette.num_entries <= 2)
+      strips.sample_depth = 1;
+    else if (rb->data.palette.num_entries <= 4)
+      strips.sample_depth = 2;
+    else if (rb->data.palette.num_entries <= 16)
+      strips.sample_depth = 4;
+    else
+      strips.sample_depth = 8;
+    strips.rowbytes = 1 + (rb->width*strips.sample_depth+7)/8;
+  } else if(rb->type == MS_BUFFER_BYTE_RGBA) {
+    color_type = rb->data.rgba.a ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB;
+    strips.sample_depth = 8;
+    strips.rowbytes = 1 + rb->width*(rb->data.rgba.a ? 4 : 3);
+  } else {
+    msSetError(MS_MISCERR,"Unknown buffer type","savePNGInStrips()");
+    return MS_FAILURE;
+  }
+
+  nThreads = MS_MAX(1, MS_MIN(nThreads, MS_MAX_WORKER_THREADS));
+  strips.rows_per_strip = MS_MAX(1, (int)(MS_PNG_STRIP_BYTES / strips.rowbytes));
+  strips.rows_per_strip = MS_MIN(strips.rows_per_strip, (rb->height + nThreads - 1) / nThreads);
+  strips.rows_per_strip = MS_MAX(1, strips.rows_per_strip);
+  strips.nstrips = (rb->height + strips.rows_per_strip - 1) / strips.rows_per_strip;
+  nThreads = MS_MIN(nThreads, strips.nstrips);
+  strips.encoders = encoders;
+  strips.rawlen = rawlen;
+  strips.outlen = outlen;
+  strips.adler = adler;
+
+  for(nacquired=0; nacquired<nThreads; nacquired++) {
+    if((encoders[nacquired] = acquirePNGEncoder(compression)) == NULL)
+      break;
+  }
+  if(nacquired < nThreads) {
+    for(i=0; i<nacquired; i++)
+      releasePNGEncoder(encoders[i]);
+    msSetError(MS_MEMERR,"failed to initialize zlib","savePNGInStrips()");
+    return MS_FAILURE;
+  }
+
+  writeImageData(info, signature, 8);
+  putPNGUInt32(ihdr, rb->width);
+  putPNGUInt32(ihdr+4, rb->height);
+  ihdr[8] = strips.sample_depth;
+  ihdr[9] = color_type;
+  ihdr[10] = ihdr[11] = ihdr[12] = 0; /* deflate, adaptive filtering, no interlace */
+  writePNGChunk(info, "IHDR", ihdr, 13);
+
+  if(rb->type == MS_BUFFER_BYTE_PALETTE) {
+    rgbPixel rgb[256];
+    unsigned char a[256];
+    int num_a;
+    if(remapPaletteForPNG(rb,rgb,a,&num_a) != MS_SUCCESS) {
+      status = MS_FAILURE;
+      goto done;
+    }
+    writePNGChunk(info, "PLTE", (unsigned char*)rgb, rb->data.palette.num_entries*3);
+    if(num_a)
+      writePNGChunk(info, "tRNS", a, num_a);
+  }
+
+  /* zlib header for a 32K window, with the level hint zlib itself would put */
+  if(compression == Z_DEFAULT_COMPRESSION || compression == 6)
+    level_flags = 2;
+  else if(compression < 2)
+    level_flags = 0;
+  else if(compression < 6)
+    level_flags = 1;
+  else
+    level_flags = 3;
+  zheader = (0x78 << 8) | (level_flags << 6);
+  zheader += 31 - zheader % 31;
+
+  for(strips.first_strip = 0; strips.first_strip < strips.nstrips; strips.first_strip += nThreads) {
+    int count = MS_MIN(nThreads, strips.nstrips - strips.first_strip);
+    msThreadRunTasks(nThreads, count, deflatePNGStrip, &strips);
+    if(strips.failed) {
+      msSetError(MS_MISCERR,"zlib compression failed","savePNGInStrips()");
+      status = MS_FAILURE;
+      goto done;
+    }
+    for(i=0; i<count; i++) {
+      int strip = strips.first_strip + i;
+      unsigned char *data = encoders[i]->out + 2;
+      size_t length = outlen[i];
+      total_adler = strip ? adler32_combine(total_adler, adler[i], rawlen[i]) : adler[i];
+      if(strip == 0) {
+        data -= 2;
+        data[0] = zheader >> 8;
+        data[1] = zheader & 0xff;
+        length += 2;
+      }
+      if(strip == strips.nstrips-1) {
+        putPNGUInt32(data + length, total_adler);
+        length += 4;
+      }
+      writePNGChunk(info, "IDAT", data, length);
+    }
+  }
+  writePNGChunk(info, "IEND", NULL, 0);
+
+done:
+  for(i=0; i<nThreads; i++)
+    releasePNGEncoder(encoders[i]);
+  return status;
+}
+
+int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression, int filter)
 {
   png_infop info_ptr;
   rgbPixel rgb[256];
@@ -321,7 +762,7 @@ int savePalettePNG(rasterBufferObj *rb, streamInfo *info, int compression)
     return (MS_FAILURE);
 
   png_set_compression_level(png_ptr, compression);
-  png_set_filter (png_ptr,0, PNG_FILTER_NONE);
+  png_set_filter (png_ptr,0, filter);
 
   info_ptr = png_create_info_struct(png_ptr);
   if (!info_ptr) {
@@ -427,19 +868,47 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
 
   int ret = MS_FAILURE;
 
-  const char *force_string,*zlib_compression;
+  const char *force_string,*zlib_compression,*threads;
   int compression = -1;
+  int filter = PNG_FILTER_NONE;
+  int nThreads = 1;
 
+  /*
+  ** FAST deflates at the lowest level, with rows filtered against the pixel
+  ** to their left so flat areas still compress well.  This is two to three
+  ** times faster than the default, and smaller on imagery.
+  */
   zlib_compression = msGetOutputFormatOption( format, "COMPRESSION", NULL);
-  if(zlib_compression && *zlib_compression) {
+  if(zlib_compression && strcasecmp(zlib_compression,"FAST") == 0) {
+    compression = 1;
+    filter = PNG_FILTER_SUB;
+  } else if(zlib_compression && *zlib_compression) {
     char *endptr;
     compression = strtol(zlib_compression,&endptr,10);
     if(*endptr || compression<-1 || compression>9) {
-      msSetError(MS_MISCERR,"failed to parse FORMATOPTION \"COMPRESSION=%s\", expecting integer from 0 to 9.","saveAsPNG()",zlib_compression);
+      msSetError(MS_MISCERR,"failed to parse FORMATOPTION \"COMPRESSION=%s\", expecting integer from 0 to 9 or FAST.","saveAsPNG()",zlib_compression);
       return MS_FAILURE;
     }
   }
 
+  /* deflate on several threads, from COMPRESSION_THREADS or else MS_WORKER_THREADS */
+  threads = msGetOutputFormatOption( format, "COMPRESSION_THREADS", NULL);
+  if(threads && *threads) {
+    char *endptr;
+    nThreads = strtol(threads,&endptr,10);
+    if(*endptr || nThreads<1) {
+      msSetError(MS_MISCERR,"failed to parse FORMATOPTION \"COMPRESSION_THREADS=%s\", expecting a positive integer.","saveAsPNG()",threads);
+      return MS_FAILURE;
+    }
+  } else if(map) {
+    nThreads = msGetWorkerThreadCount(map, NULL);
+  }
+#ifndef USE_THREAD
+  nThreads = 1;
+#endif
+  if(rb->height < 2)
+    nThreads = 1;
+
 
   force_string = msGetOutputFormatOption( format, "QUANTIZE_FORCE", NULL );
   if( force_string && (strcasecmp(force_string,"on") == 0  || strcasecmp(force_string,"yes") == 0 || strcasecmp(force_string,"true") == 0) )
@@ -453,6 +922,7 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
     rasterBufferObj qrb;
     rgbaPixel palette[256], paletteGiven[256];
     unsigned int numPaletteGivenEntries;
+    unsigned int samplePixels = atoi(msGetOutputFormatOption( format, "QUANTIZE_SAMPLE", "0"));
     memset(&qrb,0,sizeof(rasterBufferObj));
     qrb.type = MS_BUFFER_BYTE_PALETTE;
     qrb.width = rb->width;
@@ -464,7 +934,7 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
       qrb.data.palette.num_entries = atoi(msGetOutputFormatOption( format, "QUANTIZE_COLORS", "256"));
       ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
                                    NULL, 0,
-                                   &qrb.data.palette.scaling_maxval);
+                                   &qrb.data.palette.scaling_maxval, samplePixels);
     } else {
       int colorsWanted = atoi(msGetOutputFormatOption( format, "QUANTIZE_COLORS", "0"));
       const char *palettePath = msGetOutputFormatOption( format, "PALETTE", "palette.txt");
@@ -489,15 +959,20 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
         qrb.data.palette.num_entries = MS_MAX(colorsWanted,numPaletteGivenEntries);
         ret = msQuantizeRasterBuffer(rb,&(qrb.data.palette.num_entries),qrb.data.palette.palette,
                                      paletteGiven,numPaletteGivenEntries,
-                                     &qrb.data.palette.scaling_maxval);
+                                     &qrb.data.palette.scaling_maxval, samplePixels);
       }
     }
     if(ret != MS_FAILURE) {
       ret = msClassifyRasterBuffer(rb,&qrb);
-      ret = savePalettePNG(&qrb,info,compression);
+      if(nThreads > 1)
+        ret = savePNGInStrips(&qrb,info,compression,filter,nThreads);
+      else
+        ret = savePalettePNG(&qrb,info,compression,filter);
     }
     msFree(qrb.data.palette.pixels);
     return ret;
+  } else if(rb->type == MS_BUFFER_BYTE_RGBA && nThreads > 1) {
+    return savePNGInStrips(rb,info,compression,filter,nThreads);
   } else if(rb->type == MS_BUFFER_BYTE_RGBA) {
     png_infop info_ptr;
     int color_type;
@@ -510,7 +985,7 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
       return (MS_FAILURE);
 
     png_set_compression_level(png_ptr, compression);
-    png_set_filter (png_ptr,0, PNG_FILTER_NONE);
+    png_set_filter (png_ptr,0, filter);
 
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
@@ -595,6 +1070,84 @@ int saveAsPNG(mapObj *map,rasterBufferObj *rb, streamInfo *info, outputFormatObj
   }
 }
 
+#ifdef USE_WEBP
+static int webp_write_data(const uint8_t *data, size_t data_size, const WebPPicture *picture)
+{
+  writeImageData((streamInfo*)picture->custom_ptr, (unsigned char*)data, data_size);
+  return 1;
+}
+
+/*
+** Encodes with libwebp, lossy by default.  FORMATOPTIONs are QUALITY (0-100,
+** default 75), LOSSLESS (default NO) and METHOD, the compression effort from
+** 0 (fastest) to 6 (smallest, default 4).
+*/
+int saveAsWEBP(mapObj *map, rasterBufferObj *rb, streamInfo *info, outputFormatObj *format)
+{
+  WebPConfig config;
+  WebPPicture picture;
+  const char *value;
+  unsigned char *pixels;
+  int quality, method, lossless, bytes_per_pixel, row, ok;
+
+  if(rb->type != MS_BUFFER_BYTE_RGBA) {
+    msSetError(MS_MISCERR,"Unknown buffer type","saveAsWEBP()");
+    return MS_FAILURE;
+  }
+
+  quality = atoi(msGetOutputFormatOption( format, "QUALITY", "75"));
+  method = atoi(msGetOutputFormatOption( format, "METHOD", "4"));
+  value = msGetOutputFormatOption( format, "LOSSLESS", "NO");
+  lossless = EQUAL(value, "YES") || EQUAL(value, "ON") || EQUAL(value, "TRUE");
+
+  if(!WebPConfigInit(&config) || !WebPPictureInit(&picture)) {
+    msSetError(MS_MISCERR,"libwebp version mismatch","saveAsWEBP()");
+    return MS_FAILURE;
+  }
+  config.quality = quality;
+  config.method = method;
+  config.lossless = lossless;
+  if(map && msGetWorkerThreadCount(map, NULL) > 1)
+    config.thread_level = 1;
+  if(!WebPValidateConfig(&config)) {
+    msSetError(MS_MISCERR,"invalid WebP FORMATOPTIONs QUALITY=%d METHOD=%d, expecting 0 to 100 and 0 to 6.",
+               "saveAsWEBP()", quality, method);
+    return MS_FAILURE;
+  }
+
+  bytes_per_pixel = rb->data.rgba.a ? 4 : 3;
+  pixels = (unsigned char*)malloc((size_t)rb->width * rb->height * bytes_per_pixel);
+  if(!pixels) {
+    msSetError(MS_MEMERR,"failed to allocate %dx%d image","saveAsWEBP()",rb->width,rb->height);
+    return MS_FAILURE;
+  }
+  for(row=0; row<rb->height; row++)
+    packRGBARow(rb, row, pixels + (size_t)row * rb->width * bytes_per_pixel);
+
+  picture.use_argb = lossless;
+  picture.width = rb->width;
+  picture.height = rb->height;
+  if(rb->data.rgba.a)
+    ok = WebPPictureImportRGBA(&picture, pixels, rb->width * 4);
+  else
+    ok = WebPPictureImportRGB(&picture, pixels, rb->width * 3);
+  free(pixels);
+  if(!ok) {
+    WebPPictureFree(&picture);
+    msSetError(MS_MEMERR,"failed to import %dx%d image","saveAsWEBP()",rb->width,rb->height);
+    return MS_FAILURE;
+  }
+
+  picture.writer = webp_write_data;
+  picture.custom_ptr = info;
+  ok = WebPEncode(&config, &picture);
+  if(!ok)
+    msSetError(MS_MISCERR,"libwebp encoding failed with error %d","saveAsWEBP()",(int)picture.error_code);
+  WebPPictureFree(&picture);
+  return ok ? MS_SUCCESS : MS_FAILURE;
+}
+#endif
+
 /* For platforms with incomplete ANSI defines. Fortunately,
    SEEK_SET is defined to be zero by the standard. */
 
@@ -726,6 +1279,14 @@ int msSaveRasterBuffer(mapObj *map, rasterBufferObj *rb, FILE *stream,
     info.buffer=NULL;
     
     return saveAsJPEG(map, rb,&info,format);
+#ifdef USE_WEBP
+  } else if(strcasestr(format->driver,"/webp")) {
+    streamInfo info;
+    info.fp = stream;
+    info.buffer = NULL;
+
+    return saveAsWEBP(map, rb,&info,format);
+#endif
   } else {
     msSetError(MS_MISCERR,"unsupported image format\n", "msSaveRasterBuffer()");
     return MS_FAILURE;
@@ -745,6 +1306,13 @@ int msSaveRasterBufferToBuffer(rasterBufferObj *data, bufferObj *buffer,
     info.fp = NULL;
     info.buffer=buffer;
     return saveAsJPEG(NULL, data,&info,format);
+#ifdef USE_WEBP
+  } else if(strcasestr(format->driver,"/webp")) {
+    streamInfo info;
+    info.fp = NULL;
+    info.buffer = buffer;
+    return saveAsWEBP(NULL, data,&info,format);
+#endif
   } else {
     msSetError(MS_MISCERR,"unsupported image format\n", "msSaveRasterBuffer()");
     return MS_FAILURE;
@@ -28,6 +28,9 @@
  ****************************************************************************/
 
 #include "mapserver.h"
+#include "mapthread.h"
+
+#include <sys/stat.h>
 
 
 
@@ -60,6 +63,7 @@ int msPOSTGRESQLJoinConnect(layerObj *layer, joinObj *join);
 int msPOSTGRESQLJoinPrepare(joinObj *join, shapeObj *shape);
 int msPOSTGRESQLJoinNext(joinObj *join);
 int msPOSTGRESQLJoinClose(joinObj *join);
+int msPOSTGRESQLJoinPrefetch(joinObj *join, char **values, int numvalues);
 
 /* wrapper function for DB specific join functions */
 int msJoinConnect(layerObj *layer, joinObj *join)
@@ -154,16 +158,450 @@ int msJoinClose(joinObj *join)
   return MS_FAILURE;
 }
 
+static int msJoinCompareValues(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+#define MS_JOIN_BATCH_SIZE 1000
+
+/*
+** Does the layer have a join that fetches its rows ahead? It has to be
+** connected. File based joins are always indexed in memory and need no
+** batches.
+*/
+static int msJoinBatchNeeded(layerObj *layer)
+{
+  int j;
+
+  for(j=0; j<layer->numjoins; j++) {
+    if(layer->joins[j].connectiontype == MS_DB_POSTGRES && layer->joins[j].joininfo)
+      return MS_TRUE;
+  }
+  return MS_FALSE;
+}
+
+/*
+** Fetch ahead the join rows of the distinct join values of a batch.
+*/
+static int msJoinPrefetch(layerObj *layer, joinObj *join, joinBatchObj *batch)
+{
+  int i, n, fromindex, status;
+  char **values;
+
+  for(fromindex=0; fromindex<layer->numitems; fromindex++) {
+    if(strcasecmp(layer->items[fromindex],join->from) == 0) break;
+  }
+  if(fromindex == layer->numitems)
+    return(MS_SUCCESS); /* msJoinConnect() reports that */
+
+  values = (char **) msSmallMalloc(sizeof(char *)*batch->numshapes);
+  n = 0;
+  for(i=0; i<batch->numshapes; i++) {
+    if(batch->shapes[i].values && fromindex < batch->shapes[i].numvalues)
+      values[n++] = batch->shapes[i].values[fromindex];
+  }
+
+  if(n > 1) {
+    int j = 0;
+    qsort(values, n, sizeof(char *), msJoinCompareValues);
+    for(i=1; i<n; i++) {
+      if(strcmp(values[i], values[j]) != 0)
+        values[++j] = values[i];
+    }
+    n = j+1;
+  }
+
+  status = msPOSTGRESQLJoinPrefetch(join, values, n);
+
+  free(values); /* the strings belong to the shapes */
+  return(status);
+}
+
+void msJoinBatchInit(joinBatchObj *batch)
+{
+  batch->shapes = NULL;
+  batch->first = batch->numshapes = 0;
+}
+
+void msJoinBatchFree(joinBatchObj *batch)
+{
+  int i;
+
+  for(i=0; i<batch->numshapes; i++)
+    msFreeShape(&(batch->shapes[i]));
+  msFree(batch->shapes);
+  msJoinBatchInit(batch);
+}
+
+/*
+** Reads the shape of result i of the layer result cache, like
+** msLayerGetShape(). When the layer has joins that would otherwise run a
+** query per shape, the shapes are read by batches of MS_JOIN_BATCH_SIZE
+** results whose join rows are fetched at once, and handed out one by one,
+** so each shape is read once. The results are expected in order, the
+** joins have to be connected and the batch freed with msJoinBatchFree().
+*/
+int msJoinGetResultShape(layerObj *layer, joinBatchObj *batch, int i, shapeObj *shape)
+{
+  int j, n, status;
+
+  if(!layer->resultcache || i < 0 || i >= layer->resultcache->numresults) {
+    msSetError(MS_MISCERR, "Invalid result index.", "msJoinGetResultShape()");
+    return(MS_FAILURE);
+  }
+
+  if(i < batch->first || i >= batch->first + batch->numshapes) {
+    /* a lone last result gains nothing from a batch */
+    if(!msJoinBatchNeeded(layer) || i == layer->resultcache->numresults - 1)
+      return msLayerGetShape(layer, shape, &(layer->resultcache->results[i]));
+
+    msJoinBatchFree(batch);
+    n = MS_MIN(MS_JOIN_BATCH_SIZE, layer->resultcache->numresults - i);
+    batch->shapes = (shapeObj *) msSmallMalloc(sizeof(shapeObj)*n);
+    batch->first = i;
+    for(j=0; j<n; j++) {
+      msInitShape(&(batch->shapes[j]));
+      if(msLayerGetShape(layer, &(batch->shapes[j]), &(layer->resultcache->results[i+j])) != MS_SUCCESS) {
+        msFreeShape(&(batch->shapes[j]));
+        break; /* the caller gets the error when it reaches that result */
+      }
+    }
+    batch->numshapes = j;
+    if(j == 0)
+      return msLayerGetShape(layer, shape, &(layer->resultcache->results[i]));
+
+    for(j=0; j<layer->numjoins; j++) {
+      if(layer->joins[j].connectiontype == MS_DB_POSTGRES && layer->joins[j].joininfo) {
+        status = msJoinPrefetch(layer, &(layer->joins[j]), batch);
+        if(status != MS_SUCCESS) {
+          msJoinBatchFree(batch);
+          return(status);
+        }
+      }
+    }
+  }
+
+  msFreeShape(shape);
+  *shape = batch->shapes[i - batch->first];
+  msInitShape(&(batch->shapes[i - batch->first]));
+
+  return(MS_SUCCESS);
+}
+
+/*  */
+/* in memory join tables */
+/*  */
+static unsigned int msJoinTableHash(const char *key)
+{
+  unsigned int h = 2166136261U;
+  for(; *key; key++) {
+    h ^= (unsigned char)*key;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+joinTableObj *msJoinTableCreate(int numitems, int keyindex)
+{
+  joinTableObj *table = (joinTableObj *) msSmallCalloc(1, sizeof(joinTableObj));
+
+  table->numitems = numitems;
+  table->keyindex = keyindex;
+
+  return table;
+}
+
+/*
+** Append a row of table->numitems values, the table takes ownership of it.
+*/
+void msJoinTableAddRow(joinTableObj *table, char **row)
+{
+  if(table->numrows == table->maxrows) {
+    table->maxrows = MS_MAX(ROW_ALLOCATION_SIZE, table->maxrows*2);
+    table->rows = (char ***) msSmallRealloc(table->rows, sizeof(char **)*table->maxrows);
+  }
+  table->rows[table->numrows++] = row;
+}
+
+/*
+** Build the hash index on the key column, to be done once all the rows are added.
+*/
+void msJoinTableIndex(joinTableObj *table)
+{
+  int i;
+  unsigned int b;
+
+  msFree(table->buckets);
+  msFree(table->next);
+
+  table->numbuckets = 1;
+  while(table->numbuckets < table->numrows) table->numbuckets *= 2;
+
+  table->buckets = (int *) msSmallMalloc(sizeof(int)*table->numbuckets);
+  table->next = (int *) msSmallMalloc(sizeof(int)*MS_MAX(table->numrows, 1));
+  for(i=0; i<table->numbuckets; i++)
+    table->buckets[i] = -1;
+
+  /* insert backwards so that the chains are in table order */
+  for(i=table->numrows-1; i>=0; i--) {
+    b = msJoinTableHash(table->rows[i][table->keyindex]) & (table->numbuckets - 1);
+    table->next[i] = table->buckets[b];
+    table->buckets[b] = i;
+  }
+}
+
+/*
+** Returns the next row after row whose key matches, -1 if there are no more.
+*/
+int msJoinTableFindNext(joinTableObj *table, const char *key, int row)
+{
+  if(!table->buckets || row < 0) return -1;
+
+  for(row=table->next[row]; row != -1; row=table->next[row]) {
+    if(strcmp(key, table->rows[row][table->keyindex]) == 0) break;
+  }
+  return row;
+}
+
+/*
+** Returns the first row whose key matches, -1 if none.
+*/
+int msJoinTableFind(joinTableObj *table, const char *key)
+{
+  int row;
+
+  if(!table->buckets) return -1;
+
+  row = table->buckets[msJoinTableHash(key) & (table->numbuckets - 1)];
+  if(row != -1 && strcmp(key, table->rows[row][table->keyindex]) != 0)
+    row = msJoinTableFindNext(table, key, row);
+  return row;
+}
+
+void msJoinTableFree(joinTableObj *table)
+{
+  int i;
+
+  if(!table) return;
+
+  for(i=0; i<table->numrows; i++)
+    msFreeCharArray(table->rows[i], table->numitems);
+  msFree(table->rows);
+  msFree(table->buckets);
+  msFree(table->next);
+  msFree(table);
+}
+
+/*  */
+/* process wide cache of the file based join tables */
+/*  */
+typedef struct joinCacheEntryObj {
+  char *path; /* file the table was read from */
+  char *to; /* join column */
+  int connectiontype;
+  time_t mtime;
+  off_t size;
+
+  char **items;
+  joinTableObj *table;
+
+  int refcount; /* joins using the entry */
+  int stale; /* file changed, free the entry once unused */
+  struct joinCacheEntryObj *next;
+} joinCacheEntryObj;
+
+static joinCacheEntryObj *joinCache = NULL;
+
+static void msJoinCacheFreeEntry(joinCacheEntryObj *entry)
+{
+  if(entry->table)
+    msFreeCharArray(entry->items, entry->table->numitems);
+  msJoinTableFree(entry->table);
+  msFree(entry->path);
+  msFree(entry->to);
+  msFree(entry);
+}
+
+/*
+** Returns the cached table of a join file, loading it with load() if it
+** is not cached yet or if the file changed since it was loaded. The file
+** is read outside of the lock, and the table published under it; when two
+** threads load the same file the first one published is kept. The entry
+** has to be released with msJoinCacheRelease().
+*/
+static joinCacheEntryObj *msJoinCacheAcquire(const char *path, joinObj *join,
+    int (*load)(joinCacheEntryObj *, joinObj *))
+{
+  joinCacheEntryObj *entry, *loaded, **link;
+  struct stat st;
+
+  if(stat(path, &st) != 0) {
+    msSetError(MS_IOERR, "(%s)", "msJoinCacheAcquire()", path);
+    return NULL;
+  }
+
+  /* look for a current entry, dropping an outdated one */
+  msAcquireLock(TLOCK_JOINCACHE);
+  for(link=&joinCache; *link; link=&((*link)->next)) {
+    entry = *link;
+    if(entry->connectiontype != join->connectiontype || strcmp(entry->path, path) != 0 ||
+        strcmp(entry->to, join->to) != 0)
+      continue;
+
+    if(entry->mtime == st.st_mtime && entry->size == st.st_size) {
+      entry->refcount++;
+      msReleaseLock(TLOCK_JOINCACHE);
+      return entry;
+    }
+
+    /* the file changed, drop the entry */
+    *link = entry->next;
+    if(entry->refcount == 0)
+      msJoinCacheFreeEntry(entry);
+    else
+      entry->stale = MS_TRUE;
+    break;
+  }
+  msReleaseLock(TLOCK_JOINCACHE);
+
+  loaded = (joinCacheEntryObj *) msSmallCalloc(1, sizeof(joinCacheEntryObj));
+  loaded->path = msStrdup(path);
+  loaded->to = msStrdup(join->to);
+  loaded->connectiontype = join->connectiontype;
+  loaded->mtime = st.st_mtime;
+  loaded->size = st.st_size;
+
+  if(load(loaded, join) != MS_SUCCESS) {
+    msJoinCacheFreeEntry(loaded);
+    return NULL;
+  }
+
+  /* publish the table, unless another thread did meanwhile */
+  msAcquireLock(TLOCK_JOINCACHE);
+  for(entry=joinCache; entry; entry=entry->next) {
+    if(entry->connectiontype == loaded->connectiontype && strcmp(entry->path, path) == 0 &&
+        strcmp(entry->to, join->to) == 0 && entry->mtime == loaded->mtime && entry->size == loaded->size)
+      break;
+  }
+  if(entry) {
+    entry->refcount++;
+    msReleaseLock(TLOCK_JOINCACHE);
+    msJoinCacheFreeEntry(loaded);
+    return entry;
+  }
+
+  loaded->refcount = 1;
+  loaded->next = joinCache;
+  joinCache = loaded;
+  msReleaseLock(TLOCK_JOINCACHE);
+
+  return loaded;
+}
+
+static void msJoinCacheRelease(joinCacheEntryObj *entry)
+{
+  if(!entry) return;
+
+  msAcquireLock(TLOCK_JOINCACHE);
+  entry->refcount--;
+  if(entry->stale && entry->refcount == 0)
+    msJoinCacheFreeEntry(entry);
+  msReleaseLock(TLOCK_JOINCACHE);
+}
+
+void msJoinCacheCleanup(void)
+{
+  joinCacheEntryObj *entry;
+
+  msAcquireLock(TLOCK_JOINCACHE);
+  while(joinCache) {
+    entry = joinCache;
+    joinCache = entry->next;
+    msJoinCacheFreeEntry(entry);
+  }
+  msReleaseLock(TLOCK_JOINCACHE);
+}
+
+/*
+** Path of a join table file, relative to the shapepath or to the mapfile.
+*/
+static char *msJoinFilePath(char *szPath, layerObj *layer, joinObj *join)
+{
+  struct stat st;
+
+  if(stat(msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, join->table), &st) != 0)
+    msBuildPath(szPath, layer->map->mappath, join->table);
+  return szPath;
+}
+
+/*
+** Copy a row of a join table to the join values.
+*/
+static int msJoinCopyRow(joinObj *join, char **row)
+{
+  int i;
+
+  if((join->values = (char **)malloc(sizeof(char *)*join->numitems)) == NULL) {
+    msSetError(MS_MEMERR, NULL, "msJoinCopyRow()");
+    return(MS_FAILURE);
+  }
+  for(i=0; i<join->numitems; i++)
+    join->values[i] = msStrdup(row ? row[i] : "\0"); /* no row, zero length strings */
+
+  return(MS_SUCCESS);
+}
+
 /*  */
 /* XBASE join functions */
 /*  */
 typedef struct {
-  DBFHandle hDBF;
+  joinCacheEntryObj *entry;
   int fromindex, toindex;
   char *target;
   int nextrecord;
 } msDBFJoinInfo;
 
+static int msDBFJoinLoad(joinCacheEntryObj *entry, joinObj *join)
+{
+  DBFHandle hDBF;
+  int i, n, toindex;
+
+  if((hDBF = msDBFOpen(entry->path, "rb")) == NULL) {
+    msSetError(MS_IOERR, "(%s)", "msDBFJoinConnect()", join->table);
+    return(MS_FAILURE);
+  }
+
+  /* get "to" item index */
+  if((toindex = msDBFGetItemIndex(hDBF, join->to)) == -1) {
+    msSetError(MS_DBFERR, "Item %s not found in table %s.", "msDBFJoinConnect()", join->to, join->table);
+    msDBFClose(hDBF);
+    return(MS_FAILURE);
+  }
+
+  entry->items = msDBFGetItems(hDBF);
+  if(!entry->items) {
+    msDBFClose(hDBF);
+    return(MS_FAILURE);
+  }
+
+  entry->table = msJoinTableCreate(msDBFGetFieldCount(hDBF), toindex);
+  n = msDBFGetRecordCount(hDBF);
+  for(i=0; i<n; i++) {
+    char **row = msDBFGetValues(hDBF, i);
+    if(!row) {
+      msDBFClose(hDBF);
+      return(MS_FAILURE);
+    }
+    msJoinTableAddRow(entry->table, row);
+  }
+  msJoinTableIndex(entry->table);
+
+  msDBFClose(hDBF);
+
+  return(MS_SUCCESS);
+}
+
 int msDBFJoinConnect(layerObj *layer, joinObj *join)
 {
   int i;
@@ -184,24 +622,17 @@ int msDBFJoinConnect(layerObj *layer, joinObj *join)
   }
 
   /* initialize any members that won't get set later on in this function */
+  joininfo->entry = NULL;
   joininfo->target = NULL;
-  joininfo->nextrecord = 0;
+  joininfo->nextrecord = -1;
 
   join->joininfo = joininfo;
 
-  /* open the XBase file */
-  if((joininfo->hDBF = msDBFOpen( msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, join->table), "rb" )) == NULL) {
-    if((joininfo->hDBF = msDBFOpen( msBuildPath(szPath, layer->map->mappath, join->table), "rb" )) == NULL) {
-      msSetError(MS_IOERR, "(%s)", "msDBFJoinConnect()", join->table);
-      return(MS_FAILURE);
-    }
-  }
-
-  /* get "to" item index */
-  if((joininfo->toindex = msDBFGetItemIndex(joininfo->hDBF, join->to)) == -1) {
-    msSetError(MS_DBFERR, "Item %s not found in table %s.", "msDBFJoinConnect()", join->to, join->table);
+  /* get the XBase file, loaded once per process and hashed on the "to" item */
+  if((joininfo->entry = msJoinCacheAcquire(msJoinFilePath(szPath, layer, join), join, msDBFJoinLoad)) == NULL)
     return(MS_FAILURE);
-  }
+
+  joininfo->toindex = joininfo->entry->table->keyindex;
 
   /* get "from" item index   */
   for(i=0; i<layer->numitems; i++) {
@@ -217,9 +648,13 @@ int msDBFJoinConnect(layerObj *layer, joinObj *join)
   }
 
   /* finally store away the item names in the XBase table */
-  join->numitems =  msDBFGetFieldCount(joininfo->hDBF);
-  join->items = msDBFGetItems(joininfo->hDBF);
-  if(!join->items) return(MS_FAILURE);
+  join->numitems = joininfo->entry->table->numitems;
+  if((join->items = (char **)malloc(sizeof(char *)*join->numitems)) == NULL) {
+    msSetError(MS_MEMERR, NULL, "msDBFJoinConnect()");
+    return(MS_FAILURE);
+  }
+  for(i=0; i<join->numitems; i++)
+    join->items[i] = msStrdup(joininfo->entry->items[i]);
 
   return(MS_SUCCESS);
 }
@@ -243,17 +678,18 @@ int msDBFJoinPrepare(joinObj *join, shapeObj *shape)
     return(MS_FAILURE);
   }
 
-  joininfo->nextrecord = 0; /* starting with the first record */
-
   if(joininfo->target) free(joininfo->target); /* clear last target */
   joininfo->target = msStrdup(shape->values[joininfo->fromindex]);
 
+  /* starting with the first matching record */
+  joininfo->nextrecord = msJoinTableFind(joininfo->entry->table, joininfo->target);
+
   return(MS_SUCCESS);
 }
 
 int msDBFJoinNext(joinObj *join)
 {
-  int i, n;
+  int i;
   msDBFJoinInfo *joininfo = join->joininfo;
 
   if(!joininfo) {
@@ -272,28 +708,19 @@ int msDBFJoinNext(joinObj *join)
     join->values = NULL;
   }
 
-  n = msDBFGetRecordCount(joininfo->hDBF);
+  i = joininfo->nextrecord;
 
-  for(i=joininfo->nextrecord; i<n; i++) { /* find a match */
-    if(strcmp(joininfo->target, msDBFReadStringAttribute(joininfo->hDBF, i, joininfo->toindex)) == 0) break;
-  }
-
-  if(i == n) { /* unable to do the join */
-    if((join->values = (char **)malloc(sizeof(char *)*join->numitems)) == NULL) {
-      msSetError(MS_MEMERR, NULL, "msDBFJoinNext()");
+  if(i == -1) { /* unable to do the join */
+    if(msJoinCopyRow(join, NULL) != MS_SUCCESS)
       return(MS_FAILURE);
-    }
-    for(i=0; i<join->numitems; i++)
-      join->values[i] = msStrdup("\0"); /* intialize to zero length strings */
-
-    joininfo->nextrecord = n;
     return(MS_DONE);
   }
 
-  if((join->values = msDBFGetValues(joininfo->hDBF,i)) == NULL)
+  if(msJoinCopyRow(join, joininfo->entry->table->rows[i]) != MS_SUCCESS)
     return(MS_FAILURE);
 
-  joininfo->nextrecord = i+1; /* so we know where to start looking next time through */
+  /* so we know where to start looking next time through */
+  joininfo->nextrecord = msJoinTableFindNext(joininfo->entry->table, joininfo->target, i);
 
   return(MS_SUCCESS);
 }
@@ -304,7 +731,7 @@ int msDBFJoinClose(joinObj *join)
 
   if(!joininfo) return(MS_SUCCESS); /* already closed */
 
-  if(joininfo->hDBF) msDBFClose(joininfo->hDBF);
+  msJoinCacheRelease(joininfo->entry);
   if(joininfo->target) free(joininfo->target);
   free(joininfo);
   joininfo = NULL;
@@ -316,20 +743,84 @@ int msDBFJoinClose(joinObj *join)
 /* CSV (comma separated value) join functions */
 /*  */
 typedef struct {
+  joinCacheEntryObj *entry;
   int fromindex, toindex;
   char *target;
-  char ***rows;
-  int numrows;
   int nextrow;
 } msCSVJoinInfo;
 
+static int msCSVJoinLoad(joinCacheEntryObj *entry, joinObj *join)
+{
+  int i, numrows = 0, numitems = 0, *rowitems;
+  FILE *stream;
+  char ***rows;
+  char buffer[MS_BUFFER_LENGTH];
+
+  if((stream = fopen(entry->path, "r")) == NULL) {
+    msSetError(MS_IOERR, "(%s)", "msCSVJoinConnect()", join->table);
+    return(MS_FAILURE);
+  }
+
+  /* once through to get the number of rows */
+  while(fgets(buffer, MS_BUFFER_LENGTH, stream) != NULL) numrows++;
+  rewind(stream);
+
+  rows = (char ***) msSmallMalloc(MS_MAX(numrows, 1)*sizeof(char **));
+  rowitems = (int *) msSmallMalloc(MS_MAX(numrows, 1)*sizeof(int));
+
+  /* load the rows */
+  i = 0;
+  while(i < numrows && fgets(buffer, MS_BUFFER_LENGTH, stream) != NULL) {
+    msStringTrimEOL(buffer);
+    rows[i] = msStringSplitComplex(buffer, ",", &(rowitems[i]), MS_ALLOWEMPTYTOKENS);
+    numitems = rowitems[i];
+    i++;
+  }
+  numrows = i;
+  fclose(stream);
+
+  /* get "to" index (for now the user tells us which column, 1..n) */
+  i = atoi(join->to) - 1;
+  if(i < 0 || i >= numitems) {
+    msSetError(MS_JOINERR, "Invalid column index %s.", "msCSVJoinConnect()", join->to);
+    for(i=0; i<numrows; i++)
+      msFreeCharArray(rows[i], rowitems[i]);
+    free(rows);
+    free(rowitems);
+    return(MS_FAILURE);
+  }
+
+  /* the column count is the one of the last row, pad or trim the others to it */
+  entry->table = msJoinTableCreate(numitems, i);
+  for(i=0; i<numrows; i++) {
+    int j;
+    char **row = (char **) msSmallMalloc(sizeof(char *)*MS_MAX(numitems, 1));
+    for(j=0; j<numitems; j++)
+      row[j] = (j < rowitems[i]) ? rows[i][j] : msStrdup("");
+    for(; j<rowitems[i]; j++)
+      free(rows[i][j]);
+    free(rows[i]);
+    msJoinTableAddRow(entry->table, row);
+  }
+  free(rows);
+  free(rowitems);
+  msJoinTableIndex(entry->table);
+
+  /* store away the column names (1..n) */
+  entry->items = (char **) msSmallMalloc(sizeof(char *)*MS_MAX(numitems, 1));
+  for(i=0; i<numitems; i++) {
+    entry->items[i] = (char *) msSmallMalloc(8); /* plenty of space */
+    sprintf(entry->items[i], "%d", i+1);
+  }
+
+  return(MS_SUCCESS);
+}
+
 int msCSVJoinConnect(layerObj *layer, joinObj *join)
 {
   int i;
-  FILE *stream;
   char szPath[MS_MAXPATHLEN];
   msCSVJoinInfo *joininfo;
-  char buffer[MS_BUFFER_LENGTH];
 
   if(join->joininfo) return(MS_SUCCESS); /* already open */
   if ( msCheckParentPointer(layer->map,"map")==MS_FAILURE )
@@ -343,38 +834,17 @@ int msCSVJoinConnect(layerObj *layer, joinObj *join)
   }
 
   /* initialize any members that won't get set later on in this function */
+  joininfo->entry = NULL;
   joininfo->target = NULL;
-  joininfo->nextrow = 0;
+  joininfo->nextrow = -1;
 
   join->joininfo = joininfo;
 
-  /* open the CSV file */
-  if((stream = fopen( msBuildPath3(szPath, layer->map->mappath, layer->map->shapepath, join->table), "r" )) == NULL) {
-    if((stream = fopen( msBuildPath(szPath, layer->map->mappath, join->table), "r" )) == NULL) {
-      msSetError(MS_IOERR, "(%s)", "msCSVJoinConnect()", join->table);
-      return(MS_FAILURE);
-    }
-  }
-
-  /* once through to get the number of rows */
-  joininfo->numrows = 0;
-  while(fgets(buffer, MS_BUFFER_LENGTH, stream) != NULL) joininfo->numrows++;
-  rewind(stream);
-
-  if((joininfo->rows = (char ***) malloc(joininfo->numrows*sizeof(char **))) == NULL) {
-    fclose(stream);
-    msSetError(MS_MEMERR, "Error allocating rows.", "msCSVJoinConnect()");
+  /* get the CSV file, loaded once per process and hashed on the "to" column */
+  if((joininfo->entry = msJoinCacheAcquire(msJoinFilePath(szPath, layer, join), join, msCSVJoinLoad)) == NULL)
     return(MS_FAILURE);
-  }
 
-  /* load the rows */
-  i = 0;
-  while(fgets(buffer, MS_BUFFER_LENGTH, stream) != NULL) {
-    msStringTrimEOL(buffer);
-    joininfo->rows[i] = msStringSplitComplex(buffer, ",", &(join->numitems), MS_ALLOWEMPTYTOKENS);
-    i++;
-  }
-  fclose(stream);
+  joininfo->toindex = joininfo->entry->table->keyindex;
 
   /* get "from" item index   */
   for(i=0; i<layer->numitems; i++) {
@@ -389,22 +859,14 @@ int msCSVJoinConnect(layerObj *layer, joinObj *join)
     return(MS_FAILURE);
   }
 
-  /* get "to" index (for now the user tells us which column, 1..n) */
-  joininfo->toindex = atoi(join->to) - 1;
-  if(joininfo->toindex < 0 || joininfo->toindex > join->numitems) {
-    msSetError(MS_JOINERR, "Invalid column index %s.", "msCSVJoinConnect()", join->to);
-    return(MS_FAILURE);
-  }
-
   /* store away the column names (1..n) */
-  if((join->items = (char **) malloc(sizeof(char *)*join->numitems)) == NULL) {
+  join->numitems = joininfo->entry->table->numitems;
+  if((join->items = (char **) malloc(sizeof(char *)*MS_MAX(join->numitems, 1))) == NULL) {
     msSetError(MS_MEMERR, "Error allocating space for join item names.", "msCSVJoinConnect()");
     return(MS_FAILURE);
   }
-  for(i=0; i<join->numitems; i++) {
-    join->items[i] = (char *) malloc(8); /* plenty of space */
-    sprintf(join->items[i], "%d", i+1);
-  }
+  for(i=0; i<join->numitems; i++)
+    join->items[i] = msStrdup(joininfo->entry->items[i]);
 
   return(MS_SUCCESS);
 }
@@ -428,17 +890,18 @@ int msCSVJoinPrepare(joinObj *join, shapeObj *shape)
     return(MS_FAILURE);
   }
 
-  joininfo->nextrow = 0; /* starting with the first record */
-
   if(joininfo->target) free(joininfo->target); /* clear last target */
   joininfo->target = msStrdup(shape->values[joininfo->fromindex]);
 
+  /* starting with the first matching row */
+  joininfo->nextrow = msJoinTableFind(joininfo->entry->table, joininfo->target);
+
   return(MS_SUCCESS);
 }
 
 int msCSVJoinNext(joinObj *join)
 {
-  int i,j;
+  int i;
   msCSVJoinInfo *joininfo = join->joininfo;
 
   if(!joininfo) {
@@ -452,41 +915,30 @@ int msCSVJoinNext(joinObj *join)
     join->values = NULL;
   }
 
-  for(i=joininfo->nextrow; i<joininfo->numrows; i++) { /* find a match     */
-    if(strcmp(joininfo->target, joininfo->rows[i][joininfo->toindex]) == 0) break;
-  }
+  i = joininfo->nextrow;
 
-  if((join->values = (char ** )malloc(sizeof(char *)*join->numitems)) == NULL) {
-    msSetError(MS_MEMERR, NULL, "msCSVJoinNext()");
-    return(MS_FAILURE);
-  }
-
-  if(i == joininfo->numrows) { /* unable to do the join     */
-    for(j=0; j<join->numitems; j++)
-      join->values[j] = msStrdup("\0"); /* intialize to zero length strings */
-
-    joininfo->nextrow = joininfo->numrows;
+  if(i == -1) { /* unable to do the join     */
+    if(msJoinCopyRow(join, NULL) != MS_SUCCESS)
+      return(MS_FAILURE);
     return(MS_DONE);
   }
 
-  for(j=0; j<join->numitems; j++)
-    join->values[j] = msStrdup(joininfo->rows[i][j]);
+  if(msJoinCopyRow(join, joininfo->entry->table->rows[i]) != MS_SUCCESS)
+    return(MS_FAILURE);
 
-  joininfo->nextrow = i+1; /* so we know where to start looking next time through */
+  /* so we know where to start looking next time through */
+  joininfo->nextrow = msJoinTableFindNext(joininfo->entry->table, joininfo->target, i);
 
   return(MS_SUCCESS);
 }
 
 int msCSVJoinClose(joinObj *join)
 {
-  int i;
   msCSVJoinInfo *joininfo = join->joininfo;
 
   if(!joininfo) return(MS_SUCCESS); /* already closed */
 
-  for(i=0; i<joininfo->numrows; i++)
-    msFreeCharArray(joininfo->rows[i], join->numitems);
-  free(joininfo->rows);
+  msJoinCacheRelease(joininfo->entry);
   if(joininfo->target) free(joininfo->target);
   free(joininfo);
   joininfo = NULL;
@@ -494,7 +946,6 @@ int msCSVJoinClose(joinObj *join)
   return(MS_SUCCESS);
 }
 
-
 #ifdef USE_MYSQL
 
 #ifndef _mysql_h
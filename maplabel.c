@@ -273,6 +273,24 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   ts->rotation = l->angle * MS_DEG_TO_RAD;
 }
 
+/*
+** Returns the arena the label cache keeps its textsymbols in, creating it
+** from the map arena on first use. A textSymbolObj handed over to
+** msAddLabel() must come from msArenaAlloc() on this arena (NULL when
+** arenas are disabled, see maparena.c).
+*/
+arenaObj *msGetLabelCacheArena(mapObj *map)
+{
+  int p;
+
+  if(map->labelcache.arena == NULL) {
+    map->labelcache.arena = msArenaCreate(msMapGetArena(map));
+    for(p=0; p<MS_MAX_LABEL_PRIORITY; p++)
+      map->labelcache.slots[p].arena = map->labelcache.arena;
+  }
+  return map->labelcache.arena;
+}
+
 int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex, shapeObj *shape, pointObj *point, double featuresize)
 {
   int l,s, priority;
@@ -283,6 +301,7 @@ int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex
   classObj *classPtr=NULL;
   int numtextsymbols = 0;
   textSymbolObj **textsymbols, *ts;
+  arenaObj *arena;
 
   layerPtr = (GET_LAYER(map, layerindex)); /* set up a few pointers for clarity */
   classPtr = GET_LAYER(map, layerindex)->class[classindex];
@@ -318,7 +337,8 @@ int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex
     }
   }
   
-  textsymbols = msSmallMalloc(classPtr->numlabels * sizeof(textSymbolObj*));
+  arena = msGetLabelCacheArena(map);
+  textsymbols = msArenaAlloc(arena, classPtr->numlabels * sizeof(textSymbolObj*));
   
   for(l=0; l<classPtr->numlabels; l++) {
     labelObj *lbl = classPtr->labels[l];
@@ -336,7 +356,7 @@ int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex
         continue; /* no anno text, and no label symbols */
       }
     }
-    ts = msSmallMalloc(sizeof(textSymbolObj));
+    ts = msArenaAlloc(arena, sizeof(textSymbolObj));
     initTextSymbol(ts);
     msPopulateTextSymbolForLabelAndString(ts,lbl,annotext,layerPtr->scalefactor,image->resolutionfactor, 1);
   
@@ -346,7 +366,7 @@ int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex
       if(featuresize < (ts->textpath->bounds.bbox.maxx - ts->textpath->bounds.bbox.minx)) {
         /* feature is too big to be drawn, skip it */
         freeTextSymbol(ts);
-        free(ts);
+        msArenaFree(arena, ts);
         continue;
       }
     }
@@ -355,7 +375,7 @@ int msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex
   }
   
   if(numtextsymbols == 0) {
-    free(textsymbols);
+    msArenaFree(arena, textsymbols);
     return MS_SUCCESS;
   }
   
@@ -429,6 +449,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
   char *annotext = NULL;
   layerObj *layerPtr;
   classObj *classPtr;
+  arenaObj *arena = msGetLabelCacheArena(map);
 
   layerPtr=GET_LAYER(map,layerindex);
   assert(layerPtr);
@@ -453,7 +474,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
       /* label has no text or marker symbols */
       if(ts) {
         freeTextSymbol(ts);
-        free(ts);
+        msArenaFree(arena, ts);
       }
       return MS_SUCCESS;
     }
@@ -488,7 +509,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
             /* label point does not intersect mask */
             if(ts) {
               freeTextSymbol(ts);
-              free(ts);
+              msArenaFree(arena, ts);
             }
             return MS_SUCCESS;
           }
@@ -502,7 +523,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
             alphapixptr = rb.data.rgba.a + rb.data.rgba.row_step * y + rb.data.rgba.pixel_step*x;
             if (!*alphapixptr) {
               freeTextSymbol(ts);
-              free(ts);
+              msArenaFree(arena, ts);
               return MS_SUCCESS;
             }
           }
@@ -515,7 +536,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
   }
 
   if(!ts) {
-    ts = msSmallMalloc(sizeof(textSymbolObj));
+    ts = msArenaAlloc(arena, sizeof(textSymbolObj));
     initTextSymbol(ts);
     msPopulateTextSymbolForLabelAndString(ts,label,annotext,layerPtr->scalefactor,image->resolutionfactor, 1);
   }
@@ -528,7 +549,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
     if(featuresize > (ts->textpath->bounds.bbox.maxx - ts->textpath->bounds.bbox.minx)) {
       /* feature is too big to be drawn, skip it */
       freeTextSymbol(ts);
-      free(ts);
+      msArenaFree(arena, ts);
       return MS_SUCCESS;
     }
   }
@@ -575,7 +596,7 @@ int msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, in
 
   /* copy the label */
   cachePtr->numtextsymbols = 1;
-  cachePtr->textsymbols = (textSymbolObj **) msSmallMalloc(sizeof(textSymbolObj*));
+  cachePtr->textsymbols = (textSymbolObj **) msArenaAlloc(arena, sizeof(textSymbolObj*));
   cachePtr->textsymbols[0] = ts;
   cachePtr->markerid = -1;
 
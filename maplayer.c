@@ -259,6 +259,20 @@ int msLayerSupportsCommonFilters(layerObj *layer)
   return layer->vtable->LayerSupportsCommonFilters(layer);
 }
 
+/*
+** Returns MS_TRUE if the shapes the driver returns for a rect also depend on
+** the map scale, e.g. because they are generalized on the server.
+*/
+int msLayerDependsOnScale(layerObj *layer)
+{
+  if ( ! layer->vtable) {
+    int rv =  msInitializeVirtualTable(layer);
+    if (rv != MS_SUCCESS)
+      return MS_FALSE;
+  }
+  return layer->vtable->LayerDependsOnScale(layer);
+}
+
 int msLayerTranslateFilter(layerObj *layer, expressionObj *filter, char *filteritem)
 {
   if (!layer->vtable) {
@@ -281,14 +295,27 @@ int msLayerTranslateFilter(layerObj *layer, expressionObj *filter, char *filteri
 */
 int msLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
 {
+  int rv;
+
   if(!msLayerSupportsCommonFilters(layer))
     msLayerTranslateFilter(layer, &layer->filter, layer->filteritem);
 
   if ( ! layer->vtable) {
-    int rv =  msInitializeVirtualTable(layer);
+    rv =  msInitializeVirtualTable(layer);
     if (rv != MS_SUCCESS)
       return rv;
   }
+
+  /* shared feature cache: a hit doesn't touch the datasource at all */
+  if(!isQuery && msFeatureCacheEnabled(layer)) {
+    if(msFeatureCacheWhichShapes(layer, &rect, &rv))
+      return rv;
+    rv = layer->vtable->LayerWhichShapes(layer, rect, isQuery);
+    if(rv == MS_DONE)
+      msFeatureCacheStore(layer); /* cache the empty result too */
+    return rv;
+  }
+
   return layer->vtable->LayerWhichShapes(layer, rect, isQuery);
 }
 
@@ -326,7 +353,13 @@ int msLayerNextShape(layerObj *layer, shapeObj *shape)
 
   /* RFC 91: MapServer-based filtering is done at a more general level. */
   do {
-    rv = layer->vtable->LayerNextShape(layer, shape);
+    if(shape->recycle && (layer->featurecacheinfo || !layer->vtable->LayerSupportsShapeRecycling(layer)))
+      msFreeShape(shape); /* the buffers would be lost by msInitShape() */
+
+    if(layer->featurecacheinfo)
+      rv = msFeatureCacheNextShape(layer, shape);
+    else
+      rv = layer->vtable->LayerNextShape(layer, shape);
     if(rv != MS_SUCCESS) return rv;
 
     filter_passed = MS_TRUE;  /* By default accept ANY shape */
@@ -334,7 +367,10 @@ int msLayerNextShape(layerObj *layer, shapeObj *shape)
       filter_passed = msEvalExpression(layer, shape, &(layer->filter), layer->filteritemindex);
     // }
 
-    if(!filter_passed) msFreeShape(shape);
+    if(!filter_passed) {
+      if(shape->recycle) msRecycleShape(shape);
+      else msFreeShape(shape);
+    }
   } while(!filter_passed);
 
   /* RFC89 Apply Layer GeomTransform */
@@ -353,6 +389,19 @@ int msLayerNextShape(layerObj *layer, shapeObj *shape)
   return rv;
 }
 
+/*
+** Ends the use of a shape read with msLayerNextShape(): its buffers are kept
+** for the next feature (see msRecycleShape()) when the layer's driver reads
+** into them, else the shape is freed as there is nothing to keep them for.
+*/
+void msLayerRecycleShape(layerObj *layer, shapeObj *shape)
+{
+  if(!layer->featurecacheinfo && layer->vtable && layer->vtable->LayerSupportsShapeRecycling(layer))
+    msRecycleShape(shape);
+  else
+    msFreeShape(shape);
+}
+
 /*
 ** Used to retrieve a shape from a result set by index. Result sets are created by the various
 ** msQueryBy...() functions. The index is assigned by the data source.
@@ -437,6 +486,9 @@ void msLayerClose(layerObj *layer)
     }
   }
 
+  msLayerFreeClassIndex(layer);
+  msFeatureCacheLayerClose(layer);
+
   if (layer->vtable) {
     layer->vtable->LayerClose(layer);
   }
@@ -661,6 +713,7 @@ int msTokenizeExpression(expressionObj *expression, char **list, int *listsize)
       case MS_TOKEN_BINDING_TIME:
         node->token = token; /* binding type */
         node->tokenval.bindval.item = msStrdup(msyystring_buffer);
+        node->tokenval.bindval.index = -1;
         if(list) node->tokenval.bindval.index = string2list(list, listsize, msyystring_buffer);
         break;
       case MS_TOKEN_BINDING_SHAPE:
@@ -726,6 +779,10 @@ int msTokenizeExpression(expressionObj *expression, char **list, int *listsize)
   expression->curtoken = expression->tokens; /* point at the first token */
 
   msReleaseLock(TLOCK_PARSER);
+
+  /* evaluate without going through yyparse() for every shape when possible */
+  if(expression->type == MS_EXPRESSION) msCompileExpression(expression);
+
   return MS_SUCCESS;
 
 parse_error:
@@ -939,6 +996,9 @@ int msLayerWhichItems(layerObj *layer, int get_all, const char *metadata)
     }
   }
 
+  /* item indexes are known, index the class expressions */
+  msLayerBuildClassIndex(layer);
+
   /* populate the iteminfo array */
   if(layer->numitems == 0)
     return(MS_SUCCESS);
@@ -1689,6 +1749,17 @@ int msLayerDefaultGetPaging(layerObj *layer)
   return MS_FALSE;
 }
 
+/* drivers that do not know about msRecycleShape() get an empty shape */
+int msLayerDefaultSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_FALSE;
+}
+
+int msLayerDefaultDependsOnScale(layerObj *layer)
+{
+  return MS_FALSE;
+}
+
 void msLayerDefaultEnablePaging(layerObj *layer, int value)
 {
   return;
@@ -1829,6 +1900,8 @@ static int populateVirtualTable(layerVTableObj *vtable)
 
   vtable->LayerEnablePaging = msLayerDefaultEnablePaging;
   vtable->LayerGetPaging = msLayerDefaultGetPaging;
+  vtable->LayerSupportsShapeRecycling = msLayerDefaultSupportsShapeRecycling;
+  vtable->LayerDependsOnScale = msLayerDefaultDependsOnScale;
 
   return MS_SUCCESS;
 }
@@ -2062,6 +2135,12 @@ int msINLINELayerNextShape(layerObj *layer, shapeObj *shape)
   return(MS_SUCCESS);
 }
 
+/* msCopyShape() fills the buffers of a recycled shape */
+int msINLINELayerSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_TRUE;
+}
+
 int msINLINELayerGetNumFeatures(layerObj *layer)
 {
   int i = 0;
@@ -2137,6 +2216,7 @@ msINLINELayerInitializeVirtualTable(layerObj *layer)
 
   /* layer->vtable->LayerEnablePaging, use default */
   /* layer->vtable->LayerGetPaging, use default */
+  layer->vtable->LayerSupportsShapeRecycling = msINLINELayerSupportsShapeRecycling;
 
   return MS_SUCCESS;
 }
@@ -2180,6 +2180,9 @@ char *msyytext;
 #include "mapparser.h"
 #include "mapprimitive.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 /* msyylineno is required for flex 2.5.4 and older, but is already defined by
  * flex 2.5.31 (bug 975).
  * Unfortunately there is no clean way to differenciate the two versions,
@@ -2199,6 +2202,9 @@ double msyynumber;
 int msyystate=MS_TOKENIZE_DEFAULT;
 char *msyystring=NULL;
 char *msyybasepath=NULL;
+char **msyyincludes=NULL; /* files opened by INCLUDE, collected when msyytrackincludes is set */
+int msyynumincludes=0;
+int msyytrackincludes=MS_FALSE;
 char *msyystring_buffer_ptr;
 int  msyystring_buffer_size = 256;
 int  msyystring_size;
@@ -2215,15 +2221,15 @@ int msyyreturncomments = 0;
    if (string_size >= max_size) {         \
        msyystring_size_tmp = max_size;     \
        max_size = ((max_size*2) > string_size) ? max_size*2 : string_size+1;                     \
-       string = (char *) msSmallRealloc(string, sizeof(char *) * max_size);  \
+       string = (char *) msSmallRealloc(string, sizeof(char) * max_size);  \
        string_ptr = string;    \
        string_ptr += msyystring_size_tmp; \
    }
 
 #define MS_LEXER_RETURN_TOKEN(token) \
-   MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext),  \
+   MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng,  \
                            msyystring_buffer_size, msyystring_buffer_ptr); \
-   strcpy(msyystring_buffer, msyytext); \
+   memcpy(msyystring_buffer, msyytext, msyyleng + 1); \
    return(token); 
 
 #define MAX_INCLUDE_DEPTH 5
@@ -2232,6 +2238,17 @@ int include_lineno[MAX_INCLUDE_DEPTH];
 int include_stack_ptr = 0;
 char path[MS_MAXPATHLEN];
 
+/* contents of the mapfile ([0]) and of the INCLUDEs being scanned, see msyyscanfile() */
+char *include_data[MAX_INCLUDE_DEPTH+1];
+static YY_BUFFER_STATE msyyscanfiledata(FILE *fp, int depth);
+void msyyfreefiles(void);
+
+/* msyylex() wraps the generated scanner so that precompiled mapfiles can
+   record and replay the token stream, see mapfilecompile.c */
+#define YY_DECL int msyyscan(void)
+int (*msyyreplayhook)(void) = NULL;
+void (*msyyrecordhook)(int token) = NULL;
+
 
 
 
@@ -2422,7 +2439,8 @@ YY_DECL
            msyystring_buffer = (char*) msSmallMalloc(sizeof(char) * msyystring_buffer_size);
 
        msyystring_buffer[0] = '\0';
-       msyystring_buffer_size = 0;
+       if(msyystate != MS_TOKENIZE_DEFAULT)
+         msyyfreefiles(); /* the files scanned so far are done with */
        switch(msyystate) {
        case(MS_TOKENIZE_DEFAULT):
          break;
@@ -4188,11 +4206,10 @@ case 320:
 YY_RULE_SETUP
 #line 509 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-1] = '\0';
-                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext), 
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng, 
                                                                          msyystring_buffer_size, msyystring_buffer_ptr);
-                                                 strcpy(msyystring_buffer,msyytext);
+                                                 memcpy(msyystring_buffer, msyytext+1, msyyleng-2);
+                                                 msyystring_buffer[msyyleng-2] = '\0';
                                                  return(MS_BINDING);
                                                }
 	YY_BREAK
@@ -4302,11 +4319,10 @@ case 330:
 YY_RULE_SETUP
 #line 583 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-2] = '\0';
-                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext), 
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng, 
                                                                          msyystring_buffer_size, msyystring_buffer_ptr);
-                                                 strcpy(msyystring_buffer, msyytext);
+                                                 memcpy(msyystring_buffer, msyytext+1, msyyleng-3);
+                                                 msyystring_buffer[msyyleng-3] = '\0';
                                                  return(MS_IREGEX);
                                                }
 	YY_BREAK
@@ -4315,11 +4331,10 @@ case 331:
 YY_RULE_SETUP
 #line 592 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-1] = '\0';
-                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext), 
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng, 
                                                                          msyystring_buffer_size, msyystring_buffer_ptr);
-                                                 strcpy(msyystring_buffer, msyytext);
+                                                 memcpy(msyystring_buffer, msyytext+1, msyyleng-2);
+                                                 msyystring_buffer[msyyleng-2] = '\0';
                                                  return(MS_REGEX);
                                                }
 	YY_BREAK
@@ -4327,11 +4342,10 @@ case 332:
 YY_RULE_SETUP
 #line 601 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-1] = '\0';
-                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext), 
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng, 
                                                                          msyystring_buffer_size, msyystring_buffer_ptr);
-                                                 strcpy(msyystring_buffer, msyytext);
+                                                 memcpy(msyystring_buffer, msyytext+1, msyyleng-2);
+                                                 msyystring_buffer[msyyleng-2] = '\0';
                                                  return(MS_EXPRESSION);
                                                }
 	YY_BREAK
@@ -4339,11 +4353,10 @@ case 333:
 YY_RULE_SETUP
 #line 610 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-1] = '\0';
-                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, strlen(msyytext), 
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyyleng, 
                                                                          msyystring_buffer_size, msyystring_buffer_ptr);
-                                                 strcpy(msyystring_buffer, msyytext);
+                                                 memcpy(msyystring_buffer, msyytext+1, msyyleng-2);
+                                                 msyystring_buffer[msyyleng-2] = '\0';
                                                  return(MS_LIST);
                                                }
 	YY_BREAK
@@ -4410,13 +4423,12 @@ case 337:
 YY_RULE_SETUP
 #line 668 "maplexer.l"
 {
-                                                 char *yptr = msyytext;
-                                                 while ( *yptr ) { 
-                                                   MS_LEXER_STRING_REALLOC(msyystring_buffer, msyystring_size, 
-                                                                           msyystring_buffer_size, msyystring_buffer_ptr);
-                                                   ++msyystring_size;
-                                                   *msyystring_buffer_ptr++ = *yptr++;
-                                                 }
+                                                 MS_LEXER_STRING_REALLOC(msyystring_buffer, msyystring_size + msyyleng, 
+                                                                         msyystring_buffer_size, msyystring_buffer_ptr);
+                                                 msyystring_buffer_ptr = msyystring_buffer + msyystring_size;
+                                                 memcpy(msyystring_buffer_ptr, msyytext, msyyleng);
+                                                 msyystring_buffer_ptr += msyyleng;
+                                                 msyystring_size += msyyleng;
                                              }
 	YY_BREAK
 case 338:
@@ -4424,8 +4436,8 @@ case 338:
 YY_RULE_SETUP
 #line 678 "maplexer.l"
 {
-                                                 msyytext++;
-                                                 msyytext[strlen(msyytext)-1] = '\0';
+                                                 YY_BUFFER_STATE buffer;
+                                                 char quote = msyytext[msyyleng-1];
 
                                                  if(include_stack_ptr >= MAX_INCLUDE_DEPTH) {
                                                    msSetError(MS_IOERR, "Includes nested to deeply.", "msyylex()");
@@ -4436,14 +4448,24 @@ YY_RULE_SETUP
                                                  include_lineno[include_stack_ptr] = msyylineno;
                                                  include_stack_ptr++;
 
-                                                 msyyin = fopen(msBuildPath(path, msyybasepath, msyytext), "r");
+                                                 msyytext[msyyleng-1] = '\0';
+                                                 msyyin = fopen(msBuildPath(path, msyybasepath, msyytext+1), "r");
                                                  if(!msyyin) {
-                                                   msSetError(MS_IOERR, "Error opening included file \"%s\".", "msyylex()", msyytext);
+                                                   msSetError(MS_IOERR, "Error opening included file \"%s\".", "msyylex()", msyytext+1);
+                                                   msyytext[msyyleng-1] = quote;
                                                    msyyin = YY_CURRENT_BUFFER->yy_input_file;
                                                    return(-1);
                                                  }
+                                                 msyytext[msyyleng-1] = quote; /* leave the input as read, see msyyfiletext() */
 
-                                                 msyy_switch_to_buffer( msyy_create_buffer(msyyin, YY_BUF_SIZE) );
+                                                 if(msyytrackincludes) {
+                                                   msyyincludes = (char **) msSmallRealloc(msyyincludes, sizeof(char *) * (msyynumincludes+1));
+                                                   msyyincludes[msyynumincludes++] = msStrdup(path);
+                                                 }
+
+                                                 buffer = msyyscanfiledata(msyyin, include_stack_ptr);
+                                                 if(!buffer) /* not a regular file, read it in chunks */
+                                                   msyy_switch_to_buffer( msyy_create_buffer(msyyin, YY_BUF_SIZE) );
                                                  msyylineno = 1;
 
                                                  BEGIN(INITIAL);
@@ -4484,6 +4506,8 @@ case YY_STATE_EOF(INITIAL):
                                                   else {
                                                     fclose(YY_CURRENT_BUFFER->yy_input_file);
                                                     msyy_delete_buffer( YY_CURRENT_BUFFER );
+                                                    msFree(include_data[include_stack_ptr+1]);
+                                                    include_data[include_stack_ptr+1] = NULL;
                                                     msyy_switch_to_buffer(include_stack[include_stack_ptr]);
                                                     msyylineno = include_lineno[include_stack_ptr];
                                                   }
@@ -5536,3 +5560,109 @@ int msyyerror(char *s) {
   return(0);
 }
 
+int msyylex(void)
+{
+  int token;
+
+  /* calls setting up a new input are left alone */
+  if(msyystate != MS_TOKENIZE_DEFAULT)
+    return msyyscan();
+  if(msyyreplayhook)
+    return msyyreplayhook();
+  token = msyyscan();
+  if(msyyrecordhook)
+    msyyrecordhook(token);
+  return token;
+}
+
+/*
+** Mapfiles and INCLUDEs are read whole and scanned in place rather than
+** through flex's 16k read buffer, which costs a copy and a refill check per
+** chunk. Mapping the file instead measured slower: flex writes NULs into
+** its input to terminate tokens, so every page would be copied on write.
+** Returns NULL when fp is not a regular file.
+*/
+static YY_BUFFER_STATE msyyscanfiledata(FILE *fp, int depth)
+{
+  YY_BUFFER_STATE buffer;
+  struct stat st;
+  char *data;
+  size_t size;
+
+  if(fstat(fileno(fp), &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG || st.st_size <= 0)
+    return NULL;
+
+  data = (char *) msSmallMalloc((size_t) st.st_size + 2);
+  /* can come out shorter than st_size in text mode */
+  if(fseek(fp, 0, SEEK_SET) != 0 || (size = fread(data, 1, st.st_size, fp)) == 0 || ferror(fp)) {
+    msFree(data);
+    fseek(fp, 0, SEEK_SET);
+    return NULL;
+  }
+  data[size] = data[size + 1] = YY_END_OF_BUFFER_CHAR;
+
+  msFree(include_data[depth]);
+  include_data[depth] = data;
+  buffer = msyy_scan_buffer(data, size + 2);
+  buffer->yy_input_file = fp; /* still closed by whoever opened it */
+  msyyin = fp;
+  return buffer;
+}
+
+/*
+** Sets the scanner up to read fp from its start, like msyyrestart(fp) but
+** scanning the file in place. The memory is held until msyyfreefiles() or
+** until the lexer is set up for another input.
+*/
+void msyyscanfile(FILE *fp)
+{
+  msyyfreefiles();
+  msyy_delete_buffer(YY_CURRENT_BUFFER);
+  if(msyyscanfiledata(fp, 0) == NULL)
+    msyyrestart(fp);
+}
+
+/*
+** Releases the memory of the files being scanned, once they are done with
+** or abandoned on an error inside an INCLUDE.
+*/
+void msyyfreefiles(void)
+{
+  int i;
+
+  for(i=0; i<=MAX_INCLUDE_DEPTH; i++) {
+    if(include_data[i] == NULL)
+      continue;
+    /* flex writes to the buffer it switches away from */
+    if(YY_CURRENT_BUFFER && YY_CURRENT_BUFFER->yy_ch_buf == include_data[i])
+      msyy_delete_buffer(YY_CURRENT_BUFFER);
+    else if(i < include_stack_ptr && include_stack[i]->yy_ch_buf == include_data[i])
+      msyy_delete_buffer(include_stack[i]);
+    msFree(include_data[i]);
+    include_data[i] = NULL;
+  }
+  include_stack_ptr = 0;
+}
+
+/*
+** Offset of the scan position in the mapfile being scanned in place, or -1
+** while scanning an INCLUDE, a string or a replayed token stream. Text
+** behind the scan position is left as it was read, see msyyfiletext().
+*/
+long msyyfileoffset(void)
+{
+  if(msyyreplayhook || include_data[0] == NULL || YY_CURRENT_BUFFER == NULL ||
+      YY_CURRENT_BUFFER->yy_ch_buf != include_data[0])
+    return -1;
+  return (long) ((yy_c_buf_p) - include_data[0]);
+}
+
+/* Copies the mapfile text between two offsets given by msyyfileoffset(). */
+char *msyyfiletext(long start, long end)
+{
+  char *text = (char *) msSmallMalloc(end - start + 1);
+  memcpy(text, include_data[0] + start, end - start);
+  text[end - start] = '\0';
+  return text;
+}
+
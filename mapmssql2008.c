@@ -206,8 +206,32 @@ typedef struct ms_MSSQL2008_layer_info_t {
   msGeometryParserInfo gpi;   /* struct for the geometry parser */
   int geometry_format;        /* Geometry format to be retrieved from the database */
   tokenListNodeObjPtr current_node; /* filter expression translation */
+
+  /* block fetch state (PROCESSING MSSQL_FETCH_SIZE) */
+  SQLULEN     fetch_size;     /* rows per SQLFetchScroll call, 1 = row by row SQLFetch */
+  SQLLEN      cell_size;      /* largest bound column buffer cell, used for long columns */
+  SQLULEN     block_size;     /* rows per block, fetch_size bounded by MSSQL_MAX_BLOCK_BYTES */
+  int         num_bound;      /* number of columns bound to block_data */
+  char        *block_data;    /* column-wise bound value buffers */
+  SQLLEN      *block_ind;     /* column-wise length/indicator buffers */
+  SQLLEN      *block_cell;    /* cell size of each bound column */
+  size_t      *block_offset;  /* start of each bound column in block_data */
+  SQLULEN     block_rows;     /* rows returned by the last SQLFetchScroll */
+  SQLULEN     block_row;      /* current row within the block */
+
+  /* reusable SQLGetData buffer for the row by row path */
+  char        *value_buf;
+  SQLLEN      value_buf_size;
+
+  /* fetch statistics, reported at MS_DEBUGLEVEL_TUNING */
+  long        fetch_calls;
+  long        rows_fetched;
+  double      fetch_time;
 } msMSSQL2008LayerInfo;
 
+#define MSSQL_DEFAULT_CELL_SIZE 65536
+#define MSSQL_MAX_BLOCK_BYTES (16*1024*1024) /* bound buffers of a block, all columns */
+
 #define SQL_COLUMN_NAME_MAX_LENGTH 128
 #define SQL_TABLE_NAME_MAX_LENGTH 128
 
@@ -591,6 +615,12 @@ static int executeSQL(msODBCconn *conn, const char * sql)
 
   SQLCloseCursor(conn->hstmt);
 
+  /* the statement handle is shared through the connection pool, drop any */
+  /* block fetch binding left behind by a previous query */
+  SQLFreeStmt(conn->hstmt, SQL_UNBIND);
+  SQLSetStmtAttr(conn->hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 1, 0);
+  SQLSetStmtAttr(conn->hstmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+
   rc = SQLExecDirect(conn->hstmt, (SQLCHAR *) sql, SQL_NTS);
 
   if (rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO) {
@@ -601,6 +631,249 @@ static int executeSQL(msODBCconn *conn, const char * sql)
   }
 }
 
+/* Release the block fetch buffers of a layer */
+static void freeBlockBuffers(msMSSQL2008LayerInfo *layerinfo)
+{
+  if (layerinfo->block_data && layerinfo->conn)
+    SQLFreeStmt(layerinfo->conn->hstmt, SQL_UNBIND);
+
+  msFree(layerinfo->block_data);
+  layerinfo->block_data = NULL;
+  msFree(layerinfo->block_ind);
+  layerinfo->block_ind = NULL;
+  msFree(layerinfo->block_cell);
+  layerinfo->block_cell = NULL;
+  msFree(layerinfo->block_offset);
+  layerinfo->block_offset = NULL;
+  layerinfo->num_bound = 0;
+  layerinfo->block_size = 0;
+  layerinfo->block_rows = 0;
+  layerinfo->block_row = 0;
+}
+
+/*
+** Bind the columns of the current result set (items, geometry and unique id)
+** to column-wise arrays so that SQLFetchScroll transfers up to fetch_size rows
+** per round trip. Each column gets a cell of its described size, long and
+** (max) columns get cell_size and values that do not fit make the layer
+** fall back to row by row fetching. The rows per block are reduced so that
+** the buffers stay below MSSQL_MAX_BLOCK_BYTES. Returns MS_SUCCESS, or
+** MS_FAILURE if the driver refused the binding, in which case the row by row
+** path is used.
+*/
+static int bindBlockColumns(layerObj *layer, msMSSQL2008LayerInfo *layerinfo)
+{
+  SQLHSTMT hstmt = layerinfo->conn->hstmt;
+  SQLRETURN rc;
+  size_t row_width = 0;
+  int c;
+
+  freeBlockBuffers(layerinfo);
+
+  if (layerinfo->fetch_size <= 1)
+    return MS_SUCCESS;
+
+  layerinfo->num_bound = layer->numitems + 2;
+  layerinfo->block_cell = (SQLLEN *) msSmallMalloc(sizeof(SQLLEN) * layerinfo->num_bound);
+  layerinfo->block_offset = (size_t *) msSmallMalloc(sizeof(size_t) * layerinfo->num_bound);
+
+  for (c = 0; c < layerinfo->num_bound; c++) {
+    SQLSMALLINT type = 0, digits = 0, nullable = 0;
+    SQLULEN size = 0;
+    SQLLEN cell = layerinfo->cell_size;
+
+    rc = SQLDescribeCol(hstmt, (SQLUSMALLINT)(c + 1), NULL, 0, NULL, &type, &size, &digits, &nullable);
+    if ((rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO) && size > 0 &&
+        type != SQL_LONGVARCHAR && type != SQL_WLONGVARCHAR && type != SQL_LONGVARBINARY) {
+      /* binary transfer of wide characters takes two bytes each */
+      if (type == SQL_WCHAR || type == SQL_WVARCHAR)
+        size *= 2;
+      if ((SQLLEN)size < cell)
+        cell = (SQLLEN)size;
+    }
+    layerinfo->block_cell[c] = cell;
+    row_width += cell;
+  }
+
+  layerinfo->block_size = layerinfo->fetch_size;
+  if (row_width * layerinfo->block_size > MSSQL_MAX_BLOCK_BYTES)
+    layerinfo->block_size = MSSQL_MAX_BLOCK_BYTES / row_width;
+  if (layerinfo->block_size <= 1) {
+    msDebug("bindBlockColumns(): rows of %ld bytes are too wide for block fetch, using row by row fetch.\n", (long)row_width);
+    freeBlockBuffers(layerinfo);
+    return MS_FAILURE;
+  }
+
+  for (c = 0; c < layerinfo->num_bound; c++)
+    layerinfo->block_offset[c] = c == 0 ? 0 : layerinfo->block_offset[c-1] + layerinfo->block_size * layerinfo->block_cell[c-1];
+
+  if (layer->debug >= MS_DEBUGLEVEL_TUNING)
+    msDebug("bindBlockColumns(): %ld rows per block, %ld bytes per row.\n", (long)layerinfo->block_size, (long)row_width);
+
+  layerinfo->block_data = (char *) malloc(row_width * layerinfo->block_size);
+  layerinfo->block_ind = (SQLLEN *) malloc(sizeof(SQLLEN) * layerinfo->num_bound * layerinfo->block_size);
+  if (!layerinfo->block_data || !layerinfo->block_ind) {
+    msDebug("bindBlockColumns(): cannot allocate block fetch buffers, using row by row fetch.\n");
+    freeBlockBuffers(layerinfo);
+    return MS_FAILURE;
+  }
+
+  rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER) SQL_BIND_BY_COLUMN, 0);
+  if (rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO)
+    rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) layerinfo->block_size, 0);
+  if (rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO)
+    rc = SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &layerinfo->block_rows, 0);
+
+  for (c = 0; c < layerinfo->num_bound && (rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO); c++) {
+    rc = SQLBindCol(hstmt, (SQLUSMALLINT)(c + 1), SQL_C_BINARY,
+                    layerinfo->block_data + layerinfo->block_offset[c],
+                    layerinfo->block_cell[c], layerinfo->block_ind + (size_t)c * layerinfo->block_size);
+  }
+
+  if (rc != SQL_SUCCESS && rc != SQL_SUCCESS_WITH_INFO) {
+    handleSQLError(layer);
+    msDebug("bindBlockColumns(): block fetch not available, using row by row fetch.\n");
+    freeBlockBuffers(layerinfo);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 1, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+    return MS_FAILURE;
+  }
+
+  return MS_SUCCESS;
+}
+
+/* Advance to the next row of the result set, fetching a new block if needed */
+static SQLRETURN fetchNextRow(layerObj *layer, msMSSQL2008LayerInfo *layerinfo)
+{
+  SQLRETURN rc;
+  struct mstimeval starttime, endtime;
+
+  if (layerinfo->block_data && layerinfo->block_row + 1 < layerinfo->block_rows) {
+    layerinfo->block_row++;
+    return SQL_SUCCESS;
+  }
+
+  if (layer->debug >= MS_DEBUGLEVEL_TUNING)
+    msGettimeofday(&starttime, NULL);
+
+  if (layerinfo->block_data) {
+    layerinfo->block_rows = 0;
+    layerinfo->block_row = 0;
+    rc = SQLFetchScroll(layerinfo->conn->hstmt, SQL_FETCH_NEXT, 0);
+    if ((rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO) && layerinfo->block_rows == 0)
+      rc = SQL_NO_DATA;
+  } else
+    rc = SQLFetch(layerinfo->conn->hstmt);
+
+  if (layer->debug >= MS_DEBUGLEVEL_TUNING) {
+    msGettimeofday(&endtime, NULL);
+    layerinfo->fetch_time += (endtime.tv_sec+endtime.tv_usec/1.0e6) - (starttime.tv_sec+starttime.tv_usec/1.0e6);
+  }
+
+  if (rc == SQL_SUCCESS || rc == SQL_SUCCESS_WITH_INFO) {
+    layerinfo->fetch_calls++;
+    layerinfo->rows_fetched += layerinfo->block_data ? (long)layerinfo->block_rows : 1;
+  }
+
+  return rc;
+}
+
+/*
+** Return the value of a column (1 based) of the current row in *data / *len.
+** *len is -1 for NULL values. In block mode the data points into the bound
+** buffers, otherwise the value is read with a single SQLGetData call into a
+** reusable buffer which only grows (streaming the remainder) when the value
+** does not fit. Returns MS_SUCCESS, MS_FAILURE, or MS_DONE if a block fetched
+** value was truncated by the bound cell size.
+*/
+static int getColumnData(layerObj *layer, msMSSQL2008LayerInfo *layerinfo, int column, char **data, SQLLEN *len)
+{
+  SQLRETURN rc;
+  SQLLEN avail = 0, total = 0, chunk;
+
+  if (layerinfo->block_data) {
+    SQLLEN ind = layerinfo->block_ind[(size_t)(column - 1) * layerinfo->block_size + layerinfo->block_row];
+    SQLLEN cell = layerinfo->block_cell[column - 1];
+
+    if (ind == SQL_NULL_DATA) {
+      *data = NULL;
+      *len = -1;
+      return MS_SUCCESS;
+    }
+    if (ind == SQL_NO_TOTAL || ind > cell)
+      return MS_DONE;
+
+    *data = layerinfo->block_data + layerinfo->block_offset[column - 1] + layerinfo->block_row * cell;
+    *len = ind;
+    return MS_SUCCESS;
+  }
+
+  if (layerinfo->value_buf == NULL) {
+    layerinfo->value_buf_size = 4096;
+    layerinfo->value_buf = (char *) msSmallMalloc(layerinfo->value_buf_size);
+  }
+
+  chunk = layerinfo->value_buf_size - 1; /* keep room for a terminator */
+  rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)column, SQL_C_BINARY, layerinfo->value_buf, chunk, &avail);
+  while (rc == SQL_SUCCESS_WITH_INFO && (avail == SQL_NO_TOTAL || avail > chunk)) {
+    /* buffer filled, grow it and read the remainder of the value */
+    total += chunk;
+    if (avail == SQL_NO_TOTAL)
+      layerinfo->value_buf_size *= 2;
+    else
+      layerinfo->value_buf_size = total + (avail - chunk) + 1;
+    layerinfo->value_buf = (char *) msSmallRealloc(layerinfo->value_buf, layerinfo->value_buf_size);
+    chunk = layerinfo->value_buf_size - 1 - total;
+    rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)column, SQL_C_BINARY, layerinfo->value_buf + total, chunk, &avail);
+  }
+
+  if (rc == SQL_ERROR) {
+    handleSQLError(layer);
+    return MS_FAILURE;
+  }
+
+  if (avail == SQL_NULL_DATA || rc == SQL_NO_DATA) {
+    *data = NULL;
+    *len = -1;
+    return MS_SUCCESS;
+  }
+
+  *len = total + avail;
+  layerinfo->value_buf[*len] = 0;
+  *data = layerinfo->value_buf;
+  return MS_SUCCESS;
+}
+
+/*
+** A value did not fit in the bound block buffers: re-issue the query in row by
+** row mode and position the cursor before the given record.
+*/
+static int fallbackToRowFetch(layerObj *layer, msMSSQL2008LayerInfo *layerinfo, long record)
+{
+  long i;
+
+  if (layer->debug)
+    msDebug("msMSSQL2008LayerGetShapeRandom(): value larger than MSSQL_FETCH_BUFFER_SIZE=%ld, falling back to row by row fetch.\n", (long)layerinfo->cell_size);
+
+  freeBlockBuffers(layerinfo);
+  layerinfo->fetch_size = 1;
+
+  if (!layerinfo->sql || !executeSQL(layerinfo->conn, layerinfo->sql)) {
+    msSetError(MS_QUERYERR, "Error re-executing MSSQL2008 SQL statement: %s", "msMSSQL2008LayerGetShapeRandom()", layerinfo->conn->errorMessage);
+    return MS_FAILURE;
+  }
+
+  for (i = 0; i < record; i++) {
+    SQLRETURN rc = SQLFetch(layerinfo->conn->hstmt);
+    if (rc != SQL_SUCCESS && rc != SQL_SUCCESS_WITH_INFO) {
+      handleSQLError(layer);
+      return MS_FAILURE;
+    }
+  }
+
+  return MS_SUCCESS;
+}
+
 /* Get columns name from query results */
 static int columnName(msODBCconn *conn, int index, char *buffer, int bufferLength)
 {
@@ -682,6 +955,33 @@ int msMSSQL2008LayerOpen(layerObj *layer)
   layerinfo->sort_spec = NULL;
   layerinfo->conn = NULL;
 
+  layerinfo->fetch_size = 1;
+  layerinfo->cell_size = MSSQL_DEFAULT_CELL_SIZE;
+  layerinfo->num_bound = 0;
+  layerinfo->block_data = NULL;
+  layerinfo->block_ind = NULL;
+  layerinfo->block_cell = NULL;
+  layerinfo->block_offset = NULL;
+  layerinfo->block_size = 0;
+  layerinfo->block_rows = 0;
+  layerinfo->block_row = 0;
+  layerinfo->value_buf = NULL;
+  layerinfo->value_buf_size = 0;
+  layerinfo->fetch_calls = 0;
+  layerinfo->rows_fetched = 0;
+  layerinfo->fetch_time = 0.0;
+
+  if (msLayerGetProcessingKey(layer, "MSSQL_FETCH_SIZE") != NULL) {
+    int fetch_size = atoi(msLayerGetProcessingKey(layer, "MSSQL_FETCH_SIZE"));
+    if (fetch_size > 1)
+      layerinfo->fetch_size = fetch_size;
+  }
+  if (msLayerGetProcessingKey(layer, "MSSQL_FETCH_BUFFER_SIZE") != NULL) {
+    long cell_size = atol(msLayerGetProcessingKey(layer, "MSSQL_FETCH_BUFFER_SIZE"));
+    if (cell_size > 0)
+      layerinfo->cell_size = cell_size;
+  }
+
   layerinfo->conn = (msODBCconn *) msConnPoolRequest(layer);
 
   if(!layerinfo->conn) {
@@ -1016,6 +1316,8 @@ static int prepare_database(layerObj *layer, rectObj rect, char **query_string)
   if (executeSQL(layerinfo->conn, query_string_temp)) {
     *query_string = msStrdup(query_string_temp);
 
+    bindBlockColumns(layer, layerinfo);
+
     return MS_SUCCESS;
   } else {
     msSetError(MS_QUERYERR, "Error executing MSSQL2008 SQL statement: %s\n-%s\n", "msMSSQL2008LayerGetShape()", query_string_temp, layerinfo->conn->errorMessage);
@@ -1087,6 +1389,15 @@ int msMSSQL2008LayerClose(layerObj *layer)
   }
 
   if(layerinfo) {
+    if(layer->debug >= MS_DEBUGLEVEL_TUNING && layerinfo->fetch_calls > 0) {
+      msDebug("msMSSQL2008LayerClose(%s): %ld fetch calls, %ld rows, %.3fs\n",
+              layer->name ? layer->name : "", layerinfo->fetch_calls, layerinfo->rows_fetched, layerinfo->fetch_time);
+    }
+
+    freeBlockBuffers(layerinfo);
+    msFree(layerinfo->value_buf);
+    layerinfo->value_buf = NULL;
+
     msConnPoolRelease(layer, layerinfo->conn);
 
     layerinfo->conn = NULL;
@@ -1577,12 +1888,10 @@ static void find_bounds(shapeObj *shape)
 int msMSSQL2008LayerGetShapeRandom(layerObj *layer, shapeObj *shape, long *record)
 {
   msMSSQL2008LayerInfo  *layerinfo;
-  int                 result;
-  SQLINTEGER needLen = 0;
-  SQLINTEGER retLen = 0;
-  char dummyBuffer[1];
+  int                 result, status;
+  SQLLEN len = 0;
+  char *data;
   char *wkbBuffer;
-  char *valueBuffer;
   char oidBuffer[ 16 ];   /* assuming the OID will always be a long this should be enough */
   long record_oid;
   int t;
@@ -1609,7 +1918,7 @@ int msMSSQL2008LayerGetShapeRandom(layerObj *layer, shapeObj *shape, long *recor
     /* SQLRETURN rc = SQLFetchScroll(layerinfo->conn->hstmt, SQL_FETCH_ABSOLUTE, (SQLINTEGER) (*record) + 1); */
 
     /* We only do forward fetches. the parameter 'record' is ignored, but is incremented */
-    SQLRETURN rc = SQLFetch(layerinfo->conn->hstmt);
+    SQLRETURN rc = fetchNextRow(layer, layerinfo);
 
     /* Any error assume out of recordset bounds */
     if (rc != SQL_SUCCESS && rc != SQL_SUCCESS_WITH_INFO) {
@@ -1623,62 +1932,47 @@ int msMSSQL2008LayerGetShapeRandom(layerObj *layer, shapeObj *shape, long *recor
       /* have to retrieve shape attributes */
       shape->values = (char **) msSmallMalloc(sizeof(char *) * layer->numitems);
       shape->numvalues = layer->numitems;
+      status = MS_SUCCESS;
 
       for(t=0; t < layer->numitems; t++) {
-        /* figure out how big the buffer needs to be */
-        rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)(t + 1), SQL_C_BINARY, dummyBuffer, 0, &needLen);
-        if (rc == SQL_ERROR)
-          handleSQLError(layer);
-
-        if (needLen > 0) {
-          /* allocate the buffer - this will be a null-terminated string so alloc for the null too */
-          valueBuffer = (char*) msSmallMalloc( needLen + 1 );
-          if ( valueBuffer == NULL ) {
-            msSetError( MS_QUERYERR, "Could not allocate value buffer.", "msMSSQL2008LayerGetShapeRandom()" );
-            return MS_FAILURE;
-          }
-
-          /* Now grab the data */
-          rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)(t + 1), SQL_C_BINARY, valueBuffer, needLen, &retLen);
-          if (rc == SQL_ERROR || rc == SQL_SUCCESS_WITH_INFO)
-            handleSQLError(layer);
-
-          /* Terminate the buffer */
-          valueBuffer[retLen] = 0; /* null terminate it */
-
-          /* Pop the value into the shape's value array */
-          shape->values[t] = valueBuffer;
+        if (status == MS_SUCCESS)
+          status = getColumnData(layer, layerinfo, t + 1, &data, &len);
+
+        if (status == MS_SUCCESS && len > 0) {
+          /* copy as a null-terminated string */
+          shape->values[t] = (char*) msSmallMalloc( len + 1 );
+          memcpy(shape->values[t], data, len);
+          shape->values[t][len] = 0;
         } else
           /* Copy empty sting for NULL values */
           shape->values[t] = msStrdup("");
       }
 
       /* Get shape geometry */
-      {
-        /* Set up to request the size of the buffer needed */
-        rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)(layer->numitems + 1), SQL_C_BINARY, dummyBuffer, 0, &needLen);
-        if (rc == SQL_ERROR)
-          handleSQLError(layer);
+      if (status == MS_SUCCESS)
+        status = getColumnData(layer, layerinfo, layer->numitems + 1, &data, &len);
+
+      if (status == MS_DONE) {
+        /* value truncated by the block buffers, re-read this row without them */
+        msFreeCharArray(shape->values, shape->numvalues);
+        shape->values = NULL;
+        shape->numvalues = 0;
+        if (fallbackToRowFetch(layer, layerinfo, *record) != MS_SUCCESS)
+          return MS_FAILURE;
+        continue;
+      }
 
+      if (status == MS_SUCCESS && len > 0) {
         /* allow space for coercion to geometry collection if needed*/
-        wkbTemp = (char*)msSmallMalloc(needLen+9);
+        wkbTemp = (char*)msSmallMalloc(len+9);
 
         /* write data above space allocated for geometry collection coercion */
         wkbBuffer = wkbTemp + 9;
-
-        if ( wkbBuffer == NULL ) {
-          msSetError( MS_QUERYERR, "Could not allocate value buffer.", "msMSSQL2008LayerGetShapeRandom()" );
-          return MS_FAILURE;
-        }
-
-        /* Grab the WKB */
-        rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)(layer->numitems + 1), SQL_C_BINARY, wkbBuffer, needLen, &retLen);
-        if (rc == SQL_ERROR || rc == SQL_SUCCESS_WITH_INFO)
-          handleSQLError(layer);
+        memcpy(wkbBuffer, data, len);
 
         if (layerinfo->geometry_format == MSSQLGEOMETRY_NATIVE) {
           layerinfo->gpi.pszData = (unsigned char*)wkbBuffer;
-          layerinfo->gpi.nLen = retLen;
+          layerinfo->gpi.nLen = len;
 
           if (!ParseSqlGeometry(layerinfo, shape)) {
             switch(layer->type) {
@@ -1755,13 +2049,20 @@ int msMSSQL2008LayerGetShapeRandom(layerObj *layer, shapeObj *shape, long *recor
       }
 
       /* Next get unique id for row - since the OID shouldn't be larger than a long we'll assume billions as a limit */
-      rc = SQLGetData(layerinfo->conn->hstmt, (SQLUSMALLINT)(layer->numitems + 2), SQL_C_BINARY, oidBuffer, sizeof(oidBuffer) - 1, &retLen);
-      if (rc == SQL_ERROR || rc == SQL_SUCCESS_WITH_INFO)
-        handleSQLError(layer);
+      if (status == MS_SUCCESS)
+        status = getColumnData(layer, layerinfo, layer->numitems + 2, &data, &len);
 
-      if (retLen < sizeof(oidBuffer))
+      if (status == MS_DONE) {
+        msFreeShape(shape);
+        if (fallbackToRowFetch(layer, layerinfo, *record) != MS_SUCCESS)
+          return MS_FAILURE;
+        continue;
+      }
+
+      if (status == MS_SUCCESS && len >= 0 && len < sizeof(oidBuffer))
 	  {
-		oidBuffer[retLen] = 0;
+		memcpy(oidBuffer, data, len);
+		oidBuffer[len] = 0;
 		record_oid = strtol(oidBuffer, NULL, 10);
 		shape->index = record_oid;
 	  }
@@ -1779,6 +2080,9 @@ int msMSSQL2008LayerGetShapeRandom(layerObj *layer, shapeObj *shape, long *recor
         return MS_SUCCESS;
       } else {
         msDebug("msMSSQL2008LayerGetShapeRandom bad shape: %d\n", *record);
+        msFreeCharArray(shape->values, shape->numvalues);
+        shape->values = NULL;
+        shape->numvalues = 0;
       }
       /* if (layer->type == MS_LAYER_POINT) {return MS_DONE;} */
     }
@@ -1846,6 +2150,7 @@ int msMSSQL2008LayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record
 
         return MS_FAILURE;
       }
+      bindBlockColumns(layer, layerinfo);
       layerinfo->row_num = 0;
     }
     while( layerinfo->row_num < resultindex ) {
@@ -1889,6 +2194,9 @@ int msMSSQL2008LayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record
 
   msFree(columns_wanted);
 
+  /* single record query, no block fetching */
+  freeBlockBuffers(layerinfo);
+
   if (!executeSQL(layerinfo->conn, query_str)) {
     msSetError(MS_QUERYERR, "Error executing MSSQL2008 SQL statement: %s\n-%s\n", "msMSSQL2008LayerGetShape()",
                query_str, layerinfo->conn->errorMessage);
@@ -97,6 +97,8 @@ void msFreeMap(mapObj *map)
   msFreeProjection(&(map->latlon));
 
   msFreeLabelCache(&(map->labelcache));
+  msArenaDestroy(map->labelcache.arena);
+  map->labelcache.arena = NULL;
 
   msFree(map->imagetype);
 
@@ -112,10 +114,10 @@ void msFreeMap(mapObj *map)
   freeLegend(&(map->legend));
 
   for(i=0; i<map->maxlayers; i++) {
-    if(GET_LAYER(map, i) != NULL) {
-      GET_LAYER(map, i)->map = NULL;
-      if(freeLayer((GET_LAYER(map, i))) == MS_SUCCESS)
-        free(GET_LAYER(map, i));
+    if(GET_LAYER_HEADER(map, i) != NULL) {
+      GET_LAYER_HEADER(map, i)->map = NULL;
+      if(freeLayer((GET_LAYER_HEADER(map, i))) == MS_SUCCESS)
+        free(GET_LAYER_HEADER(map, i));
     }
   }
   msFree(map->layers);
@@ -138,6 +140,8 @@ void msFreeMap(mapObj *map)
 
   msFreeQuery(&(map->query));
 
+  msMapFreeArena(map);
+
 #ifdef USE_V8_MAPSCRIPT
   if (map->v8context)
     msV8FreeContext(map);
@@ -496,7 +500,7 @@ int msMapSetFakedExtent( mapObj *map )
   map->projection.gt.geotransform[5] *= -1;
 
   for(i=0; i<map->numlayers; i++)
-    GET_LAYER(map, i)->project = MS_TRUE;
+    GET_LAYER_HEADER(map, i)->project = MS_TRUE;
 
   return InvGeoTransform( map->projection.gt.geotransform,
                           map->projection.gt.invgeotransform );
@@ -548,9 +552,9 @@ int msInsertLayer(mapObj *map, layerObj *layer, int nIndex)
     return -1;
   } else if (nIndex < 0) { /* Insert at the end by default */
     map->layerorder[map->numlayers] = map->numlayers;
-    GET_LAYER(map, map->numlayers) = layer;
-    GET_LAYER(map, map->numlayers)->index = map->numlayers;
-    GET_LAYER(map, map->numlayers)->map = map;
+    GET_LAYER_HEADER(map, map->numlayers) = layer;
+    GET_LAYER_HEADER(map, map->numlayers)->index = map->numlayers;
+    GET_LAYER_HEADER(map, map->numlayers)->map = map;
     MS_REFCNT_INCR(layer);
     map->numlayers++;
     return map->numlayers-1;
@@ -559,14 +563,14 @@ int msInsertLayer(mapObj *map, layerObj *layer, int nIndex)
     /* to an index one higher */
     int i;
     for (i=map->numlayers; i>nIndex; i--) {
-      GET_LAYER(map, i)=GET_LAYER(map, i-1);
-      GET_LAYER(map, i)->index = i;
+      GET_LAYER_HEADER(map, i)=GET_LAYER_HEADER(map, i-1);
+      GET_LAYER_HEADER(map, i)->index = i;
     }
 
     /* assign new layer to specified index */
-    GET_LAYER(map, nIndex)=layer;
-    GET_LAYER(map, nIndex)->index = nIndex;
-    GET_LAYER(map, nIndex)->map = map;
+    GET_LAYER_HEADER(map, nIndex)=layer;
+    GET_LAYER_HEADER(map, nIndex)->index = nIndex;
+    GET_LAYER_HEADER(map, nIndex)->map = map;
 
     /* adjust layers drawing order */
     for (i=map->numlayers; i>nIndex; i--) {
@@ -610,12 +614,12 @@ layerObj *msRemoveLayer(mapObj *map, int nIndex)
       /* freeLayer((GET_LAYER(map, i))); */
       /* initLayer((GET_LAYER(map, i)), map); */
       /* msCopyLayer(GET_LAYER(map, i), GET_LAYER(map, i+1)); */
-      GET_LAYER(map, i)=GET_LAYER(map, i+1);
-      GET_LAYER(map, i)->index = i;
+      GET_LAYER_HEADER(map, i)=GET_LAYER_HEADER(map, i+1);
+      GET_LAYER_HEADER(map, i)->index = i;
     }
     /* Free the extra layer at the end */
     /* freeLayer((GET_LAYER(map, map->numlayers-1))); */
-    GET_LAYER(map, map->numlayers-1)=NULL;
+    GET_LAYER_HEADER(map, map->numlayers-1)=NULL;
 
     /* Adjust drawing order */
     order_index = 0;
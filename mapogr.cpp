@@ -550,7 +550,8 @@ int msOGRGeometryToShape(OGRGeometryH hGeometry, shapeObj *psShape,
 /**********************************************************************
  *                     msOGRGetValues()
  *
- * Load selected item (i.e. field) values into a char array
+ * Load selected item (i.e. field) values into the values of shape,
+ * reusing the buffers of a recycled shape (see msRecycleShape())
  *
  * Some special attribute names are used to return some OGRFeature params
  * like for instance stuff encoded in the OGRStyleString.
@@ -558,23 +559,21 @@ int msOGRGeometryToShape(OGRGeometryH hGeometry, shapeObj *psShape,
  *  "OGR:TextString"  OGRFeatureStyle's text string if present
  *  "OGR:TextAngle"   OGRFeatureStyle's text angle, or 0 if not set
  **********************************************************************/
-static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
+static int msOGRGetValues(layerObj *layer, OGRFeatureH hFeature, shapeObj *shape)
 {
   char **values;
   const char *pszValue = NULL;
   int i;
 
   if(layer->numitems == 0)
-    return(NULL);
+    return(MS_SUCCESS);
 
   if(!layer->iteminfo)  // Should not happen... but just in case!
     if (msOGRLayerInitItemInfo(layer) != MS_SUCCESS)
-      return NULL;
+      return(MS_FAILURE);
 
-  if((values = (char **)malloc(sizeof(char *)*layer->numitems)) == NULL) {
-    msSetError(MS_MEMERR, NULL, "msOGRGetValues()");
-    return(NULL);
-  }
+  if((values = msShapeReserveValues(shape, layer->numitems)) == NULL)
+    return(MS_FAILURE);
 
   OGRStyleMgrH  hStyleMgr = NULL;
   OGRStyleToolH hLabelStyle = NULL;
@@ -587,7 +586,7 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
   for(i=0; i<layer->numitems; i++) {
     if (itemindexes[i] >= 0) {
       // Extract regular attributes
-      values[i] = msStrdup(OGR_F_GetFieldAsString( hFeature, itemindexes[i]));
+      msShapeSetValue(shape, i, OGR_F_GetFieldAsString( hFeature, itemindexes[i]));
     } else {
       // Handle special OGR attributes coming from StyleString
       if (!hStyleMgr) {
@@ -622,9 +621,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelTextString,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELTEXTNAME " = \"%s\"\n", values[i]);
@@ -633,9 +632,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelAngle,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELANGLENAME " = \"%s\"\n", values[i]);
@@ -644,9 +643,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelSize,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELSIZENAME " = \"%s\"\n", values[i]);
@@ -655,9 +654,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelFColor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("#000000");
+          msShapeSetValue(shape, i, "#000000");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELFCOLORNAME " = \"%s\"\n", values[i]);
@@ -666,9 +665,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelFontName,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("Arial");
+          msShapeSetValue(shape, i, "Arial");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELFONTNAMENAME " =       \"%s\"\n", values[i]);
@@ -677,9 +676,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelBColor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("#000000");
+          msShapeSetValue(shape, i, "#000000");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELBCOLORNAME " = \"%s\"\n", values[i]);
@@ -688,9 +687,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelPlacement,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELPLACEMENTNAME " = \"%s\"\n", values[i]);
@@ -699,9 +698,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelAnchor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELANCHORNAME " = \"%s\"\n", values[i]);
@@ -710,9 +709,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelDx,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELDXNAME " = \"%s\"\n", values[i]);
@@ -721,9 +720,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelDy,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELDYNAME " = \"%s\"\n", values[i]);
@@ -732,9 +731,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelPerp,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELPERPNAME " = \"%s\"\n", values[i]);
@@ -743,9 +742,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelBold,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELBOLDNAME " = \"%s\"\n", values[i]);
@@ -754,9 +753,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelItalic,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELITALICNAME " = \"%s\"\n", values[i]);
@@ -765,9 +764,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelUnderline,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELUNDERLINENAME " = \"%s\"\n", values[i]);
@@ -776,9 +775,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelPriority,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELPRIORITYNAME " = \"%s\"\n", values[i]);
@@ -787,9 +786,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelStrikeout,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELSTRIKEOUTNAME " = \"%s\"\n", values[i]);
@@ -798,9 +797,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelStretch,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("0");
+          msShapeSetValue(shape, i, "0");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELSTRETCHNAME " = \"%s\"\n", values[i]);
@@ -809,9 +808,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelAdjHor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELADJHORNAME " = \"%s\"\n", values[i]);
@@ -820,9 +819,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelAdjVert,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELADJVERTNAME " = \"%s\"\n", values[i]);
@@ -831,9 +830,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelHColor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELHCOLORNAME " = \"%s\"\n", values[i]);
@@ -844,9 +843,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                OGRSTLabelOColor,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELOCOLORNAME " = \"%s\"\n", values[i]);
@@ -857,9 +856,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hLabelStyle,
                                                itemindexes[i] - MSOGR_LABELPARAMINDEX,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_LABELPARAMNAME " = \"%s\"\n", values[i]);
@@ -869,9 +868,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hBrushStyle,
                                                itemindexes[i] - MSOGR_BRUSHPARAMINDEX,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_BRUSHPARAMNAME " = \"%s\"\n", values[i]);
@@ -881,9 +880,9 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hPenStyle,
                                                itemindexes[i] - MSOGR_PENPARAMINDEX,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_PENPARAMNAME " = \"%s\"\n", values[i]);
@@ -893,16 +892,14 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
             || ((pszValue = OGR_ST_GetParamStr(hSymbolStyle,
                                                itemindexes[i] - MSOGR_SYMBOLPARAMINDEX,
                                                &bDefault)) == NULL))
-          values[i] = msStrdup("");
+          msShapeSetValue(shape, i, "");
         else
-          values[i] = msStrdup(pszValue);
+          msShapeSetValue(shape, i, pszValue);
 
         if (layer->debug >= MS_DEBUGLEVEL_VVV)
           msDebug(MSOGR_SYMBOLPARAMNAME " = \"%s\"\n", values[i]);
       }
       else {
-        msFreeCharArray(values,i);
-
         OGR_SM_Destroy(hStyleMgr);
         OGR_ST_Destroy(hLabelStyle);
         OGR_ST_Destroy(hPenStyle);
@@ -910,7 +907,7 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
         OGR_ST_Destroy(hSymbolStyle);
 
         msSetError(MS_OGRERR,"Invalid field index!?!","msOGRGetValues()");
-        return(NULL);
+        return(MS_FAILURE);
       }
     }
   }
@@ -921,7 +918,26 @@ static char **msOGRGetValues(layerObj *layer, OGRFeatureH hFeature)
   OGR_ST_Destroy(hBrushStyle);
   OGR_ST_Destroy(hSymbolStyle);
 
-  return(values);
+  return(MS_SUCCESS);
+}
+
+/**********************************************************************
+ *                     msOGRSetNumericValues()
+ *
+ * Stores the numbers of integer fields with the shape, so expressions and
+ * bindings don't parse them back from the strings of msOGRGetValues().
+ * Reals are left alone: their string form is rounded and the number must
+ * be what atof() returns for it.
+ **********************************************************************/
+static void msOGRSetNumericValues(layerObj *layer, OGRFeatureH hFeature, shapeObj *shape)
+{
+  int *itemindexes = (int*)layer->iteminfo;
+
+  for(int i=0; i<layer->numitems; i++) {
+    if (itemindexes[i] >= 0 &&
+        OGR_Fld_GetType(OGR_F_GetFieldDefnRef(hFeature, itemindexes[i])) == OFTInteger)
+      msShapeSetValueAsDouble(shape, i, OGR_F_GetFieldAsInteger(hFeature, itemindexes[i]));
+  }
 }
 
 #endif  /* USE_OGR */
@@ -1854,7 +1870,10 @@ msOGRFileNextShape(layerObj *layer, shapeObj *shape,
    * Read until we find a feature that matches attribute filter and
    * whose geometry is compatible with current layer type.
    * ------------------------------------------------------------------ */
-  msFreeShape(shape);
+  if (shape->recycle)
+    msRecycleShape(shape);
+  else
+    msFreeShape(shape);
   shape->type = MS_SHAPE_NULL;
 
   ACQUIRE_OGR_LOCK;
@@ -1880,13 +1899,12 @@ msOGRFileNextShape(layerObj *layer, shapeObj *shape,
     psInfo->last_record_index_read++;
 
     if(layer->numitems > 0) {
-      shape->values = msOGRGetValues(layer, hFeature);
-      shape->numvalues = layer->numitems;
-      if(!shape->values) {
+      if(msOGRGetValues(layer, hFeature, shape) != MS_SUCCESS) {
         OGR_F_Destroy( hFeature );
         RELEASE_OGR_LOCK;
         return(MS_FAILURE);
       }
+      msOGRSetNumericValues(layer, hFeature, shape);
     }
 
     // Feature matched filter expression... process geometry
@@ -1910,7 +1928,10 @@ msOGRFileNextShape(layerObj *layer, shapeObj *shape,
     }
 
     // Feature rejected... free shape to clear attributes values.
-    msFreeShape(shape);
+    if (shape->recycle)
+      msRecycleShape(shape);
+    else
+      msFreeShape(shape);
     shape->type = MS_SHAPE_NULL;
   }
 
@@ -2016,12 +2037,11 @@ msOGRFileGetShape(layerObj *layer, shapeObj *shape, long record,
    * Process shape attributes
    * ------------------------------------------------------------------ */
   if(layer->numitems > 0) {
-    shape->values = msOGRGetValues(layer, hFeature);
-    shape->numvalues = layer->numitems;
-    if(!shape->values) {
+    if(msOGRGetValues(layer, hFeature, shape) != MS_SUCCESS) {
       RELEASE_OGR_LOCK;
       return(MS_FAILURE);
     }
+    msOGRSetNumericValues(layer, hFeature, shape);
 
   }
 
@@ -3629,6 +3649,13 @@ static int msOGRLayerSupportsCommonFilters(layerObj *layer)
   return MS_FALSE;
 }
 
+/* attribute values are read into the buffers of a recycled shape, the
+   geometry is still allocated for each feature */
+static int msOGRLayerSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_TRUE;
+}
+
 /************************************************************************/
 /*                  msOGRLayerInitializeVirtualTable()                  */
 /************************************************************************/
@@ -3660,6 +3687,7 @@ int msOGRLayerInitializeVirtualTable(layerObj *layer)
 
   layer->vtable->LayerEscapeSQLParam = msOGREscapeSQLParam;
   layer->vtable->LayerEscapePropertyName = msOGREscapePropertyName;
+  layer->vtable->LayerSupportsShapeRecycling = msOGRLayerSupportsShapeRecycling;
 
   return MS_SUCCESS;
 }
@@ -860,6 +860,7 @@ int msOGRWriteFromQuery( mapObj *map, outputFormatObj *format, int sendheaders )
     int status;
     layerObj *layer = GET_LAYER(map, iLayer);
     shapeObj resultshape;
+    joinBatchObj batch;
     OGRLayerH hOGRLayer;
     OGRwkbGeometryType eGeomType;
     OGRSpatialReferenceH srs = NULL;
@@ -1043,6 +1044,7 @@ int msOGRWriteFromQuery( mapObj *map, outputFormatObj *format, int sendheaders )
     }
 
     msInitShape( &resultshape );
+    msJoinBatchInit( &batch );
 
     /* -------------------------------------------------------------------- */
     /*      Loop over all the shapes in the resultcache.                    */
@@ -1054,12 +1056,13 @@ int msOGRWriteFromQuery( mapObj *map, outputFormatObj *format, int sendheaders )
       /*
       ** Read the shape.
       */
-      status = msLayerGetShape(layer, &resultshape, &(layer->resultcache->results[i]));
+      status = msJoinGetResultShape(layer, &batch, i, &resultshape);
       if(status != MS_SUCCESS) {
         OGR_DS_Destroy( hDS );
         msOGRCleanupDS( datasource_name );
         msGMLFreeItems(item_list);
         msFreeShape(&resultshape);
+        msJoinBatchFree(&batch);
         return status;
       }
 
@@ -1110,12 +1113,14 @@ int msOGRWriteFromQuery( mapObj *map, outputFormatObj *format, int sendheaders )
         msOGRCleanupDS( datasource_name );
         msGMLFreeItems(item_list);
         msFreeShape(&resultshape);
+        msJoinBatchFree(&batch);
         return status;
       }
     }
 
     msGMLFreeItems(item_list);
     msFreeShape(&resultshape); /* init too */
+    msJoinBatchFree(&batch);
   }
 
   /* -------------------------------------------------------------------- */
@@ -139,6 +139,11 @@ struct {
   ub4 row_num; /* current row index within cursor results */
   ub4 rows_fetched; /* total number of rows fetched into our buffer */
   ub4 row; /* current row index within our buffer */
+  ub4 array_size; /* rows requested per execute/fetch call (<= ARRAY_SIZE) */
+
+  /* fetch statistics, reported at MS_DEBUGLEVEL_TUNING */
+  long fetch_calls;
+  double fetch_time;
 
   item_text_array *items; /* items buffer */
   item_text_array_query *items_query; /* items buffer */
@@ -198,6 +203,8 @@ static void osAggrGetExtent(layerObj *layer, char *query_str, size_t size, char
 static void osConvexHullGetExtent(layerObj *layer, char *query_str, size_t size, char *geom_column_name, char *table_name);
 static void osGeodeticData(int function, int version, char *query_str, size_t size, char *geom_column_name, char *index_column_name, char *srid, rectObj rect);
 static void osNoGeodeticData(int function, int version, char *query_str, size_t size, char *geom_column_name, char *index_column_name, char *srid, rectObj rect);
+static int osSetFetchSize(layerObj *layer, msOracleSpatialHandler *hand, msOracleSpatialStatement *sthand);
+static void osFetchTimerStop(msOracleSpatialStatement *sthand, struct mstimeval *starttime);
 static double osCalculateArcRadius(pointObj *pnt);
 static void osCalculateArc(pointObj *pnt, int data3d, int data4d, double area, double radius, double npoints, int side, lineObj arcline, shapeObj *shape);
 static void osGenerateArc(shapeObj *shape, lineObj arcline, lineObj points, int i, int n, int data3d, int data4d);
@@ -563,6 +570,9 @@ static int msOCIOpenStatement( msOracleSpatialHandler *hand, msOracleSpatialStat
   sthand->row_num = 0;
   sthand->rows_fetched = 0;
   sthand->row = 0;
+  sthand->array_size = ARRAY_SIZE;
+  sthand->fetch_calls = 0;
+  sthand->fetch_time = 0.0;
   sthand->items = NULL;
   sthand->items_query = NULL;
 
@@ -1009,6 +1019,54 @@ static int msOCIConvertCircle( pointObj *pt )
   return 1;
 }
 
+/*
+** Set up the array fetch size and the OCI prefetch row count of a statement.
+**
+** PROCESSING "ORACLE_FETCH_SIZE=n" sets the number of rows transferred by each
+** OCIStmtExecute/OCIStmtFetch2 call (1 to ARRAY_SIZE). PROCESSING
+** "ORACLE_PREFETCH_ROWS=n" sets OCI_ATTR_PREFETCH_ROWS; when it is not set the
+** prefetch count follows the fetch size. Both are reduced to MAXFEATURES when
+** the layer only wants a few rows so we don't prefetch rows that are discarded.
+*/
+static int osSetFetchSize(layerObj *layer, msOracleSpatialHandler *hand, msOracleSpatialStatement *sthand)
+{
+  const char *value;
+  ub4 prefetch_rows;
+  int n;
+
+  sthand->array_size = ARRAY_SIZE;
+  if ((value = msLayerGetProcessingKey(layer, "ORACLE_FETCH_SIZE")) != NULL) {
+    n = atoi(value);
+    if (n < 1 || n > ARRAY_SIZE) {
+      msDebug("osSetFetchSize(): ORACLE_FETCH_SIZE=%s out of range, using %d.\n", value, MS_MAX(1, MS_MIN(n, ARRAY_SIZE)));
+      n = MS_MAX(1, MS_MIN(n, ARRAY_SIZE));
+    }
+    sthand->array_size = (ub4)n;
+  }
+
+  if (layer->maxfeatures > 0 && layer->startindex <= 1 && (ub4)layer->maxfeatures < sthand->array_size)
+    sthand->array_size = (ub4)layer->maxfeatures;
+
+  prefetch_rows = sthand->array_size;
+  if ((value = msLayerGetProcessingKey(layer, "ORACLE_PREFETCH_ROWS")) != NULL && atoi(value) >= 0)
+    prefetch_rows = (ub4)atoi(value);
+
+  if (layer->debug >= MS_DEBUGLEVEL_V)
+    msDebug("osSetFetchSize(): fetch size %u rows, prefetch %u rows.\n", sthand->array_size, prefetch_rows);
+
+  return TRY(hand, OCIAttrSet((dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&prefetch_rows, (ub4)0, (ub4)OCI_ATTR_PREFETCH_ROWS, hand->errhp));
+}
+
+/* accumulate the time spent in a round trip started at starttime */
+static void osFetchTimerStop(msOracleSpatialStatement *sthand, struct mstimeval *starttime)
+{
+  struct mstimeval endtime;
+
+  msGettimeofday(&endtime, NULL);
+  sthand->fetch_calls++;
+  sthand->fetch_time += (endtime.tv_sec+endtime.tv_usec/1.0e6) - (starttime->tv_sec+starttime->tv_usec/1.0e6);
+}
+
 /*function that creates the correct sql for filter and filteritem*/
 static void osFilteritem(layerObj *layer, int function, char *query_str, size_t size, int mode)
 {
@@ -1852,6 +1910,10 @@ int msOracleSpatialLayerClose( layerObj *layer )
       layerinfo->orastmt = NULL;
     }
     if (layerinfo->orastmt2 != NULL) {
+      if (layer->debug >= MS_DEBUGLEVEL_TUNING && layerinfo->orastmt2->fetch_calls > 0)
+        msDebug("msOracleSpatialLayerClose(%s): %ld fetch calls of up to %u rows, %u rows, %.3fs\n",
+                layer->name ? layer->name : "", layerinfo->orastmt2->fetch_calls, layerinfo->orastmt2->array_size,
+                layerinfo->orastmt2->rows_count, layerinfo->orastmt2->fetch_time);
       msOCIFinishStatement(layerinfo->orastmt2);
       layerinfo->orastmt2 = NULL;
     }
@@ -2163,9 +2225,15 @@ int msOracleSpatialLayerWhichShapes( layerObj *layer, rectObj rect, int isQuery)
 
   if (success) {
     int cursor_type = OCI_DEFAULT;
+    struct mstimeval starttime;
     if(isQuery) cursor_type =OCI_STMT_SCROLLABLE_READONLY;
 
-    success = TRY( hand,
+    sthand->fetch_calls = 0;
+    sthand->fetch_time = 0.0;
+    msGettimeofday(&starttime, NULL);
+
+    success = osSetFetchSize(layer, hand, sthand)
+              && TRY( hand,
                    /* define spatial position adtp ADT object */
                    OCIDefineByPos( sthand->stmthp, &adtp, hand->errhp, (ub4)numitemsinselect+1, (dvoid *)0, (sb4)0, SQLT_NTY, (dvoid *)0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT) )
               && TRY( hand,
@@ -2173,13 +2241,15 @@ int msOracleSpatialLayerWhichShapes( layerObj *layer, rectObj rect, int isQuery)
                       OCIDefineObject( adtp, hand->errhp, dthand->tdo, (dvoid **)sthand->obj, (ub4 *)0, (dvoid **)sthand->ind, (ub4 *)0 ) )
               && TRY(hand,
                      /* execute */
-                     OCIStmtExecute( hand->svchp, sthand->stmthp, hand->errhp, (ub4)ARRAY_SIZE, (ub4)0, (OCISnapshot *)NULL, (OCISnapshot *)NULL, (ub4)cursor_type ) )
+                     OCIStmtExecute( hand->svchp, sthand->stmthp, hand->errhp, sthand->array_size, (ub4)0, (OCISnapshot *)NULL, (OCISnapshot *)NULL, (ub4)cursor_type ) )
               &&  TRY( hand,
                        /* get rows fetched */
                        OCIAttrGet( (dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&sthand->rows_fetched, (ub4 *)0, (ub4)OCI_ATTR_ROWS_FETCHED, hand->errhp ) )
               && TRY( hand,
                       /* get rows count */
                       OCIAttrGet( (dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&sthand->rows_count, (ub4 *)0, (ub4)OCI_ATTR_ROW_COUNT, hand->errhp ) );
+
+    osFetchTimerStop(sthand, &starttime);
   }
 
   if (!success) {
@@ -2249,12 +2319,15 @@ int msOracleSpatialLayerNextShape( layerObj *layer, shapeObj *shape )
   do {
     /* is buffer empty? */
     if (sthand->row >= sthand->rows_fetched) {
+      struct mstimeval starttime;
+
       /* fetch more */
-      success = TRY( hand, OCIStmtFetch2( sthand->stmthp, hand->errhp, (ub4)ARRAY_SIZE, (ub2)OCI_FETCH_NEXT, (sb4)0, (ub4)OCI_DEFAULT ) )
+      msGettimeofday(&starttime, NULL);
+      success = TRY( hand, OCIStmtFetch2( sthand->stmthp, hand->errhp, sthand->array_size, (ub2)OCI_FETCH_NEXT, (sb4)0, (ub4)OCI_DEFAULT ) )
                 && TRY( hand, OCIAttrGet( (dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&sthand->rows_fetched, (ub4 *)0, (ub4)OCI_ATTR_ROWS_FETCHED, hand->errhp ) )
                 && TRY( hand, OCIAttrGet( (dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&sthand->rows_count, (ub4 *)0, (ub4)OCI_ATTR_ROW_COUNT, hand->errhp ) );
+      osFetchTimerStop(sthand, &starttime);
 
-  
       if (!success || sthand->rows_fetched == 0 || sthand->row_num >= sthand->rows_count) {
         hand->last_oci_status=MS_SUCCESS;
         return MS_DONE;
@@ -2369,11 +2442,15 @@ int msOracleSpatialLayerGetShape( layerObj *layer, shapeObj *shape, resultObj *r
       sthand->row += resultindex - sthand->row_num; /* move sthand row an row_num by offset from last call */
       sthand->row_num += resultindex - sthand->row_num;
     } else { /* Item is not in buffer. Fetch item from Oracle */
+      struct mstimeval starttime;
+
       if (layer->debug >= 4)
         msDebug("msOracleSpatialLayerGetShape: Fetching result from DB start: %ld end:%ld record: %d\n", buffer_first_row_num, buffer_last_row_num, resultindex);
 
-      success = TRY( hand, OCIStmtFetch2( sthand->stmthp, hand->errhp, (ub4)ARRAY_SIZE, (ub2)OCI_FETCH_ABSOLUTE, (sb4)resultindex+1, (ub4)OCI_DEFAULT ) )
+      msGettimeofday(&starttime, NULL);
+      success = TRY( hand, OCIStmtFetch2( sthand->stmthp, hand->errhp, sthand->array_size, (ub2)OCI_FETCH_ABSOLUTE, (sb4)resultindex+1, (ub4)OCI_DEFAULT ) )
                 && TRY( hand, OCIAttrGet( (dvoid *)sthand->stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&sthand->rows_fetched, (ub4 *)0, (ub4)OCI_ATTR_ROWS_FETCHED, hand->errhp ) );
+      osFetchTimerStop(sthand, &starttime);
       
       sthand->row_num = resultindex;
       sthand->row = 0; /* reset row index */
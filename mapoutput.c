@@ -102,6 +102,9 @@ struct defaultOutputFormatEntry defaultoutputformats[] = {
   {"jpeg","AGG/JPEG","image/jpeg"},
   {"png8","AGG/PNG8","image/png; mode=8bit"},
   {"png24","AGG/PNG","image/png; mode=24bit"},
+#ifdef USE_WEBP
+  {"webp","AGG/WEBP","image/webp"},
+#endif
 #ifdef USE_CAIRO
   {"pdf","CAIRO/PDF","application/x-pdf"},
   {"svg","CAIRO/SVG","image/svg+xml"},
@@ -203,6 +206,17 @@ outputFormatObj *msCreateDefaultOutputFormat( mapObj *map,
     format->renderer = MS_RENDER_WITH_AGG;
   }
 
+#if defined(USE_WEBP)
+  else if( strcasecmp(driver,"AGG/WEBP") == 0 ) {
+    if(!name) name="webp";
+    format = msAllocOutputFormat( map, name, driver );
+    format->mimetype = msStrdup("image/webp");
+    format->imagemode = MS_IMAGEMODE_RGB;
+    format->extension = msStrdup("webp");
+    format->renderer = MS_RENDER_WITH_AGG;
+  }
+#endif
+
 #if defined(USE_CAIRO)
   else if( strcasecmp(driver,"CAIRO/PNG") == 0 ) {
     if(!name) name="cairopng";
@@ -852,7 +852,7 @@ int yylex(YYSTYPE *lvalp, parseObj *p)
   case MS_TOKEN_BINDING_DOUBLE:
   case MS_TOKEN_BINDING_INTEGER:
     token = NUMBER;
-    (*lvalp).dblval = atof(p->shape->values[p->expr->curtoken->tokenval.bindval.index]);
+    (*lvalp).dblval = msShapeGetValueAsDouble(p->shape, p->expr->curtoken->tokenval.bindval.index);
     break;
   case MS_TOKEN_BINDING_STRING:
     token = STRING;
@@ -179,6 +179,8 @@ copyVirtualTable(layerVTableObj *dest,
   dest->LayerEscapeSQLParam = src->LayerEscapeSQLParam ? src->LayerEscapeSQLParam: dest->LayerEscapeSQLParam;
   dest->LayerEnablePaging = src->LayerEnablePaging ? src->LayerEnablePaging: dest->LayerEnablePaging;
   dest->LayerGetPaging = src->LayerGetPaging ? src->LayerGetPaging: dest->LayerGetPaging;
+  dest->LayerSupportsShapeRecycling = src->LayerSupportsShapeRecycling ? src->LayerSupportsShapeRecycling: dest->LayerSupportsShapeRecycling;
+  dest->LayerDependsOnScale = src->LayerDependsOnScale ? src->LayerDependsOnScale: dest->LayerDependsOnScale;
 }
 
 int
@@ -83,7 +83,56 @@
 
 #ifdef USE_POSTGIS
 
+/*
+** Map the WKB type numbers returned by PostGIS < 2.0 to the
+** valid OGC numbers
+*/
+static int wkb_postgis15[WKB_TYPE_COUNT] = {
+  0,
+  WKB_POINT,
+  WKB_LINESTRING,
+  WKB_POLYGON,
+  WKB_MULTIPOINT,
+  WKB_MULTILINESTRING,
+  WKB_MULTIPOLYGON,
+  WKB_GEOMETRYCOLLECTION,
+  WKB_CIRCULARSTRING,
+  WKB_COMPOUNDCURVE,
+  0,0,0,
+  WKB_CURVEPOLYGON,
+  WKB_MULTICURVE,
+  WKB_MULTISURFACE
+};
 
+/*
+** Map the WKB type numbers returned by PostGIS >= 2.0 to the
+** valid OGC numbers
+*/
+static int wkb_postgis20[WKB_TYPE_COUNT] = {
+  0,
+  WKB_POINT,
+  WKB_LINESTRING,
+  WKB_POLYGON,
+  WKB_MULTIPOINT,
+  WKB_MULTILINESTRING,
+  WKB_MULTIPOLYGON,
+  WKB_GEOMETRYCOLLECTION,
+  WKB_CIRCULARSTRING,
+  WKB_COMPOUNDCURVE,
+  WKB_CURVEPOLYGON,
+  WKB_MULTICURVE,
+  WKB_MULTISURFACE,
+  0,0,0
+};
+
+/*
+** The type map of wkbObj for a PostGIS version, as in
+** msPostGISLayerInfo.version.
+*/
+int *msPostGISWKBTypeMap(int version)
+{
+  return version >= 20000 ? wkb_postgis20 : wkb_postgis15;
+}
 
 /*
 ** msPostGISCloseConnection()
@@ -118,6 +167,16 @@ msPostGISLayerInfo *msPostGISCreateLayerInfo(void)
 #else
   layerinfo->force2d = MS_TRUE;
 #endif
+  layerinfo->generalize = MS_POSTGIS_GENERALIZE_NONE;
+  layerinfo->generalize_factor = 0.5;
+  layerinfo->generalize_tolerance = 0.0;
+  layerinfo->clip = MS_FALSE;
+  layerinfo->clip_buffer = 16.0;
+  layerinfo->clip_rect_set = MS_FALSE;
+  layerinfo->twkb = MS_FALSE;
+  layerinfo->quantize = 0.5;
+  layerinfo->quantize_step = 0.0;
+  layerinfo->quantize_origin.x = layerinfo->quantize_origin.y = 0.0;
   return layerinfo;
 }
 
@@ -727,6 +786,271 @@ wkbConvGeometryToShape(wkbObj *w, shapeObj *shape)
   return MS_FAILURE;
 }
 
+/*
+** TWKB support. Tile draw queries can ask the server for geometries
+** clipped to the request box and quantized to a grid of a fraction of a
+** pixel, transferred as TWKB: coordinates are varint encoded deltas on
+** that grid, which is much more compact than WKB doubles.
+*/
+typedef struct {
+  wkbObj *w;
+  int ndims;     /* number of coordinates per point */
+  double scale;  /* map units per TWKB integer unit */
+  double originx, originy; /* map coordinates of the TWKB origin */
+  long coords[4]; /* running point, TWKB coordinates are deltas */
+} twkbObj;
+
+/*
+** Read an unsigned varint, fails when running past the end of the buffer.
+*/
+static int
+twkbReadUVarInt(wkbObj *w, unsigned long *value)
+{
+  unsigned long v = 0;
+  unsigned int shift = 0;
+  unsigned char c;
+
+  do {
+    if ( w->ptr >= w->wkb + w->size || shift >= sizeof(unsigned long) * 8 )
+      return MS_FAILURE;
+    c = (unsigned char)*(w->ptr++);
+    v |= (unsigned long)(c & 0x7f) << shift;
+    shift += 7;
+  } while ( c & 0x80 );
+
+  *value = v;
+  return MS_SUCCESS;
+}
+
+/*
+** Read a zig-zag encoded signed varint.
+*/
+static int
+twkbReadVarInt(wkbObj *w, long *value)
+{
+  unsigned long u;
+  if ( twkbReadUVarInt(w, &u) != MS_SUCCESS )
+    return MS_FAILURE;
+  *value = (long)(u >> 1) ^ -(long)(u & 1);
+  return MS_SUCCESS;
+}
+
+/*
+** Read a TWKB point array into a lineObj.
+*/
+static int
+twkbReadLine(twkbObj *t, lineObj *line)
+{
+  unsigned long npoints;
+  int i, d;
+
+  line->numpoints = 0;
+  line->point = NULL;
+  if ( twkbReadUVarInt(t->w, &npoints) != MS_SUCCESS )
+    return MS_FAILURE;
+  /* every point takes at least ndims bytes */
+  if ( npoints > (unsigned long)(t->w->wkb + t->w->size - t->w->ptr) / t->ndims )
+    return MS_FAILURE;
+  if ( npoints == 0 )
+    return MS_SUCCESS;
+
+  line->point = (pointObj*)msSmallMalloc(sizeof(pointObj) * npoints);
+  for ( i = 0; i < (int)npoints; i++ ) {
+    for ( d = 0; d < t->ndims; d++ ) {
+      long delta;
+      if ( twkbReadVarInt(t->w, &delta) != MS_SUCCESS ) {
+        free(line->point);
+        line->point = NULL;
+        return MS_FAILURE;
+      }
+      t->coords[d] += delta;
+    }
+    line->point[i].x = t->originx + t->coords[0] * t->scale;
+    line->point[i].y = t->originy + t->coords[1] * t->scale;
+#ifdef USE_POINT_Z_M
+    line->point[i].z = 0;
+    line->point[i].m = 0;
+#endif
+  }
+  line->numpoints = npoints;
+
+  return MS_SUCCESS;
+}
+
+/*
+** Add a line to the shape if the shape can use it, free it otherwise.
+** Returns MS_TRUE if the line was added.
+*/
+static int
+twkbAddLine(shapeObj *shape, lineObj *line, int type)
+{
+  int keep = MS_TRUE;
+
+  if ( line->numpoints == 0 )
+    keep = MS_FALSE;
+  else if ( type != WKB_POLYGON && shape->type == MS_SHAPE_POLYGON )
+    keep = MS_FALSE;
+  else if ( type == WKB_POINT && shape->type == MS_SHAPE_LINE )
+    keep = MS_FALSE;
+
+  if ( keep )
+    msAddLineDirectly(shape, line);
+  else
+    free(line->point);
+  return keep;
+}
+
+/*
+** Convert the body of a single TWKB point, linestring or polygon.
+** Returns the number of lines added to the shape, -1 on a read error.
+*/
+static int
+twkbConvSimpleToShape(twkbObj *t, shapeObj *shape, int type)
+{
+  lineObj line;
+  unsigned long i, nrings;
+  int added = 0;
+
+  switch ( type ) {
+    case WKB_POINT:
+      line.point = (pointObj*)msSmallMalloc(sizeof(pointObj));
+      line.numpoints = 1;
+      for ( i = 0; i < (unsigned long)t->ndims; i++ ) {
+        long delta;
+        if ( twkbReadVarInt(t->w, &delta) != MS_SUCCESS ) {
+          free(line.point);
+          return -1;
+        }
+        t->coords[i] += delta;
+      }
+      line.point[0].x = t->originx + t->coords[0] * t->scale;
+      line.point[0].y = t->originy + t->coords[1] * t->scale;
+#ifdef USE_POINT_Z_M
+      line.point[0].z = 0;
+      line.point[0].m = 0;
+#endif
+      return twkbAddLine(shape, &line, type);
+
+    case WKB_LINESTRING:
+      if ( twkbReadLine(t, &line) != MS_SUCCESS )
+        return -1;
+      return twkbAddLine(shape, &line, type);
+
+    case WKB_POLYGON:
+      if ( twkbReadUVarInt(t->w, &nrings) != MS_SUCCESS )
+        return -1;
+      for ( i = 0; i < nrings; i++ ) {
+        if ( twkbReadLine(t, &line) != MS_SUCCESS )
+          return -1;
+        added += twkbAddLine(shape, &line, type);
+      }
+      return added;
+  }
+
+  return -1;
+}
+
+/*
+** Convert a TWKB geometry, header included, to a shapeObj.
+** Returns the number of lines added to the shape, -1 on a read error.
+*/
+static int
+twkbConvGeometryToShape(twkbObj *t, shapeObj *shape, double step)
+{
+  unsigned char typebyte, metabyte;
+  unsigned long n, i, ngeoms;
+  long value;
+  int type, precision, d, added = 0, rv;
+
+  if ( t->w->ptr + 2 > t->w->wkb + t->w->size )
+    return -1;
+  typebyte = (unsigned char)*(t->w->ptr++);
+  metabyte = (unsigned char)*(t->w->ptr++);
+  type = typebyte & 0x0f;
+  precision = (typebyte >> 4);
+  precision = (precision >> 1) ^ -(precision & 1);
+  t->scale = step / pow(10.0, precision);
+
+  t->ndims = 2;
+  if ( metabyte & 0x08 ) { /* extended dimensions */
+    unsigned char dims;
+    if ( t->w->ptr >= t->w->wkb + t->w->size )
+      return -1;
+    dims = (unsigned char)*(t->w->ptr++);
+    t->ndims += (dims & 0x01) + ((dims & 0x02) >> 1);
+  }
+  if ( metabyte & 0x02 ) { /* size */
+    if ( twkbReadUVarInt(t->w, &n) != MS_SUCCESS )
+      return -1;
+  }
+  if ( metabyte & 0x01 ) { /* bbox, min and delta per dimension */
+    for ( d = 0; d < t->ndims * 2; d++ ) {
+      if ( twkbReadVarInt(t->w, &value) != MS_SUCCESS )
+        return -1;
+    }
+  }
+  if ( metabyte & 0x10 ) /* empty */
+    return 0;
+
+  /* a new header restarts the deltas */
+  memset(t->coords, 0, sizeof(t->coords));
+
+  switch ( type ) {
+    case WKB_POINT:
+    case WKB_LINESTRING:
+    case WKB_POLYGON:
+      return twkbConvSimpleToShape(t, shape, type);
+
+    case WKB_MULTIPOINT:
+    case WKB_MULTILINESTRING:
+    case WKB_MULTIPOLYGON:
+    case WKB_GEOMETRYCOLLECTION:
+      if ( twkbReadUVarInt(t->w, &ngeoms) != MS_SUCCESS )
+        return -1;
+      if ( metabyte & 0x04 ) { /* id list */
+        for ( i = 0; i < ngeoms; i++ ) {
+          if ( twkbReadVarInt(t->w, &value) != MS_SUCCESS )
+            return -1;
+        }
+      }
+      for ( i = 0; i < ngeoms; i++ ) {
+        if ( type == WKB_GEOMETRYCOLLECTION )
+          rv = twkbConvGeometryToShape(t, shape, step);
+        else
+          rv = twkbConvSimpleToShape(t, shape, type - 3);
+        if ( rv < 0 )
+          return -1;
+        added += rv;
+      }
+      return added;
+  }
+
+  return -1;
+}
+
+/*
+** msPostGISReadTWKB()
+**
+** Decode a TWKB geometry quantized on a grid of the given step and origin,
+** as requested by msPostGISSetTransfer(), into the lines of a shape whose
+** type is already set. Returns the number of lines added, -1 on a read
+** error.
+*/
+int msPostGISReadTWKB(char *twkb, size_t size, double step, pointObj *origin, shapeObj *shape)
+{
+  wkbObj w;
+  twkbObj t;
+
+  w.wkb = w.ptr = twkb;
+  w.size = size;
+  w.typemap = NULL;
+  t.w = &w;
+  t.originx = origin->x;
+  t.originy = origin->y;
+
+  return twkbConvGeometryToShape(&t, shape, step);
+}
+
 
 /*
 ** Calculate determinant of a 3x3 matrix. Handy for
@@ -1684,6 +2008,54 @@ char *msPostGISBuildSQLBox(layerObj *layer, rectObj *rect, char *strSRID)
 }
 
 
+/*
+** msPostGISBuildSQLGeometry()
+**
+** Returns the SQL expression of the geometry column, wrapped in the
+** generalization function of the layer when the query being built
+** has a tolerance set, and clipped to the query clip box if any.
+**
+** Returns malloc'ed char* that must be freed by caller.
+*/
+static char *msPostGISBuildSQLGeometry(layerObj *layer)
+{
+  msPostGISLayerInfo *layerinfo = (msPostGISLayerInfo *)layer->layerinfo;
+  const char *strFunction = NULL;
+  char *strColumn;
+
+  switch(layerinfo->generalize) {
+    case MS_POSTGIS_GENERALIZE_SNAPTOGRID:
+      strFunction = "ST_SnapToGrid";
+      break;
+    case MS_POSTGIS_GENERALIZE_SIMPLIFY:
+      strFunction = "ST_Simplify";
+      break;
+    case MS_POSTGIS_GENERALIZE_SIMPLIFYPT:
+      strFunction = "ST_SimplifyPreserveTopology";
+      break;
+  }
+
+  if( strFunction == NULL || layerinfo->generalize_tolerance <= 0 ) {
+    strColumn = (char*)msSmallMalloc(strlen(layerinfo->geomcolumn) + 3);
+    sprintf(strColumn, "\"%s\"", layerinfo->geomcolumn);
+  } else {
+    strColumn = (char*)msSmallMalloc(strlen(strFunction) + strlen(layerinfo->geomcolumn) + 64);
+    sprintf(strColumn, "%s(\"%s\",%.15g)", strFunction, layerinfo->geomcolumn, layerinfo->generalize_tolerance);
+  }
+
+  if( layerinfo->clip_rect_set ) {
+    const char *strClipTemplate = "ST_ClipByBox2D(%s,ST_MakeEnvelope(%.15g,%.15g,%.15g,%.15g)::box2d)";
+    char *strClip = (char*)msSmallMalloc(strlen(strClipTemplate) + strlen(strColumn) + 4 * 22 + 1);
+    sprintf(strClip, strClipTemplate, strColumn,
+            layerinfo->clip_rect.minx, layerinfo->clip_rect.miny,
+            layerinfo->clip_rect.maxx, layerinfo->clip_rect.maxy);
+    free(strColumn);
+    strColumn = strClip;
+  }
+
+  return strColumn;
+}
+
 /*
 ** msPostGISBuildSQLItems()
 **
@@ -1729,10 +2101,11 @@ char *msPostGISBuildSQLItems(layerObj *layer)
     ** need, saving transfer and encode/decode time.
     */
     char *force2d = "";
+    char *strGeomColumn = NULL;
 #if TRANSFER_ENCODING == 64
-    const char *strGeomTemplate = "encode(ST_AsBinary(%s(\"%s\"),'%s'),'base64') as geom,\"%s\"";
+    const char *strGeomTemplate = "encode(ST_AsBinary(%s(%s),'%s'),'base64') as geom,\"%s\"";
 #else
-    const char *strGeomTemplate = "encode(ST_AsBinary(%s(\"%s\"),'%s'),'hex') as geom,\"%s\"";
+    const char *strGeomTemplate = "encode(ST_AsBinary(%s(%s),'%s'),'hex') as geom,\"%s\"";
 #endif
     if( layerinfo->force2d ) {
       if( layerinfo->version >= 20100 )
@@ -1744,13 +2117,50 @@ char *msPostGISBuildSQLItems(layerObj *layer)
     {
         /* Use AsEWKB() to get 3D */
 #if TRANSFER_ENCODING == 64
-        strGeomTemplate = "encode(AsEWKB(%s(\"%s\"),'%s'),'base64') as geom,\"%s\"";
+        strGeomTemplate = "encode(AsEWKB(%s(%s),'%s'),'base64') as geom,\"%s\"";
+#else
+        strGeomTemplate = "encode(AsEWKB(%s(%s),'%s'),'hex') as geom,\"%s\"";
+#endif
+    }
+
+    /*
+    ** Generalize and clip on the server for draw queries, vertices closer
+    ** than a fraction of a pixel or outside of the request box would be
+    ** dropped by the renderer anyway.
+    */
+    strGeomColumn = msPostGISBuildSQLGeometry(layer);
+
+    if( layerinfo->quantize_step > 0 ) {
+      /*
+      ** Quantized transport: move the geometry to the integer grid of
+      ** the result and send it as TWKB, read by twkbConvGeometryToShape().
+      */
+      double scale = 1.0 / layerinfo->quantize_step;
+#if TRANSFER_ENCODING == 64
+      const char *strTWKBTemplate = "encode(ST_AsTWKB(ST_Affine(ST_Force2D(%s),%.15g,0,0,%.15g,%.15g,%.15g),0),'base64') as geom,\"%s\"";
 #else
-        strGeomTemplate = "encode(AsEWKB(%s(\"%s\"),'%s'),'hex') as geom,\"%s\"";
+      const char *strTWKBTemplate = "encode(ST_AsTWKB(ST_Affine(ST_Force2D(%s),%.15g,0,0,%.15g,%.15g,%.15g),0),'hex') as geom,\"%s\"";
 #endif
+      strGeom = (char*)msSmallMalloc(strlen(strTWKBTemplate) + strlen(strGeomColumn) + 4 * 22 + strlen(layerinfo->uid) + 1);
+      sprintf(strGeom, strTWKBTemplate, strGeomColumn, scale, scale,
+              -layerinfo->quantize_origin.x * scale, -layerinfo->quantize_origin.y * scale, layerinfo->uid);
+    } else {
+      strGeom = (char*)msSmallMalloc(strlen(strGeomTemplate) + strlen(force2d) + strlen(strEndian) + strlen(strGeomColumn) + strlen(layerinfo->uid) + 1);
+      sprintf(strGeom, strGeomTemplate, force2d, strGeomColumn, strEndian, layerinfo->uid);
+    }
+    free(strGeomColumn);
+
+    /*
+    ** Also ask for the size of the original geometry so the transfer
+    ** saving of the generalization can be reported when tuning.
+    */
+    if( layerinfo->generalize_tolerance > 0 && layer->debug >= MS_DEBUGLEVEL_TUNING ) {
+      const char *strSizeTemplate = ",octet_length(ST_AsBinary(%s(\"%s\"),'%s')) as geom_bytes";
+      char *strSize = (char*)msSmallMalloc(strlen(strSizeTemplate) + strlen(force2d) + strlen(layerinfo->geomcolumn) + strlen(strEndian) + 1);
+      sprintf(strSize, strSizeTemplate, force2d, layerinfo->geomcolumn, strEndian);
+      strGeom = msStringConcatenate(strGeom, strSize);
+      free(strSize);
     }
-    strGeom = (char*)msSmallMalloc(strlen(strGeomTemplate) + strlen(force2d) + strlen(strEndian) + strlen(layerinfo->geomcolumn) + strlen(layerinfo->uid) + 1);
-    sprintf(strGeom, strGeomTemplate, force2d, layerinfo->geomcolumn, strEndian, layerinfo->uid);
   }
 
   if( layer->debug > 1 ) {
@@ -2246,11 +2656,9 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
   w.size = (wkbstrlen - 1)/2;
 
   /* Set the type map according to what version of PostGIS we are dealing with */
-  if( layerinfo->version >= 20000 ) /* PostGIS 2.0+ */
-    w.typemap = wkb_postgis20;
-  else
+  w.typemap = msPostGISWKBTypeMap(layerinfo->version);
+  if( layerinfo->version < 20000 ) /* PostGIS < 2.0 */
   {
-    w.typemap = wkb_postgis15;
     if( layerinfo->force2d == MS_FALSE )
     {
         /* Is there SRID ? Skip it */
@@ -2267,7 +2675,16 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
     }
   }
 
-  switch (layer->type) {
+  if( layerinfo->quantize_step > 0 ) {
+    /* TWKB result of a quantized draw query, see msPostGISSetTransfer() */
+    shape->type = (layer->type == MS_LAYER_POLYGON) ? MS_SHAPE_POLYGON : MS_SHAPE_LINE;
+    if( msPostGISReadTWKB(w.wkb, result, layerinfo->quantize_step, &layerinfo->quantize_origin, shape) > 0 ) {
+      result = MS_SUCCESS;
+    } else {
+      msFreeShape(shape);
+      result = MS_FAILURE;
+    }
+  } else switch (layer->type) {
 
     case MS_LAYER_POINT:
       shape->type = MS_SHAPE_POINT;
@@ -2311,17 +2728,18 @@ int msPostGISReadShape(layerObj *layer, shapeObj *shape)
     char *tmp;
     /* Found a drawable shape, so now retreive the attributes. */
 
-    shape->values = (char**) msSmallMalloc(sizeof(char*) * layer->numitems);
+    /* text results are null terminated, the buffers of a recycled shape can hold them */
+    if( msShapeReserveValues(shape, layer->numitems) == NULL ) {
+      msFreeShape(shape);
+      return MS_FAILURE;
+    }
     for ( t = 0; t < layer->numitems; t++) {
       int size = PQgetlength(layerinfo->pgresult, layerinfo->rownum, t);
       char *val = (char*)PQgetvalue(layerinfo->pgresult, layerinfo->rownum, t);
       int isnull = PQgetisnull(layerinfo->pgresult, layerinfo->rownum, t);
       if ( isnull ) {
-        shape->values[t] = msStrdup("");
-      } else {
-        shape->values[t] = (char*) msSmallMalloc(size + 1);
-        memcpy(shape->values[t], val, size);
-        shape->values[t][size] = '\0'; /* null terminate it */
+        msShapeSetValue(shape, t, "");
+      } else if( msShapeSetValue(shape, t, val) ) {
         msStringTrimBlanks(shape->values[t]);
       }
       if( layer->debug > 4 ) {
@@ -2380,6 +2798,8 @@ int msPostGISLayerOpen(layerObj *layer)
   msPostGISLayerInfo  *layerinfo;
   int order_test = 1;
   const char* force2d_processing;
+  const char* generalize_processing;
+  const char* clip_processing;
 
   assert(layer != NULL);
 
@@ -2511,6 +2931,51 @@ int msPostGISLayerOpen(layerObj *layer)
   if (layer->debug)
     msDebug("msPostGISLayerOpen: Forcing 2D geometries: %s.\n", (layerinfo->force2d)?"yes":"no");
 
+  generalize_processing = msLayerGetProcessingKey( layer, "GENERALIZE" );
+  if(generalize_processing) {
+    if(!strcasecmp(generalize_processing,"snaptogrid"))
+      layerinfo->generalize = MS_POSTGIS_GENERALIZE_SNAPTOGRID;
+    else if(!strcasecmp(generalize_processing,"simplify"))
+      layerinfo->generalize = MS_POSTGIS_GENERALIZE_SIMPLIFY;
+    else if(!strcasecmp(generalize_processing,"simplifypt"))
+      layerinfo->generalize = MS_POSTGIS_GENERALIZE_SIMPLIFYPT;
+    else if(strcasecmp(generalize_processing,"off") && strcasecmp(generalize_processing,"no"))
+      msDebug("msPostGISLayerOpen: Ignoring unknown GENERALIZE method '%s'.\n", generalize_processing);
+  }
+  generalize_processing = msLayerGetProcessingKey( layer, "GENERALIZE_FACTOR" );
+  if(generalize_processing && atof(generalize_processing) > 0) {
+    layerinfo->generalize_factor = atof(generalize_processing);
+  }
+  if (layer->debug && layerinfo->generalize != MS_POSTGIS_GENERALIZE_NONE)
+    msDebug("msPostGISLayerOpen: Generalizing geometries by %g pixels.\n", layerinfo->generalize_factor);
+
+  /* ST_ClipByBox2D() and ST_AsTWKB() need PostGIS 2.2 */
+  clip_processing = msLayerGetProcessingKey( layer, "CLIP" );
+  if(clip_processing && (!strcasecmp(clip_processing,"on") || !strcasecmp(clip_processing,"yes"))) {
+    if(layerinfo->version >= 20200)
+      layerinfo->clip = MS_TRUE;
+    else
+      msDebug("msPostGISLayerOpen: CLIP requires PostGIS 2.2 or later, ignored.\n");
+  }
+  clip_processing = msLayerGetProcessingKey( layer, "CLIP_BUFFER" );
+  if(clip_processing && atof(clip_processing) >= 0) {
+    layerinfo->clip_buffer = atof(clip_processing);
+  }
+  clip_processing = msLayerGetProcessingKey( layer, "TRANSPORT" );
+  if(clip_processing && !strcasecmp(clip_processing,"twkb")) {
+    if(layerinfo->version >= 20200)
+      layerinfo->twkb = MS_TRUE;
+    else
+      msDebug("msPostGISLayerOpen: TRANSPORT=TWKB requires PostGIS 2.2 or later, ignored.\n");
+  }
+  clip_processing = msLayerGetProcessingKey( layer, "QUANTIZE" );
+  if(clip_processing && atof(clip_processing) > 0) {
+    layerinfo->quantize = atof(clip_processing);
+  }
+  if (layer->debug && (layerinfo->clip || layerinfo->twkb))
+    msDebug("msPostGISLayerOpen: Clipping with a %g pixels buffer: %s, TWKB transport on a %g pixels grid: %s.\n",
+            layerinfo->clip_buffer, layerinfo->clip?"yes":"no", layerinfo->quantize, layerinfo->twkb?"yes":"no");
+
   /* Save the layerinfo in the layerObj. */
   layer->layerinfo = (void*)layerinfo;
 
@@ -2639,6 +3104,121 @@ int msPostGISLayerInitItemInfo(layerObj *layer)
 #endif
 }
 
+#ifdef USE_POSTGIS
+/*
+** msPostGISLayerCellsize()
+**
+** Returns the size of a map pixel in layer units, or 0 if unknown.
+*/
+static double msPostGISLayerCellsize(layerObj *layer)
+{
+  mapObj *map = layer->map;
+  double cellsize;
+
+  if( !map )
+    return 0.0;
+
+  cellsize = map->cellsize;
+#ifdef USE_PROJ
+  if( layer->project && msProjectionsDiffer(&(map->projection), &(layer->projection)) ) {
+    rectObj extent = map->extent;
+    if( msProjectRect(&(map->projection), &(layer->projection), &extent) != MS_SUCCESS )
+      return 0.0;
+    cellsize = MS_MIN((extent.maxx - extent.minx) / map->width,
+                      (extent.maxy - extent.miny) / map->height);
+  }
+#endif
+
+  return (cellsize > 0) ? cellsize : 0.0;
+}
+
+/*
+** msPostGISSetTransfer()
+**
+** Sets up the server side generalization, clipping and quantization of
+** a draw query for the request rect, as configured for the layer.
+** Returns MS_TRUE if any of them is used.
+*/
+static int msPostGISSetTransfer(layerObj *layer, rectObj *rect)
+{
+  msPostGISLayerInfo *layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
+  double cellsize;
+
+  /* points have nothing to simplify, charts and queries need the exact geometry */
+  if( layer->type != MS_LAYER_LINE && layer->type != MS_LAYER_POLYGON )
+    return MS_FALSE;
+  if( layerinfo->generalize == MS_POSTGIS_GENERALIZE_NONE && !layerinfo->clip && !layerinfo->twkb )
+    return MS_FALSE;
+  cellsize = msPostGISLayerCellsize(layer);
+  if( cellsize <= 0 )
+    return MS_FALSE;
+
+  if( layerinfo->generalize != MS_POSTGIS_GENERALIZE_NONE )
+    layerinfo->generalize_tolerance = cellsize * layerinfo->generalize_factor;
+
+  if( layerinfo->clip ) {
+    layerinfo->clip_rect.minx = rect->minx - layerinfo->clip_buffer * cellsize;
+    layerinfo->clip_rect.miny = rect->miny - layerinfo->clip_buffer * cellsize;
+    layerinfo->clip_rect.maxx = rect->maxx + layerinfo->clip_buffer * cellsize;
+    layerinfo->clip_rect.maxy = rect->maxy + layerinfo->clip_buffer * cellsize;
+    layerinfo->clip_rect_set = MS_TRUE;
+  }
+
+  if( layerinfo->twkb ) {
+    /* align the grid on its step so that neighbouring tiles share it */
+    layerinfo->quantize_step = cellsize * layerinfo->quantize;
+    layerinfo->quantize_origin.x = floor(rect->minx / layerinfo->quantize_step) * layerinfo->quantize_step;
+    layerinfo->quantize_origin.y = floor(rect->miny / layerinfo->quantize_step) * layerinfo->quantize_step;
+  }
+
+  return MS_TRUE;
+}
+
+/*
+** msPostGISResetTransfer()
+**
+** Clears the query building state set by msPostGISSetTransfer(), and
+** restores the quantization of the current result.
+*/
+static void msPostGISResetTransfer(msPostGISLayerInfo *layerinfo, double quantize_step, pointObj quantize_origin)
+{
+  layerinfo->generalize_tolerance = 0.0;
+  layerinfo->clip_rect_set = MS_FALSE;
+  layerinfo->quantize_step = quantize_step;
+  layerinfo->quantize_origin = quantize_origin;
+}
+
+/*
+** msPostGISReportGeneralize()
+**
+** Debug output of the geometry bytes saved by the generalization of
+** the current result.
+*/
+static void msPostGISReportGeneralize(layerObj *layer)
+{
+  msPostGISLayerInfo *layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
+  PGresult *pgresult = layerinfo->pgresult;
+  double received = 0, original = 0;
+  int i, ntuples = PQntuples(pgresult);
+
+  if( PQnfields(pgresult) < layer->numitems + 3 )
+    return;
+
+  for( i = 0; i < ntuples; i++ ) {
+#if TRANSFER_ENCODING == 64
+    received += PQgetlength(pgresult, i, layer->numitems) * 3 / 4;
+#else
+    received += PQgetlength(pgresult, i, layer->numitems) / 2;
+#endif
+    original += atof(PQgetvalue(pgresult, i, layer->numitems + 2));
+  }
+
+  msDebug("msPostGISLayerWhichShapes(%s): generalized with tolerance %g, %.0f of %.0f geometry bytes transferred (%.1f%% saved).\n",
+          layer->name ? layer->name : "(null)", layerinfo->generalize_tolerance, received, original,
+          original > 0 ? 100.0 * (original - received) / original : 0.0);
+}
+#endif
+
 /*
 ** msPostGISLayerWhichShapes()
 **
@@ -2653,6 +3233,8 @@ int msPostGISLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
   char** layer_bind_values = (char**)msSmallMalloc(sizeof(char*) * 1000);
   char* bind_value;
   char* bind_key = (char*)msSmallMalloc(3);
+  double quantize_step;
+  pointObj quantize_origin;
 
   int num_bind_values = 0;
 
@@ -2688,8 +3270,14 @@ int msPostGISLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
   layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
 
   /* Build a SQL query based on our current state. */
+  quantize_step = layerinfo->quantize_step;
+  quantize_origin = layerinfo->quantize_origin;
+  layerinfo->quantize_step = 0.0;
+  if( !isQuery )
+    msPostGISSetTransfer(layer, &rect);
   strSQL = msPostGISBuildSQL(layer, &rect, NULL);
   if ( ! strSQL ) {
+    msPostGISResetTransfer(layerinfo, quantize_step, quantize_origin);
     msSetError(MS_QUERYERR, "Failed to build query SQL.", "msPostGISLayerWhichShapes()");
     return MS_FAILURE;
   }
@@ -2722,6 +3310,8 @@ int msPostGISLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
     if (pgresult) {
       PQclear(pgresult);
     }
+    /* the previous result, if any, is kept */
+    msPostGISResetTransfer(layerinfo, quantize_step, quantize_origin);
     return MS_FAILURE;
   }
 
@@ -2733,6 +3323,12 @@ int msPostGISLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery)
   if(layerinfo->pgresult) PQclear(layerinfo->pgresult);
   layerinfo->pgresult = pgresult;
 
+  if ( layerinfo->generalize_tolerance > 0 && layer->debug >= MS_DEBUGLEVEL_TUNING )
+    msPostGISReportGeneralize(layer);
+
+  /* quantization stays in effect for reading the result */
+  msPostGISResetTransfer(layerinfo, layerinfo->quantize_step, layerinfo->quantize_origin);
+
   /* Clean any existing SQL before storing current. */
   if(layerinfo->sql) free(layerinfo->sql);
   layerinfo->sql = strSQL;
@@ -2868,6 +3464,7 @@ int msPostGISLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
   } else { /* no resultindex, fetch the shape from the DB */
     int num_tuples;
     char *strSQL = 0;
+    double quantize_step;
 
     /* Fill out layerinfo with our current DATA state. */
     if ( msPostGISParseData(layer) != MS_SUCCESS) {
@@ -2881,7 +3478,10 @@ int msPostGISLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
     layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
 
     /* Build a SQL query based on our current state. */
+    quantize_step = layerinfo->quantize_step;
+    layerinfo->quantize_step = 0.0; /* exact WKB geometry */
     strSQL = msPostGISBuildSQL(layer, 0, &shapeindex);
+    layerinfo->quantize_step = quantize_step;
     if ( ! strSQL ) {
       msSetError(MS_QUERYERR, "Failed to build query SQL.", "msPostGISLayerGetShape()");
       return MS_FAILURE;
@@ -2909,6 +3509,7 @@ int msPostGISLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record)
     /* Clean any existing pgresult before storing current one. */
     if(layerinfo->pgresult) PQclear(layerinfo->pgresult);
     layerinfo->pgresult = pgresult;
+    layerinfo->quantize_step = 0.0;
 
     /* Clean any existing SQL before storing current. */
     if(layerinfo->sql) free(layerinfo->sql);
@@ -3559,6 +4160,36 @@ int msPostGISGetPaging(layerObj *layer)
 #endif
 }
 
+/*
+** Attribute values are read into the buffers of a recycled shape, the
+** geometry is still allocated by the WKB readers.
+*/
+int msPostGISLayerSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_TRUE;
+}
+
+/*
+** Generalization, clipping and TWKB quantization of draw queries are sized
+** in pixels, see msPostGISSetTransfer().
+*/
+int msPostGISLayerDependsOnScale(layerObj *layer)
+{
+#ifdef USE_POSTGIS
+  msPostGISLayerInfo *layerinfo = (msPostGISLayerInfo*) layer->layerinfo;
+
+  if( layer->type != MS_LAYER_LINE && layer->type != MS_LAYER_POLYGON )
+    return MS_FALSE;
+  if( layerinfo )
+    return (layerinfo->generalize != MS_POSTGIS_GENERALIZE_NONE || layerinfo->clip || layerinfo->twkb);
+  /* not open, go by the settings */
+  return (msLayerGetProcessingKey(layer, "GENERALIZE") || msLayerGetProcessingKey(layer, "CLIP") ||
+          msLayerGetProcessingKey(layer, "TRANSPORT"));
+#else
+  return MS_FALSE;
+#endif
+}
+
 /*
 ** Look ahead to find the next node of a specific type.
 */
@@ -3839,6 +4470,8 @@ int msPostGISLayerInitializeVirtualTable(layerObj *layer)
   layer->vtable->LayerEscapeSQLParam = msPostGISEscapeSQLParam;
   layer->vtable->LayerEnablePaging = msPostGISEnablePaging;
   layer->vtable->LayerGetPaging = msPostGISGetPaging;
+  layer->vtable->LayerSupportsShapeRecycling = msPostGISLayerSupportsShapeRecycling;
+  layer->vtable->LayerDependsOnScale = msPostGISLayerDependsOnScale;
 
   return MS_SUCCESS;
 }
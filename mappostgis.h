@@ -43,6 +43,12 @@
 /* HEX = 16 or BASE64 = 64*/
 #define TRANSFER_ENCODING 16
 
+/* Server side generalization methods */
+#define MS_POSTGIS_GENERALIZE_NONE 0
+#define MS_POSTGIS_GENERALIZE_SNAPTOGRID 1
+#define MS_POSTGIS_GENERALIZE_SIMPLIFY 2
+#define MS_POSTGIS_GENERALIZE_SIMPLIFYPT 3
+
 /* Substitution token for box hackery */
 #define BOXTOKEN "!BOX!"
 #define BOXTOKENLENGTH 5
@@ -65,6 +71,17 @@ typedef struct {
   int         version;     /* PostGIS version of the database */
   int         paging;      /* Driver handling of pagination, enabled by default */
   int         force2d;     /* Pass geometry through ST_Force2D */
+  int         generalize;  /* Server side generalization method for draw queries (MS_POSTGIS_GENERALIZE_*) */
+  double      generalize_factor; /* Generalization tolerance, in pixels */
+  double      generalize_tolerance; /* Tolerance of the query being built, in layer units, 0 if none */
+  int         clip;        /* Clip draw query geometries to the request box on the server */
+  double      clip_buffer; /* Buffer of the clip box, in pixels */
+  rectObj     clip_rect;   /* Clip box of the query being built, in layer units */
+  int         clip_rect_set; /* Is clip_rect to be used by the query being built */
+  int         twkb;        /* Transfer draw query geometries as quantized TWKB */
+  double      quantize;    /* Quantization grid step, in pixels */
+  double      quantize_step; /* Grid step of the current result in layer units, 0 if the result is WKB */
+  pointObj    quantize_origin; /* Grid origin of the current result */
 }
 msPostGISLayerInfo;
 
@@ -113,49 +130,6 @@ typedef enum {
 */
 #define WKB_TYPE_COUNT 16
 
-/*
-** Map the WKB type numbers returned by PostGIS < 2.0 to the
-** valid OGC numbers
-*/
-static int wkb_postgis15[WKB_TYPE_COUNT] = {
-  0,
-  WKB_POINT,
-  WKB_LINESTRING,
-  WKB_POLYGON,
-  WKB_MULTIPOINT,
-  WKB_MULTILINESTRING,
-  WKB_MULTIPOLYGON,
-  WKB_GEOMETRYCOLLECTION,
-  WKB_CIRCULARSTRING,
-  WKB_COMPOUNDCURVE,
-  0,0,0,
-  WKB_CURVEPOLYGON,
-  WKB_MULTICURVE,
-  WKB_MULTISURFACE
-};
-
-/*
-** Map the WKB type numbers returned by PostGIS >= 2.0 to the
-** valid OGC numbers
-*/
-static int wkb_postgis20[WKB_TYPE_COUNT] = {
-  0,
-  WKB_POINT,
-  WKB_LINESTRING,
-  WKB_POLYGON,
-  WKB_MULTIPOINT,
-  WKB_MULTILINESTRING,
-  WKB_MULTIPOLYGON,
-  WKB_GEOMETRYCOLLECTION,
-  WKB_CIRCULARSTRING,
-  WKB_COMPOUNDCURVE,
-  WKB_CURVEPOLYGON,
-  WKB_MULTICURVE,
-  WKB_MULTISURFACE,
-  0,0,0
-};
-
-
 /*
 ** Prototypes
 */
@@ -165,6 +139,8 @@ char *msPostGISBuildSQL(layerObj *layer, rectObj *rect, long *uid);
 int msPostGISParseData(layerObj *layer);
 int arcStrokeCircularString(wkbObj *w, double segment_angle, lineObj *line, int pnZMFlag);
 int wkbConvGeometryToShape(wkbObj *w, shapeObj *shape);
+int msPostGISReadTWKB(char *twkb, size_t size, double step, pointObj *origin, shapeObj *shape);
+int *msPostGISWKBTypeMap(int version);
 pointArrayObj* pointArrayNew(int maxpoints);
 void pointArrayFree(pointArrayObj *d);
 
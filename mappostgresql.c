@@ -61,8 +61,17 @@ typedef struct {
   char        *to_column;
   char        *from_value;
   int         layer_debug;    /* there's no debug on the join, so use the layer */
+  Oid         to_type;        /* type of the join to column */
+  Oid         to_array_type;  /* array type of the join to column, looked up by the first prefetch */
+  joinTableObj *prefetched;   /* rows fetched ahead by msPOSTGRESQLJoinPrefetch(), keyed on the from value */
+  joinTableObj *requested;    /* from values that were fetched ahead */
+  int         prefetch_row;   /* next prefetched row of the current from value, -1 if none */
+  int         prefetch_mode;  /* is the current from value served from the prefetched rows */
 } msPOSTGRESQLJoinInfo;
 
+/* number of join values fetched per query */
+#define PREFETCH_BATCH_SIZE 1000
+
 /************************************************************************/
 /*                      msPOSTGRESQLJoinConnect()                       */
 /*                                                                      */
@@ -96,6 +105,12 @@ int msPOSTGRESQLJoinConnect(layerObj *layer, joinObj *join)
   joininfo->to_column = join->to;
   joininfo->from_value = NULL;
   joininfo->layer_debug = layer->debug;
+  joininfo->to_type = InvalidOid;
+  joininfo->to_array_type = InvalidOid;
+  joininfo->prefetched = NULL;
+  joininfo->requested = NULL;
+  joininfo->prefetch_row = -1;
+  joininfo->prefetch_mode = MS_FALSE;
   join->joininfo = joininfo;
 
   /*
@@ -182,6 +197,7 @@ int msPOSTGRESQLJoinConnect(layerObj *layer, joinObj *join)
       test = 0;
       join->items[0] = (char *)malloc(strlen(column) + 1);
       strcpy(join->items[0], column);
+      joininfo->to_type = PQftype(query_result, i);
     }
   }
   PQclear(query_result);
@@ -258,6 +274,12 @@ int msPOSTGRESQLJoinPrepare(joinObj *join, shapeObj *shape)
   /* Copy the next join value from the shape. */
   joininfo->from_value = msStrdup(shape->values[joininfo->from_index]);
 
+  /* Serve the value from the prefetched rows if it was part of the prefetch. */
+  joininfo->prefetch_mode = (joininfo->requested &&
+                             msJoinTableFind(joininfo->requested, joininfo->from_value) != -1);
+  if(joininfo->prefetch_mode)
+    joininfo->prefetch_row = msJoinTableFind(joininfo->prefetched, joininfo->from_value);
+
   if(joininfo->layer_debug) {
     msDebug("msPOSTGRESQLJoinPrepare() preping for value %s.\n",
             joininfo->from_value);
@@ -266,6 +288,174 @@ int msPOSTGRESQLJoinPrepare(joinObj *join, shapeObj *shape)
   return MS_SUCCESS;
 }
 
+/************************************************************************/
+/*                       msPOSTGRESQLJoinColumns()                      */
+/*                                                                      */
+/* Returns the select list of the join items, as text.                  */
+/************************************************************************/
+
+static char *msPOSTGRESQLJoinColumns(joinObj *join)
+{
+  int i, length = 1;
+  char *columns;
+
+  for(i = 0; i < join->numitems; i++) {
+    length += 8 + strlen(join->items[i]) + 2;
+  }
+
+  columns = (char *)malloc(length);
+  if(!columns) {
+    return NULL;
+  }
+
+  strcpy(columns, "");
+  for(i = 0; i < join->numitems; i++) {
+    strcat(columns, "\"");
+    strcat(columns, join->items[i]);
+    strcat(columns, "\"::text");
+    if(i != join->numitems - 1) {
+      strcat(columns, ", ");
+    }
+  }
+
+  return columns;
+}
+
+/************************************************************************/
+/*                       msPOSTGRESQLJoinPrefetch()                     */
+/*                                                                      */
+/* Fetches the rows of many join values at once, a query per batch of   */
+/* PREFETCH_BATCH_SIZE values instead of one per shape.  The values are */
+/* passed as an array of the join to column type so the comparison is   */
+/* the same as the one of the single value query.  Any failure only     */
+/* disables the prefetch, the values are then queried one by one.       */
+/************************************************************************/
+
+int msPOSTGRESQLJoinPrefetch(joinObj *join, char **values, int numvalues)
+{
+  msPOSTGRESQLJoinInfo *joininfo = join->joininfo;
+  PGresult *query_result;
+  Oid array_type;
+  char *sql, *columns;
+  int i, j, t, numqueries = 0;
+
+  if(!joininfo || !joininfo->conn || joininfo->to_type == InvalidOid || numvalues <= 0) {
+    return MS_SUCCESS;
+  }
+
+  msJoinTableFree(joininfo->prefetched);
+  msJoinTableFree(joininfo->requested);
+  joininfo->prefetched = joininfo->requested = NULL;
+  joininfo->prefetch_mode = MS_FALSE;
+
+  /* The array type of the join to column, the same for every batch of shapes. */
+  if(joininfo->to_array_type == InvalidOid) {
+    sql = (char *)malloc(64);
+    sprintf(sql, "SELECT typarray FROM pg_type WHERE oid = %u", (unsigned int)joininfo->to_type);
+    query_result = PQexec(joininfo->conn, sql);
+    free(sql);
+    if(query_result && PQresultStatus(query_result) == PGRES_TUPLES_OK && PQntuples(query_result) == 1) {
+      joininfo->to_array_type = (Oid)strtoul(PQgetvalue(query_result, 0, 0), NULL, 10);
+    }
+    if(query_result) {
+      PQclear(query_result);
+    }
+  }
+  array_type = joininfo->to_array_type;
+  if(array_type == InvalidOid) {
+    if(joininfo->layer_debug) {
+      msDebug("msPOSTGRESQLJoinPrefetch(): no array type for column %s, prefetch disabled.\n", join->to);
+    }
+    return MS_SUCCESS;
+  }
+
+  columns = msPOSTGRESQLJoinColumns(join);
+  if(!columns) {
+    msSetError(MS_MEMERR, "Failure to malloc.\n", "msPOSTGRESQLJoinPrefetch()");
+    return MS_FAILURE;
+  }
+  sql = (char *)malloc(128 + strlen(columns) + strlen(join->table) + strlen(join->to));
+  sprintf(sql, "SELECT ms_prefetch.ms_i, %s FROM generate_subscripts($1,1) AS ms_prefetch(ms_i) JOIN %s ON %s = ($1)[ms_prefetch.ms_i]",
+          columns, join->table, join->to);
+  free(columns);
+
+  joininfo->prefetched = msJoinTableCreate(join->numitems + 1, join->numitems);
+  joininfo->requested = msJoinTableCreate(1, 0);
+
+  for(i = 0; i < numvalues; i += PREFETCH_BATCH_SIZE) {
+    int count = MS_MIN(PREFETCH_BATCH_SIZE, numvalues - i);
+    bufferObj array;
+    const char *param;
+
+    /* Array literal of the values, quoted and escaped. */
+    msBufferInit(&array);
+    msBufferAppend(&array, "{", 1);
+    for(j = 0; j < count; j++) {
+      const char *c;
+      if(j > 0) msBufferAppend(&array, ",", 1);
+      msBufferAppend(&array, "\"", 1);
+      for(c = values[i + j]; *c; c++) {
+        if(*c == '"' || *c == '\\') msBufferAppend(&array, "\\", 1);
+        msBufferAppend(&array, (void *)c, 1);
+      }
+      msBufferAppend(&array, "\"", 1);
+    }
+    msBufferAppend(&array, "}", 2); /* with the terminating nul */
+    param = (const char *)array.data;
+
+    query_result = PQexecParams(joininfo->conn, sql, 1, &array_type, &param, NULL, NULL, 0);
+    msBufferFree(&array);
+    numqueries++;
+
+    if(!query_result || PQresultStatus(query_result) != PGRES_TUPLES_OK) {
+      if(joininfo->layer_debug) {
+        msDebug("msPOSTGRESQLJoinPrefetch(): error executing %s: %s, prefetch disabled.\n",
+                sql, PQerrorMessage(joininfo->conn));
+      }
+      if(query_result) {
+        PQclear(query_result);
+      }
+      msJoinTableFree(joininfo->prefetched);
+      msJoinTableFree(joininfo->requested);
+      joininfo->prefetched = joininfo->requested = NULL;
+      free(sql);
+      return MS_SUCCESS;
+    }
+
+    for(t = 0; t < PQntuples(query_result); t++) {
+      int index = atoi(PQgetvalue(query_result, t, 0)) - 1;
+      char **row;
+      if(index < 0 || index >= count) {
+        continue;
+      }
+      row = (char **)msSmallMalloc(sizeof(char *) * (join->numitems + 1));
+      for(j = 0; j < join->numitems; j++) {
+        row[j] = msStrdup(PQgetvalue(query_result, t, j + 1));
+      }
+      row[join->numitems] = msStrdup(values[i + index]);
+      msJoinTableAddRow(joininfo->prefetched, row);
+    }
+    PQclear(query_result);
+
+    for(j = 0; j < count; j++) {
+      char **row = (char **)msSmallMalloc(sizeof(char *));
+      row[0] = msStrdup(values[i + j]);
+      msJoinTableAddRow(joininfo->requested, row);
+    }
+  }
+  free(sql);
+
+  msJoinTableIndex(joininfo->prefetched);
+  msJoinTableIndex(joininfo->requested);
+
+  if(joininfo->layer_debug) {
+    msDebug("msPOSTGRESQLJoinPrefetch(): %d rows fetched for %d values in %d queries.\n",
+            joininfo->prefetched->numrows, numvalues, numqueries);
+  }
+
+  return MS_SUCCESS;
+}
+
 /************************************************************************/
 /*                       msPOSTGRESQLJoinNext()                         */
 /*                                                                      */
@@ -280,7 +470,7 @@ int msPOSTGRESQLJoinPrepare(joinObj *join, shapeObj *shape)
 int msPOSTGRESQLJoinNext(joinObj *join)
 {
   msPOSTGRESQLJoinInfo *joininfo = join->joininfo;
-  int i, length, row_count;
+  int i, row_count;
   char *sql, *columns;
 
   /* We need a connection, and a join value. */
@@ -302,31 +492,31 @@ int msPOSTGRESQLJoinNext(joinObj *join)
     join->values = NULL;
   }
 
-  /* We only need to execute the query if no results exist. */
-  if(!joininfo->query_result) {
-    /* Write the list of column names. */
-    length = 0;
+  /* Rows fetched ahead, no query needed. */
+  if(joininfo->prefetch_mode) {
+    char **row;
+    if(joininfo->prefetch_row == -1) {
+      return(MS_DONE);
+    }
+    row = joininfo->prefetched->rows[joininfo->prefetch_row];
+    join->values = (char **)malloc(sizeof(char *) * join->numitems);
     for(i = 0; i < join->numitems; i++) {
-      length += 8 + strlen(join->items[i]) + 2;
+      join->values[i] = msStrdup(row[i]);
     }
+    joininfo->prefetch_row = msJoinTableFindNext(joininfo->prefetched, joininfo->from_value, joininfo->prefetch_row);
+    return MS_SUCCESS;
+  }
 
-    columns = (char *)malloc(length);
+  /* We only need to execute the query if no results exist. */
+  if(!joininfo->query_result) {
+    /* Write the list of column names. */
+    columns = msPOSTGRESQLJoinColumns(join);
     if(!columns) {
       msSetError(MS_MEMERR, "Failure to malloc.\n",
                  "msPOSTGRESQLJoinNext()");
       return MS_FAILURE;
     }
 
-    strcpy(columns, "");
-    for(i = 0; i < join->numitems; i++) {
-      strcat(columns, "\"");
-      strcat(columns, join->items[i]);
-      strcat(columns, "\"::text");
-      if(i != join->numitems - 1) {
-        strcat(columns, ", ");
-      }
-    }
-
     /* Create the query string. */
     sql = (char *)malloc(26 + strlen(columns) + strlen(join->table) +
                          strlen(join->to) + strlen(joininfo->from_value));
@@ -414,6 +604,9 @@ int msPOSTGRESQLJoinClose(joinObj *join)
     free(joininfo->from_value);
   }
 
+  msJoinTableFree(joininfo->prefetched);
+  msJoinTableFree(joininfo->requested);
+
   free(joininfo);
   join->joininfo = NULL;
 
@@ -434,6 +627,12 @@ int msPOSTGRESQLJoinPrepare(joinObj *join, shapeObj *shape)
 
 }
 
+int msPOSTGRESQLJoinPrefetch(joinObj *join, char **values, int numvalues)
+{
+  msSetError(MS_QUERYERR, "PostgreSQL support not available.", "msPOSTGRESQLJoinPrefetch()");
+  return MS_FAILURE;
+}
+
 int msPOSTGRESQLJoinNext(joinObj *join)
 {
   msSetError(MS_QUERYERR, "PostgreSQL support not available.", "msPOSTGRESQLJoinNext()");
@@ -103,6 +103,8 @@ void msInitShape(shapeObj *shape)
 
   shape->geometry = NULL;
   shape->renderer_cache = NULL;
+  shape->recycle = NULL;
+  shape->valuecache = NULL;
 
   /* annotation component */
   shape->text = NULL;
@@ -120,8 +122,17 @@ int msCopyShape(shapeObj *from, shapeObj *to)
 
   if(!from || !to) return(-1);
 
-  for(i=0; i<from->numlines; i++)
-    msAddLine(to, &(from->line[i])); /* copy each line */
+  if(to->recycle && to->numlines == 0 && from->numlines > 0) {
+    /* fill the buffers kept by msRecycleShape() */
+    if(msShapeReserveLines(to, from->numlines) == NULL) return(-1);
+    for(i=0; i<from->numlines; i++) {
+      if(msShapeReservePoints(to, i, from->line[i].numpoints) == NULL) return(-1);
+      memcpy(to->line[i].point, from->line[i].point, sizeof(pointObj)*from->line[i].numpoints);
+    }
+  } else {
+    for(i=0; i<from->numlines; i++)
+      msAddLine(to, &(from->line[i])); /* copy each line */
+  }
 
   to->type = from->type;
 
@@ -137,7 +148,11 @@ int msCopyShape(shapeObj *from, shapeObj *to)
   to->tileindex = from->tileindex;
   to->resultindex = from->resultindex;
 
-  if(from->values) {
+  if(from->values && to->recycle && to->values == NULL) {
+    if(msShapeReserveValues(to, from->numvalues) == NULL) return(-1);
+    for(i=0; i<from->numvalues; i++)
+      if(msShapeSetValue(to, i, from->values[i] ? from->values[i] : "") == NULL) return(-1);
+  } else if(from->values) {
     to->values = (char **)msSmallMalloc(sizeof(char *)*from->numvalues);
     for(i=0; i<from->numvalues; i++)
       to->values[i] = msStrdup(from->values[i]);
@@ -150,6 +165,9 @@ int msCopyShape(shapeObj *from, shapeObj *to)
   return(0);
 }
 
+static void freeRecycledBuffers(shapeRecycleObj *recycle);
+static void freeValueCache(shapeValueCacheObj *cache);
+
 void msFreeShape(shapeObj *shape)
 {
   int c;
@@ -167,9 +185,299 @@ void msFreeShape(shapeObj *shape)
   msGEOSFreeGeometry(shape);
 #endif
 
+  if(shape->recycle) freeRecycledBuffers(shape->recycle);
+  if(shape->valuecache) freeValueCache(shape->valuecache);
+
   msInitShape(shape); /* now reset */
 }
 
+/*
+** Numeric attribute values: expressions and attribute bindings used to run
+** atof() on the same attribute string for every class, style and label that
+** looks at it. msShapeGetValueAsDouble() parses a value once per feature and
+** keeps the number with the shape, drivers that read typed data can store
+** it directly with msShapeSetValueAsDouble().
+**
+** The numbers belong to the values array they were taken from and are
+** forgotten when the shape is freed or recycled or its values array is
+** replaced. Code that changes a string of the array in place must call
+** msShapeResetValueCache().
+*/
+struct shapeValueCacheObj {
+  char **values; /* shape->values the numbers belong to */
+  int size;
+  double *numbers; /* both arrays follow the structure in the same block */
+  char *isset;
+};
+
+static void freeValueCache(shapeValueCacheObj *cache)
+{
+  free(cache);
+}
+
+static shapeValueCacheObj *getValueCache(shapeObj *shape, int i)
+{
+  shapeValueCacheObj *cache = shape->valuecache;
+
+  if(cache == NULL || i >= cache->size) {
+    /* numbers already parsed are simply parsed again */
+    int size = MS_MAX(i+1, shape->numvalues);
+    cache = (shapeValueCacheObj *) msSmallRealloc(cache, sizeof(shapeValueCacheObj) + size*(sizeof(double)+1));
+    cache->size = size;
+    cache->numbers = (double *) (cache + 1);
+    cache->isset = (char *) (cache->numbers + size);
+    cache->values = NULL;
+    shape->valuecache = cache;
+  }
+  if(cache->values != shape->values) {
+    memset(cache->isset, 0, cache->size);
+    cache->values = shape->values;
+  }
+  return cache;
+}
+
+/* Returns atof() of value i of shape, which must not be NULL. */
+double msShapeGetValueAsDouble(shapeObj *shape, int i)
+{
+  shapeValueCacheObj *cache = shape->valuecache;
+
+  if(cache == NULL || cache->values != shape->values || i >= cache->size)
+    cache = getValueCache(shape, i);
+
+  if(!cache->isset[i]) {
+    cache->numbers[i] = atof(shape->values[i]);
+    cache->isset[i] = MS_TRUE;
+  }
+  return cache->numbers[i];
+}
+
+/*
+** Stores the number of value i of shape, for drivers that have it already.
+** It must be what atof() returns for the string.
+*/
+void msShapeSetValueAsDouble(shapeObj *shape, int i, double value)
+{
+  shapeValueCacheObj *cache = getValueCache(shape, i);
+
+  cache->numbers[i] = value;
+  cache->isset[i] = MS_TRUE;
+}
+
+void msShapeResetValueCache(shapeObj *shape)
+{
+  if(shape->valuecache)
+    shape->valuecache->values = NULL; /* cleared on next use */
+}
+
+/*
+** Shape buffer recycling: a loop reading features with msLayerNextShape()
+** can call msLayerRecycleShape() instead of msFreeShape() once it is done
+** with a feature, which calls msRecycleShape() for the drivers that support
+** it. The line, point and value buffers are then kept with the shape,
+** and a driver whose LayerSupportsShapeRecycling() returns MS_TRUE fills the
+** next feature into them through msShapeReserveLines(),
+** msShapeReservePoints(), msShapeReserveValues() and msShapeSetValue(),
+** allocating only when a buffer is too small. msFreeShape() releases the
+** kept buffers, so the loop must still end with one.
+**
+** Buffers are kept per line and per value index, as consecutive features of
+** a layer tend to have the same structure. The size of a kept buffer is what
+** the shape was known to use, never more, so it stays correct whatever code
+** replaced the shape's buffers in the meantime.
+*/
+typedef struct {
+  void *buffer;
+  size_t size;
+} recycledBufferObj;
+
+struct shapeRecycleObj {
+  recycledBufferObj line;
+  recycledBufferObj *points; /* points of line i */
+  int numpoints;
+  recycledBufferObj values;
+  recycledBufferObj *strings; /* value i */
+  int numstrings;
+
+  long reused, allocated; /* buffers taken from the above vs. allocated */
+};
+
+static void freeRecycledBuffers(shapeRecycleObj *recycle)
+{
+  int i;
+
+  free(recycle->line.buffer);
+  for(i=0; i<recycle->numpoints; i++)
+    free(recycle->points[i].buffer);
+  free(recycle->points);
+  free(recycle->values.buffer);
+  for(i=0; i<recycle->numstrings; i++)
+    free(recycle->strings[i].buffer);
+  free(recycle->strings);
+  free(recycle);
+}
+
+static recycledBufferObj *getRecycledBuffer(recycledBufferObj **buffers, int *numbuffers, int i)
+{
+  if(i >= *numbuffers) {
+    *buffers = (recycledBufferObj *) msSmallRealloc(*buffers, sizeof(recycledBufferObj)*(i+1));
+    memset(*buffers + *numbuffers, 0, sizeof(recycledBufferObj)*(i+1-*numbuffers));
+    *numbuffers = i+1;
+  }
+  return *buffers + i;
+}
+
+/* keeps buffer in slot, or frees it if the slot already holds a big enough one */
+static void keepBuffer(recycledBufferObj *slot, void *buffer, size_t size)
+{
+  if(buffer == NULL)
+    return;
+  if(slot->buffer) {
+    if(slot->size >= size) {
+      free(buffer);
+      return;
+    }
+    free(slot->buffer);
+  }
+  slot->buffer = buffer;
+  slot->size = size;
+}
+
+static void *takeBuffer(shapeRecycleObj *recycle, recycledBufferObj *slot, size_t size)
+{
+  void *buffer;
+
+  if(slot && slot->buffer && slot->size >= size) {
+    buffer = slot->buffer;
+    recycle->reused++;
+  } else {
+    if(slot)
+      free(slot->buffer);
+    buffer = malloc(MS_MAX(size, 1));
+    if(recycle)
+      recycle->allocated++;
+  }
+  if(slot) {
+    slot->buffer = NULL;
+    slot->size = 0;
+  }
+  return buffer;
+}
+
+/*
+** Like msFreeShape(), but keeps the shape's buffers for the next feature
+** read into it (see above).
+*/
+void msRecycleShape(shapeObj *shape)
+{
+  shapeRecycleObj *recycle = shape->recycle;
+  shapeValueCacheObj *valuecache = shape->valuecache;
+  int i;
+
+  if(recycle == NULL)
+    recycle = (shapeRecycleObj *) msSmallCalloc(1, sizeof(shapeRecycleObj));
+
+  for(i=0; i<shape->numlines; i++)
+    keepBuffer(getRecycledBuffer(&recycle->points, &recycle->numpoints, i),
+               shape->line[i].point, sizeof(pointObj)*shape->line[i].numpoints);
+  keepBuffer(&recycle->line, shape->line, sizeof(lineObj)*shape->numlines);
+
+  if(shape->values) {
+    for(i=0; i<shape->numvalues; i++) {
+      if(shape->values[i])
+        keepBuffer(getRecycledBuffer(&recycle->strings, &recycle->numstrings, i),
+                   shape->values[i], strlen(shape->values[i])+1);
+    }
+    keepBuffer(&recycle->values, shape->values, sizeof(char *)*shape->numvalues);
+  }
+
+  free(shape->text);
+
+#ifdef USE_GEOS
+  msGEOSFreeGeometry(shape);
+#endif
+
+  msInitShape(shape);
+  shape->recycle = recycle;
+  shape->valuecache = valuecache;
+  msShapeResetValueCache(shape);
+}
+
+/*
+** Gives an empty shape numlines lines, without points yet. Returns NULL when
+** out of memory.
+*/
+lineObj *msShapeReserveLines(shapeObj *shape, int numlines)
+{
+  shapeRecycleObj *recycle = shape->recycle;
+  int i;
+
+  assert(shape->line == NULL);
+  shape->line = (lineObj *) takeBuffer(recycle, recycle ? &recycle->line : NULL, sizeof(lineObj)*numlines);
+  MS_CHECK_ALLOC(shape->line, sizeof(lineObj)*numlines, NULL);
+  for(i=0; i<numlines; i++) {
+    shape->line[i].numpoints = 0;
+    shape->line[i].point = NULL;
+  }
+  shape->numlines = numlines;
+  return shape->line;
+}
+
+/*
+** Gives line of shape, reserved with msShapeReserveLines(), room for
+** numpoints points. Returns NULL when out of memory.
+*/
+pointObj *msShapeReservePoints(shapeObj *shape, int line, int numpoints)
+{
+  shapeRecycleObj *recycle = shape->recycle;
+  lineObj *l = shape->line + line;
+
+  assert(l->point == NULL);
+  l->point = (pointObj *) takeBuffer(recycle, recycle ? getRecycledBuffer(&recycle->points, &recycle->numpoints, line) : NULL,
+                                     sizeof(pointObj)*numpoints);
+  MS_CHECK_ALLOC(l->point, sizeof(pointObj)*numpoints, NULL);
+  l->numpoints = numpoints;
+  return l->point;
+}
+
+/* Gives an empty shape numvalues values, all NULL. */
+char **msShapeReserveValues(shapeObj *shape, int numvalues)
+{
+  shapeRecycleObj *recycle = shape->recycle;
+
+  assert(shape->values == NULL);
+  msShapeResetValueCache(shape);
+  shape->values = (char **) takeBuffer(recycle, recycle ? &recycle->values : NULL, sizeof(char *)*numvalues);
+  MS_CHECK_ALLOC(shape->values, sizeof(char *)*numvalues, NULL);
+  memset(shape->values, 0, sizeof(char *)*numvalues);
+  shape->numvalues = numvalues;
+  return shape->values;
+}
+
+/* Sets value i of a shape reserved with msShapeReserveValues() to a copy of value. */
+char *msShapeSetValue(shapeObj *shape, int i, const char *value)
+{
+  shapeRecycleObj *recycle = shape->recycle;
+  size_t size = strlen(value)+1;
+
+  free(shape->values[i]);
+  if(shape->valuecache && i < shape->valuecache->size)
+    shape->valuecache->isset[i] = MS_FALSE;
+  shape->values[i] = (char *) takeBuffer(recycle, recycle ? getRecycledBuffer(&recycle->strings, &recycle->numstrings, i) : NULL, size);
+  MS_CHECK_ALLOC(shape->values[i], size, NULL);
+  memcpy(shape->values[i], value, size);
+  return shape->values[i];
+}
+
+/*
+** Returns how many buffers were served from recycled ones and how many had
+** to be allocated since the shape was first recycled.
+*/
+void msShapeRecycleStats(shapeObj *shape, long *reused, long *allocated)
+{
+  *reused = shape->recycle ? shape->recycle->reused : 0;
+  *allocated = shape->recycle ? shape->recycle->allocated : 0;
+}
+
 void msFreeLabelPathObj(labelPathObj *path)
 {
   msFreeShape(&(path->bounds));
@@ -2141,7 +2449,7 @@ LABEL_END:
         lfr->follow_labels = msSmallRealloc(lfr->follow_labels,lfr->num_follow_labels * sizeof(textSymbolObj*));
         tmptp = ts->textpath;
         ts->textpath = NULL;
-        lfr->follow_labels[lfr->num_follow_labels - 1] = msSmallMalloc(sizeof(textSymbolObj));
+        lfr->follow_labels[lfr->num_follow_labels - 1] = msArenaAlloc(msGetLabelCacheArena(map), sizeof(textSymbolObj));
         tsnew = lfr->follow_labels[lfr->num_follow_labels - 1];
         initTextSymbol(tsnew);
         msCopyTextSymbol(tsnew,ts);
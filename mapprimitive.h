@@ -64,6 +64,11 @@ typedef struct {
 #endif
 } lineObj;
 
+#ifndef SWIG
+typedef struct shapeRecycleObj shapeRecycleObj;
+typedef struct shapeValueCacheObj shapeValueCacheObj;
+#endif
+
 typedef struct {
 #ifdef SWIG
   %immutable;
@@ -75,6 +80,8 @@ typedef struct {
   char **values;
   void *geometry;
   void *renderer_cache;
+  shapeRecycleObj *recycle; /* buffers kept by msRecycleShape() */
+  shapeValueCacheObj *valuecache; /* numeric values, see msShapeGetValueAsDouble() */
 #endif
 
 #ifdef SWIG
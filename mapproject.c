@@ -184,6 +184,239 @@ int msProjectPoint(projectionObj *in, projectionObj *out, pointObj *point)
 #endif
 }
 
+#ifdef USE_PROJ
+/************************************************************************/
+/*                   msProjectApplyGeotransform()                       */
+/*                                                                      */
+/*      Applies in->gt ahead of and out->gt after a projection, as      */
+/*      msProjectPoint() does, for code projecting point arrays.        */
+/************************************************************************/
+static void msProjectApplyGeotransform(projectionObj *in, pointObj *points, int count)
+{
+  int i;
+
+  if( !in || !in->gt.need_geotransform )
+    return;
+
+  for( i = 0; i < count; i++ ) {
+    double x_out, y_out;
+
+    x_out = in->gt.geotransform[0]
+            + in->gt.geotransform[1] * points[i].x
+            + in->gt.geotransform[2] * points[i].y;
+    y_out = in->gt.geotransform[3]
+            + in->gt.geotransform[4] * points[i].x
+            + in->gt.geotransform[5] * points[i].y;
+    points[i].x = x_out;
+    points[i].y = y_out;
+  }
+}
+
+static void msProjectApplyInvGeotransform(projectionObj *out, pointObj *points, int count)
+{
+  int i;
+
+  if( !out || !out->gt.need_geotransform )
+    return;
+
+  for( i = 0; i < count; i++ ) {
+    double x_out, y_out;
+
+    if( points[i].x == HUGE_VAL )
+      continue;
+    x_out = out->gt.invgeotransform[0]
+            + out->gt.invgeotransform[1] * points[i].x
+            + out->gt.invgeotransform[2] * points[i].y;
+    y_out = out->gt.invgeotransform[3]
+            + out->gt.invgeotransform[4] * points[i].x
+            + out->gt.invgeotransform[5] * points[i].y;
+    points[i].x = x_out;
+    points[i].y = y_out;
+  }
+}
+#endif /* def USE_PROJ */
+
+#if defined(USE_PROJ) && defined(USE_PROJ_FASTPATHS)
+#define MAXEXTENT 20037508.34
+#define M_PIby360 .0087266462599716479
+#define MAXEXTENTby180 111319.4907777777777777777
+
+/************************************************************************/
+/*                msProjectLonLatToGMerc() / GMercToLonLat()            */
+/*                                                                      */
+/*      EPSG:4326 <-> EPSG:3857 without PROJ. The loops have no         */
+/*      branches so that the compiler can vectorize them.               */
+/************************************************************************/
+static void msProjectLonLatToGMerc(pointObj *points, int count)
+{
+  int i;
+
+  for( i = 0; i < count; i++ ) {
+    double x = points[i].x * MAXEXTENTby180;
+    double y = log(tan((90 + points[i].y) * M_PIby360)) * MS_RAD_TO_DEG * MAXEXTENTby180;
+    points[i].x = MS_MAX(-MAXEXTENT, MS_MIN(MAXEXTENT, x));
+    points[i].y = MS_MAX(-MAXEXTENT, MS_MIN(MAXEXTENT, y));
+  }
+}
+
+static void msProjectGMercToLonLat(pointObj *points, int count)
+{
+  int i;
+
+  for( i = 0; i < count; i++ ) {
+    double x = MS_MAX(-MAXEXTENT, MS_MIN(MAXEXTENT, points[i].x));
+    double y = MS_MAX(-MAXEXTENT, MS_MIN(MAXEXTENT, points[i].y));
+    points[i].x = (x / MAXEXTENT) * 180;
+    points[i].y = MS_RAD_TO_DEG * (2 * atan(exp((y / MAXEXTENT) * 180 * MS_DEG_TO_RAD)) - MS_PI2);
+  }
+}
+
+/************************************************************************/
+/*                 msProjectIsFastPath() / msProjectFastPath()          */
+/*                                                                      */
+/*      msProjectFastPath() projects the points if in/out is one of     */
+/*      the fast paths and returns MS_TRUE, or returns MS_FALSE         */
+/*      without touching them.                                          */
+/************************************************************************/
+static int msProjectIsFastPath(projectionObj *in, projectionObj *out)
+{
+  return in && out
+         && ((in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc)
+             || (in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat));
+}
+
+static int msProjectFastPath(projectionObj *in, projectionObj *out, pointObj *points, int count)
+{
+  if( !msProjectIsFastPath(in, out) )
+    return MS_FALSE;
+
+  msProjectApplyGeotransform(in, points, count);
+  if( in->wellknownprojection == wkp_lonlat )
+    msProjectLonLatToGMerc(points, count);
+  else
+    msProjectGMercToLonLat(points, count);
+  msProjectApplyInvGeotransform(out, points, count);
+  return MS_TRUE;
+}
+#endif
+
+#ifdef USE_PROJ
+/* points projected per pj_transform() call by msProjectPoints() */
+#define MS_PROJECT_POINTS_CHUNK 256
+
+/* only the pj_transform() case of msProjectPoint() is batched */
+static int msProjectPointsBatched(projectionObj *in, projectionObj *out, int count)
+{
+  return count >= 2 && in && in->proj && out && out->proj
+         && !(in->numargs == 1 && out->numargs == 1 && strcmp(in->args[0],out->args[0]) == 0);
+}
+
+/************************************************************************/
+/*                         msProjectPointsTo()                          */
+/*                                                                      */
+/*      Projects count points of src into dst, which must not overlap   */
+/*      src. src is left as is, so if pj_transform() rejects the        */
+/*      whole batch the points are projected again one by one from it. */
+/************************************************************************/
+static int msProjectPointsTo(projectionObj *in, projectionObj *out,
+                             const pointObj *src, pointObj *dst, int count)
+{
+  int i, error, failures = 0;
+
+  if( !msProjectPointsBatched(in, out, count) ) {
+    memcpy(dst, src, sizeof(pointObj) * count);
+    return msProjectPoints(in, out, dst, count);
+  }
+
+  memcpy(dst, src, sizeof(pointObj) * count);
+  msProjectApplyGeotransform(in, dst, count);
+  if( pj_is_latlong(in->proj) ) {
+    for( i = 0; i < count; i++ ) {
+      dst[i].x *= DEG_TO_RAD;
+      dst[i].y *= DEG_TO_RAD;
+    }
+  }
+
+#if PJ_VERSION < 480
+  msAcquireLock( TLOCK_PROJ );
+#endif
+  error = pj_transform( in->proj, out->proj, count, sizeof(pointObj) / sizeof(double),
+                        &(dst[0].x), &(dst[0].y), NULL );
+#if PJ_VERSION < 480
+  msReleaseLock( TLOCK_PROJ );
+#endif
+
+  /* pj_transform() gives up on the whole array for some errors */
+  if( error ) {
+    for( i = 0; i < count; i++ ) {
+      dst[i] = src[i];
+      if( msProjectPoint(in, out, dst+i) == MS_FAILURE ) {
+        dst[i].x = dst[i].y = HUGE_VAL;
+        failures++;
+      }
+    }
+    return failures ? MS_FAILURE : MS_SUCCESS;
+  }
+
+  for( i = 0; i < count; i++ ) {
+    if( dst[i].x == HUGE_VAL || dst[i].y == HUGE_VAL ) {
+      dst[i].x = dst[i].y = HUGE_VAL;
+      failures++;
+    } else if( pj_is_latlong(out->proj) ) {
+      dst[i].x *= RAD_TO_DEG;
+      dst[i].y *= RAD_TO_DEG;
+    }
+  }
+  msProjectApplyInvGeotransform(out, dst, count);
+
+  return failures ? MS_FAILURE : MS_SUCCESS;
+}
+#endif /* def USE_PROJ */
+
+/************************************************************************/
+/*                           msProjectPoints()                          */
+/*                                                                      */
+/*      Projects an array of points, with a pj_transform() call per     */
+/*      MS_PROJECT_POINTS_CHUNK points where possible. Points that do   */
+/*      not project are set to HUGE_VAL and MS_FAILURE is returned if   */
+/*      there are any.                                                  */
+/************************************************************************/
+int msProjectPoints(projectionObj *in, projectionObj *out, pointObj *points, int count)
+{
+#ifdef USE_PROJ
+  pointObj original[MS_PROJECT_POINTS_CHUNK];
+  int i, n, failures = 0;
+
+#ifdef USE_PROJ_FASTPATHS
+  if( msProjectFastPath(in, out, points, count) )
+    return MS_SUCCESS;
+#endif
+
+  if( !msProjectPointsBatched(in, out, count) ) {
+    for( i = 0; i < count; i++ ) {
+      if( msProjectPoint(in, out, points+i) == MS_FAILURE ) {
+        points[i].x = points[i].y = HUGE_VAL;
+        failures++;
+      }
+    }
+    return failures ? MS_FAILURE : MS_SUCCESS;
+  }
+
+  /* the fallback needs the original points, keep them for a chunk at a time */
+  for( i = 0; i < count; i += n ) {
+    n = MS_MIN(count - i, MS_PROJECT_POINTS_CHUNK);
+    memcpy(original, points + i, sizeof(pointObj) * n);
+    if( msProjectPointsTo(in, out, original, points + i, n) == MS_FAILURE )
+      failures++;
+  }
+
+  return failures ? MS_FAILURE : MS_SUCCESS;
+#else
+  msSetError(MS_PROJERR, "Projection support is not available.", "msProjectPoints()");
+  return(MS_FAILURE);
+#endif
+}
+
 /************************************************************************/
 /*                         msProjectGrowRect()                          */
 /************************************************************************/
@@ -307,40 +540,14 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
   int numpoints_in = line->numpoints;
   int line_alloc = numpoints_in;
   int wrap_test;
+  pointObj stackbuf[MS_PROJECT_POINTS_CHUNK];
+  pointObj *projected = stackbuf;
 
 #ifdef USE_PROJ_FASTPATHS
-#define MAXEXTENT 20037508.34
-#define M_PIby360 .0087266462599716479
-#define MAXEXTENTby180 111319.4907777777777777777
-#define p_x line->point[i].x
-#define p_y line->point[i].y
-  if(in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc) {
-    for( i = line->numpoints-1; i >= 0; i-- ) {
-      p_x *= MAXEXTENTby180;
-      p_y = log(tan((90 + p_y) * M_PIby360)) * MS_RAD_TO_DEG;
-      p_y *= MAXEXTENTby180;
-      if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-      if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-      if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-      if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-    }
-    return MS_SUCCESS;
-  }
-  if(in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat) {
-    for( i = line->numpoints-1; i >= 0; i-- ) {
-      if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-      else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-      if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-      else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-      p_x = (p_x / MAXEXTENT) * 180;
-      p_y = (p_y / MAXEXTENT) * 180;
-      p_y = MS_RAD_TO_DEG * (2 * atan(exp(p_y * MS_DEG_TO_RAD)) - MS_PI2);
-    }
+  if( msProjectFastPath(in, out, line->point, line->numpoints) ) {
     msComputeBounds( shape ); /* fixes bug 1586 */
     return MS_SUCCESS;
   }
-#undef p_x
-#undef p_y
 #endif
 
 
@@ -348,6 +555,11 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
   wrap_test = out != NULL && out->proj != NULL && pj_is_latlong(out->proj)
               && !pj_is_latlong(in->proj);
 
+  /* project all points at once, the originals are needed for the horizon */
+  if( numpoints_in > MS_PROJECT_POINTS_CHUNK )
+    projected = (pointObj *) msSmallMalloc(sizeof(pointObj) * numpoints_in);
+  msProjectPointsTo( in, out, line->point, projected, numpoints_in );
+
   line->numpoints = 0;
 
   memset( &lastPoint, 0, sizeof(lastPoint) );
@@ -357,9 +569,10 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
   /* -------------------------------------------------------------------- */
   for( i=0; i < numpoints_in; i++ ) {
     int ms_err;
-    wrkPoint = thisPoint = line->point[i];
+    thisPoint = line->point[i];
+    wrkPoint = projected[i];
 
-    ms_err = msProjectPoint(in, out, &wrkPoint );
+    ms_err = (wrkPoint.x == HUGE_VAL) ? MS_FAILURE : MS_SUCCESS;
 
     /* -------------------------------------------------------------------- */
     /*      Apply wrap logic.                                               */
@@ -495,6 +708,8 @@ msProjectShapeLine(projectionObj *in, projectionObj *out,
     msAddPointToLine( line_out, &sFirstPoint );
   }
 
+  if( projected != stackbuf )
+    msFree(projected);
   return(MS_SUCCESS);
 }
 #endif
@@ -507,42 +722,12 @@ int msProjectShape(projectionObj *in, projectionObj *out, shapeObj *shape)
 #ifdef USE_PROJ
   int i;
 #ifdef USE_PROJ_FASTPATHS
-  int j;
-
-#define p_x shape->line[i].point[j].x
-#define p_y shape->line[i].point[j].y
-  if(in->wellknownprojection == wkp_lonlat && out->wellknownprojection == wkp_gmerc) {
-    for( i = shape->numlines-1; i >= 0; i-- ) {
-      for( j = shape->line[i].numpoints-1; j >= 0; j-- ) {
-        p_x *= MAXEXTENTby180;
-        p_y = log(tan((90 + p_y) * M_PIby360)) * MS_RAD_TO_DEG;
-        p_y *= MAXEXTENTby180;
-        if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-        else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-        if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-        else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-      }
-    }
-    msComputeBounds( shape ); /* fixes bug 1586 */
-    return MS_SUCCESS;
-  }
-  if(in->wellknownprojection == wkp_gmerc && out->wellknownprojection == wkp_lonlat) {
-    for( i = shape->numlines-1; i >= 0; i-- ) {
-      for( j = shape->line[i].numpoints-1; j >= 0; j-- ) {
-        if (p_x > MAXEXTENT) p_x = MAXEXTENT;
-        else if (p_x < -MAXEXTENT) p_x = -MAXEXTENT;
-        if (p_y > MAXEXTENT) p_y = MAXEXTENT;
-        else if (p_y < -MAXEXTENT) p_y = -MAXEXTENT;
-        p_x = (p_x / MAXEXTENT) * 180;
-        p_y = (p_y / MAXEXTENT) * 180;
-        p_y = MS_RAD_TO_DEG * (2 * atan(exp(p_y * MS_DEG_TO_RAD)) - MS_PI2);
-      }
-    }
+  if( msProjectIsFastPath(in, out) ) {
+    for( i = shape->numlines-1; i >= 0; i-- )
+      msProjectFastPath(in, out, shape->line[i].point, shape->line[i].numpoints);
     msComputeBounds( shape ); /* fixes bug 1586 */
     return MS_SUCCESS;
   }
-#undef p_x
-#undef p_y
 #endif
 
 
@@ -617,10 +802,7 @@ int msProjectLine(projectionObj *in, projectionObj *out, lineObj *line)
       }
     }
   } else {
-    for(i=0; i<line->numpoints; i++) {
-      if( msProjectPoint(in, out, &(line->point[i])) == MS_FAILURE )
-        return MS_FAILURE;
-    }
+    return msProjectPoints(in, out, line->point, line->numpoints);
   }
 
   return(MS_SUCCESS);
@@ -1051,6 +1233,27 @@ static projectionObj* msGetProjectNormalized( const projectionObj* p )
   
   return pnew;
 }
+
+/************************************************************************/
+/*                     msGetProjectNormalizedString()                   */
+/*                                                                      */
+/*      The normalized arguments joined by "+", computed once per       */
+/*      projectionObj since pj_get_def() and the sort are not cheap     */
+/*      and msProjectionsDiffer() is called for every layer drawn.      */
+/************************************************************************/
+
+static const char* msGetProjectNormalizedString( projectionObj* p )
+{
+  if( p->normalized == NULL ) {
+    projectionObj* pnormalized = msGetProjectNormalized( p );
+    p->normalized = msJoinStrings( pnormalized->args, pnormalized->numargs, "+" );
+    if( p->normalized == NULL )
+      p->normalized = msStrdup("");
+    msFreeProjection(pnormalized);
+    msFree(pnormalized);
+  }
+  return p->normalized;
+}
 #endif /* USE_PROJ */
 
 /************************************************************************/
@@ -1098,18 +1301,16 @@ int msProjectionsDiffer( projectionObj *proj1, projectionObj *proj2 )
     int ret;
 
     ret = msProjectionsDifferInternal(proj1, proj2); 
-    if( ret ) 
+    if( ret && proj1->proj != NULL && proj2->proj != NULL
+        && !proj1->gt.need_geotransform && !proj2->gt.need_geotransform )
     {
-        projectionObj* p1normalized;
-        projectionObj* p2normalized;
-
-        p1normalized = msGetProjectNormalized( proj1 );
-        p2normalized = msGetProjectNormalized( proj2 );
-        ret = msProjectionsDifferInternal(p1normalized, p2normalized);
-        msFreeProjection(p1normalized);
-        msFree(p1normalized);
-        msFreeProjection(p2normalized);
-        msFree(p2normalized);
+        /* compared as msGetProjectNormalized() rewrites them, cached */
+        const char* p1normalized = msGetProjectNormalizedString( proj1 );
+        const char* p2normalized = msGetProjectNormalizedString( proj2 );
+        if( *p1normalized == '\0' || *p2normalized == '\0' )
+            ret = MS_FALSE;
+        else
+            ret = strcmp(p1normalized, p2normalized) != 0;
     }
     return ret;
 #else
@@ -1223,6 +1424,164 @@ static int msTestNeedWrap( pointObj pt1, pointObj pt2, pointObj pt2_geo,
 }
 #endif /* def USE_PROJ */
 
+/************************************************************************/
+/*                       Projection handle cache                        */
+/*                                                                      */
+/*      pj_init() of a definition like "init=epsg:3857" reads and       */
+/*      parses the PROJ init files, and msLoadMap() and msCopyMap()     */
+/*      do that for every layer of every request. The handles are       */
+/*      kept in a process wide cache keyed by the projection            */
+/*      arguments and shared, with a reference count, between the       */
+/*      projectionObjs using the same definition. Unused handles stay   */
+/*      for the next request until the cache is full, PROJ_LIB          */
+/*      changes or msProjectionCacheCleanup() is called. All of this    */
+/*      happens with TLOCK_PROJ held.                                   */
+/************************************************************************/
+#ifdef USE_PROJ_CACHE
+
+#define MS_PROJ_CACHE_SIZE 64
+
+typedef struct {
+  char *key; /* NULL once PROJ_LIB changed, freed on last release */
+  projPJ proj;
+#if PJ_VERSION >= 480
+  projCtx proj_ctx;
+#endif
+  int refcount;
+} projCacheEntryObj;
+
+static projCacheEntryObj *projCache = NULL;
+static int projCacheSize = 0, projCacheMax = 0;
+
+static void msProjectionCacheFreeEntry(int i)
+{
+  pj_free(projCache[i].proj);
+#if PJ_VERSION >= 480
+  pj_ctx_free(projCache[i].proj_ctx);
+#endif
+  msFree(projCache[i].key);
+  projCache[i] = projCache[--projCacheSize];
+}
+
+/* Drops unused handles and makes the others unreachable, TLOCK_PROJ held. */
+static void msProjectionCacheFlush(void)
+{
+  int i;
+
+  for(i = projCacheSize-1; i >= 0; i--) {
+    if(projCache[i].refcount == 0) {
+      msProjectionCacheFreeEntry(i);
+    } else {
+      msFree(projCache[i].key);
+      projCache[i].key = NULL;
+    }
+  }
+  if(projCacheSize == 0) {
+    msFree(projCache);
+    projCache = NULL;
+    projCacheMax = 0;
+  }
+}
+
+/*
+** Returns a handle for the definition, from the cache or initialized
+** and added to it, or NULL with the PROJ error set. To be called with
+** TLOCK_PROJ held, the handle is given back with msProjectionCacheRelease().
+*/
+projPJ msProjectionCacheAcquire(int numargs, char **args)
+{
+  char *key = NULL;
+  projPJ proj;
+  int i;
+#if PJ_VERSION >= 480
+  projCtx proj_ctx;
+#endif
+
+  for(i = 0; i < numargs; i++) {
+    if(i > 0)
+      key = msStringConcatenate(key, "+");
+    key = msStringConcatenate(key, args[i]);
+  }
+  if(key == NULL)
+    key = msStrdup("");
+
+  for(i = 0; i < projCacheSize; i++) {
+    if(projCache[i].key && strcmp(projCache[i].key, key) == 0) {
+      projCache[i].refcount++;
+      msFree(key);
+      return projCache[i].proj;
+    }
+  }
+
+#if PJ_VERSION >= 480
+  proj_ctx = pj_ctx_alloc();
+  if( !(proj = pj_init_ctx(proj_ctx, numargs, args)) ) {
+    pj_ctx_free(proj_ctx);
+#else
+  if( !(proj = pj_init(numargs, args)) ) {
+#endif
+    msFree(key);
+    return NULL;
+  }
+
+  if(projCacheSize == MS_PROJ_CACHE_SIZE) {
+    /* make room by dropping an unused handle, if any */
+    for(i = 0; i < projCacheSize; i++) {
+      if(projCache[i].refcount == 0) {
+        msProjectionCacheFreeEntry(i);
+        break;
+      }
+    }
+  }
+  if(projCacheSize == projCacheMax) {
+    projCacheMax = projCacheMax ? projCacheMax*2 : 16;
+    projCache = (projCacheEntryObj *) msSmallRealloc(projCache, sizeof(projCacheEntryObj) * projCacheMax);
+  }
+  projCache[projCacheSize].key = key;
+  projCache[projCacheSize].proj = proj;
+#if PJ_VERSION >= 480
+  projCache[projCacheSize].proj_ctx = proj_ctx;
+#endif
+  projCache[projCacheSize].refcount = 1;
+  projCacheSize++;
+
+  return proj;
+}
+
+/*
+** Gives back a handle of msProjectionCacheAcquire(). Returns MS_FALSE if
+** proj does not come from the cache and is still to be freed by the caller.
+*/
+int msProjectionCacheRelease(projPJ proj)
+{
+  int i;
+
+  msAcquireLock( TLOCK_PROJ );
+  for(i = 0; i < projCacheSize; i++) {
+    if(projCache[i].proj == proj) {
+      if(--projCache[i].refcount == 0 && projCache[i].key == NULL)
+        msProjectionCacheFreeEntry(i);
+      msReleaseLock( TLOCK_PROJ );
+      return MS_TRUE;
+    }
+  }
+  msReleaseLock( TLOCK_PROJ );
+  return MS_FALSE;
+}
+#endif /* def USE_PROJ_CACHE */
+
+/************************************************************************/
+/*                      msProjectionCacheCleanup()                      */
+/************************************************************************/
+void msProjectionCacheCleanup(void)
+{
+#ifdef USE_PROJ_CACHE
+  msAcquireLock( TLOCK_PROJ );
+  msProjectionCacheFlush();
+  msReleaseLock( TLOCK_PROJ );
+#endif
+}
+
 /************************************************************************/
 /*                            msProjFinder()                            */
 /************************************************************************/
@@ -1300,6 +1659,13 @@ void msSetPROJ_LIB( const char *proj_lib, const char *pszRelToPath )
 
   if (proj_lib == NULL) pj_set_finder(NULL);
 
+#ifdef USE_PROJ_CACHE
+  /* cached handles were initialized from the files of the old PROJ_LIB */
+  if( (ms_proj_lib == NULL) != (proj_lib == NULL)
+      || (proj_lib != NULL && strcmp(ms_proj_lib, proj_lib) != 0) )
+    msProjectionCacheFlush();
+#endif
+
   if( ms_proj_lib != NULL ) {
     free( ms_proj_lib );
     ms_proj_lib = NULL;
@@ -42,6 +42,11 @@ extern "C" {
 #if PJ_VERSION >= 470 && PJ_VERSION < 480
    void pj_clear_initcache();
 #endif
+/* projPJ handles are shared through a process wide cache unless every */
+/* projectionObj needs its own context, see msProcessProjection() */
+#if PJ_VERSION < 480 || !defined(USE_THREAD)
+#  define USE_PROJ_CACHE
+#endif
 #endif
 
 #define wkp_none 0
@@ -69,6 +74,7 @@ extern "C" {
     void *proj;
 #endif
     geotransformObj gt; /* extra transformation to apply */
+    char *normalized; /* arguments as compared by msProjectionsDiffer(), set on first use */
 #endif
     int wellknownprojection;
   } projectionObj;
@@ -77,6 +83,7 @@ extern "C" {
 
   MS_DLL_EXPORT int msIsAxisInverted(int epsg_code);
   MS_DLL_EXPORT int msProjectPoint(projectionObj *in, projectionObj *out, pointObj *point);
+  MS_DLL_EXPORT int msProjectPoints(projectionObj *in, projectionObj *out, pointObj *points, int count);
   MS_DLL_EXPORT int msProjectShape(projectionObj *in, projectionObj *out, shapeObj *shape);
   MS_DLL_EXPORT int msProjectLine(projectionObj *in, projectionObj *out, lineObj *line);
   MS_DLL_EXPORT int msProjectRect(projectionObj *in, projectionObj *out, rectObj *rect);
@@ -99,6 +106,11 @@ extern "C" {
       double *x, double *y );
 
   MS_DLL_EXPORT void msSetPROJ_LIB( const char *, const char * );
+  MS_DLL_EXPORT void msProjectionCacheCleanup(void);
+#ifdef USE_PROJ_CACHE
+  projPJ msProjectionCacheAcquire(int numargs, char **args);
+  int msProjectionCacheRelease(projPJ proj);
+#endif
   MS_DLL_EXPORT void msProjLibInitFromEnv();
 
   /* Provides compatiblity with PROJ.4 4.4.2 */
@@ -46,6 +46,7 @@
 
 #include "mapserver.h"
 #include <stdlib.h>
+#include <stddef.h>
 
 #define PAM_GETR(p) ((p).r)
 #define PAM_GETG(p) ((p).g)
@@ -71,17 +72,8 @@ struct acolorhist_item {
   int value;
 };
 
-typedef struct acolorhist_list_item *acolorhist_list;
-struct acolorhist_list_item {
-  struct acolorhist_item ch;
-  acolorhist_list next;
-};
-
-typedef acolorhist_list *acolorhash_table;
-
 #define MAXCOLORS  32767
 
-#define LARGE_NORM
 #define REP_AVERAGE_PIXELS
 
 typedef struct box *box_vector;
@@ -91,26 +83,55 @@ struct box {
   int sum;
 };
 
+/*
+** The color histogram is a fixed size open addressed hash table keyed on
+** the 32 bit pixel value, large enough to hold MAXCOLORS colors at a load
+** factor under one half.
+*/
+#define HIST_HASH_BITS 16
+#define HIST_HASH_SIZE (1<<HIST_HASH_BITS)
+
+typedef struct {
+  unsigned int key;
+  int value; /* pixel count, 0 for an empty slot */
+  int order; /* insertion order */
+} acolorhist_slot;
+
+/*
+** Nearest palette entry lookups go through a direct mapped cache of the
+** last colors seen, and on a miss through the palette sorted on its most
+** spread out component, searched outwards from the pixel's value.
+*/
+#define CLASSIFY_CACHE_BITS 15
+#define CLASSIFY_CACHE_SIZE (1<<CLASSIFY_CACHE_BITS)
+
+typedef struct {
+  unsigned int key;
+  int index; /* -1 for an empty slot */
+} classify_cache_slot;
+
+typedef struct {
+  const rgbaPixel *palette;
+  int num_entries;
+  size_t component; /* offset in rgbaPixel of the sort component */
+  unsigned char sorted_index[256];
+  unsigned char sorted_key[256];
+  int first_ge[257]; /* first sorted entry with a key >= v */
+} palette_search;
+
 static acolorhist_vector mediancut
 (acolorhist_vector achv, int colors, int sum, unsigned char maxval, int newcolors);
-static int redcompare (const void *ch1, const void *ch2);
-static int greencompare (const void *ch1, const void *ch2);
-static int bluecompare (const void *ch1, const void *ch2);
-static int alphacompare (const void *ch1, const void *ch2);
 static int sumcompare (const void *b1, const void *b2);
 
-static acolorhist_vector pam_acolorhashtoacolorhist
-(acolorhash_table acht, int maxacolors);
 static acolorhist_vector pam_computeacolorhist
-(rgbaPixel **apixels, int cols, int rows, int maxacolors, int* acolorsP);
-static acolorhash_table pam_computeacolorhash
-(rgbaPixel** apixels, int cols, int rows, int maxacolors, int* acolorsP);
-static acolorhash_table pam_allocacolorhash (void);
-static int pam_addtoacolorhash
-(acolorhash_table acht, rgbaPixel *acolorP, int value);
-static int pam_lookupacolor (acolorhash_table acht, rgbaPixel* acolorP);
+(rgbaPixel **apixels, int cols, int rows, int rowstep, int colstep,
+ int maxacolors, int* acolorsP, int *sumP);
 static void pam_freeacolorhist (acolorhist_vector achv);
-static void pam_freeacolorhash (acolorhash_table acht);
+
+#define PIXEL_KEY(p) \
+    ( (unsigned int)(p).b | ((unsigned int)(p).g << 8) | \
+      ((unsigned int)(p).r << 16) | ((unsigned int)(p).a << 24) )
+#define PIXEL_COMPONENT(p,offset) (((const unsigned char *)&(p))[offset])
 
 
 /**
@@ -125,11 +146,14 @@ static void pam_freeacolorhash (acolorhash_table acht);
  *   by iteratively dividing the pixels by 2. In case palette_scaling_maxval is set to
  *   something different than 255, the returned palette colors have to be scaled back up to
  *   255, and rb's pixels will have been scaled down to maxsize (see bug #3848)
+ * - sample_pixels: if non zero and the image is larger, the histogram is built from a
+ *   regular sample of about that many pixels instead of all of them
  */
 int msQuantizeRasterBuffer(rasterBufferObj *rb,
                            unsigned int *reqcolors, rgbaPixel *palette,
                            rgbaPixel *forced_palette, int num_forced_palette_entries,
-                           unsigned int *palette_scaling_maxval)
+                           unsigned int *palette_scaling_maxval,
+                           unsigned int sample_pixels)
 {
   rgbaPixel **apixels=NULL; /* pointer to the start rows of truecolor pixels */
 
@@ -140,8 +164,9 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
   acolorhist_vector achv, acolormap=NULL;
 
   int row;
-  int colors;
+  int colors, sum;
   int newcolors = 0;
+  int rowstep = 1, colstep = 1;
 
   int x;
   /*  int channels;  */
@@ -156,6 +181,10 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
     apixels[row]=(rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));
   }
 
+  if(sample_pixels > 0 && (double)rb->width * rb->height > sample_pixels) {
+    rowstep = colstep = (int)ceil(sqrt((double)rb->width * rb->height / sample_pixels));
+  }
+
   /*
    ** Step 2: attempt to make a histogram of the colors, unclustered.
    ** If at first we don't succeed, lower maxval to increase color
@@ -165,7 +194,8 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
    */
   for ( ; ; ) {
     achv = pam_computeacolorhist(
-             apixels, rb->width, rb->height, MAXCOLORS, &colors );
+             apixels, rb->width, rb->height, rowstep, colstep,
+             MAXCOLORS, &colors, &sum );
     if ( achv != (acolorhist_vector) 0 )
       break;
     newmaxval = *palette_scaling_maxval / 2;
@@ -175,7 +205,7 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
     *palette_scaling_maxval = newmaxval;
   }
   newcolors = MS_MIN(colors, *reqcolors);
-  acolormap = mediancut(achv, colors, rb->width*rb->height, *palette_scaling_maxval, newcolors);
+  acolormap = mediancut(achv, colors, sum, *palette_scaling_maxval, newcolors);
   pam_freeacolorhist(achv);
 
 
@@ -195,76 +225,167 @@ int msQuantizeRasterBuffer(rasterBufferObj *rb,
 }
 
 
+/*
+** Prepare the palette for nearest color searches.
+*/
+static void palette_search_init(palette_search *ps, const rgbaPixel *palette, int num_entries)
+{
+  static const size_t offsets[4] = { offsetof(rgbaPixel,r), offsetof(rgbaPixel,g),
+                                     offsetof(rgbaPixel,b), offsetof(rgbaPixel,a) };
+  int count[257], i, c, best_range = -1;
+
+  ps->palette = palette;
+  ps->num_entries = num_entries;
+  ps->component = offsets[0];
+
+  /* sort on the component with the largest range, it prunes best */
+  for ( c = 0; c < 4; ++c ) {
+    int minv = 255, maxv = 0;
+    for ( i = 0; i < num_entries; ++i ) {
+      int v = PIXEL_COMPONENT( palette[i], offsets[c] );
+      if ( v < minv ) minv = v;
+      if ( v > maxv ) maxv = v;
+    }
+    if ( maxv - minv > best_range ) {
+      best_range = maxv - minv;
+      ps->component = offsets[c];
+    }
+  }
+
+  memset( count, 0, sizeof(count) );
+  for ( i = 0; i < num_entries; ++i )
+    count[PIXEL_COMPONENT( palette[i], ps->component ) + 1]++;
+  for ( i = 1; i < 257; ++i )
+    count[i] += count[i-1];
+  memcpy( ps->first_ge, count, sizeof(count) );
+  for ( i = 0; i < num_entries; ++i ) {
+    int v = PIXEL_COMPONENT( palette[i], ps->component );
+    ps->sorted_key[count[v]] = v;
+    ps->sorted_index[count[v]++] = i;
+  }
+}
+
+/*
+** Index of the palette entry closest to *pP, the lowest index among equally
+** close ones, as a linear search of the palette would give.
+*/
+static int palette_search_nearest(const palette_search *ps, const rgbaPixel *pP)
+{
+  int r1 = PAM_GETR( *pP ), g1 = PAM_GETG( *pP ), b1 = PAM_GETB( *pP ), a1 = PAM_GETA( *pP );
+  int v = PIXEL_COMPONENT( *pP, ps->component );
+  int up = ps->first_ge[v], down = up - 1;
+  long dist = 2000000000;
+  int ind = -1;
+
+  while ( up < ps->num_entries || down >= 0 ) {
+    int j;
+    for ( j = 0; j < 2; ++j ) {
+      int k, dk;
+      long newdist;
+      const rgbaPixel *q;
+
+      if ( j == 0 ) {
+        if ( up >= ps->num_entries ) continue;
+        k = up;
+      } else {
+        if ( down < 0 ) continue;
+        k = down;
+      }
+      dk = ps->sorted_key[k] - v;
+      if ( (long)dk * dk > dist ) {
+        /* nothing further on this side can be as close */
+        if ( j == 0 ) up = ps->num_entries;
+        else down = -1;
+        continue;
+      }
+      if ( j == 0 ) ++up;
+      else --down;
+
+      q = ps->palette + ps->sorted_index[k];
+      newdist = ( r1 - PAM_GETR( *q ) ) * ( r1 - PAM_GETR( *q ) ) +
+                ( g1 - PAM_GETG( *q ) ) * ( g1 - PAM_GETG( *q ) ) +
+                ( b1 - PAM_GETB( *q ) ) * ( b1 - PAM_GETB( *q ) ) +
+                ( a1 - PAM_GETA( *q ) ) * ( a1 - PAM_GETA( *q ) );
+      if ( newdist < dist || ( newdist == dist && ps->sorted_index[k] < ind ) ) {
+        ind = ps->sorted_index[k];
+        dist = newdist;
+      }
+    }
+  }
+
+  return ind;
+}
+
 int msClassifyRasterBuffer(rasterBufferObj *rb, rasterBufferObj *qrb)
 {
-  register int ind;
-  unsigned char *outrow,*pQ;
-  register rgbaPixel *pP;
-  acolorhash_table acht;
-  int usehash, row, col;
+  unsigned char *pQ;
+  rgbaPixel *pP;
+  classify_cache_slot *cache;
+  palette_search ps;
+  int row, col;
+
   /*
    ** Step 4: map the colors in the image to their closest match in the
    ** new colormap, and write 'em out.
    */
-  acht = pam_allocacolorhash( );
-  usehash = 1;
+  cache = (classify_cache_slot*) msSmallMalloc( CLASSIFY_CACHE_SIZE * sizeof(classify_cache_slot) );
+  for ( col = 0; col < CLASSIFY_CACHE_SIZE; ++col )
+    cache[col].index = -1;
+  palette_search_init( &ps, qrb->data.palette.palette, qrb->data.palette.num_entries );
 
   for ( row = 0; row < qrb->height; ++row ) {
-    outrow = &(qrb->data.palette.pixels[row*qrb->width]);
-    col = 0;
-    pP = (rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));;
-    pQ = outrow;
-    do {
-      /* Check hash table to see if we have already matched this color. */
-      ind = pam_lookupacolor( acht, pP );
-      if ( ind == -1 ) {
-        /* No; search acolormap for closest match. */
-        register int i, r1, g1, b1, a1, r2, g2, b2, a2;
-        register long dist, newdist;
-
-        r1 = PAM_GETR( *pP );
-        g1 = PAM_GETG( *pP );
-        b1 = PAM_GETB( *pP );
-        a1 = PAM_GETA( *pP );
-        dist = 2000000000;
-        for ( i = 0; i < qrb->data.palette.num_entries; ++i ) {
-          r2 = PAM_GETR( qrb->data.palette.palette[i] );
-          g2 = PAM_GETG( qrb->data.palette.palette[i] );
-          b2 = PAM_GETB( qrb->data.palette.palette[i] );
-          a2 = PAM_GETA( qrb->data.palette.palette[i] );
-          /* GRR POSSIBLE BUG */
-          newdist = ( r1 - r2 ) * ( r1 - r2 ) +  /* may overflow? */
-                    ( g1 - g2 ) * ( g1 - g2 ) +
-                    ( b1 - b2 ) * ( b1 - b2 ) +
-                    ( a1 - a2 ) * ( a1 - a2 );
-          if ( newdist < dist ) {
-            ind = i;
-            dist = newdist;
-          }
-        }
-        if ( usehash ) {
-          if ( pam_addtoacolorhash( acht, pP, ind ) < 0 ) {
-            usehash = 0;
-          }
-        }
+    unsigned int last_key = 0;
+    int last_index = -1;
+
+    pP = (rgbaPixel*)(&(rb->data.rgba.pixels[row * rb->data.rgba.row_step]));
+    pQ = &(qrb->data.palette.pixels[row*qrb->width]);
+    for ( col = 0; col < rb->width; ++col, ++pP, ++pQ ) {
+      unsigned int key = PIXEL_KEY( *pP );
+      classify_cache_slot *slot;
+
+      /* runs of the same color are the common case */
+      if ( key == last_key && last_index >= 0 ) {
+        *pQ = (unsigned char)last_index;
+        continue;
       }
 
-      /*          *pP = acolormap[ind].acolor;  */
-      *pQ = (unsigned char)ind;
-
-      ++col;
-      ++pP;
-      ++pQ;
-
-    } while ( col != rb->width );
+      slot = cache + ( (key * 2654435761U) >> (32 - CLASSIFY_CACHE_BITS) );
+      if ( slot->index < 0 || slot->key != key ) {
+        slot->key = key;
+        slot->index = palette_search_nearest( &ps, pP );
+      }
+      last_key = key;
+      last_index = slot->index;
+      *pQ = (unsigned char)last_index;
+    }
   }
-  pam_freeacolorhash(acht);
+  free( cache );
 
   return MS_SUCCESS;
 }
 
 
 
+/*
+** Stable counting sort of the colors on one component, giving the same
+** order qsort() with a per component comparison gave on glibc, which
+** merge sorts.
+*/
+static void
+sortcolors( acolorhist_vector achv, int clrs, size_t component, acolorhist_vector tmp )
+{
+  int count[257], i;
+
+  memset( count, 0, sizeof(count) );
+  for ( i = 0; i < clrs; ++i )
+    count[PIXEL_COMPONENT( achv[i].acolor, component ) + 1]++;
+  for ( i = 1; i < 257; ++i )
+    count[i] += count[i-1];
+  for ( i = 0; i < clrs; ++i )
+    tmp[count[PIXEL_COMPONENT( achv[i].acolor, component )]++] = achv[i];
+  memcpy( achv, tmp, clrs * sizeof(struct acolorhist_item) );
+}
+
 /*
  ** Here is the fun part, the median-cut colormap generator.  This is based
  ** on Paul Heckbert's paper, "Color Image Quantization for Frame Buffer
@@ -274,7 +395,7 @@ int msClassifyRasterBuffer(rasterBufferObj *rb, rasterBufferObj *qrb)
 static acolorhist_vector
 mediancut( acolorhist_vector achv, int colors, int sum, unsigned char maxval, int newcolors )
 {
-  acolorhist_vector acolormap;
+  acolorhist_vector acolormap, sorttmp;
   box_vector bv;
   register int bi, i;
   int boxes;
@@ -282,7 +403,8 @@ mediancut( acolorhist_vector achv, int colors, int sum, unsigned char maxval, in
   bv = (box_vector) malloc( sizeof(struct box) * newcolors );
   acolormap =
     (acolorhist_vector) malloc( sizeof(struct acolorhist_item) * newcolors);
-  if ( bv == (box_vector) 0 || acolormap == (acolorhist_vector) 0 ) {
+  sorttmp = (acolorhist_vector) malloc( sizeof(struct acolorhist_item) * MS_MAX(colors,1) );
+  if ( bv == (box_vector) 0 || acolormap == (acolorhist_vector) 0 || sorttmp == (acolorhist_vector) 0 ) {
     fprintf( stderr, "  out of memory allocating box vector\n" );
     fflush(stderr);
     exit(6);
@@ -343,69 +465,17 @@ mediancut( acolorhist_vector achv, int colors, int sum, unsigned char maxval, in
     }
 
     /*
-     ** Find the largest dimension, and sort by that component.  I have
-     ** included two methods for determining the "largest" dimension;
-     ** first by simply comparing the range in RGB space, and second
-     ** by transforming into luminosities before the comparison.  You
-     ** can switch which method is used by switching the commenting on
-     ** the LARGE_ defines at the beginning of this source file.
+     ** Find the largest dimension, simply comparing the range of the
+     ** components, and sort by that component.
      */
-#ifdef LARGE_NORM
     if ( maxa - mina >= maxr - minr && maxa - mina >= maxg - ming && maxa - mina >= maxb - minb )
-      qsort(
-        (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-        alphacompare );
+      sortcolors( &(achv[indx]), clrs, offsetof(rgbaPixel,a), sorttmp );
     else if ( maxr - minr >= maxg - ming && maxr - minr >= maxb - minb )
-      qsort(
-        (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-        redcompare );
+      sortcolors( &(achv[indx]), clrs, offsetof(rgbaPixel,r), sorttmp );
     else if ( maxg - ming >= maxb - minb )
-      qsort(
-        (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-        greencompare );
+      sortcolors( &(achv[indx]), clrs, offsetof(rgbaPixel,g), sorttmp );
     else
-      qsort(
-        (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-        bluecompare );
-#endif /*LARGE_NORM*/
-#ifdef LARGE_LUM
-    {
-      apixel p;
-      float rl, gl, bl, al;
-
-      PAM_ASSIGN(p, maxr - minr, 0, 0, 0);
-      rl = PPM_LUMIN(p);
-      PAM_ASSIGN(p, 0, maxg - ming, 0, 0);
-      gl = PPM_LUMIN(p);
-      PAM_ASSIGN(p, 0, 0, maxb - minb, 0);
-      bl = PPM_LUMIN(p);
-
-      /*
-      GRR: treat alpha as grayscale and assign (maxa - mina) to each of R, G, B?
-      assign (maxa - mina)/3 to each?
-      use alpha-fractional luminosity?  (normalized_alpha * lum(r,g,b))
-      al = dunno ...
-      [probably should read Heckbert's paper to decide]
-       */
-
-      if ( al >= rl && al >= gl && al >= bl )
-        qsort(
-          (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-          alphacompare );
-      else if ( rl >= gl && rl >= bl )
-        qsort(
-          (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-          redcompare );
-      else if ( gl >= bl )
-        qsort(
-          (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-          greencompare );
-      else
-        qsort(
-          (char*) &(achv[indx]), clrs, sizeof(struct acolorhist_item),
-          bluecompare );
-    }
-#endif /*LARGE_LUM*/
+      sortcolors( &(achv[indx]), clrs, offsetof(rgbaPixel,b), sorttmp );
 
     /*
      ** Now find the median based on the counts, so that about half the
@@ -519,37 +589,10 @@ mediancut( acolorhist_vector achv, int colors, int sum, unsigned char maxval, in
    ** All done.
    */
   free(bv);
+  free(sorttmp);
   return acolormap;
 }
 
-static int
-redcompare( const void *ch1, const void *ch2 )
-{
-  return (int) PAM_GETR( ((acolorhist_vector)ch1)->acolor ) -
-         (int) PAM_GETR( ((acolorhist_vector)ch2)->acolor );
-}
-
-static int
-greencompare( const void *ch1, const void *ch2 )
-{
-  return (int) PAM_GETG( ((acolorhist_vector)ch1)->acolor ) -
-         (int) PAM_GETG( ((acolorhist_vector)ch2)->acolor );
-}
-
-static int
-bluecompare( const void *ch1, const void *ch2 )
-{
-  return (int) PAM_GETB( ((acolorhist_vector)ch1)->acolor ) -
-         (int) PAM_GETB( ((acolorhist_vector)ch2)->acolor );
-}
-
-static int
-alphacompare( const void *ch1, const void *ch2 )
-{
-  return (int) PAM_GETA( ((acolorhist_vector)ch1)->acolor ) -
-         (int) PAM_GETA( ((acolorhist_vector)ch2)->acolor );
-}
-
 static int
 sumcompare( const void *b1, const void *b2 )
 {
@@ -581,6 +624,7 @@ sumcompare( const void *b1, const void *b2 )
 #include "pamcmap.h"
  */
 
+/* the bucket of a color in the original chained hash table */
 #define HASH_SIZE 20023
 
 #define pam_hashapixel(p) ( ( ( (long) PAM_GETR(p) * 33023 + \
@@ -589,184 +633,94 @@ sumcompare( const void *b1, const void *b2 )
     (long) PAM_GETA(p) * 24007 ) \
     & 0x7fffffff ) % HASH_SIZE )
 
-static acolorhist_vector
-pam_computeacolorhist( apixels, cols, rows, maxacolors, acolorsP )
-rgbaPixel** apixels;
-int cols, rows, maxacolors;
-int* acolorsP;
+static int
+histordercompare( const void *h1, const void *h2 )
 {
-  acolorhash_table acht;
-  acolorhist_vector achv;
-
-  acht = pam_computeacolorhash( apixels, cols, rows, maxacolors, acolorsP );
-  if ( acht == (acolorhash_table) 0 )
-    return (acolorhist_vector) 0;
-  achv = pam_acolorhashtoacolorhist( acht, maxacolors );
-  pam_freeacolorhash( acht );
-  return achv;
+  const acolorhist_slot *s1 = *(const acolorhist_slot * const *)h1;
+  const acolorhist_slot *s2 = *(const acolorhist_slot * const *)h2;
+  rgbaPixel p1, p2;
+  long b1, b2;
+
+  PAM_ASSIGN( p1, (s1->key >> 16) & 0xff, (s1->key >> 8) & 0xff, s1->key & 0xff, s1->key >> 24 );
+  PAM_ASSIGN( p2, (s2->key >> 16) & 0xff, (s2->key >> 8) & 0xff, s2->key & 0xff, s2->key >> 24 );
+  b1 = pam_hashapixel( p1 );
+  b2 = pam_hashapixel( p2 );
+  if ( b1 != b2 )
+    return b1 < b2 ? -1 : 1;
+  return s2->order - s1->order;
 }
 
-
-
-static acolorhash_table
-pam_computeacolorhash( apixels, cols, rows, maxacolors, acolorsP )
-rgbaPixel** apixels;
-int cols, rows, maxacolors;
-int* acolorsP;
+/*
+** Count the colors of every colstep'th pixel of every rowstep'th row.
+** Returns NULL if there are more than maxacolors of them, else the
+** histogram, in the order the chained hash table this replaces listed it
+** so that the palettes stay the same.
+*/
+static acolorhist_vector
+pam_computeacolorhist( rgbaPixel **apixels, int cols, int rows, int rowstep, int colstep,
+                       int maxacolors, int* acolorsP, int *sumP )
 {
-  acolorhash_table acht;
+  acolorhist_slot *table, **used;
+  acolorhist_vector achv;
   register rgbaPixel* pP;
-  acolorhist_list achl;
-  int col, row, hash;
+  int col, row, i;
 
-  acht = pam_allocacolorhash( );
+  table = (acolorhist_slot*) msSmallCalloc( HIST_HASH_SIZE, sizeof(acolorhist_slot) );
+  used = (acolorhist_slot**) msSmallMalloc( maxacolors * sizeof(acolorhist_slot*) );
   *acolorsP = 0;
-
-  /* Go through the entire image, building a hash table of colors. */
-  for ( row = 0; row < rows; ++row )
-    for ( col = 0, pP = apixels[row]; col < cols; ++col, ++pP ) {
-      hash = pam_hashapixel( *pP );
-      for ( achl = acht[hash]; achl != (acolorhist_list) 0; achl = achl->next )
-        if ( PAM_EQUAL( achl->ch.acolor, *pP ) )
+  *sumP = 0;
+
+  /* Go through the image, building a hash table of colors. */
+  for ( row = 0; row < rows; row += rowstep ) {
+    /* shift the sampled columns from row to row */
+    col = (rowstep > 1) ? (row / rowstep * 7) % colstep : 0;
+    for ( pP = apixels[row] + col; col < cols; col += colstep, pP += colstep ) {
+      unsigned int key = PIXEL_KEY( *pP );
+      unsigned int h = (key * 2654435761U) >> (32 - HIST_HASH_BITS);
+      acolorhist_slot *slot;
+
+      for ( ;; ) {
+        slot = table + h;
+        if ( slot->value == 0 || slot->key == key )
           break;
-      if ( achl != (acolorhist_list) 0 )
-        ++(achl->ch.value);
-      else {
-        if ( ++(*acolorsP) > maxacolors ) {
-          pam_freeacolorhash( acht );
-          return (acolorhash_table) 0;
-        }
-        achl = (acolorhist_list) malloc( sizeof(struct acolorhist_list_item) );
-        if ( achl == 0 ) {
-          fprintf( stderr, "  out of memory computing hash table\n" );
-          exit(7);
-        }
-        achl->ch.acolor = *pP;
-        achl->ch.value = 1;
-        achl->next = acht[hash];
-        acht[hash] = achl;
+        h = (h + 1) & (HIST_HASH_SIZE - 1);
       }
+      (*sumP)++;
+      if ( slot->value > 0 ) {
+        ++(slot->value);
+        continue;
+      }
+      if ( *acolorsP >= maxacolors ) {
+        free( used );
+        free( table );
+        return (acolorhist_vector) 0;
+      }
+      slot->key = key;
+      slot->value = 1;
+      slot->order = *acolorsP;
+      used[(*acolorsP)++] = slot;
     }
-
-  return acht;
-}
-
-
-
-static acolorhash_table
-pam_allocacolorhash( )
-{
-  acolorhash_table acht;
-  int i;
-
-  acht = (acolorhash_table) malloc( HASH_SIZE * sizeof(acolorhist_list) );
-  if ( acht == 0 ) {
-    fprintf( stderr, "  out of memory allocating hash table\n" );
-    exit(8);
   }
 
-  for ( i = 0; i < HASH_SIZE; ++i )
-    acht[i] = (acolorhist_list) 0;
-
-  return acht;
-}
-
-
-
-static int
-pam_addtoacolorhash( acht, acolorP, value )
-acolorhash_table acht;
-rgbaPixel* acolorP;
-int value;
-{
-  register int hash;
-  register acolorhist_list achl;
-
-  achl = (acolorhist_list) msSmallMalloc( sizeof(struct acolorhist_list_item) );
+  qsort( used, *acolorsP, sizeof(acolorhist_slot*), histordercompare );
 
-  hash = pam_hashapixel( *acolorP );
-  achl->ch.acolor = *acolorP;
-  achl->ch.value = value;
-  achl->next = acht[hash];
-  acht[hash] = achl;
-  return 0;
-}
-
-
-
-static acolorhist_vector
-pam_acolorhashtoacolorhist( acht, maxacolors )
-acolorhash_table acht;
-int maxacolors;
-{
-  acolorhist_vector achv;
-  acolorhist_list achl;
-  int i, j;
-
-  /* Now collate the hash table into a simple acolorhist array. */
-  achv = (acolorhist_vector) malloc( maxacolors * sizeof(struct acolorhist_item) );
-  /* (Leave room for expansion by caller.) */
-  if ( achv == (acolorhist_vector) 0 ) {
-    fprintf( stderr, "  out of memory generating histogram\n" );
-    exit(9);
+  achv = (acolorhist_vector) msSmallMalloc( MS_MAX(*acolorsP,1) * sizeof(struct acolorhist_item) );
+  for ( i = 0; i < *acolorsP; ++i ) {
+    unsigned int key = used[i]->key;
+    PAM_ASSIGN( achv[i].acolor, (key >> 16) & 0xff, (key >> 8) & 0xff, key & 0xff, key >> 24 );
+    achv[i].value = used[i]->value;
   }
 
-  /* Loop through the hash table. */
-  j = 0;
-  for ( i = 0; i < HASH_SIZE; ++i )
-    for ( achl = acht[i]; achl != (acolorhist_list) 0; achl = achl->next ) {
-      /* Add the new entry. */
-      achv[j] = achl->ch;
-      ++j;
-    }
-
-  /* All done. */
+  free( used );
+  free( table );
   return achv;
 }
 
 
 
-static int
-pam_lookupacolor( acht, acolorP )
-acolorhash_table acht;
-rgbaPixel* acolorP;
-{
-  int hash;
-  acolorhist_list achl;
-
-  hash = pam_hashapixel( *acolorP );
-  for ( achl = acht[hash]; achl != (acolorhist_list) 0; achl = achl->next )
-    if ( PAM_EQUAL( achl->ch.acolor, *acolorP ) )
-      return achl->ch.value;
-
-  return -1;
-}
-
-
-
 static void
 pam_freeacolorhist( achv )
 acolorhist_vector achv;
 {
   free( (char*) achv );
 }
-
-
-
-static void
-pam_freeacolorhash( acht )
-acolorhash_table acht;
-{
-  int i;
-  acolorhist_list achl, achlnext;
-
-  for ( i = 0; i < HASH_SIZE; ++i )
-    for ( achl = acht[i]; achl != (acolorhist_list) 0; achl = achlnext ) {
-      achlnext = achl->next;
-      free( (char*) achl );
-    }
-  free( (char*) acht );
-}
-
-
-
@@ -485,6 +485,10 @@ int msQueryByIndex(mapObj *map)
   }
 
   lp = (GET_LAYER(map, map->query.layer));
+  if(lp->lazyerror) { /* see msLoadLazyLayer() */
+    msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByIndex()", lp->name?lp->name:"");
+    return(MS_FAILURE);
+  }
 
   if(!msIsLayerQueryable(lp)) {
     msSetError(MS_QUERYERR, "Requested layer has no templates defined.", "msQueryByIndex()");
@@ -696,7 +700,12 @@ int msQueryByFilter(mapObj *map)
     start = stop = map->query.layer;
 
   for(l=start; l>=stop; l--) {
+    if(MS_LAZY_LAYER_IS_OFF(map, l)) continue; /* not loaded and not queried */
     lp = (GET_LAYER(map, l));
+    if(lp->lazyerror) { /* see msLoadLazyLayer() */
+      msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByFilter()", lp->name?lp->name:"");
+      return(MS_FAILURE);
+    }
     if (map->query.maxfeatures == 0)
       break; /* nothing else to do */
     else if (map->query.maxfeatures > 0)
@@ -792,19 +801,19 @@ int msQueryByFilter(mapObj *map)
         if (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE) {
           if( lp->debug >= MS_DEBUGLEVEL_V )
             msDebug("msQueryByFilter(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
       }
 
       shape.classindex = msShapeGetClass(lp, map, &shape, classgroup, nclasses);
       if(!(lp->template) && ((shape.classindex == -1) || (lp->class[shape.classindex]->status == MS_OFF))) { /* not a valid shape */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
       if(!(lp->template) && !(lp->class[shape.classindex]->template)) { /* no valid template */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
@@ -818,7 +827,7 @@ int msQueryByFilter(mapObj *map)
       /* Should we skip this feature? */
       if (!msLayerGetPaging(lp) && map->query.startindex > 1) {
         --map->query.startindex;
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
     
@@ -826,7 +835,7 @@ int msQueryByFilter(mapObj *map)
         lp->resultcache->numresults ++;
       else
         addResult(lp->resultcache, &shape);
-      msFreeShape(&shape);
+      msLayerRecycleShape(lp, &shape);
 
       if(map->query.mode == MS_QUERY_SINGLE) { /* no need to look any further */
 	status = MS_DONE;
@@ -839,6 +848,7 @@ int msQueryByFilter(mapObj *map)
         break;
       }
     } /* next shape */
+    msFreeShape(&shape); /* releases the buffers kept by msLayerRecycleShape() */
 
     if(classgroup) msFree(classgroup);
 
@@ -853,7 +863,7 @@ int msQueryByFilter(mapObj *map)
 
   /* was anything found? */
   for(l=start; l>=stop; l--) {
-    if(GET_LAYER(map, l)->resultcache && GET_LAYER(map, l)->resultcache->numresults > 0)
+    if(GET_LAYER_HEADER(map, l)->resultcache && GET_LAYER_HEADER(map, l)->resultcache->numresults > 0)
       return MS_SUCCESS;
   }
 
@@ -900,7 +910,12 @@ int msQueryByRect(mapObj *map)
     start = stop = map->query.layer;
 
   for(l=start; l>=stop; l--) {
+    if(MS_LAZY_LAYER_IS_OFF(map, l)) continue; /* not loaded and not queried */
     lp = (GET_LAYER(map, l));
+    if(lp->lazyerror) { /* see msLoadLazyLayer() */
+      msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByRect()", lp->name?lp->name:"");
+      return(MS_FAILURE);
+    }
     /* Set the global maxfeatures */
     if (map->query.maxfeatures == 0)
       break; /* nothing else to do */
@@ -1014,19 +1029,19 @@ int msQueryByRect(mapObj *map)
         if (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE) {
           if( lp->debug >= MS_DEBUGLEVEL_V )
             msDebug("msQueryByRect(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
       }
 
       shape.classindex = msShapeGetClass(lp, map, &shape, classgroup, nclasses);
       if(!(lp->template) && ((shape.classindex == -1) || (lp->class[shape.classindex]->status == MS_OFF))) { /* not a valid shape */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
       if(!(lp->template) && !(lp->class[shape.classindex]->template)) { /* no valid template */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
@@ -1059,7 +1074,7 @@ int msQueryByRect(mapObj *map)
         /* Should we skip this feature? */
         if (!paging && map->query.startindex > 1) {
           --map->query.startindex;
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
         if( map->query.only_cache_result_count )
@@ -1068,7 +1083,7 @@ int msQueryByRect(mapObj *map)
             addResult(lp->resultcache, &shape);
         --map->query.maxfeatures;
       }
-      msFreeShape(&shape);
+      msLayerRecycleShape(lp, &shape);
 
       /* check shape count */
       if(lp->maxfeatures > 0 && lp->maxfeatures == lp->resultcache->numresults) {
@@ -1077,6 +1092,7 @@ int msQueryByRect(mapObj *map)
       }
       
     } /* next shape */
+    msFreeShape(&shape); /* releases the buffers kept by msLayerRecycleShape() */
 
     if (classgroup)
       msFree(classgroup);
@@ -1094,7 +1110,7 @@ int msQueryByRect(mapObj *map)
 
   /* was anything found? */
   for(l=start; l>=stop; l--) {
-    if(GET_LAYER(map, l)->resultcache && GET_LAYER(map, l)->resultcache->numresults > 0)
+    if(GET_LAYER_HEADER(map, l)->resultcache && GET_LAYER_HEADER(map, l)->resultcache->numresults > 0)
       return(MS_SUCCESS);
   }
 
@@ -1159,7 +1175,12 @@ int msQueryByFeatures(mapObj *map)
   for(l=start; l>=stop; l--) {
     if(l == map->query.slayer) continue; /* skip the selection layer */
 
+    if(MS_LAZY_LAYER_IS_OFF(map, l)) continue; /* not loaded and not queried */
     lp = (GET_LAYER(map, l));
+    if(lp->lazyerror) { /* see msLoadLazyLayer() */
+      msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByFeatures()", lp->name?lp->name:"");
+      return(MS_FAILURE);
+    }
     if (map->query.maxfeatures == 0)
       break; /* nothing else to do */
     else if (map->query.maxfeatures > 0)
@@ -1292,19 +1313,19 @@ int msQueryByFeatures(mapObj *map)
           if (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE) {
             if( lp->debug >= MS_DEBUGLEVEL_V )
               msDebug("msQueryByFeature(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-            msFreeShape(&shape);
+            msLayerRecycleShape(lp, &shape);
             continue;
           }
         }
 
         shape.classindex = msShapeGetClass(lp, map, &shape, classgroup, nclasses);
         if(!(lp->template) && ((shape.classindex == -1) || (lp->class[shape.classindex]->status == MS_OFF))) { /* not a valid shape */
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
 
         if(!(lp->template) && !(lp->class[shape.classindex]->template)) { /* no valid template */
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
 
@@ -1387,12 +1408,12 @@ int msQueryByFeatures(mapObj *map)
           /* Should we skip this feature? */
           if (!msLayerGetPaging(lp) && map->query.startindex > 1) {
             --map->query.startindex;
-            msFreeShape(&shape);
+            msLayerRecycleShape(lp, &shape);
             continue;
           }
           addResult(lp->resultcache, &shape);
         }
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
 
         /* check shape count */
         if(lp->maxfeatures > 0 && lp->maxfeatures == lp->resultcache->numresults) {
@@ -1400,6 +1421,7 @@ int msQueryByFeatures(mapObj *map)
           break;
         }
       } /* next shape */
+      msFreeShape(&shape); /* releases the buffers kept by msLayerRecycleShape() */
 
       if (classgroup)
         msFree(classgroup);
@@ -1415,7 +1437,7 @@ int msQueryByFeatures(mapObj *map)
   /* was anything found? */
   for(l=start; l>=stop; l--) {
     if(l == map->query.slayer) continue; /* skip the selection layer */
-    if(GET_LAYER(map, l)->resultcache && GET_LAYER(map, l)->resultcache->numresults > 0) return(MS_SUCCESS);
+    if(GET_LAYER_HEADER(map, l)->resultcache && GET_LAYER_HEADER(map, l)->resultcache->numresults > 0) return(MS_SUCCESS);
   }
 
   msSetError(MS_NOTFOUND, "No matching record(s) found.", "msQueryByFeatures()");
@@ -1467,7 +1489,12 @@ int msQueryByPoint(mapObj *map)
     start = stop = map->query.layer;
 
   for(l=start; l>=stop; l--) {
+    if(MS_LAZY_LAYER_IS_OFF(map, l)) continue; /* not loaded and not queried */
     lp = (GET_LAYER(map, l));
+    if(lp->lazyerror) { /* see msLoadLazyLayer() */
+      msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByPoint()", lp->name?lp->name:"");
+      return(MS_FAILURE);
+    }
     if (map->query.maxfeatures == 0)
       break; /* nothing else to do */
     else if (map->query.maxfeatures > 0)
@@ -1578,19 +1605,19 @@ int msQueryByPoint(mapObj *map)
         if (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE) {
           if( lp->debug >= MS_DEBUGLEVEL_V )
             msDebug("msQueryByPoint(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
       }
 
       shape.classindex = msShapeGetClass(lp, map, &shape, classgroup, nclasses);
       if(!(lp->template) && ((shape.classindex == -1) || (lp->class[shape.classindex]->status == MS_OFF))) { /* not a valid shape */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
       if(!(lp->template) && !(lp->class[shape.classindex]->template)) { /* no valid template */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
@@ -1607,7 +1634,7 @@ int msQueryByPoint(mapObj *map)
         /* Should we skip this feature? */
         if (!paging && map->query.startindex > 1) {
           --map->query.startindex;
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
 
@@ -1620,7 +1647,7 @@ int msQueryByPoint(mapObj *map)
         }
       }
 
-      msFreeShape(&shape);
+      msLayerRecycleShape(lp, &shape);
 
       if(map->query.mode == MS_QUERY_MULTIPLE && map->query.maxresults > 0 && lp->resultcache->numresults == map->query.maxresults) {
         status = MS_DONE;   /* got enough results for this layer */
@@ -1633,6 +1660,7 @@ int msQueryByPoint(mapObj *map)
         break;
       }
     } /* next shape */
+    msFreeShape(&shape); /* releases the buffers kept by msLayerRecycleShape() */
 
     if (classgroup)
       msFree(classgroup);
@@ -1647,7 +1675,7 @@ int msQueryByPoint(mapObj *map)
 
   /* was anything found? */
   for(l=start; l>=stop; l--) {
-    if(GET_LAYER(map, l)->resultcache && GET_LAYER(map, l)->resultcache->numresults > 0)
+    if(GET_LAYER_HEADER(map, l)->resultcache && GET_LAYER_HEADER(map, l)->resultcache->numresults > 0)
       return(MS_SUCCESS);
   }
 
@@ -1693,7 +1721,12 @@ int msQueryByShape(mapObj *map)
   msComputeBounds(qshape); /* make sure an accurate extent exists */
 
   for(l=start; l>=stop; l--) { /* each layer */
+    if(MS_LAZY_LAYER_IS_OFF(map, l)) continue; /* not loaded and not queried */
     lp = (GET_LAYER(map, l));
+    if(lp->lazyerror) { /* see msLoadLazyLayer() */
+      msSetError(MS_QUERYERR, "Layer (%s) failed to load.", "msQueryByShape()", lp->name?lp->name:"");
+      return(MS_FAILURE);
+    }
     if (map->query.maxfeatures == 0)
       break; /* nothing else to do */
     else if (map->query.maxfeatures > 0)
@@ -1800,19 +1833,19 @@ int msQueryByShape(mapObj *map)
         if (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE) {
           if( lp->debug >= MS_DEBUGLEVEL_V )
             msDebug("msQueryByShape(): Skipping shape (%ld) because LAYER::MINFEATURESIZE is bigger than shape size\n", shape.index);
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
       }
 
       shape.classindex = msShapeGetClass(lp, map, &shape, classgroup, nclasses);
       if(!(lp->template) && ((shape.classindex == -1) || (lp->class[shape.classindex]->status == MS_OFF))) { /* not a valid shape */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
       if(!(lp->template) && !(lp->class[shape.classindex]->template)) { /* no valid template */
-        msFreeShape(&shape);
+        msLayerRecycleShape(lp, &shape);
         continue;
       }
 
@@ -1900,12 +1933,12 @@ int msQueryByShape(mapObj *map)
         /* Should we skip this feature? */
         if (!msLayerGetPaging(lp) && map->query.startindex > 1) {
           --map->query.startindex;
-          msFreeShape(&shape);
+          msLayerRecycleShape(lp, &shape);
           continue;
         }
         addResult(lp->resultcache, &shape);
       }
-      msFreeShape(&shape);
+      msLayerRecycleShape(lp, &shape);
 
       /* check shape count */
       if(lp->maxfeatures > 0 && lp->maxfeatures == lp->resultcache->numresults) {
@@ -1913,6 +1946,7 @@ int msQueryByShape(mapObj *map)
         break;
       }
     } /* next shape */
+    msFreeShape(&shape); /* releases the buffers kept by msLayerRecycleShape() */
 
     if(status != MS_DONE) {
       free(classgroup);
@@ -1926,7 +1960,7 @@ int msQueryByShape(mapObj *map)
 
   /* was anything found? */
   for(l=start; l>=stop; l--) {
-    if(GET_LAYER(map, l)->resultcache && GET_LAYER(map, l)->resultcache->numresults > 0)
+    if(GET_LAYER_HEADER(map, l)->resultcache && GET_LAYER_HEADER(map, l)->resultcache->numresults > 0)
       return(MS_SUCCESS);
   }
 
@@ -1948,7 +1982,7 @@ int msGetQueryResultBounds(mapObj *map, rectObj *bounds)
   for(i=0; i<map->numlayers; i++) {
 
     layerObj *lp;
-    lp = (GET_LAYER(map, i));
+    lp = (GET_LAYER_HEADER(map, i));
 
     if(!lp->resultcache) continue;
     if(lp->resultcache->numresults <= 0) continue;
@@ -1984,7 +2018,7 @@ void msQueryFree(mapObj *map, int qlayer)
     start = stop = qlayer;
 
   for(l=start; l>=stop; l--) {
-    lp = (GET_LAYER(map, l));
+    lp = (GET_LAYER_HEADER(map, l));
 
     if(lp->resultcache) {
       if(lp->resultcache->results)
@@ -34,6 +34,7 @@
 #include "mapfile.h"
 #include "mapresample.h"
 #include "mapthread.h"
+#include "maptime.h"
 
 
 
@@ -56,38 +57,17 @@ extern parseResultObj yypresult; /* result of parsing, true/false */
 
 #define NUMGRAYS 16
 
-/************************************************************************/
-/*                         msGetClass_String()                          */
-/************************************************************************/
-
-static int msGetClass_String( layerObj *layer, colorObj *color, const char *pixel_value )
+/*
+** Class lookup for msGetClass_String(). values_shape carries the pixel
+** values for the expressions, its number cache lives for the whole lookup.
+*/
+static int getClassForValues( layerObj *layer, const char *pixel_value, shapeObj *values_shape )
 
 {
   int i;
   const char *tmpstr1=NULL;
-  int numitems;
+  int numitems = values_shape->numvalues;
   char *item_names[4] = { "pixel", "red", "green", "blue" };
-  char *item_values[4];
-  char red_value[8], green_value[8], blue_value[8];
-
-  /* -------------------------------------------------------------------- */
-  /*      No need to do a lookup in the case of one default class.        */
-  /* -------------------------------------------------------------------- */
-  if((layer->numclasses == 1) && !(layer->class[0]->expression.string)) /* no need to do lookup */
-    return(0);
-
-  /* -------------------------------------------------------------------- */
-  /*      Setup values list for expressions.                              */
-  /* -------------------------------------------------------------------- */
-  numitems = 4;
-  sprintf( red_value, "%d", color->red );
-  sprintf( green_value, "%d", color->green );
-  sprintf( blue_value, "%d", color->blue );
-
-  item_values[0] = (char *)pixel_value;
-  item_values[1] = red_value;
-  item_values[2] = green_value;
-  item_values[3] = blue_value;
 
   /* -------------------------------------------------------------------- */
   /*      Loop over classes till we find a match.                         */
@@ -138,16 +118,12 @@ static int msGetClass_String( layerObj *layer, colorObj *color, const char *pixe
       case(MS_EXPRESSION): {
         int status;
         parseObj p;
-        shapeObj dummy_shape;
         expressionObj *expression = &(layer->class[i]->expression);
 
-        dummy_shape.numvalues = numitems;
-        dummy_shape.values = item_values;
-
         if( expression->tokens == NULL )
           msTokenizeExpression( expression, item_names, &numitems );
 
-        p.shape = &dummy_shape;
+        p.shape = values_shape;
         p.expr = expression;
         p.expr->curtoken = p.expr->tokens; /* reset */
         p.type = MS_PARSE_TYPE_BOOLEAN;
@@ -169,6 +145,50 @@ static int msGetClass_String( layerObj *layer, colorObj *color, const char *pixe
   return(-1); /* not found */
 }
 
+/************************************************************************/
+/*                         msGetClass_String()                          */
+/************************************************************************/
+
+static int msGetClass_String( layerObj *layer, colorObj *color, const char *pixel_value )
+
+{
+  int i;
+  shapeObj values_shape;
+  char *item_values[4];
+  char red_value[8], green_value[8], blue_value[8];
+
+  /* -------------------------------------------------------------------- */
+  /*      No need to do a lookup in the case of one default class.        */
+  /* -------------------------------------------------------------------- */
+  if((layer->numclasses == 1) && !(layer->class[0]->expression.string)) /* no need to do lookup */
+    return(0);
+
+  /* -------------------------------------------------------------------- */
+  /*      Setup values list for expressions.                              */
+  /* -------------------------------------------------------------------- */
+  sprintf( red_value, "%d", color->red );
+  sprintf( green_value, "%d", color->green );
+  sprintf( blue_value, "%d", color->blue );
+
+  item_values[0] = (char *)pixel_value;
+  item_values[1] = red_value;
+  item_values[2] = green_value;
+  item_values[3] = blue_value;
+
+  msInitShape(&values_shape);
+  values_shape.numvalues = 4;
+  values_shape.values = item_values;
+
+  i = getClassForValues(layer, pixel_value, &values_shape);
+
+  /* the values are borrowed, only the number cache is the shape's */
+  values_shape.values = NULL;
+  values_shape.numvalues = 0;
+  msFreeShape(&values_shape);
+
+  return i;
+}
+
 /************************************************************************/
 /*                             msGetClass()                             */
 /************************************************************************/
@@ -540,6 +560,396 @@ int msDrawRasterLoadProjection(layerObj *layer,
 
     return MS_SUCCESS;
 }
+/************************************************************************/
+/*                    msDrawRasterAdviseTileReads()                     */
+/*                                                                      */
+/*      With PROCESSING "TILEINDEX_ADVISE_READ=YES", walk the selected  */
+/*      tiles once before drawing and tell GDAL which window of each    */
+/*      one the map covers, so drivers able to prefetch (remote and     */
+/*      cloud formats mostly) can fetch the blocks of all the tiles     */
+/*      ahead of the decoding.  The tile layer is rewound afterwards.   */
+/************************************************************************/
+
+static void msDrawRasterAdviseTileReads(mapObj *map, layerObj *layer,
+                                        layerObj *tlp, rectObj *psearchrect,
+                                        int tileitemindex, int tilesrsindex)
+{
+    const char *advise = CSLFetchNameValue(layer->processing, "TILEINDEX_ADVISE_READ");
+    char tilename[MS_MAXPATHLEN], tilesrsname[1024];
+    char szPath[MS_MAXPATHLEN];
+    shapeObj tshp;
+    int numtiles = 0;
+
+    if( advise == NULL || !CSLTestBoolean(advise) )
+      return;
+
+    /* the map extent must be in the tile coordinates to get a window */
+    if( tilesrsindex >= 0 || !layer->transform
+        || msProjectionsDiffer(&(map->projection), &(layer->projection)) )
+      return;
+
+    msInitShape(&tshp);
+    while( msDrawRasterIterateTileIndex(layer, tlp, &tshp,
+                                        tileitemindex, tilesrsindex,
+                                        tilename, sizeof(tilename),
+                                        tilesrsname, sizeof(tilesrsname)) == MS_SUCCESS ) {
+      char *decrypted_path;
+      GDALDatasetH hDS;
+      double adfGeoTransform[6];
+
+      if( strlen(tilename) == 0 )
+        continue;
+
+      msDrawRasterBuildRasterPath(map, layer, tilename, szPath);
+      decrypted_path = msDecryptStringTokens( map, szPath );
+      if( decrypted_path == NULL )
+        break;
+
+      msAcquireLock( TLOCK_GDAL );
+      CPLPushErrorHandler( CPLQuietErrorHandler );
+      hDS = (GDALDatasetH) msGDALOpenDataset( map, decrypted_path );
+      CPLPopErrorHandler();
+      msFree( decrypted_path );
+
+      if( hDS != NULL ) {
+        msGetGDALGeoTransform( hDS, map, layer, adfGeoTransform );
+
+        if( adfGeoTransform[2] == 0.0 && adfGeoTransform[4] == 0.0
+            && adfGeoTransform[1] != 0.0 && adfGeoTransform[5] != 0.0 ) {
+          int nXSize = GDALGetRasterXSize( hDS );
+          int nYSize = GDALGetRasterYSize( hDS );
+          double x1 = (map->extent.minx - adfGeoTransform[0]) / adfGeoTransform[1];
+          double x2 = (map->extent.maxx - adfGeoTransform[0]) / adfGeoTransform[1];
+          double y1 = (map->extent.maxy - adfGeoTransform[3]) / adfGeoTransform[5];
+          double y2 = (map->extent.miny - adfGeoTransform[3]) / adfGeoTransform[5];
+          int xoff = MAX(0, (int) floor(MIN(x1,x2)));
+          int yoff = MAX(0, (int) floor(MIN(y1,y2)));
+          int xend = MIN(nXSize, (int) ceil(MAX(x1,x2)));
+          int yend = MIN(nYSize, (int) ceil(MAX(y1,y2)));
+
+          if( xend > xoff && yend > yoff ) {
+            GDALDatasetAdviseRead( hDS, xoff, yoff, xend - xoff, yend - yoff,
+                                   MIN(xend - xoff, map->width),
+                                   MIN(yend - yoff, map->height),
+                                   GDT_Unknown, 0, NULL, NULL );
+            numtiles++;
+          }
+        }
+        msGDALCloseDataset( layer, hDS );
+      }
+      msReleaseLock( TLOCK_GDAL );
+    }
+    msFreeShape(&tshp);
+
+    if( layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING )
+      msDebug( "msDrawRasterLayerLow(%s): advised reads on %d tile(s).\n",
+               layer->name, numtiles );
+
+    /* start the tile iteration over for the drawing loop */
+    msLayerWhichShapes(tlp, *psearchrect, MS_FALSE);
+}
+/************************************************************************/
+/* ==================================================================== */
+/*      Drawing the tiles of a tile index on several threads.           */
+/*                                                                      */
+/*      With PROCESSING "TILEINDEX_THREADS=n" the tiles are opened,     */
+/*      read and resampled up to n at a time, each into a private       */
+/*      RGBA buffer of the map size, and the buffers are then           */
+/*      composited over the image in the tile index order so the        */
+/*      overlap priority is the same as when drawing one by one.        */
+/*                                                                      */
+/*      The datasets are read without holding TLOCK_GDAL, which is      */
+/*      only taken to get them from and give them back to the dataset   */
+/*      cache.  The layer is shallow copied for each tile since the     */
+/*      resampler temporarily alters its processing options.  Layers    */
+/*      that change the layer state per tile (TILESRS, PROJECTION       */
+/*      AUTO), are classified or don't draw into an RGBA raster         */
+/*      buffer are drawn one tile at a time.                            */
+/* ==================================================================== */
+/************************************************************************/
+
+typedef struct {
+  char szPath[MS_MAXPATHLEN];
+  char *decrypted_path;
+  int status; /* MS_SUCCESS, MS_FAILURE, or MS_DONE if it can't be opened */
+  int error_code;
+  char *error_message;
+} msDrawRasterTileObj;
+
+typedef struct {
+  mapObj *map;
+  layerObj *layer;
+  imageObj *image;
+  msDrawRasterTileObj *tiles; /* of the current batch */
+  layerObj *layers; /* one per thread */
+  rasterBufferObj *buffers; /* one per thread */
+  void *main_thread_id;
+} msDrawRasterTileBatchObj;
+
+/************************************************************************/
+/*                      msDrawRasterGetTileThreads()                    */
+/************************************************************************/
+
+static int msDrawRasterGetTileThreads(layerObj *layer, rasterBufferObj *rb,
+                                      int tilesrsindex)
+{
+#if defined(USE_THREAD)
+    const char *value = msLayerGetProcessingKey(layer, "TILEINDEX_THREADS");
+    int nthreads;
+
+    if( value == NULL )
+      return 1;
+    nthreads = MS_MAX(1, MS_MIN(atoi(value), MS_MAX_WORKER_THREADS));
+    if( nthreads == 1 )
+      return 1;
+
+    if( rb == NULL || rb->type != MS_BUFFER_BYTE_RGBA || tilesrsindex >= 0
+        || layer->numclasses > 0 || layer->connectiontype == MS_KERNELDENSITY
+        || (layer->projection.numargs > 0 &&
+            EQUAL(layer->projection.args[0], "auto")) ) {
+      if( layer->debug || (layer->map && layer->map->debug) )
+        msDebug( "msDrawRasterLayerLow(%s): TILEINDEX_THREADS ignored, "
+                 "tiles of this layer are drawn one at a time.\n", layer->name );
+      return 1;
+    }
+
+    return nthreads;
+#else
+    (void) layer;
+    (void) rb;
+    (void) tilesrsindex;
+    return 1;
+#endif
+}
+
+/************************************************************************/
+/*                        msDrawRasterTileTask()                        */
+/*                                                                      */
+/*      Draw one tile into the buffer of the thread slot.               */
+/************************************************************************/
+
+static void msDrawRasterTileTask(void *pData, int iTask)
+{
+    msDrawRasterTileBatchObj *batch = (msDrawRasterTileBatchObj *) pData;
+    msDrawRasterTileObj *tile = batch->tiles + iTask;
+    layerObj *layer = batch->layers + iTask;
+    rasterBufferObj *rb = batch->buffers + iTask;
+    mapObj *map = batch->map;
+    GDALDatasetH hDS;
+    double adfGeoTransform[6];
+    int status;
+
+    memcpy(layer, batch->layer, sizeof(layerObj));
+    memset(rb->data.rgba.pixels, 0, (size_t)rb->data.rgba.row_step * rb->height);
+
+    msAcquireLock( TLOCK_GDAL );
+    hDS = (GDALDatasetH) msGDALOpenDatasetExclusive( map, tile->decrypted_path );
+    if( hDS == NULL ) {
+      tile->status = MS_DONE;
+      tile->error_message = msStrdup(msDrawRasterGetCPLErrorMsg(tile->decrypted_path, tile->szPath));
+      msReleaseLock( TLOCK_GDAL );
+      return;
+    }
+    msReleaseLock( TLOCK_GDAL );
+
+    msGetGDALGeoTransform( hDS, map, layer, adfGeoTransform );
+
+#ifdef USE_PROJ
+    if( ((adfGeoTransform[2] != 0.0 || adfGeoTransform[4] != 0.0
+          || adfGeoTransform[5] > 0.0 || adfGeoTransform[1] < 0.0 )
+         && layer->transform )
+        || msProjectionsDiffer( &(map->projection),
+                                &(layer->projection) )
+        || CSLFetchNameValue( layer->processing, "RESAMPLE" ) != NULL ) {
+      status = msResampleGDALToMap( map, layer, batch->image, rb, hDS );
+    } else
+#endif
+    {
+      status = msDrawRasterLayerGDAL( map, layer, batch->image, rb, hDS );
+    }
+
+    msAcquireLock( TLOCK_GDAL );
+    msGDALCloseDataset( layer, hDS );
+    msReleaseLock( TLOCK_GDAL );
+
+    tile->status = (status == -1) ? MS_FAILURE : MS_SUCCESS;
+
+    /* errors set on another thread are reported again by the caller */
+    if( tile->status == MS_FAILURE && msGetThreadId() != batch->main_thread_id ) {
+      errorObj *ms_error = msGetErrorObj();
+      tile->error_code = ms_error->code;
+      tile->error_message = msStrdup(ms_error->message);
+    }
+}
+
+/************************************************************************/
+/*                      msDrawRasterCompositeTile()                     */
+/*                                                                      */
+/*      Composite a premultiplied RGBA tile buffer over rb.             */
+/************************************************************************/
+
+static void msDrawRasterCompositeTile(rasterBufferObj *rb, rasterBufferObj *tile_rb)
+{
+    int i, j;
+
+    for( i = 0; i < rb->height; i++ ) {
+      unsigned char *src = tile_rb->data.rgba.pixels + (size_t)i * tile_rb->data.rgba.row_step;
+      int dst_off = i * rb->data.rgba.row_step;
+
+      for( j = 0; j < rb->width; j++, src += 4, dst_off += rb->data.rgba.pixel_step ) {
+        int alpha = src[3], weight;
+
+        if( alpha == 0 )
+          continue;
+
+        if( alpha == 255 || rb->data.rgba.a == NULL ) {
+          /* same as drawing the tile straight into rb */
+          rb->data.rgba.b[dst_off] = src[0];
+          rb->data.rgba.g[dst_off] = src[1];
+          rb->data.rgba.r[dst_off] = src[2];
+          if( rb->data.rgba.a )
+            rb->data.rgba.a[dst_off] = 255;
+          continue;
+        }
+
+        weight = 255 - alpha;
+        rb->data.rgba.b[dst_off] = src[0] + (rb->data.rgba.b[dst_off] * weight + 127) / 255;
+        rb->data.rgba.g[dst_off] = src[1] + (rb->data.rgba.g[dst_off] * weight + 127) / 255;
+        rb->data.rgba.r[dst_off] = src[2] + (rb->data.rgba.r[dst_off] * weight + 127) / 255;
+        rb->data.rgba.a[dst_off] = alpha + (rb->data.rgba.a[dst_off] * weight + 127) / 255;
+      }
+    }
+}
+
+/************************************************************************/
+/*                    msDrawRasterLayerTilesThreaded()                  */
+/*                                                                      */
+/*      Draw all the remaining tiles of the tile layer, nthreads at a   */
+/*      time.                                                           */
+/************************************************************************/
+
+static int msDrawRasterLayerTilesThreaded(mapObj *map, layerObj *layer,
+                                          imageObj *image, rasterBufferObj *rb,
+                                          layerObj *tlp, int tileitemindex,
+                                          int tilesrsindex, int nthreads)
+{
+    char tilename[MS_MAXPATHLEN], tilesrsname[1024];
+    msDrawRasterTileObj *tiles = NULL;
+    msDrawRasterTileBatchObj batch;
+    int numtiles = 0, i, first, status = MS_SUCCESS;
+    int ignore_missing = msMapIgnoreMissingData(map);
+    struct mstimeval starttime = {0}, endtime = {0};
+    shapeObj tshp;
+
+    if( layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING )
+      msGettimeofday(&starttime, NULL);
+
+    /* collect the tiles, resolving the paths is not thread safe */
+    msInitShape(&tshp);
+    while( (status = msDrawRasterIterateTileIndex(layer, tlp, &tshp,
+                                                  tileitemindex, tilesrsindex,
+                                                  tilename, sizeof(tilename),
+                                                  tilesrsname, sizeof(tilesrsname))) == MS_SUCCESS ) {
+      msDrawRasterTileObj *tile;
+
+      if( strlen(tilename) == 0 )
+        continue;
+
+      tiles = (msDrawRasterTileObj *) msSmallRealloc(tiles, sizeof(msDrawRasterTileObj) * (numtiles+1));
+      tile = tiles + numtiles;
+      memset(tile, 0, sizeof(msDrawRasterTileObj));
+
+      msDrawRasterBuildRasterPath(map, layer, tilename, tile->szPath);
+      if(layer->debug == MS_TRUE)
+        msDebug("msDrawRasterLayerLow(%s): Path is: %s\n", layer->name, tile->szPath);
+
+      tile->decrypted_path = msDecryptStringTokens( map, tile->szPath );
+      if( tile->decrypted_path == NULL ) {
+        status = MS_FAILURE;
+        break;
+      }
+      numtiles++;
+    }
+
+    if( status == MS_FAILURE ) {
+      for( i = 0; i < numtiles; i++ )
+        msFree(tiles[i].decrypted_path);
+      msFree(tiles);
+      return MS_FAILURE;
+    }
+    status = MS_SUCCESS;
+
+    nthreads = MS_MIN(nthreads, numtiles);
+    batch.map = map;
+    batch.layer = layer;
+    batch.image = image;
+    batch.main_thread_id = msGetThreadId();
+    batch.layers = (layerObj *) msSmallMalloc(sizeof(layerObj) * MS_MAX(1, nthreads));
+    batch.buffers = (rasterBufferObj *) msSmallCalloc(MS_MAX(1, nthreads), sizeof(rasterBufferObj));
+    for( i = 0; i < nthreads; i++ ) {
+      rasterBufferObj *tile_rb = batch.buffers + i;
+
+      tile_rb->type = MS_BUFFER_BYTE_RGBA;
+      tile_rb->width = rb->width;
+      tile_rb->height = rb->height;
+      tile_rb->data.rgba.pixel_step = 4;
+      tile_rb->data.rgba.row_step = rb->width * 4;
+      tile_rb->data.rgba.pixels = (unsigned char *) msSmallMalloc((size_t)rb->width * rb->height * 4);
+      tile_rb->data.rgba.b = tile_rb->data.rgba.pixels;
+      tile_rb->data.rgba.g = tile_rb->data.rgba.pixels + 1;
+      tile_rb->data.rgba.r = tile_rb->data.rgba.pixels + 2;
+      tile_rb->data.rgba.a = tile_rb->data.rgba.pixels + 3;
+    }
+
+    /* -------------------------------------------------------------------- */
+    /*      Draw nthreads tiles at a time and composite them in order.      */
+    /* -------------------------------------------------------------------- */
+    for( first = 0; first < numtiles && status == MS_SUCCESS; first += nthreads ) {
+      int count = MS_MIN(nthreads, numtiles - first);
+
+      batch.tiles = tiles + first;
+      msThreadRunTasks(count, count, msDrawRasterTileTask, &batch);
+
+      for( i = 0; i < count && status == MS_SUCCESS; i++ ) {
+        msDrawRasterTileObj *tile = batch.tiles + i;
+
+        if( tile->status == MS_SUCCESS ) {
+          msDrawRasterCompositeTile(rb, batch.buffers + i);
+        } else if( tile->status == MS_FAILURE ) {
+          if( tile->error_message )
+            msSetError(tile->error_code, "%s", "msDrawRasterLayerLow()", tile->error_message);
+          status = MS_FAILURE;
+        } else if( ignore_missing == MS_MISSING_DATA_FAIL ) {
+          msSetError(MS_IOERR, "Corrupt, empty or missing file '%s' for layer '%s'. %s", "msDrawRasterLayerLow()", tile->szPath, layer->name, tile->error_message );
+          status = MS_FAILURE;
+        } else if( ignore_missing == MS_MISSING_DATA_LOG ) {
+          if( layer->debug || layer->map->debug ) {
+            msDebug( "Corrupt, empty or missing file '%s' for layer '%s' ... ignoring this missing data.  %s\n", tile->szPath, layer->name, tile->error_message );
+          }
+        }
+      }
+    }
+
+    if( layer->debug >= MS_DEBUGLEVEL_TUNING || map->debug >= MS_DEBUGLEVEL_TUNING ) {
+      msGettimeofday(&endtime, NULL);
+      msDebug("msDrawRasterLayerLow(%s): drew %d tiles on %d threads in %.3fs\n",
+              layer->name, numtiles, nthreads,
+              (endtime.tv_sec+endtime.tv_usec/1.0e6)-
+              (starttime.tv_sec+starttime.tv_usec/1.0e6) );
+    }
+
+    for( i = 0; i < nthreads; i++ )
+      free(batch.buffers[i].data.rgba.pixels);
+    free(batch.buffers);
+    free(batch.layers);
+    for( i = 0; i < numtiles; i++ ) {
+      msFree(tiles[i].decrypted_path);
+      msFree(tiles[i].error_message);
+    }
+    msFree(tiles);
+
+    return status;
+}
 #endif // defined(USE_GDAL)
 
 /************************************************************************/
@@ -569,6 +979,7 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
 
   layerObj *tlp=NULL; /* pointer to the tile layer either real or temporary */
   int tileitemindex=-1, tilelayerindex=-1, tilesrsindex=-1;
+  int nthreads;
   shapeObj tshp;
 
   char szPath[MS_MAXPATHLEN];
@@ -645,6 +1056,20 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
         final_status = status;
       goto cleanup;
     }
+
+    msDrawRasterAdviseTileReads(map, layer, tlp, &searchrect,
+                                tileitemindex, tilesrsindex);
+
+    nthreads = msDrawRasterGetTileThreads(layer, rb, tilesrsindex);
+    if( nthreads > 1 ) {
+      final_status = msDrawRasterLayerTilesThreaded(map, layer, image, rb, tlp,
+                                                    tileitemindex, tilesrsindex,
+                                                    nthreads);
+      msAcquireLock( TLOCK_GDAL );
+      msGDALDebugDatasetCache( layer, "msDrawRasterLayerLow" );
+      msReleaseLock( TLOCK_GDAL );
+      goto cleanup;
+    }
   }
 
   done = MS_FALSE;
@@ -689,7 +1114,7 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
         return MS_FAILURE;
 
       msAcquireLock( TLOCK_GDAL );
-      hDS = GDALOpenShared( decrypted_path, GA_ReadOnly );
+      hDS = (GDALDatasetH) msGDALOpenDataset( map, decrypted_path );
     } else {
       status = msComputeKernelDensityDataset(map, image, layer, &hDS, &kernel_density_cleanup_ptr);
       if(status != MS_SUCCESS) {
@@ -745,6 +1170,8 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
 
     if( msDrawRasterLoadProjection(layer, hDS, filename, tilesrsindex, tilesrsname) != MS_SUCCESS )
     {
+        if( layer->connectiontype != MS_KERNELDENSITY )
+          msGDALCloseDataset( layer, hDS );
         msReleaseLock( TLOCK_GDAL );
         final_status = MS_FAILURE;
         break;
@@ -781,26 +1208,32 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
     }
 
     if( status == -1 ) {
-      GDALClose( hDS );
+      if( layer->connectiontype == MS_KERNELDENSITY )
+        GDALClose( hDS );
+      else
+        msGDALCloseDataset( layer, hDS );
       msReleaseLock( TLOCK_GDAL );
       final_status = MS_FAILURE;
       break;
     }
 
     /*
-    ** Should we keep this file open for future use?
-    ** default to keeping open for single data files, and
-    ** to closing for tile indexes
+    ** Files and tiles go back to the dataset cache, which keeps single
+    ** files open for future use, and tiles only with CLOSE_CONNECTION=DEFER.
     */
+    if( layer->connectiontype != MS_KERNELDENSITY ) {
+      msGDALCloseDataset( layer, hDS );
+      msReleaseLock( TLOCK_GDAL );
+      continue;
+    }
 
     close_connection = msLayerGetProcessingKey( layer,
                        "CLOSE_CONNECTION" );
 
-    if( close_connection == NULL && layer->tileindex == NULL )
+    if( close_connection == NULL )
       close_connection = "DEFER";
 
-    if( close_connection != NULL
-        && strcasecmp(close_connection,"DEFER") == 0 ) {
+    if( strcasecmp(close_connection,"DEFER") == 0 ) {
       GDALDereferenceDataset( hDS );
     } else {
       GDALClose( hDS );
@@ -808,6 +1241,12 @@ int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image,
     msReleaseLock( TLOCK_GDAL );
   } /* next tile */
 
+  if( layer->connectiontype != MS_KERNELDENSITY ) {
+    msAcquireLock( TLOCK_GDAL );
+    msGDALDebugDatasetCache( layer, "msDrawRasterLayerLow" );
+    msReleaseLock( TLOCK_GDAL );
+  }
+
 cleanup:
   if(layer->tileindex) { /* tiling clean-up */
     msDrawRasterCleanupTileLayer(tlp, tilelayerindex);
@@ -791,7 +791,7 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
     }
 
     msAcquireLock( TLOCK_GDAL );
-    hDS = GDALOpen(decrypted_path, GA_ReadOnly );
+    hDS = (GDALDatasetH) msGDALOpenDataset( map, decrypted_path );
 
     if( hDS == NULL ) {
       int ignore_missing = msMapIgnoreMissingData( map );
@@ -824,6 +824,7 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
 
     if( msDrawRasterLoadProjection(layer, hDS, filename, tilesrsindex, tilesrsname) != MS_SUCCESS )
     {
+        msGDALCloseDataset( layer, hDS );
         msReleaseLock( TLOCK_GDAL );
         status = MS_FAILURE;
         goto cleanup;
@@ -835,11 +836,15 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
     if( status == MS_SUCCESS )
       status = msRasterQueryByRectLow( map, layer, hDS, queryRect );
 
-    GDALClose( hDS );
+    msGDALCloseDataset( layer, hDS );
     msReleaseLock( TLOCK_GDAL );
 
   } /* next tile */
 
+  msAcquireLock( TLOCK_GDAL );
+  msGDALDebugDatasetCache( layer, "msRasterQueryByRect" );
+  msReleaseLock( TLOCK_GDAL );
+
   /* -------------------------------------------------------------------- */
   /*      Cleanup tileindex if it is open.                                */
   /* -------------------------------------------------------------------- */
@@ -1381,7 +1386,7 @@ int msRASTERLayerGetExtent(layerObj *layer, rectObj *extent)
 
   msAcquireLock( TLOCK_GDAL );
   if( decrypted_path ) {
-    hDS = GDALOpen(decrypted_path, GA_ReadOnly );
+    hDS = (GDALDatasetH) msGDALOpenDataset( map, decrypted_path );
     msFree( decrypted_path );
   } else
     hDS = NULL;
@@ -1391,7 +1396,7 @@ int msRASTERLayerGetExtent(layerObj *layer, rectObj *extent)
     nYSize = GDALGetRasterYSize( hDS );
     eErr = GDALGetGeoTransform( hDS, adfGeoTransform );
 
-    GDALClose( hDS );
+    msGDALCloseDataset( layer, hDS );
   }
 
   msReleaseLock( TLOCK_GDAL );
@@ -1465,7 +1470,7 @@ int msRASTERLayerSetTimeFilter(layerObj *layer, const char *timestring,
   /* -------------------------------------------------------------------- */
   if ( msCheckParentPointer(layer->map,"map")==MS_FAILURE )
     return MS_FAILURE;
-  return msLayerSetTimeFilter( layer->GET_LAYER(map,tilelayerindex),
+  return msLayerSetTimeFilter( GET_LAYER(layer->map, tilelayerindex),
                                timestring, timefield );
 }
 
@@ -30,6 +30,7 @@
 #include <assert.h>
 #include "mapresample.h"
 #include "mapthread.h"
+#include "maptime.h"
 
 
 
@@ -88,14 +89,15 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                           imageObj *psDstImage, rasterBufferObj *dst_rb,
                           int *panCMap,
                           SimpleTransformer pfnTransform, void *pCBData,
-                          int debug, rasterBufferObj *mask_rb )
+                          rasterBufferObj *mask_rb,
+                          int nDstYStart, int nDstYEnd,
+                          int *pnFailedPoints, int *pnSetPoints )
 
 {
   double  *x, *y;
   int   nDstX, nDstY;
   int         *panSuccess;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nSrcXSize = psSrcImage->width;
   int   nSrcYSize = psSrcImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
@@ -106,7 +108,7 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   y = (double *) msSmallMalloc( sizeof(double) * nDstXSize );
   panSuccess = (int *) msSmallMalloc( sizeof(int) * nDstXSize );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYStart; nDstY < nDstYEnd; nDstY++ ) {
     for( nDstX = 0; nDstX < nDstXSize; nDstX++ ) {
       x[nDstX] = nDstX + 0.5;
       y[nDstX] = nDstY + 0.5;
@@ -218,16 +220,9 @@ msNearestRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess );
   free( x );
   free( y );
-  msFree(mask_rb);
 
-  /* -------------------------------------------------------------------- */
-  /*      Some debugging output.                                          */
-  /* -------------------------------------------------------------------- */
-  if( nFailedPoints > 0 && debug ) {
-    msDebug( "msNearestRasterResampler: "
-             "%d failed to transform, %d actually set.\n",
-             nFailedPoints, nSetPoints );
-  }
+  *pnFailedPoints = nFailedPoints;
+  *pnSetPoints = nSetPoints;
 
   return 0;
 }
@@ -307,14 +302,15 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                            imageObj *psDstImage, rasterBufferObj *dst_rb,
                            int *panCMap,
                            SimpleTransformer pfnTransform, void *pCBData,
-                           int debug, rasterBufferObj *mask_rb )
+                           rasterBufferObj *mask_rb,
+                           int nDstYStart, int nDstYEnd,
+                           int *pnFailedPoints, int *pnSetPoints )
 
 {
   double  *x, *y;
   int   nDstX, nDstY, i;
   int         *panSuccess;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nSrcXSize = psSrcImage->width;
   int   nSrcYSize = psSrcImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
@@ -329,7 +325,7 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   y = (double *) msSmallMalloc( sizeof(double) * nDstXSize );
   panSuccess = (int *) msSmallMalloc( sizeof(int) * nDstXSize );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYStart; nDstY < nDstYEnd; nDstY++ ) {
     for( nDstX = 0; nDstX < nDstXSize; nDstX++ ) {
       x[nDstX] = nDstX + 0.5;
       y[nDstX] = nDstY + 0.5;
@@ -449,17 +445,9 @@ msBilinearRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess );
   free( x );
   free( y );
-  msFree(mask_rb);
 
-  /* -------------------------------------------------------------------- */
-  /*      Some debugging output.                                          */
-  /* -------------------------------------------------------------------- */
-  if( nFailedPoints > 0 && debug )
-  {
-    msDebug( "msBilinearRasterResampler: "
-             "%d failed to transform, %d actually set.\n",
-             nFailedPoints, nSetPoints );
-  }
+  *pnFailedPoints = nFailedPoints;
+  *pnSetPoints = nSetPoints;
 
   return 0;
 }
@@ -526,14 +514,15 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
                           imageObj *psDstImage, rasterBufferObj *dst_rb,
                           int *panCMap,
                           SimpleTransformer pfnTransform, void *pCBData,
-                          int debug, rasterBufferObj *mask_rb )
+                          rasterBufferObj *mask_rb,
+                          int nDstYStart, int nDstYEnd,
+                          int *pnFailedPoints, int *pnSetPoints )
 
 {
   double  *x1, *y1, *x2, *y2;
   int   nDstX, nDstY;
   int         *panSuccess1, *panSuccess2;
   int   nDstXSize = psDstImage->width;
-  int   nDstYSize = psDstImage->height;
   int   nFailedPoints = 0, nSetPoints = 0;
   double     *padfPixelSum;
 
@@ -550,7 +539,7 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   panSuccess1 = (int *) msSmallMalloc( sizeof(int) * (nDstXSize+1) );
   panSuccess2 = (int *) msSmallMalloc( sizeof(int) * (nDstXSize+1) );
 
-  for( nDstY = 0; nDstY < nDstYSize; nDstY++ ) {
+  for( nDstY = nDstYStart; nDstY < nDstYEnd; nDstY++ ) {
     for( nDstX = 0; nDstX <= nDstXSize; nDstX++ ) {
       x1[nDstX] = nDstX;
       y1[nDstX] = nDstY;
@@ -647,16 +636,145 @@ msAverageRasterResampler( imageObj *psSrcImage, rasterBufferObj *src_rb,
   free( panSuccess2 );
   free( x2 );
   free( y2 );
+
+  *pnFailedPoints = nFailedPoints;
+  *pnSetPoints = nSetPoints;
+
+  return 0;
+}
+
+/************************************************************************/
+/* ==================================================================== */
+/*      Running the resamplers over bands of destination rows.          */
+/* ==================================================================== */
+/************************************************************************/
+
+typedef int (*RasterResampler)( imageObj *psSrcImage, rasterBufferObj *src_rb,
+                                imageObj *psDstImage, rasterBufferObj *dst_rb,
+                                int *panCMap,
+                                SimpleTransformer pfnTransform, void *pCBData,
+                                rasterBufferObj *mask_rb,
+                                int nDstYStart, int nDstYEnd,
+                                int *pnFailedPoints, int *pnSetPoints );
+
+typedef struct {
+  RasterResampler pfnResampler;
+  imageObj *psSrcImage;
+  rasterBufferObj *src_rb;
+  imageObj *psDstImage;
+  rasterBufferObj *dst_rb;
+  int *panCMap;
+  SimpleTransformer pfnTransform;
+  void *pCBData;
+  rasterBufferObj *mask_rb;
+
+  int nRowsPerTask;
+  int *panFailedPoints;
+  int *panSetPoints;
+} msResampleTaskInfo;
+
+/************************************************************************/
+/*                           msResampleTask()                           */
+/************************************************************************/
+
+static void msResampleTask( void *pData, int iTask )
+
+{
+  msResampleTaskInfo *psInfo = (msResampleTaskInfo *) pData;
+  int nDstYStart = iTask * psInfo->nRowsPerTask;
+  int nDstYEnd = MIN(nDstYStart + psInfo->nRowsPerTask,
+                     psInfo->psDstImage->height);
+
+  psInfo->pfnResampler( psInfo->psSrcImage, psInfo->src_rb,
+                        psInfo->psDstImage, psInfo->dst_rb,
+                        psInfo->panCMap,
+                        psInfo->pfnTransform, psInfo->pCBData,
+                        psInfo->mask_rb, nDstYStart, nDstYEnd,
+                        psInfo->panFailedPoints + iTask,
+                        psInfo->panSetPoints + iTask );
+}
+
+/************************************************************************/
+/*                        msRunRasterResampler()                        */
+/*                                                                      */
+/*      Every destination pixel only depends on the source image, so    */
+/*      the destination rows are split in bands resampled by up to      */
+/*      nThreads threads.  The bands are a multiple of 8 rows so that   */
+/*      no two of them update the same byte of a raw data image mask.   */
+/*                                                                      */
+/*      Only the resampling and the interpolation of the approximate    */
+/*      transformer run in parallel: the workers share the PROJ         */
+/*      handles of the layer and map, so msProjTransformer() still      */
+/*      serializes its pj_transform() calls on TLOCK_PROJ.  The         */
+/*      approximate transformer only calls it for a few points per      */
+/*      row, so this matters most for strongly curved projections.      */
+/************************************************************************/
+
+static int
+msRunRasterResampler( const char *pszName, RasterResampler pfnResampler,
+                      imageObj *psSrcImage, rasterBufferObj *src_rb,
+                      imageObj *psDstImage, rasterBufferObj *dst_rb,
+                      int *panCMap,
+                      SimpleTransformer pfnTransform, void *pCBData,
+                      int nThreads, int debug, rasterBufferObj *mask_rb )
+
+{
+  msResampleTaskInfo sInfo;
+  int nDstYSize = psDstImage->height;
+  int nTasks, i, nFailedPoints = 0, nSetPoints = 0;
+  struct mstimeval starttime, endtime;
+
+  if( debug >= MS_DEBUGLEVEL_TUNING )
+    msGettimeofday(&starttime, NULL);
+
+  sInfo.pfnResampler = pfnResampler;
+  sInfo.psSrcImage = psSrcImage;
+  sInfo.src_rb = src_rb;
+  sInfo.psDstImage = psDstImage;
+  sInfo.dst_rb = dst_rb;
+  sInfo.panCMap = panCMap;
+  sInfo.pfnTransform = pfnTransform;
+  sInfo.pCBData = pCBData;
+  sInfo.mask_rb = mask_rb;
+
+  /* a few bands per thread to even out the load */
+  if( nThreads > 1 ) {
+    sInfo.nRowsPerTask = (nDstYSize + nThreads*4 - 1) / (nThreads*4);
+    sInfo.nRowsPerTask = MAX(8, (sInfo.nRowsPerTask + 7) / 8 * 8);
+  } else
+    sInfo.nRowsPerTask = MAX(1, nDstYSize);
+
+  nTasks = (nDstYSize + sInfo.nRowsPerTask - 1) / sInfo.nRowsPerTask;
+
+  sInfo.panFailedPoints = (int *) msSmallCalloc( MAX(1,nTasks), sizeof(int) );
+  sInfo.panSetPoints = (int *) msSmallCalloc( MAX(1,nTasks), sizeof(int) );
+
+  nThreads = msThreadRunTasks( nThreads, nTasks, msResampleTask, &sInfo );
+
+  for( i = 0; i < nTasks; i++ ) {
+    nFailedPoints += sInfo.panFailedPoints[i];
+    nSetPoints += sInfo.panSetPoints[i];
+  }
+
+  free( sInfo.panFailedPoints );
+  free( sInfo.panSetPoints );
   msFree(mask_rb);
 
   /* -------------------------------------------------------------------- */
   /*      Some debugging output.                                          */
   /* -------------------------------------------------------------------- */
-  if( nFailedPoints > 0 && debug )
-  {
-    msDebug( "msAverageRasterResampler: "
+  if( nFailedPoints > 0 && debug ) {
+    msDebug( "%s: "
              "%d failed to transform, %d actually set.\n",
-             nFailedPoints, nSetPoints );
+             pszName, nFailedPoints, nSetPoints );
+  }
+
+  if( debug >= MS_DEBUGLEVEL_TUNING ) {
+    msGettimeofday(&endtime, NULL);
+    msDebug( "%s: %dx%d pixels in %d bands on %d threads, %.3fs\n",
+             pszName, psDstImage->width, nDstYSize, nTasks, nThreads,
+             (endtime.tv_sec+endtime.tv_usec/1.0e6)-
+             (starttime.tv_sec+starttime.tv_usec/1.0e6) );
   }
 
   return 0;
@@ -791,6 +909,7 @@ int msProjTransformer( void *pCBData, int nPoints,
 
     z = (double *) msSmallCalloc(sizeof(double),nPoints);
 
+    /* the handles may be shared by the resampling worker threads */
     msAcquireLock( TLOCK_PROJ );
     tr_result = pj_transform( psPTInfo->psDstProj, psPTInfo->psSrcProj,
                               nPoints, 1, x, y,  z);
@@ -1186,6 +1305,7 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
   double      dfOversampleRatio;
   rasterBufferObj src_rb, *psrc_rb = NULL, *mask_rb = NULL;
   int         bAddPixelMargin = MS_TRUE;
+  int         nThreads = msGetWorkerThreadCount( map, layer );
 
 
   const char *resampleMode = CSLFetchNameValue( layer->processing,
@@ -1538,19 +1658,25 @@ int msResampleGDALToMap( mapObj *map, layerObj *layer, imageObj *image,
   /* -------------------------------------------------------------------- */
   if( EQUAL(resampleMode,"AVERAGE") )
     result =
-      msAverageRasterResampler( srcImage, psrc_rb, image, rb,
-                                anCMap, msApproxTransformer, pACBData,
-                                layer->debug, mask_rb );
+      msRunRasterResampler( "msAverageRasterResampler",
+                            msAverageRasterResampler,
+                            srcImage, psrc_rb, image, rb,
+                            anCMap, msApproxTransformer, pACBData,
+                            nThreads, layer->debug, mask_rb );
   else if( EQUAL(resampleMode,"BILINEAR") )
     result =
-      msBilinearRasterResampler( srcImage, psrc_rb, image, rb,
-                                 anCMap, msApproxTransformer, pACBData,
-                                 layer->debug, mask_rb );
+      msRunRasterResampler( "msBilinearRasterResampler",
+                            msBilinearRasterResampler,
+                            srcImage, psrc_rb, image, rb,
+                            anCMap, msApproxTransformer, pACBData,
+                            nThreads, layer->debug, mask_rb );
   else
     result =
-      msNearestRasterResampler( srcImage, psrc_rb, image, rb,
-                                anCMap, msApproxTransformer, pACBData,
-                                layer->debug, mask_rb );
+      msRunRasterResampler( "msNearestRasterResampler",
+                            msNearestRasterResampler,
+                            srcImage, psrc_rb, image, rb,
+                            anCMap, msApproxTransformer, pACBData,
+                            nThreads, layer->debug, mask_rb );
 
   /* -------------------------------------------------------------------- */
   /*      cleanup                                                         */
@@ -88,7 +88,7 @@ int mapObj_setRotation(mapObj* self, double rotation_angle )
 layerObj *mapObj_getLayer(mapObj* self, int i)
 {
   if(i >= 0 && i < self->numlayers)
-    return (self->layers[i]); /* returns an EXISTING layer */
+    return (GET_LAYER(self, i)); /* returns an EXISTING layer */
   else
     return NULL;
 }
@@ -100,7 +100,7 @@ layerObj *mapObj_getLayerByName(mapObj* self, char *name)
   i = msGetLayerIndex(self, name);
 
   if(i != -1)
-    return (self->layers[i]); /* returns an EXISTING layer */
+    return (GET_LAYER(self, i)); /* returns an EXISTING layer */
   else
     return NULL;
 }
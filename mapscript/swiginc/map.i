@@ -114,7 +114,7 @@
   %newobject getLayer;
   layerObj *getLayer(int i) {
     if(i >= 0 && i < self->numlayers) {
-    	MS_REFCNT_INCR(self->layers[i]);
+    	MS_REFCNT_INCR(GET_LAYER(self, i));
       	return (self->layers[i]); /* returns an EXISTING layer */
     } else {
       return NULL;
@@ -128,7 +128,7 @@
     i = msGetLayerIndex(self, name);
 
     if(i != -1) {
-      MS_REFCNT_INCR(self->layers[i]);
+      MS_REFCNT_INCR(GET_LAYER(self, i));
       return (self->layers[i]); /* returns an EXISTING layer */
     }
     else
@@ -215,6 +215,7 @@
         {
             msFree(self->values[i]);
             self->values[i] = strdup(value);
+            msShapeResetValueCache(self);
             if (!self->values[i])
             {
                 return MS_FAILURE;
@@ -236,6 +237,7 @@
         if(self->values) msFreeCharArray(self->values, self->numvalues);
         self->values = NULL;
         self->numvalues = 0;
+        msShapeResetValueCache(self);
         
         /* Allocate memory for the values */
         if (numvalues > 0) {
@@ -114,6 +114,7 @@ typedef struct textPathObj textPathObj;
 typedef struct textRunObj textRunObj;
 typedef struct glyph_element glyph_element;
 typedef struct face_element face_element;
+typedef struct arenaObj arenaObj;
 #endif
 
 
@@ -433,8 +434,12 @@ extern "C" {
 
 #define MS_ENCRYPTION_KEY_SIZE  16   /* Key size: 128 bits = 16 bytes */
 
-#define GET_LAYER(map, pos) map->layers[pos]
-#define GET_CLASS(map, lid, cid) map->layers[lid]->class[cid]
+/* GET_LAYER() loads a lazy layer on first use, GET_LAYER_HEADER() gives the */
+/* layer as it is, see msLoadLazyLayer() */
+#define GET_LAYER(map, pos) ((map)->layers[pos]->lazysource ? msLoadLazyLayer((map), (pos)) : (map)->layers[pos])
+#define GET_LAYER_HEADER(map, pos) (map)->layers[pos]
+#define MS_LAZY_LAYER_IS_OFF(map, pos) ((map)->layers[pos]->lazysource && (map)->layers[pos]->status == MS_OFF)
+#define GET_CLASS(map, lid, cid) GET_LAYER(map, lid)->class[cid]
 
 #ifdef USE_THREAD
 #if defined(HAVE_SYNC_FETCH_AND_ADD)
@@ -754,6 +759,8 @@ extern "C" {
     int compiled;
 
     char *native_string; /* RFC 91 */
+
+    void *program; /* tokens compiled for evaluation, see mapexpression.c */
   } expressionObj;
 
   typedef struct {
@@ -807,6 +814,34 @@ extern "C" {
     char *connection;
     enum MS_JOIN_CONNECTION_TYPE connectiontype;
   } joinObj;
+
+  /************************************************************************/
+  /*                             joinTableObj                             */
+  /*                                                                      */
+  /*      rows of a join table held in memory, hashed on the join column  */
+  /************************************************************************/
+
+  typedef struct {
+    char ***rows;
+    int numrows, maxrows, numitems;
+    int keyindex; /* column the rows are hashed on */
+
+    int numbuckets;
+    int *buckets; /* first row of each bucket, -1 if none */
+    int *next; /* next row of the same bucket, in table order */
+  } joinTableObj;
+
+  /************************************************************************/
+  /*                             joinBatchObj                             */
+  /*                                                                      */
+  /*      shapes of a run of layer results read ahead together with      */
+  /*      their join rows, see msJoinGetResultShape()                     */
+  /************************************************************************/
+
+  typedef struct {
+    shapeObj *shapes;
+    int first, numshapes; /* results held, shapes handed out are reset */
+  } joinBatchObj;
 #endif
 
   /************************************************************************/
@@ -1275,6 +1310,9 @@ extern "C" {
     markerCacheMemberObj *markers;
     int nummarkers;
     int markercachesize;
+#ifndef SWIG
+    arenaObj *arena; /* the labelCacheObj arena, owns the textsymbols and leader lines */
+#endif
   } labelCacheSlotObj;
 
   /************************************************************************/
@@ -1287,6 +1325,9 @@ extern "C" {
     labelCacheMemberObj **rendered_text_symbols;
     int num_allocated_rendered_members;
     int num_rendered_members;
+#ifndef SWIG
+    arenaObj *arena; /* child of the map arena, emptied when the cache is cleared */
+#endif
   } labelCacheObj;
 
   /************************************************************************/
@@ -1685,6 +1726,14 @@ extern "C" {
     /* SDL has converted OracleSpatial, SDE, Graticules */
     void *layerinfo; /* all connection types should use this generic pointer to a vendor specific structure */
     void *wfslayerinfo; /* For WFS layers, will contain a msWFSLayerInfo struct */
+    void *featurecacheinfo; /* feature cache iteration state, see mapfeaturecache.c */
+    void *classtableinfo; /* 16bit classification color table, see mapdrawgdal.c */
+    void *classindex; /* class selection lookup tables, see mapclassindex.c */
+    arenaObj *arena; /* per feature scratch memory while the layer is drawn, see maparena.c */
+    char *lazysource; /* mapfile text of a layer not parsed yet, see msLoadLazyLayer() */
+    int lazyline; /* mapfile line lazysource starts at */
+    int lazyerror; /* MS_TRUE if msLoadLazyLayer() failed to parse the layer */
+    int lazyinclude; /* MS_TRUE if lazysource INCLUDEs files, whose text it lacks */
 #endif /* not SWIG */
 
     /* attribute/classification handling components */
@@ -1923,6 +1972,8 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
     unsigned char encryption_key[MS_ENCRYPTION_KEY_SIZE]; /* 128bits encryption key */
 
     queryObj query;
+
+    arenaObj *arena; /* request scoped allocations, see maparena.c */
 #endif
 
 #ifdef USE_V8_MAPSCRIPT
@@ -1962,6 +2013,8 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
     char* (*LayerEscapePropertyName)(layerObj *layer, const char* pszString);
     void (*LayerEnablePaging)(layerObj *layer, int value);
     int (*LayerGetPaging)(layerObj *layer);
+    int (*LayerSupportsShapeRecycling)(layerObj *layer);
+    int (*LayerDependsOnScale)(layerObj *layer);
   };
 #endif /*SWIG*/
 
@@ -1994,6 +2047,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT void initSymbol(symbolObj *s);
   MS_DLL_EXPORT int initMap(mapObj *map);
   MS_DLL_EXPORT layerObj *msGrowMapLayers( mapObj *map );
+  MS_DLL_EXPORT layerObj *msLoadLazyLayer(mapObj *map, int nIndex);
   MS_DLL_EXPORT int initLayer(layerObj *layer, mapObj *map);
   MS_DLL_EXPORT int freeLayer( layerObj * );
   MS_DLL_EXPORT classObj *msGrowLayerClasses( layerObj *layer );
@@ -2079,12 +2133,34 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
       const char *wmtver_string );
   MS_DLL_EXPORT int msMapIgnoreMissingData( mapObj *map );
 
+  /* mapthread.c */
+
+  MS_DLL_EXPORT int msGetWorkerThreadCount( mapObj *map, layerObj *layer );
+
   /* mapfile.c */
 
   MS_DLL_EXPORT int msValidateParameter(char *value, char *pattern1, char *pattern2, char *pattern3, char *pattern4);
   MS_DLL_EXPORT int msGetLayerIndex(mapObj *map, const char *name);
   MS_DLL_EXPORT int msGetSymbolIndex(symbolSetObj *set, char *name, int try_addimage_if_notfound);
   MS_DLL_EXPORT mapObj  *msLoadMap(char *filename, char *new_mappath);
+  MS_DLL_EXPORT mapObj  *msLoadMapWithIncludes(char *filename, char *new_mappath, char ***includes, int *numincludes);
+  MS_DLL_EXPORT mapObj  *msLoadMapFromCache(char *filename); /* mapfilecache.c */
+  MS_DLL_EXPORT void msMapfileCacheCleanup(void);
+
+  /* in maparena.c */
+  MS_DLL_EXPORT arenaObj *msArenaCreate(arenaObj *parent);
+  MS_DLL_EXPORT void *msArenaAlloc(arenaObj *arena, size_t size);
+  MS_DLL_EXPORT void *msArenaCalloc(arenaObj *arena, size_t nmemb, size_t size);
+  MS_DLL_EXPORT char *msArenaStrdup(arenaObj *arena, const char *str);
+  MS_DLL_EXPORT void msArenaFree(arenaObj *arena, void *ptr);
+  MS_DLL_EXPORT void msArenaReset(arenaObj *arena);
+  MS_DLL_EXPORT void msArenaDestroy(arenaObj *arena);
+  MS_DLL_EXPORT arenaObj *msMapGetArena(mapObj *map);
+  MS_DLL_EXPORT void msMapFreeArena(mapObj *map);
+  MS_DLL_EXPORT int msCompileMapfile(char *filename, char *outfile); /* mapfilecompile.c */
+  MS_DLL_EXPORT int msIsCompiledMapfile(FILE *fp);
+  MS_DLL_EXPORT int msStartCompiledMapfileReplay(const char *filename);
+  MS_DLL_EXPORT void msStopMapfileTokenStream(void);
   MS_DLL_EXPORT int msTransformXmlMapfile(const char *stylesheet, const char *xmlMapfile, FILE *tmpfile);
   MS_DLL_EXPORT int msSaveMap(mapObj *map, char *filename);
   MS_DLL_EXPORT void msFreeCharArray(char **array, int num_items);
@@ -2126,6 +2202,13 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT void msOGRCleanup(void);
   MS_DLL_EXPORT void msGDALCleanup(void);
   MS_DLL_EXPORT void msGDALInitialize(void);
+  MS_DLL_EXPORT void *msGDALOpenDataset(mapObj *map, const char *pszPath);
+  MS_DLL_EXPORT void *msGDALOpenDatasetExclusive(mapObj *map, const char *pszPath);
+  MS_DLL_EXPORT void msGDALCloseDataset(layerObj *layer, void *hDS);
+  MS_DLL_EXPORT void msGDALCloseDatasetCache(void);
+  MS_DLL_EXPORT void msGDALDebugDatasetCache(layerObj *layer, const char *pszCaller);
+  MS_DLL_EXPORT void *msGDALAcquireReadBuffer(size_t nBytes);
+  MS_DLL_EXPORT void msGDALReleaseReadBuffer(void *pBuffer);
 
   MS_DLL_EXPORT imageObj *msDrawScalebar(mapObj *map); /* in mapscale.c */
   MS_DLL_EXPORT int msCalculateScale(rectObj extent, int units, int width, int height, double resolution, double *scaledenom);
@@ -2309,6 +2392,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
 
   MS_DLL_EXPORT int WARN_UNUSED msAddLabel(mapObj *map, imageObj *image, labelObj *label, int layerindex, int classindex, shapeObj *shape, pointObj *point, double featuresize, textSymbolObj *ts);
   MS_DLL_EXPORT int WARN_UNUSED msAddLabelGroup(mapObj *map, imageObj *image, int layerindex, int classindex, shapeObj *shape, pointObj *point, double featuresize);
+  MS_DLL_EXPORT arenaObj *msGetLabelCacheArena(mapObj *map);
   MS_DLL_EXPORT void insertRenderedLabelMember(mapObj *map, labelCacheMemberObj *cachePtr);
   MS_DLL_EXPORT int msTestLabelCacheCollisions(mapObj *map, labelCacheMemberObj *cachePtr, label_bounds *lb, int current_priority, int current_label);
   MS_DLL_EXPORT int msTestLabelCacheLeaderCollision(mapObj *map, pointObj *lp1, pointObj *lp2);
@@ -2321,6 +2405,15 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT void msInitShape(shapeObj *shape);
   MS_DLL_EXPORT void msShapeDeleteLine( shapeObj *shape, int line );
   MS_DLL_EXPORT int msCopyShape(shapeObj *from, shapeObj *to);
+  MS_DLL_EXPORT void msRecycleShape(shapeObj *shape);
+  MS_DLL_EXPORT lineObj *msShapeReserveLines(shapeObj *shape, int numlines);
+  MS_DLL_EXPORT pointObj *msShapeReservePoints(shapeObj *shape, int line, int numpoints);
+  MS_DLL_EXPORT char **msShapeReserveValues(shapeObj *shape, int numvalues);
+  MS_DLL_EXPORT char *msShapeSetValue(shapeObj *shape, int i, const char *value);
+  MS_DLL_EXPORT void msShapeRecycleStats(shapeObj *shape, long *reused, long *allocated);
+  MS_DLL_EXPORT double msShapeGetValueAsDouble(shapeObj *shape, int i);
+  MS_DLL_EXPORT void msShapeSetValueAsDouble(shapeObj *shape, int i, double value);
+  MS_DLL_EXPORT void msShapeResetValueCache(shapeObj *shape);
   MS_DLL_EXPORT int msIsOuterRing(shapeObj *shape, int r);
   MS_DLL_EXPORT int *msGetOuterList(shapeObj *shape);
   MS_DLL_EXPORT int *msGetInnerList(shapeObj *shape, int r, int *outerlist);
@@ -2414,6 +2507,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msLayerGetItemIndex(layerObj *layer, char *item);
   MS_DLL_EXPORT int msLayerWhichItems(layerObj *layer, int get_all, const char *metadata);
   MS_DLL_EXPORT int msLayerNextShape(layerObj *layer, shapeObj *shape);
+  MS_DLL_EXPORT void msLayerRecycleShape(layerObj *layer, shapeObj *shape);
   MS_DLL_EXPORT int msLayerGetItems(layerObj *layer);
   MS_DLL_EXPORT int msLayerSetItems(layerObj *layer, char **items, int numitems);
   MS_DLL_EXPORT int msLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record);
@@ -2430,11 +2524,35 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT char *msLayerGetFilterString( layerObj *layer );
   MS_DLL_EXPORT int msLayerEncodeShapeAttributes( layerObj *layer, shapeObj *shape);
 
+  /* in mapfeaturecache.c */
+  MS_DLL_EXPORT int msFeatureCacheEnabled(layerObj *layer);
+  MS_DLL_EXPORT int msFeatureCacheWhichShapes(layerObj *layer, rectObj *rect, int *status);
+  MS_DLL_EXPORT int msFeatureCacheNextShape(layerObj *layer, shapeObj *shape);
+  MS_DLL_EXPORT void msFeatureCacheStore(layerObj *layer);
+  MS_DLL_EXPORT void msFeatureCacheLayerClose(layerObj *layer);
+  MS_DLL_EXPORT int msFeatureCacheInvalidate(layerObj *layer);
+  MS_DLL_EXPORT void msFeatureCacheInvalidateAll(mapObj *map);
+  MS_DLL_EXPORT void msFeatureCacheCleanup(void);
+
   MS_DLL_EXPORT int msLayerTranslateFilter(layerObj *layer, expressionObj *filter, char *filteritem);
   MS_DLL_EXPORT int msLayerSupportsCommonFilters(layerObj *layer);
+  MS_DLL_EXPORT int msLayerDependsOnScale(layerObj *layer);
   MS_DLL_EXPORT const char *msExpressionTokenToString(int token);
   MS_DLL_EXPORT int msTokenizeExpression(expressionObj *expression, char **list, int *listsize);
 
+  /* mapexpression.c */
+  MS_DLL_EXPORT int msCompileExpression(expressionObj *expression);
+  MS_DLL_EXPORT void msFreeCompiledExpression(expressionObj *expression);
+  MS_DLL_EXPORT int msEvalCompiledExpression(expressionObj *expression, shapeObj *shape, int *result);
+  MS_DLL_EXPORT int msEvalCompiledTextExpression(expressionObj *expression, shapeObj *shape, char **result);
+  MS_DLL_EXPORT int msGetNumericExpressionItem(expressionObj *expression, double **constants, int *numconstants);
+  MS_DLL_EXPORT int msEvalNumericExpression(expressionObj *expression, double value);
+
+  /* mapclassindex.c */
+  MS_DLL_EXPORT void msLayerBuildClassIndex(layerObj *layer);
+  MS_DLL_EXPORT void msLayerFreeClassIndex(layerObj *layer);
+  MS_DLL_EXPORT int msLayerGetClassIndexCandidates(layerObj *layer, shapeObj *shape, int *classgroup, int numclasses, int *matches, int maxmatches, const int **generic, int *numgeneric);
+
   MS_DLL_EXPORT int msLayerSetTimeFilter(layerObj *lp, const char *timestring, const char *timefield);
   MS_DLL_EXPORT int msLayerMakeBackticsTimeFilter(layerObj *lp, const char *timestring, const char *timefield);
   MS_DLL_EXPORT int msLayerMakePlainTimeFilter(layerObj *lp, const char *timestring, const char *timefield);
@@ -2486,6 +2604,7 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msRASTERLayerInitializeVirtualTable(layerObj *layer);
   MS_DLL_EXPORT int msUVRASTERLayerInitializeVirtualTable(layerObj *layer);
   MS_DLL_EXPORT int msContourLayerInitializeVirtualTable(layerObj *layer);  
+  MS_DLL_EXPORT void msContourCacheCleanup(void);
   MS_DLL_EXPORT int msPluginLayerInitializeVirtualTable(layerObj *layer);
   MS_DLL_EXPORT int msUnionLayerInitializeVirtualTable(layerObj *layer);
   MS_DLL_EXPORT void msPluginFreeVirtualTableFactory(void);
@@ -2580,6 +2699,18 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msJoinPrepare(joinObj *join, shapeObj *shape);
   MS_DLL_EXPORT int msJoinNext(joinObj *join);
   MS_DLL_EXPORT int msJoinClose(joinObj *join);
+  MS_DLL_EXPORT void msJoinCacheCleanup(void);
+#ifndef SWIG
+  MS_DLL_EXPORT void msJoinBatchInit(joinBatchObj *batch);
+  MS_DLL_EXPORT void msJoinBatchFree(joinBatchObj *batch);
+  MS_DLL_EXPORT int msJoinGetResultShape(layerObj *layer, joinBatchObj *batch, int i, shapeObj *shape);
+  MS_DLL_EXPORT joinTableObj *msJoinTableCreate(int numitems, int keyindex);
+  MS_DLL_EXPORT void msJoinTableAddRow(joinTableObj *table, char **row);
+  MS_DLL_EXPORT void msJoinTableIndex(joinTableObj *table);
+  MS_DLL_EXPORT int msJoinTableFind(joinTableObj *table, const char *key);
+  MS_DLL_EXPORT int msJoinTableFindNext(joinTableObj *table, const char *key, int row);
+  MS_DLL_EXPORT void msJoinTableFree(joinTableObj *table);
+#endif
 
   /*in mapraster.c */
   MS_DLL_EXPORT int msDrawRasterLayerLow(mapObj *map, layerObj *layer, imageObj *image, rasterBufferObj *rb );
@@ -2592,8 +2723,12 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   MS_DLL_EXPORT int msGetGDALGeoTransform(void *hDS, mapObj *map, layerObj *layer, double *padfGeoTransform );
   MS_DLL_EXPORT int *msGetGDALBandList( layerObj *layer, void *hDS, int max_bands, int *band_count );
   MS_DLL_EXPORT double msGetGDALNoDataValue( layerObj *layer, void *hBand, int *pbGotNoData );
+  MS_DLL_EXPORT void msGDALFreeClassTable( layerObj *layer );
 
   /* in interpolation.c */
+#define MS_KERNELDENSITY_GAUSSIAN 0
+#define MS_KERNELDENSITY_BOX 1
+  MS_DLL_EXPORT void msKernelDensityBlur(float *values, int width, int height, int radius, int method, int nThreads);
   MS_DLL_EXPORT int msComputeKernelDensityDataset(mapObj *map, imageObj *image, layerObj *layer, void **hDSvoid, void **cleanup_ptr);
   MS_DLL_EXPORT int msCleanupKernelDensityDataset(mapObj *map, imageObj *image, layerObj *layer, void *cleanup_ptr);
 
@@ -3038,10 +3173,11 @@ void msPopulateTextSymbolForLabelAndString(textSymbolObj *ts, labelObj *l, char
   /* in mapimageio.c */
   int msQuantizeRasterBuffer(rasterBufferObj *rb, unsigned int *reqcolors, rgbaPixel *palette,
                              rgbaPixel *forced_palette, int num_forced_palette_entries,
-                             unsigned int *palette_scaling_maxval);
+                             unsigned int *palette_scaling_maxval, unsigned int sample_pixels);
   int msClassifyRasterBuffer(rasterBufferObj *rb, rasterBufferObj *qrb);
   int msSaveRasterBuffer(mapObj *map, rasterBufferObj *data, FILE *stream, outputFormatObj *format);
   int msSaveRasterBufferToBuffer(rasterBufferObj *data, bufferObj *buffer, outputFormatObj *format);
+  void msPNGEncoderCleanup(void);
   int msLoadMSRasterBufferFromFile(char *path, rasterBufferObj *rb);
   
   /* in mapagg.cpp */
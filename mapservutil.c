@@ -205,14 +205,14 @@ mapObj *msCGILoadMap(mapservObj *mapserv)
   if(i == mapserv->request->NumParams) {
     char *ms_mapfile = getenv("MS_MAPFILE");
     if(ms_mapfile) {
-      map = msLoadMap(ms_mapfile,NULL);
+      map = msLoadMapFromCache(ms_mapfile);
     } else {
       msSetError(MS_WEBERR, "CGI variable \"map\" is not set.", "msCGILoadMap()"); /* no default, outta here */
       return NULL;
     }
   } else {
     if(getenv(mapserv->request->ParamValues[i])) /* an environment variable references the actual file to use */
-      map = msLoadMap(getenv(mapserv->request->ParamValues[i]), NULL);
+      map = msLoadMapFromCache(getenv(mapserv->request->ParamValues[i]));
     else {
       /* by here we know the request isn't for something in an environment variable */
       if(getenv("MS_MAP_NO_PATH")) {
@@ -226,7 +226,7 @@ mapObj *msCGILoadMap(mapservObj *mapserv)
       }
 
       /* ok to try to load now */
-      map = msLoadMap(mapserv->request->ParamValues[i], NULL);
+      map = msLoadMapFromCache(mapserv->request->ParamValues[i]);
     }
   }
   
@@ -256,6 +256,10 @@ mapObj *msCGILoadMap(mapservObj *mapserv)
 
       if(strncasecmp(mapserv->request->ParamNames[i],"classgroup",10) == 0) { /* #4207 */
         for(j=0; j<map->numlayers; j++) {
+          /* a lazy layer not mentioning the group (nor INCLUDEing files) has no class in it */
+          layerObj *lp = GET_LAYER_HEADER(map, j);
+          if(lp->lazysource && !lp->lazyinclude && !strstr(lp->lazysource, mapserv->request->ParamValues[i]))
+            continue;
           setClassGroup(GET_LAYER(map, j), mapserv->request->ParamValues[i]);
         }
         continue;
@@ -870,8 +874,8 @@ int msCGILoadForm(mapservObj *mapserv)
           if(msGrowMapservLayers(mapserv) == MS_FAILURE)
             return MS_FAILURE;
 
-          if(GET_LAYER(mapserv->map, mapserv->NumLayers)->name) {
-            mapserv->Layers[mapserv->NumLayers] = msStrdup(GET_LAYER(mapserv->map, mapserv->NumLayers)->name);
+          if(GET_LAYER_HEADER(mapserv->map, mapserv->NumLayers)->name) {
+            mapserv->Layers[mapserv->NumLayers] = msStrdup(GET_LAYER_HEADER(mapserv->map, mapserv->NumLayers)->name);
           } else {
             mapserv->Layers[mapserv->NumLayers] = msStrdup("");
           }
@@ -1765,11 +1769,11 @@ int msCGIDispatchRequest(mapservObj *mapserv)
   ** For each layer let's set layer status
   */
   for(i=0; i<mapserv->map->numlayers; i++) {
-    if((GET_LAYER(mapserv->map, i)->status != MS_DEFAULT)) {
-      if(isOn(mapserv,  GET_LAYER(mapserv->map, i)->name, GET_LAYER(mapserv->map, i)->group) == MS_TRUE) /* Set layer status */
-        GET_LAYER(mapserv->map, i)->status = MS_ON;
+    if((GET_LAYER_HEADER(mapserv->map, i)->status != MS_DEFAULT)) {
+      if(isOn(mapserv,  GET_LAYER_HEADER(mapserv->map, i)->name, GET_LAYER_HEADER(mapserv->map, i)->group) == MS_TRUE) /* Set layer status */
+        GET_LAYER_HEADER(mapserv->map, i)->status = MS_ON;
       else
-        GET_LAYER(mapserv->map, i)->status = MS_OFF;
+        GET_LAYER_HEADER(mapserv->map, i)->status = MS_OFF;
     }
   }
 
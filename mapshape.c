@@ -1237,10 +1237,31 @@ int msSHXReadSize( SHPHandle psSHP, int hEntity )
 
 }
 
+static void msSHPReadShapeBuffers( SHPHandle psSHP, int hEntity, shapeObj *shape );
+
 /*
 ** msSHPReadShape() - Reads the vertices for one shape from a shape file.
 */
 void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
+{
+  msInitShape(shape); /* initialize the shape */
+  msSHPReadShapeBuffers(psSHP, hEntity, shape);
+}
+
+/*
+** msSHPReadRecycledShape() - Same as msSHPReadShape(), but reuses the buffers
+** of a shape passed to msRecycleShape().
+*/
+void msSHPReadRecycledShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
+{
+  if(shape->recycle)
+    msRecycleShape(shape);
+  else
+    msInitShape(shape);
+  msSHPReadShapeBuffers(psSHP, hEntity, shape);
+}
+
+static void msSHPReadShapeBuffers( SHPHandle psSHP, int hEntity, shapeObj *shape )
 {
   int i, j, k;
 #ifdef USE_POINT_Z_M
@@ -1248,8 +1269,6 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
 #endif
   int nEntitySize, nRequiredSize;
 
-  msInitShape(shape); /* initialize the shape */
-
   /* -------------------------------------------------------------------- */
   /*      Validate the record/entity number.                              */
   /* -------------------------------------------------------------------- */
@@ -1367,20 +1386,22 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj)*nParts);
-    MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj)*nParts);
-
-    shape->numlines = nParts;
+    if( msShapeReserveLines(shape, nParts) == NULL ) {
+      shape->numlines = 0;
+      shape->type = MS_SHAPE_NULL;
+      return;
+    }
 
     k = 0; /* overall point counter */
     for( i = 0; i < nParts; i++) {
+      int numpoints;
       if( i == nParts-1)
-        shape->line[i].numpoints = nPoints - psSHP->panParts[i];
+        numpoints = nPoints - psSHP->panParts[i];
       else
-        shape->line[i].numpoints = psSHP->panParts[i+1] - psSHP->panParts[i];
-      if (shape->line[i].numpoints <= 0) {
+        numpoints = psSHP->panParts[i+1] - psSHP->panParts[i];
+      if (numpoints <= 0) {
         msSetError(MS_SHPERR, "Corrupted .shp file : shape %d, shape->line[%d].numpoints=%d", "msSHPReadShape()",
-                   hEntity, i, shape->line[i].numpoints);
+                   hEntity, i, numpoints);
         while(--i >= 0)
           free(shape->line[i].point);
         free(shape->line);
@@ -1390,13 +1411,13 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
         return;
       }
 
-      if( (shape->line[i].point = (pointObj *)malloc(sizeof(pointObj)*shape->line[i].numpoints)) == NULL ) {
+      if( msShapeReservePoints(shape, i, numpoints) == NULL ) {
         while(--i >= 0)
           free(shape->line[i].point);
         free(shape->line);
+        shape->line = NULL;
         shape->numlines = 0;
         shape->type = MS_SHAPE_NULL;
-        msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
         return;
       }
 
@@ -1481,14 +1502,7 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    if( (shape->line = (lineObj *)malloc(sizeof(lineObj))) == NULL ) {
-      shape->type = MS_SHAPE_NULL;
-      msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
-      return;
-    }
-
     if (nPoints < 0 || nPoints > 50 * 1000 * 1000) {
-      free(shape->line);
       shape->type = MS_SHAPE_NULL;
       msSetError(MS_SHPERR, "Corrupted .shp file : shape %d, nPoints=%d.",
                  "msSHPReadShape()", hEntity, nPoints);
@@ -1499,21 +1513,22 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     if (psSHP->nShapeType == SHP_MULTIPOINTZ || psSHP->nShapeType == SHP_MULTIPOINTM)
       nRequiredSize += 16 + nPoints * 8;
     if (nRequiredSize > nEntitySize) {
-      free(shape->line);
       shape->type = MS_SHAPE_NULL;
       msSetError(MS_SHPERR, "Corrupted .shp file : shape %d : nPoints = %d, nEntitySize = %d",
                  "msSHPReadShape()", hEntity, nPoints, nEntitySize);
       return;
     }
 
-    shape->numlines = 1;
-    shape->line[0].numpoints = nPoints;
-    shape->line[0].point = (pointObj *) malloc( nPoints * sizeof(pointObj) );
-    if (shape->line[0].point == NULL) {
+    if( msShapeReserveLines(shape, 1) == NULL ) {
+      shape->numlines = 0;
+      shape->type = MS_SHAPE_NULL;
+      return;
+    }
+    if( msShapeReservePoints(shape, 0, nPoints) == NULL ) {
       free(shape->line);
+      shape->line = NULL;
       shape->numlines = 0;
       shape->type = MS_SHAPE_NULL;
-      msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
       return;
     }
 
@@ -1568,12 +1583,13 @@ void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape )
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj));
-    MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj));
-
-    shape->numlines = 1;
-    shape->line[0].numpoints = 1;
-    shape->line[0].point = (pointObj *) msSmallMalloc(sizeof(pointObj));
+    if( msShapeReserveLines(shape, 1) == NULL || msShapeReservePoints(shape, 0, 1) == NULL ) {
+      free(shape->line);
+      shape->line = NULL;
+      shape->numlines = 0;
+      shape->type = MS_SHAPE_NULL;
+      return;
+    }
 
     memcpy( &(shape->line[0].point[0].x), psSHP->pabyRec + 12, 8 );
     memcpy( &(shape->line[0].point[0].y), psSHP->pabyRec + 20, 8 );
@@ -2263,22 +2279,22 @@ int msTiledSHPNextShape(layerObj *layer, shapeObj *shape)
 
     tSHP->shpfile->lastshape = i;
 
-    msSHPReadShape(tSHP->shpfile->hSHP, i, shape);
+    msSHPReadRecycledShape(tSHP->shpfile->hSHP, i, shape);
     if(shape->type == MS_SHAPE_NULL) {
-      msFreeShape(shape);
       continue; /* skip NULL shapes */
     }
     shape->tileindex = tSHP->tileshpfile->lastshape;
-    shape->numvalues = layer->numitems;
-    shape->values = msDBFGetValueList(tSHP->shpfile->hDBF, i, layer->iteminfo, layer->numitems);
-    if(!shape->values) shape->numvalues = 0;
+    msDBFGetShapeValues(tSHP->shpfile->hDBF, i, layer->iteminfo, layer->numitems, shape);
 
     filter_passed = MS_TRUE;  /* By default accept ANY shape */
     if(layer->numitems > 0 && layer->iteminfo) {
       filter_passed = msEvalExpression(layer, shape, &(layer->filter), layer->filteritemindex);
     }
 
-    if(!filter_passed) msFreeShape(shape); /* free's values as well */
+    if(!filter_passed) { /* free's values as well */
+      if(shape->recycle) msRecycleShape(shape);
+      else msFreeShape(shape);
+    }
 
   } while(!filter_passed);  /* Loop until both spatial and attribute filters match  */
 
@@ -2509,6 +2525,11 @@ int msTiledSHPLayerSupportsCommonFilters(layerObj *layer)
   return MS_TRUE;
 }
 
+int msTiledSHPLayerSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_TRUE;
+}
+
 int msTiledSHPLayerInitializeVirtualTable(layerObj *layer)
 {
   assert(layer != NULL);
@@ -2527,6 +2548,7 @@ int msTiledSHPLayerInitializeVirtualTable(layerObj *layer)
   layer->vtable->LayerClose = msTiledSHPCloseVT;
   layer->vtable->LayerGetItems = msTiledSHPLayerGetItems;
   layer->vtable->LayerGetExtent = msTiledSHPLayerGetExtent;
+  layer->vtable->LayerSupportsShapeRecycling = msTiledSHPLayerSupportsShapeRecycling;
   /* layer->vtable->LayerApplyFilterToLayer, use default */
   /* layer->vtable->LayerGetAutoStyle, use default */
   /* layer->vtable->LayerCloseConnection, use default */;
@@ -2687,14 +2709,11 @@ int msSHPLayerNextShape(layerObj *layer, shapeObj *shape)
   shpfile->lastshape = i;
   if(i == -1) return(MS_DONE); /* nothing else to read */
 
-  msSHPReadShape(shpfile->hSHP, i, shape);
+  msSHPReadRecycledShape(shpfile->hSHP, i, shape);
   if(shape->type == MS_SHAPE_NULL) {
-    msFreeShape(shape);
     return msSHPLayerNextShape(layer, shape); /* skip NULL shapes */
   }
-  shape->numvalues = layer->numitems;
-  shape->values = msDBFGetValueList(shpfile->hDBF, i, layer->iteminfo, layer->numitems);
-  if(!shape->values) shape->numvalues = 0;
+  msDBFGetShapeValues(shpfile->hDBF, i, layer->iteminfo, layer->numitems, shape);
 
   return MS_SUCCESS;
 }
@@ -2782,6 +2801,11 @@ int msSHPLayerSupportsCommonFilters(layerObj *layer)
   return MS_TRUE;
 }
 
+int msSHPLayerSupportsShapeRecycling(layerObj *layer)
+{
+  return MS_TRUE;
+}
+
 int msSHPLayerInitializeVirtualTable(layerObj *layer)
 {
   assert(layer != NULL);
@@ -2798,6 +2822,7 @@ int msSHPLayerInitializeVirtualTable(layerObj *layer)
   layer->vtable->LayerClose = msSHPLayerClose;
   layer->vtable->LayerGetItems = msSHPLayerGetItems;
   layer->vtable->LayerGetExtent = msSHPLayerGetExtent;
+  layer->vtable->LayerSupportsShapeRecycling = msSHPLayerSupportsShapeRecycling;
   /* layer->vtable->LayerGetAutoStyle, use default */
   /* layer->vtable->LayerCloseConnection, use default */
   layer->vtable->LayerSetTimeFilter = msLayerMakeBackticsTimeFilter;
@@ -194,6 +194,7 @@ extern "C" {
   MS_DLL_EXPORT void msSHPGetInfo( SHPHandle hSHP, int * pnEntities, int * pnShapeType );
   MS_DLL_EXPORT int msSHPReadBounds( SHPHandle psSHP, int hEntity, rectObj *padBounds );
   MS_DLL_EXPORT void msSHPReadShape( SHPHandle psSHP, int hEntity, shapeObj *shape );
+  MS_DLL_EXPORT void msSHPReadRecycledShape( SHPHandle psSHP, int hEntity, shapeObj *shape );
   MS_DLL_EXPORT int msSHPReadPoint(SHPHandle psSHP, int hEntity, pointObj *point );
   MS_DLL_EXPORT int msSHPWriteShape( SHPHandle psSHP, shapeObj *shape );
   MS_DLL_EXPORT int msSHPWritePoint(SHPHandle psSHP, pointObj *point );
@@ -228,6 +229,7 @@ extern "C" {
   MS_DLL_EXPORT char **msDBFGetItems(DBFHandle dbffile);
   MS_DLL_EXPORT char **msDBFGetValues(DBFHandle dbffile, int record);
   MS_DLL_EXPORT char **msDBFGetValueList(DBFHandle dbffile, int record, int *itemindexes, int numitems);
+  MS_DLL_EXPORT int msDBFGetShapeValues(DBFHandle dbffile, int record, int *itemindexes, int numitems, shapeObj *shape);
   MS_DLL_EXPORT int *msDBFGetItemIndexes(DBFHandle dbffile, char **items, int numitems);
   MS_DLL_EXPORT int msDBFGetItemIndex(DBFHandle dbffile, char *name);
 
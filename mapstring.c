@@ -2236,6 +2236,7 @@ int msLayerEncodeShapeAttributes( layerObj *layer, shapeObj *shape) {
     shape->values[i] = out;
   }
   iconv_close(cd);
+  msShapeResetValueCache(shape);
 
   return MS_SUCCESS;
 #else
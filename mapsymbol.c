@@ -40,7 +40,8 @@
 
 
 extern int msyylex(void); /* lexer globals */
-extern void msyyrestart(FILE *);
+extern void msyyscanfile(FILE *);
+extern void msyyfreefiles(void);
 extern double msyynumber;
 extern char *msyystring_buffer;
 extern int msyylineno;
@@ -574,7 +575,7 @@ int loadSymbolSet(symbolSetObj *symbolset, mapObj *map)
   msyylex(); /* sets things up, but doesn't process any tokens */
 
   msyylineno = 0; /* reset line counter */
-  msyyrestart(msyyin); /* flush the scanner - there's a better way but this works for now */
+  msyyscanfile(msyyin);
 
   /*
   ** Read the symbol file
@@ -614,6 +615,7 @@ int loadSymbolSet(symbolSetObj *symbolset, mapObj *map)
 
   fclose(msyyin);
   msyyin = NULL;
+  msyyfreefiles();
   free(pszSymbolPath);
   return(status);
 }
@@ -854,6 +854,7 @@ static int processFeatureTag(mapservObj *mapserv, char **line, layerObj *layer)
 
   int limit=-1;
   char *trimLast=NULL;
+  joinBatchObj batch;
 
   int i, j, status;
 
@@ -924,9 +925,11 @@ static int processFeatureTag(mapservObj *mapserv, char **line, layerObj *layer)
   else
     limit = MS_MIN(limit, layer->resultcache->numresults);
 
+  msJoinBatchInit(&batch);
   for(i=0; i<limit; i++) {
-    status = msLayerGetShape(layer, &(mapserv->resultshape), &(layer->resultcache->results[i]));
+    status = msJoinGetResultShape(layer, &batch, i, &(mapserv->resultshape));
     if(status != MS_SUCCESS) {
+      msJoinBatchFree(&batch);
       msFreeHashTable(tagArgs);
       msFree(postTag);
       msFree(tag);
@@ -964,6 +967,7 @@ static int processFeatureTag(mapservObj *mapserv, char **line, layerObj *layer)
     mapserv->RN++; /* increment counters */
     mapserv->LRN++;
   }
+  msJoinBatchFree(&batch);
 
   /* msLayerClose(layer); */
   mapserv->resultlayer = NULL; /* necessary? */
@@ -4206,6 +4210,7 @@ int msReturnNestedTemplateQuery(mapservObj* mapserv, char* pszMimeType, char **p
   int nExpandBuffer = 0;
 
   char *template;
+  joinBatchObj batch;
 
   layerObj *lp=NULL;
 
@@ -4343,9 +4348,13 @@ int msReturnNestedTemplateQuery(mapservObj* mapserv, char* pszMimeType, char **p
     }
 
     mapserv->LRN = 1; /* layer result number */
+    msJoinBatchInit(&batch);
     for(j=0; j<lp->resultcache->numresults; j++) {
-      status = msLayerGetShape(lp, &(mapserv->resultshape), &(lp->resultcache->results[j]));
-      if(status != MS_SUCCESS) return status;
+      status = msJoinGetResultShape(lp, &batch, j, &(mapserv->resultshape));
+      if(status != MS_SUCCESS) {
+        msJoinBatchFree(&batch);
+        return status;
+      }
 
       /* prepare any necessary JOINs here (one-to-one only) */
       if(lp->numjoins > 0) {
@@ -4364,6 +4373,7 @@ int msReturnNestedTemplateQuery(mapservObj* mapserv, char* pszMimeType, char **p
 
       if(msReturnPage(mapserv, template, QUERY, papszBuffer) != MS_SUCCESS) {
         msFreeShape(&(mapserv->resultshape));
+        msJoinBatchFree(&batch);
         return MS_FAILURE;
       }
 
@@ -4372,6 +4382,7 @@ int msReturnNestedTemplateQuery(mapservObj* mapserv, char* pszMimeType, char **p
       mapserv->RN++; /* increment counters */
       mapserv->LRN++;
     }
+    msJoinBatchFree(&batch);
 
     if(lp->footer) {
       if(msReturnPage(mapserv, lp->footer, BROWSE, papszBuffer) != MS_SUCCESS) return MS_FAILURE;
@@ -59,6 +59,14 @@ possible to implement for other thread libraries if needed.
         Releases the indicated mutex.  If the lock id is invalid, or if the
         mutex is not currently held by this thread then results are undefined.
 
+  int msThreadRunTasks(int nThreads, int nTasks, msThreadTaskFunc, void*):
+        Runs the task function for the task indices 0 to nTasks-1 on up to
+        nThreads threads, the calling thread included, and returns once all
+        the tasks are done.  Tasks must not depend on each other, and must
+        not use msSetError() since the error state of the worker threads is
+        lost.  Without thread support the tasks are run one after the other
+        in the calling thread.
+
 It is incredibly important to ensure that any mutex that is acquired is
 released as soon as possible.  Any flow of control that could result in a
 mutex not being release is going to be a disaster.
@@ -144,7 +152,7 @@ static int thread_debug = 0;
 
 static char *lock_names[] = {
   NULL, "PARSER", "GDAL", "ERROROBJ", "PROJ", "TTF", "POOL", "SDE",
-  "ORACLE", "OWS", "LAYER_VTABLE", "IOCONTEXT", "TMPFILE", "DEBUGOBJ", "OGR", "TIME", "FRIBIDI", "WXS", "GEOS", NULL
+  "ORACLE", "OWS", "LAYER_VTABLE", "IOCONTEXT", "TMPFILE", "DEBUGOBJ", "OGR", "TIME", "FRIBIDI", "WXS", "GEOS", "FEATURECACHE", "JOINCACHE", "GDALBUFFER", "PNGENCODER", "CONTOURCACHE", "MAPFILECACHE", NULL
 };
 #endif
 
@@ -316,3 +324,185 @@ void msReleaseLock( int nLockId )
 }
 
 #endif /* defined(USE_THREAD) && defined(_WIN32) */
+
+/************************************************************************/
+/* ==================================================================== */
+/*                            WORKER TASKS                              */
+/* ==================================================================== */
+/************************************************************************/
+
+typedef struct {
+  msThreadTaskFunc pfnTask;
+  void *pData;
+  int nTasks;
+  int nNextTask;
+  void *pMainThreadId;
+#if defined(USE_THREAD) && !defined(_WIN32)
+  pthread_mutex_t sMutex;
+#endif
+} msThreadTaskList;
+
+#if defined(USE_THREAD)
+
+/************************************************************************/
+/*                          msThreadNextTask()                          */
+/************************************************************************/
+
+static int msThreadNextTask( msThreadTaskList *psList )
+
+{
+  int iTask;
+
+#if !defined(_WIN32)
+  pthread_mutex_lock( &(psList->sMutex) );
+  iTask = psList->nNextTask++;
+  pthread_mutex_unlock( &(psList->sMutex) );
+#else
+  iTask = InterlockedIncrement( (LONG *) &(psList->nNextTask) ) - 1;
+#endif
+
+  return iTask;
+}
+
+/************************************************************************/
+/*                         msThreadTaskWorker()                         */
+/************************************************************************/
+
+#if defined(_WIN32)
+static DWORD WINAPI msThreadTaskWorker( void *pArg )
+#else
+static void *msThreadTaskWorker( void *pArg )
+#endif
+
+{
+  msThreadTaskList *psList = (msThreadTaskList *) pArg;
+  int iTask;
+
+  while( (iTask = msThreadNextTask( psList )) < psList->nTasks )
+    psList->pfnTask( psList->pData, iTask );
+
+  /* drop the error and debug state tasks may have set up for this thread */
+  if( msGetThreadId() != psList->pMainThreadId ) {
+    msResetErrorList();
+    msDebugCleanup();
+  }
+
+  return 0;
+}
+
+#endif /* defined(USE_THREAD) */
+
+/************************************************************************/
+/*                          msThreadRunTasks()                          */
+/************************************************************************/
+
+int msThreadRunTasks( int nThreads, int nTasks,
+                      msThreadTaskFunc pfnTask, void *pData )
+
+{
+  msThreadTaskList sList;
+
+  sList.pfnTask = pfnTask;
+  sList.pData = pData;
+  sList.nTasks = nTasks;
+  sList.nNextTask = 0;
+  sList.pMainThreadId = msGetThreadId();
+
+  if( nThreads > nTasks )
+    nThreads = nTasks;
+
+#if defined(USE_THREAD) && !defined(_WIN32)
+  if( nThreads > 1 ) {
+    pthread_t *pahThreads = (pthread_t *) msSmallMalloc( sizeof(pthread_t) * (nThreads-1) );
+    int i, nStarted;
+
+    pthread_mutex_init( &(sList.sMutex), NULL );
+
+    /* the calling thread is a worker too, run the others on top of it */
+    for( nStarted = 0; nStarted < nThreads-1; nStarted++ ) {
+      if( pthread_create( pahThreads + nStarted, NULL, msThreadTaskWorker, &sList ) != 0 )
+        break;
+    }
+
+    msThreadTaskWorker( &sList );
+
+    for( i = 0; i < nStarted; i++ )
+      pthread_join( pahThreads[i], NULL );
+
+    pthread_mutex_destroy( &(sList.sMutex) );
+    free( pahThreads );
+
+    return nStarted+1;
+  }
+#elif defined(USE_THREAD) && defined(_WIN32)
+  if( nThreads > 1 ) {
+    HANDLE *pahThreads = (HANDLE *) msSmallMalloc( sizeof(HANDLE) * (nThreads-1) );
+    int i, nStarted;
+
+    for( nStarted = 0; nStarted < nThreads-1; nStarted++ ) {
+      if( (pahThreads[nStarted] = CreateThread( NULL, 0, msThreadTaskWorker, &sList, 0, NULL )) == NULL )
+        break;
+    }
+
+    msThreadTaskWorker( &sList );
+
+    for( i = 0; i < nStarted; i++ ) {
+      WaitForSingleObject( pahThreads[i], INFINITE );
+      CloseHandle( pahThreads[i] );
+    }
+    free( pahThreads );
+
+    return nStarted+1;
+  }
+#endif
+
+  /* single threaded, no locking needed */
+  for( ; sList.nNextTask < nTasks; sList.nNextTask++ )
+    pfnTask( pData, sList.nNextTask );
+
+  return 1;
+}
+
+/************************************************************************/
+/*                       msGetWorkerThreadCount()                       */
+/*                                                                      */
+/*      Number of threads CPU bound work of a layer may be split        */
+/*      over, from the WORKER_THREADS processing option of the          */
+/*      layer or else the MS_WORKER_THREADS map config option.          */
+/*      AUTO uses one thread per online processor.  Always 1 without    */
+/*      thread support, since the error and debug state would not be    */
+/*      thread specific.                                                */
+/************************************************************************/
+
+int msGetWorkerThreadCount( mapObj *map, layerObj *layer )
+
+{
+#if defined(USE_THREAD)
+  const char *pszValue = NULL;
+  int nThreads;
+
+  if( layer )
+    pszValue = msLayerGetProcessingKey( layer, "WORKER_THREADS" );
+  if( pszValue == NULL && map )
+    pszValue = msGetConfigOption( map, "MS_WORKER_THREADS" );
+  if( pszValue == NULL )
+    return 1;
+
+  if( strcasecmp( pszValue, "AUTO" ) == 0 ) {
+#if defined(_WIN32)
+    SYSTEM_INFO sInfo;
+    GetSystemInfo( &sInfo );
+    nThreads = sInfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    nThreads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+#else
+    nThreads = 1;
+#endif
+  } else
+    nThreads = atoi( pszValue );
+
+  return MS_MAX( 1, MS_MIN( nThreads, MS_MAX_WORKER_THREADS ) );
+#else
+  return 1;
+#endif
+}
@@ -46,6 +46,15 @@ extern "C" {
 #define msReleaseLock(x)
 #endif
 
+  /*
+  ** worker tasks, see msThreadRunTasks() in mapthread.c
+  */
+  typedef void (*msThreadTaskFunc)(void *pData, int iTask);
+
+  int msThreadRunTasks(int nThreads, int nTasks, msThreadTaskFunc pfnTask, void *pData);
+
+#define MS_MAX_WORKER_THREADS 64
+
   /*
   ** lock ids - note there is a corresponding lock_names[] array in
   ** mapthread.c that needs to be extended when new ids are added.
@@ -69,8 +78,14 @@ extern "C" {
 #define TLOCK_FRIBIDI   16
 #define TLOCK_WxS       17
 #define TLOCK_GEOS       18
-
-#define TLOCK_STATIC_MAX 20
+#define TLOCK_FEATURECACHE 19
+#define TLOCK_JOINCACHE 20
+#define TLOCK_GDALBUFFER 21
+#define TLOCK_PNGENCODER 22
+#define TLOCK_CONTOURCACHE 23
+#define TLOCK_MAPFILECACHE 24
+
+#define TLOCK_STATIC_MAX 25
 #define TLOCK_MAX       100
 
 #ifdef __cplusplus
@@ -57,6 +57,7 @@
 
 extern char *msyystring_buffer;
 extern int msyylex_destroy(void);
+extern void msyyfreefiles(void);
 extern int yyparse(parseObj *);
 
 int msScaleInBounds(double scale, double minscale, double maxscale)
@@ -71,17 +72,19 @@ int msScaleInBounds(double scale, double minscale, double maxscale)
 /*
 ** Helper functions to convert from strings to other types or objects.
 */
-static int bindIntegerAttribute(int *attribute, char *value)
+static int bindIntegerAttribute(int *attribute, shapeObj *shape, int index)
 {
-  if(!value || strlen(value) == 0) return MS_FAILURE;
-  *attribute = MS_NINT(atof(value)); /*use atof instead of atoi as a fix for bug 2394*/
+  char *value = shape->values[index];
+  if(!value || value[0] == '\0') return MS_FAILURE;
+  *attribute = MS_NINT(msShapeGetValueAsDouble(shape, index)); /*use atof instead of atoi as a fix for bug 2394*/
   return MS_SUCCESS;
 }
 
-static int bindDoubleAttribute(double *attribute, char *value)
+static int bindDoubleAttribute(double *attribute, shapeObj *shape, int index)
 {
-  if(!value || strlen(value) == 0) return MS_FAILURE;
-  *attribute = atof(value);
+  char *value = shape->values[index];
+  if(!value || value[0] == '\0') return MS_FAILURE;
+  *attribute = msShapeGetValueAsDouble(shape, index); /* parsed once per feature */
   return MS_SUCCESS;
 }
 
@@ -140,15 +143,15 @@ static void bindStyle(layerObj *layer, shapeObj *shape, styleObj *style, int dra
     }
     if(style->bindings[MS_STYLE_BINDING_ANGLE].index != -1) {
       style->angle = 360.0;
-      bindDoubleAttribute(&style->angle, shape->values[style->bindings[MS_STYLE_BINDING_ANGLE].index]);
+      bindDoubleAttribute(&style->angle, shape, style->bindings[MS_STYLE_BINDING_ANGLE].index);
     }
     if(style->bindings[MS_STYLE_BINDING_SIZE].index != -1) {
       style->size = 1;
-      bindDoubleAttribute(&style->size, shape->values[style->bindings[MS_STYLE_BINDING_SIZE].index]);
+      bindDoubleAttribute(&style->size, shape, style->bindings[MS_STYLE_BINDING_SIZE].index);
     }
     if(style->bindings[MS_STYLE_BINDING_WIDTH].index != -1) {
       style->width = 1;
-      bindDoubleAttribute(&style->width, shape->values[style->bindings[MS_STYLE_BINDING_WIDTH].index]);
+      bindDoubleAttribute(&style->width, shape, style->bindings[MS_STYLE_BINDING_WIDTH].index);
     }
     if(style->bindings[MS_STYLE_BINDING_COLOR].index != -1 && !MS_DRAW_QUERY(drawmode)) {
       MS_INIT_COLOR(style->color, -1,-1,-1,255);
@@ -160,31 +163,31 @@ static void bindStyle(layerObj *layer, shapeObj *shape, styleObj *style, int dra
     }
     if(style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index != -1) {
       style->outlinewidth = 1;
-      bindDoubleAttribute(&style->outlinewidth, shape->values[style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index]);
+      bindDoubleAttribute(&style->outlinewidth, shape, style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index);
     }
     if(style->bindings[MS_STYLE_BINDING_OPACITY].index != -1) {
       style->opacity = 100;
-      bindIntegerAttribute(&style->opacity, shape->values[style->bindings[MS_STYLE_BINDING_OPACITY].index]);
+      bindIntegerAttribute(&style->opacity, shape, style->bindings[MS_STYLE_BINDING_OPACITY].index);
     }
     if(style->bindings[MS_STYLE_BINDING_OFFSET_X].index != -1) {
       style->offsetx = 0;
-      bindDoubleAttribute(&style->offsetx, shape->values[style->bindings[MS_STYLE_BINDING_OFFSET_X].index]);
+      bindDoubleAttribute(&style->offsetx, shape, style->bindings[MS_STYLE_BINDING_OFFSET_X].index);
     }
     if(style->bindings[MS_STYLE_BINDING_OFFSET_Y].index != -1) {
       style->offsety = 0;
-      bindDoubleAttribute(&style->offsety, shape->values[style->bindings[MS_STYLE_BINDING_OFFSET_Y].index]);
+      bindDoubleAttribute(&style->offsety, shape, style->bindings[MS_STYLE_BINDING_OFFSET_Y].index);
     }
     if(style->bindings[MS_STYLE_BINDING_POLAROFFSET_PIXEL].index != -1) {
       style->polaroffsetpixel = 0;
-      bindDoubleAttribute(&style->polaroffsetpixel, shape->values[style->bindings[MS_STYLE_BINDING_POLAROFFSET_PIXEL].index]);
+      bindDoubleAttribute(&style->polaroffsetpixel, shape, style->bindings[MS_STYLE_BINDING_POLAROFFSET_PIXEL].index);
     }
     if(style->bindings[MS_STYLE_BINDING_POLAROFFSET_ANGLE].index != -1) {
       style->polaroffsetangle = 0;
-      bindDoubleAttribute(&style->polaroffsetangle, shape->values[style->bindings[MS_STYLE_BINDING_POLAROFFSET_ANGLE].index]);
+      bindDoubleAttribute(&style->polaroffsetangle, shape, style->bindings[MS_STYLE_BINDING_POLAROFFSET_ANGLE].index);
     }
     if(style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index != -1) {
       style->outlinewidth = 1;
-      bindDoubleAttribute(&style->outlinewidth, shape->values[style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index]);
+      bindDoubleAttribute(&style->outlinewidth, shape, style->bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index);
     }
     if(style->opacity < 100 || style->color.alpha != 255 ) {
       int alpha;
@@ -212,12 +215,12 @@ static void bindLabel(layerObj *layer, shapeObj *shape, labelObj *label, int dra
   if(label->numbindings > 0) {
     if(label->bindings[MS_LABEL_BINDING_ANGLE].index != -1) {
       label->angle = 0.0;
-      bindDoubleAttribute(&label->angle, shape->values[label->bindings[MS_LABEL_BINDING_ANGLE].index]);
+      bindDoubleAttribute(&label->angle, shape, label->bindings[MS_LABEL_BINDING_ANGLE].index);
     }
 
     if(label->bindings[MS_LABEL_BINDING_SIZE].index != -1) {
       label->size = 1;
-      bindIntegerAttribute(&label->size, shape->values[label->bindings[MS_LABEL_BINDING_SIZE].index]);
+      bindIntegerAttribute(&label->size, shape, label->bindings[MS_LABEL_BINDING_SIZE].index);
     }
 
     if(label->bindings[MS_LABEL_BINDING_COLOR].index != -1) {
@@ -237,21 +240,21 @@ static void bindLabel(layerObj *layer, shapeObj *shape, labelObj *label, int dra
 
     if(label->bindings[MS_LABEL_BINDING_PRIORITY].index != -1) {
       label->priority = MS_DEFAULT_LABEL_PRIORITY;
-      bindIntegerAttribute(&label->priority, shape->values[label->bindings[MS_LABEL_BINDING_PRIORITY].index]);
+      bindIntegerAttribute(&label->priority, shape, label->bindings[MS_LABEL_BINDING_PRIORITY].index);
     }
 
     if(label->bindings[MS_LABEL_BINDING_SHADOWSIZEX].index != -1) {
       label->shadowsizex = 1;
-      bindIntegerAttribute(&label->shadowsizex, shape->values[label->bindings[MS_LABEL_BINDING_SHADOWSIZEX].index]);
+      bindIntegerAttribute(&label->shadowsizex, shape, label->bindings[MS_LABEL_BINDING_SHADOWSIZEX].index);
     }
     if(label->bindings[MS_LABEL_BINDING_SHADOWSIZEY].index != -1) {
       label->shadowsizey = 1;
-      bindIntegerAttribute(&label->shadowsizey, shape->values[label->bindings[MS_LABEL_BINDING_SHADOWSIZEY].index]);
+      bindIntegerAttribute(&label->shadowsizey, shape, label->bindings[MS_LABEL_BINDING_SHADOWSIZEY].index);
     }
 
     if(label->bindings[MS_LABEL_BINDING_POSITION].index != -1) {
       int tmpPosition;
-      bindIntegerAttribute(&tmpPosition, shape->values[label->bindings[MS_LABEL_BINDING_POSITION].index]);
+      bindIntegerAttribute(&tmpPosition, shape, label->bindings[MS_LABEL_BINDING_POSITION].index);
       if(tmpPosition != 0) { /* is this test sufficient? */
         label->position = tmpPosition;
       } else { /* Integer binding failed, look for strings like cc, ul, lr, etc... */
@@ -340,9 +343,9 @@ static int searchContextForTag(mapObj *map, char **ltags, char *tag, char *conte
   for(i=0; i<map->numlayers; i++) {
     if(strstr(context, ltags[i]) != NULL) { /* need to check this layer */
       if(requires == MS_TRUE) {
-        if(searchContextForTag(map, ltags, tag, GET_LAYER(map, i)->requires, MS_TRUE) == MS_SUCCESS) return MS_SUCCESS;
+        if(searchContextForTag(map, ltags, tag, GET_LAYER_HEADER(map, i)->requires, MS_TRUE) == MS_SUCCESS) return MS_SUCCESS;
       } else {
-        if(searchContextForTag(map, ltags, tag, GET_LAYER(map, i)->labelrequires, MS_FALSE) == MS_SUCCESS) return MS_SUCCESS;
+        if(searchContextForTag(map, ltags, tag, GET_LAYER_HEADER(map, i)->labelrequires, MS_FALSE) == MS_SUCCESS) return MS_SUCCESS;
       }
     }
   }
@@ -363,24 +366,24 @@ int msValidateContexts(mapObj *map)
 
   ltags = (char **) msSmallMalloc(map->numlayers*sizeof(char *));
   for(i=0; i<map->numlayers; i++) {
-    if(GET_LAYER(map, i)->name == NULL) {
+    if(GET_LAYER_HEADER(map, i)->name == NULL) {
       ltags[i] = msStrdup("[NULL]");
     } else {
-      ltags[i] = (char *) msSmallMalloc(sizeof(char)*strlen(GET_LAYER(map, i)->name) + 3);
-      sprintf(ltags[i], "[%s]", GET_LAYER(map, i)->name);
+      ltags[i] = (char *) msSmallMalloc(sizeof(char)*strlen(GET_LAYER_HEADER(map, i)->name) + 3);
+      sprintf(ltags[i], "[%s]", GET_LAYER_HEADER(map, i)->name);
     }
   }
 
   /* check each layer's REQUIRES and LABELREQUIRES parameters */
   for(i=0; i<map->numlayers; i++) {
     /* printf("working on layer %s, looking for references to %s\n", GET_LAYER(map, i)->name, ltags[i]); */
-    if(searchContextForTag(map, ltags, ltags[i], GET_LAYER(map, i)->requires, MS_TRUE) == MS_SUCCESS) {
-      msSetError(MS_PARSEERR, "Recursion error found for REQUIRES parameter for layer %s.", "msValidateContexts", GET_LAYER(map, i)->name);
+    if(searchContextForTag(map, ltags, ltags[i], GET_LAYER_HEADER(map, i)->requires, MS_TRUE) == MS_SUCCESS) {
+      msSetError(MS_PARSEERR, "Recursion error found for REQUIRES parameter for layer %s.", "msValidateContexts", GET_LAYER_HEADER(map, i)->name);
       status = MS_FAILURE;
       break;
     }
-    if(searchContextForTag(map, ltags, ltags[i], GET_LAYER(map, i)->labelrequires, MS_FALSE) == MS_SUCCESS) {
-      msSetError(MS_PARSEERR, "Recursion error found for LABELREQUIRES parameter for layer %s.", "msValidateContexts", GET_LAYER(map, i)->name);
+    if(searchContextForTag(map, ltags, ltags[i], GET_LAYER_HEADER(map, i)->labelrequires, MS_FALSE) == MS_SUCCESS) {
+      msSetError(MS_PARSEERR, "Recursion error found for LABELREQUIRES parameter for layer %s.", "msValidateContexts", GET_LAYER_HEADER(map, i)->name);
       status = MS_FAILURE;
       break;
     }
@@ -411,13 +414,13 @@ int msEvalContext(mapObj *map, layerObj *layer, char *context)
 
   for(i=0; i<map->numlayers; i++) { /* step through all the layers */
     if(layer->index == i) continue; /* skip the layer in question */
-    if (GET_LAYER(map, i)->name == NULL) continue; /* Layer without name cannot be used in contexts */
+    if (GET_LAYER_HEADER(map, i)->name == NULL) continue; /* Layer without name cannot be used in contexts */
 
-    tag = (char *)msSmallMalloc(sizeof(char)*strlen(GET_LAYER(map, i)->name) + 3);
-    sprintf(tag, "[%s]", GET_LAYER(map, i)->name);
+    tag = (char *)msSmallMalloc(sizeof(char)*strlen(GET_LAYER_HEADER(map, i)->name) + 3);
+    sprintf(tag, "[%s]", GET_LAYER_HEADER(map, i)->name);
 
     if(strstr(e.string, tag)) {
-      if(msLayerIsVisible(map, (GET_LAYER(map, i))))
+      if(!MS_LAZY_LAYER_IS_OFF(map, i) && msLayerIsVisible(map, (GET_LAYER(map, i))))
         e.string = msReplaceSubstring(e.string, tag, "1");
       else
         e.string = msReplaceSubstring(e.string, tag, "0");
@@ -497,6 +500,10 @@ int msEvalExpression(layerObj *layer, shapeObj *shape, expressionObj *expression
       int status;
       parseObj p;
 
+      /* compiled by msTokenizeExpression(), yyparse() reports evaluation errors */
+      if(expression->program && msEvalCompiledExpression(expression, shape, &status) == MS_SUCCESS)
+        return status;
+
       p.shape = shape;
       p.expr = expression;
       p.expr->curtoken = p.expr->tokens; /* reset */
@@ -575,14 +582,54 @@ int *msAllocateValidClassGroups(layerObj *lp, int *nclasses)
 
 }
 
+/* scale and minfeaturesize limits of a class, MS_FALSE if the shape is out of them */
+static int msShapeInClassLimits(layerObj *layer, mapObj *map, shapeObj *shape, int iclass)
+{
+  if(map->scaledenom > 0) { /* verify scaledenom here  */
+    if((layer->class[iclass]->maxscaledenom > 0) && (map->scaledenom > layer->class[iclass]->maxscaledenom))
+      return MS_FALSE; /* can skip this one, next class */
+    if((layer->class[iclass]->minscaledenom > 0) && (map->scaledenom <= layer->class[iclass]->minscaledenom))
+      return MS_FALSE; /* can skip this one, next class */
+  }
+
+  /* verify the minfeaturesize */
+  if ((shape->type == MS_SHAPE_LINE || shape->type == MS_SHAPE_POLYGON) && (layer->class[iclass]->minfeaturesize > 0)) {
+    double minfeaturesize = Pix2LayerGeoref(map, layer,
+                                            layer->class[iclass]->minfeaturesize);
+    if (msShapeCheckSize(shape, minfeaturesize) == MS_FALSE)
+      return MS_FALSE; /* skip this one, next class */
+  }
+
+  return MS_TRUE;
+}
+
 int msShapeGetClass(layerObj *layer, mapObj *map, shapeObj *shape, int *classgroup, int numclasses)
 {
   int i, iclass;
 
   if (layer->numclasses > 0) {
+    int matches[64], nmatches, m, g, numgeneric;
+    const int *generic;
+
     if (classgroup == NULL || numclasses <=0)
       numclasses = layer->numclasses;
 
+    /* indexed classes are known to match, the others are evaluated, in class order (see mapclassindex.c) */
+    nmatches = msLayerGetClassIndexCandidates(layer, shape, classgroup, numclasses, matches, 64, &generic, &numgeneric);
+    if(nmatches >= 0) {
+      m = g = 0;
+      while(m < nmatches || g < numgeneric) {
+        int indexed = (g == numgeneric || (m < nmatches && matches[m] < generic[g]));
+
+        iclass = indexed ? matches[m++] : generic[g++];
+        if(msShapeInClassLimits(layer, map, shape, iclass) == MS_FALSE)
+          continue;
+        if(layer->class[iclass]->status != MS_DELETE && (indexed || msEvalExpression(layer, shape, &(layer->class[iclass]->expression), layer->classitemindex) == MS_TRUE))
+          return(iclass);
+      }
+      return(-1); /* no match */
+    }
+
     for(i=0; i<numclasses; i++) {
       if (classgroup)
         iclass = classgroup[i];
@@ -592,20 +639,8 @@ int msShapeGetClass(layerObj *layer, mapObj *map, shapeObj *shape, int *classgro
       if (iclass < 0 || iclass >= layer->numclasses)
         continue; /* this should never happen but just in case */
 
-      if(map->scaledenom > 0) { /* verify scaledenom here  */
-        if((layer->class[iclass]->maxscaledenom > 0) && (map->scaledenom > layer->class[iclass]->maxscaledenom))
-          continue; /* can skip this one, next class */
-        if((layer->class[iclass]->minscaledenom > 0) && (map->scaledenom <= layer->class[iclass]->minscaledenom))
-          continue; /* can skip this one, next class */
-      }
-
-      /* verify the minfeaturesize */
-      if ((shape->type == MS_SHAPE_LINE || shape->type == MS_SHAPE_POLYGON) && (layer->class[iclass]->minfeaturesize > 0)) {
-        double minfeaturesize = Pix2LayerGeoref(map, layer,
-                                                layer->class[iclass]->minfeaturesize);
-        if (msShapeCheckSize(shape, minfeaturesize) == MS_FALSE)
-          continue; /* skip this one, next class */
-      }
+      if(msShapeInClassLimits(layer, map, shape, iclass) == MS_FALSE)
+        continue;
 
       if(layer->class[iclass]->status != MS_DELETE && msEvalExpression(layer, shape, &(layer->class[iclass]->expression), layer->classitemindex) == MS_TRUE)
         return(iclass);
@@ -659,6 +694,9 @@ char *msEvalTextExpressionInternal(expressionObj *expr, shapeObj *shape, int bJS
       int status;
       parseObj p;
 
+      if(expr->program && msEvalCompiledTextExpression(expr, shape, &result) == MS_SUCCESS)
+        break;
+
       p.shape = shape;
       p.expr = expr;
       p.expr->curtoken = p.expr->tokens; /* reset */
@@ -1005,9 +1043,9 @@ int *msGetLayersIndexByGroup(mapObj *map, char *groupname, int *pnCount)
   aiIndex = (int *)msSmallMalloc(sizeof(int) * map->numlayers);
 
   for(i=0; i<map->numlayers; i++) {
-    if(!GET_LAYER(map, i)->group) /* skip it */
+    if(!GET_LAYER_HEADER(map, i)->group) /* skip it */
       continue;
-    if(strcmp(groupname, GET_LAYER(map, i)->group) == 0) {
+    if(strcmp(groupname, GET_LAYER_HEADER(map, i)->group) == 0) {
       aiIndex[iLayer] = i;
       iLayer++;
     }
@@ -1934,6 +1972,7 @@ void msCleanup()
     msFree(msyystring_buffer);
     msyystring_buffer = NULL;
   }
+  msyyfreefiles();
   msyylex_destroy();
 
 #ifdef USE_OGR
@@ -1943,6 +1982,7 @@ void msCleanup()
   msGDALCleanup();
 #endif
 #ifdef USE_PROJ
+  msProjectionCacheCleanup();
 #  if PJ_VERSION >= 480
   pj_clear_initcache();
 #  endif
@@ -1957,6 +1997,12 @@ void msCleanup()
   msGEOSCleanup();
 #endif
 
+  msFeatureCacheCleanup();
+  msJoinCacheCleanup();
+  msPNGEncoderCleanup();
+  msContourCacheCleanup();
+  msMapfileCacheCleanup();
+
 /* make valgrind happy on debug code */
 #ifndef NDEBUG
 #ifdef USE_CAIRO
@@ -2230,13 +2230,13 @@ int msWCSDispatch(mapObj *map, cgiRequestObj *request, owsRequestObj *ows_reques
 
     /* check if all layer names are valid NCNames */
     for(i = 0; i < map->numlayers; ++i) {
-      if(!msWCSIsLayerSupported(map->layers[i]))
+      if(!msWCSIsLayerSupported(GET_LAYER(map, i)))
         continue;
 
       /* Check if each layers name is a valid NCName. */
-      if (msEvalRegex("^[a-zA-z_][a-zA-Z0-9_.-]*$" , map->layers[i]->name) == MS_FALSE) {
+      if (msEvalRegex("^[a-zA-z_][a-zA-Z0-9_.-]*$" , GET_LAYER(map, i)->name) == MS_FALSE) {
         msSetError(MS_WCSERR, "Layer name '%s' is not a valid NCName.",
-                   "msWCSDispatch()", map->layers[i]->name);
+                   "msWCSDispatch()", GET_LAYER(map, i)->name);
         msWCSFreeParamsObj20(params);
         return msWCSException(map, "mapserv", "Internal", "2.0.1");
       }
@@ -3363,7 +3363,7 @@ int msWCSGetCapabilities20(mapObj *map, cgiRequestObj *req,
                                          "Check wcs/ows_enable_request settings.")));
     } else {
       for(i = 0; i < map->numlayers; ++i) {
-        layerObj *layer = map->layers[i];
+        layerObj *layer = GET_LAYER(map, i);
         int       status;
 
         if(!msWCSIsLayerSupported(layer))
@@ -812,6 +812,11 @@ int msWFSLayerOpen(layerObj *lp,
     msProjectRect(&lp->map->projection, &lp->projection, &psInfo->rect); /* project the searchrect to source coords */
 #endif
 
+  /* With the feature cache the download is deferred to whichshapes(), */
+  /* which is never called when the features come from the cache. */
+  if (msFeatureCacheEnabled(lp))
+    return status;
+
   if (msWFSLayerWhichShapes(lp, psInfo->rect, MS_FALSE) == MS_FAILURE)  /* no access to context (draw vs. query) here, although I doubt it matters... */
     status = MS_FAILURE;
 
@@ -964,6 +969,12 @@ int msWFSLayerGetExtent(layerObj *layer, rectObj *extent)
     return MS_FAILURE;
   }
 
+  /* download deferred by the feature cache (see msWFSLayerOpen()) */
+  if(psInfo->nStatus == 0 && layer->layerinfo == NULL) {
+    if (msWFSLayerWhichShapes(layer, psInfo->rect, MS_FALSE) == MS_FAILURE)
+      return MS_FAILURE;
+  }
+
   if(psInfo->bLayerHasValidGML)
     return msOGRLayerGetExtent(layer, extent);
   else {
@@ -1004,6 +1015,12 @@ int msWFSLayerGetItems(layerObj *layer)
     return MS_FAILURE;
   }
 
+  /* download deferred by the feature cache (see msWFSLayerOpen()) */
+  if(psInfo->nStatus == 0 && layer->layerinfo == NULL) {
+    if (msWFSLayerWhichShapes(layer, psInfo->rect, MS_FALSE) == MS_FAILURE)
+      return MS_FAILURE;
+  }
+
   if(psInfo->bLayerHasValidGML)
     return msOGRLayerGetItems(layer);
   else {
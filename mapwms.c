@@ -900,8 +900,8 @@ int msWMSLoadGetMapParams(mapObj *map, int nVersion,
       for(j=0; j<map->numlayers; j++) {
         /* Keep only layers with status=DEFAULT by default */
         /* Layer with status DEFAULT is drawn first. */
-        if (GET_LAYER(map, j)->status != MS_DEFAULT)
-          GET_LAYER(map, j)->status = MS_OFF;
+        if (GET_LAYER_HEADER(map, j)->status != MS_DEFAULT)
+          GET_LAYER_HEADER(map, j)->status = MS_OFF;
         else {
           map->layerorder[nLayerOrder++] = j;
           layerOrder[j] = 1;
@@ -917,17 +917,17 @@ int msWMSLoadGetMapParams(mapObj *map, int nVersion,
         layerfound = 0;
         for (j=0; j<map->numlayers; j++) {
           /* Turn on selected layers only. */
-          if ( ((GET_LAYER(map, j)->name &&
-                 strcasecmp(GET_LAYER(map, j)->name, layers[k]) == 0) ||
+          if ( ((GET_LAYER_HEADER(map, j)->name &&
+                 strcasecmp(GET_LAYER_HEADER(map, j)->name, layers[k]) == 0) ||
                 (map->name && strcasecmp(map->name, layers[k]) == 0) ||
-                (GET_LAYER(map, j)->group && strcasecmp(GET_LAYER(map, j)->group, layers[k]) == 0) ||
+                (GET_LAYER_HEADER(map, j)->group && strcasecmp(GET_LAYER_HEADER(map, j)->group, layers[k]) == 0) ||
                 ((numNestedGroups[j] >0) && msStringInArray(layers[k], nestedGroups[j], numNestedGroups[j]))) &&
-               ((msIntegerInArray(GET_LAYER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers))) ) {
-            if (GET_LAYER(map, j)->status != MS_DEFAULT) {
+               ((msIntegerInArray(GET_LAYER_HEADER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers))) ) {
+            if (GET_LAYER_HEADER(map, j)->status != MS_DEFAULT) {
               if (layerOrder[j] == 0) {
                 map->layerorder[nLayerOrder++] = j;
                 layerOrder[j] = 1;
-                GET_LAYER(map, j)->status = MS_ON;
+                GET_LAYER_HEADER(map, j)->status = MS_ON;
               }
             }
             validlayers++;
@@ -1473,8 +1473,8 @@ this request. Check wms/ows_enable_request settings.",
     /* -------------------------------------------------------------------- */
     if (validlayers == 0) { /*no LAYERS parameter is give*/
       for(j=0; j<map->numlayers; j++) {
-        if (GET_LAYER(map, j)->status != MS_DEFAULT)
-          GET_LAYER(map, j)->status = MS_OFF;
+        if (GET_LAYER_HEADER(map, j)->status != MS_DEFAULT)
+          GET_LAYER_HEADER(map, j)->status = MS_OFF;
       }
     }
 
@@ -1513,13 +1513,13 @@ this request. Check wms/ows_enable_request settings.",
         if (ntokens >0) {
           for (i=0; i<ntokens; i++) {
             for (j=0; j<map->numlayers; j++) {
-              if ( ((GET_LAYER(map, j)->name &&
-                     strcasecmp(GET_LAYER(map, j)->name, tokens[i]) == 0) ||
+              if ( ((GET_LAYER_HEADER(map, j)->name &&
+                     strcasecmp(GET_LAYER_HEADER(map, j)->name, tokens[i]) == 0) ||
                     (map->name && strcasecmp(map->name, tokens[i]) == 0) ||
-                    (GET_LAYER(map, j)->group && strcasecmp(GET_LAYER(map, j)->group, tokens[i]) == 0)) &&
-                   ((msIntegerInArray(GET_LAYER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers))) ) {
-                if (GET_LAYER(map, j)->status != MS_DEFAULT)
-                  GET_LAYER(map, j)->status = MS_ON;
+                    (GET_LAYER_HEADER(map, j)->group && strcasecmp(GET_LAYER_HEADER(map, j)->group, tokens[i]) == 0)) &&
+                   ((msIntegerInArray(GET_LAYER_HEADER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers))) ) {
+                if (GET_LAYER_HEADER(map, j)->status != MS_DEFAULT)
+                  GET_LAYER_HEADER(map, j)->status = MS_ON;
               }
             }
           }
@@ -3857,13 +3857,13 @@ int msWMSFeatureInfo(mapObj *map, int nVersion, char **names, char **values, int
 
       for(j=0; j<map->numlayers; j++) {
         /* Force all layers OFF by default */
-        GET_LAYER(map, j)->status = MS_OFF;
+        GET_LAYER_HEADER(map, j)->status = MS_OFF;
         for(k=0; k<numlayers; k++) {
-          if (((GET_LAYER(map, j)->name && strcasecmp(GET_LAYER(map, j)->name, layers[k]) == 0) ||
+          if (((GET_LAYER_HEADER(map, j)->name && strcasecmp(GET_LAYER_HEADER(map, j)->name, layers[k]) == 0) ||
                (map->name && strcasecmp(map->name, layers[k]) == 0) ||
-               (GET_LAYER(map, j)->group && strcasecmp(GET_LAYER(map, j)->group, layers[k]) == 0) ||
+               (GET_LAYER_HEADER(map, j)->group && strcasecmp(GET_LAYER_HEADER(map, j)->group, layers[k]) == 0) ||
                ((numNestedGroups[j] >0) && msStringInArray(layers[k], nestedGroups[j], numNestedGroups[j]))) &&
-              (msIntegerInArray(GET_LAYER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers)) ) {
+              (msIntegerInArray(GET_LAYER_HEADER(map, j)->index, ows_request->enabled_layers, ows_request->numlayers)) ) {
             if (GET_LAYER(map, j)->connectiontype == MS_WMS) {
               wms_layer = MS_TRUE;
               wms_connection = GET_LAYER(map, j)->connection;
@@ -4668,18 +4668,18 @@ int msWMSGetStyles(mapObj *map, int nVersion, char **names,
         return msWMSException(map, nVersion, NULL, wms_exception_format);
       }
       for(j=0; j<map->numlayers; j++)
-        GET_LAYER(map, j)->status = MS_OFF;
+        GET_LAYER_HEADER(map, j)->status = MS_OFF;
 
       for (k=0; k<numlayers; k++) {
         for (j=0; j<map->numlayers; j++) {
           if ((map->name &&
                strcasecmp(map->name, layers[k]) == 0) ||
-              (GET_LAYER(map, j)->name &&
-               strcasecmp(GET_LAYER(map, j)->name, layers[k]) == 0) ||
-              (GET_LAYER(map, j)->group &&
-               strcasecmp(GET_LAYER(map, j)->group, layers[k]) == 0) ||
+              (GET_LAYER_HEADER(map, j)->name &&
+               strcasecmp(GET_LAYER_HEADER(map, j)->name, layers[k]) == 0) ||
+              (GET_LAYER_HEADER(map, j)->group &&
+               strcasecmp(GET_LAYER_HEADER(map, j)->group, layers[k]) == 0) ||
               ((numNestedGroups[j] >0) && msStringInArray(layers[k], nestedGroups[j], numNestedGroups[j])) ) {
-            GET_LAYER(map, j)->status = MS_ON;
+            GET_LAYER_HEADER(map, j)->status = MS_ON;
             validlayer =1;
           }
         }
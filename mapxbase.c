@@ -903,3 +903,32 @@ char **msDBFGetValueList(DBFHandle dbffile, int record, int *itemindexes, int nu
 
   return(values);
 }
+
+/*
+** Same as msDBFGetValueList(), but stores the values in shape, reusing the
+** buffers of a shape passed to msRecycleShape().
+*/
+int msDBFGetShapeValues(DBFHandle dbffile, int record, int *itemindexes, int numitems, shapeObj *shape)
+{
+  const char *value;
+  int i;
+
+  if(numitems == 0) return(MS_SUCCESS);
+
+  if(msShapeReserveValues(shape, numitems) == NULL)
+    return(MS_FAILURE);
+
+  for(i=0; i<numitems; i++) {
+    value = msDBFReadStringAttribute(dbffile, record, itemindexes[i]);
+    if (value == NULL || msShapeSetValue(shape, i, value) == NULL) {
+      while(i >= 0)
+        free(shape->values[i--]);
+      free(shape->values);
+      shape->values = NULL;
+      shape->numvalues = 0;
+      return(MS_FAILURE); /* Error already reported */
+    }
+  }
+
+  return(MS_SUCCESS);
+}
@@ -0,0 +1,226 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Checks that batched reprojection matches msProjectPoint().
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include <math.h>
+#include "mapserver.h"
+
+#ifdef USE_PROJ
+
+/*
+** Reprojects points between EPSG:4326 and EPSG:3857 with msProjectPoints(),
+** msProjectLine() and msProjectShape(), which batch the pj_transform()
+** calls, and compares the result with msProjectPoint() one point at a
+** time. Each case runs with the well known projections detected (the fast
+** paths, when built with them) and with PROJ forced, and with and without
+** geotransforms on both sides. Exits with 1 if a point differs.
+*/
+
+#define NUM_POINTS 600
+
+static char mapfile[] =
+  "MAP EXTENT -180 -90 180 90 SIZE 100 100\n"
+  "  PROJECTION \"init=epsg:4326\" END\n"
+  "  LAYER NAME \"merc\" TYPE LINE STATUS ON PROJECTION \"init=epsg:3857\" END END\n"
+  "END";
+
+/* polar points may be over the horizon of PROJ, failing in both paths */
+static void setPoints(pointObj *points, int count, int geotransformed, int polar)
+{
+  int i;
+
+  for(i = 0; i < count; i++) {
+    if(geotransformed) {
+      /* pixel coordinates of the geotransforms below */
+      points[i].x = (i * 7) % 700;
+      points[i].y = (i * 3) % 600;
+    } else {
+      points[i].x = -170 + (i * 37) % 340;
+      points[i].y = -80 + (i * 13) % 160;
+      if(polar && i % 97 == 5)
+        points[i].y = 89.9;
+    }
+#ifdef USE_POINT_Z_M
+    points[i].z = points[i].m = 0.0;
+#endif
+  }
+}
+
+/* the reference, one msProjectPoint() per point */
+static void projectEach(projectionObj *in, projectionObj *out, pointObj *points, int count)
+{
+  int i;
+
+  for(i = 0; i < count; i++)
+    if(msProjectPoint(in, out, points + i) == MS_FAILURE)
+      points[i].x = points[i].y = HUGE_VAL;
+}
+
+static int comparePoints(const char *name, pointObj *a, pointObj *b, int count)
+{
+  int i, differing = 0;
+
+  for(i = 0; i < count; i++) {
+    if(fabs(a[i].x - b[i].x) > 1e-6 * (1 + fabs(b[i].x)) || fabs(a[i].y - b[i].y) > 1e-6 * (1 + fabs(b[i].y))) {
+      if(differing == 0)
+        printf("%s: point %d is %.10g,%.10g instead of %.10g,%.10g\n", name, i, a[i].x, a[i].y, b[i].x, b[i].y);
+      differing++;
+    }
+  }
+  printf("%s: %d of %d points differ\n", name, differing, count);
+  return differing != 0;
+}
+
+static int checkPoints(projectionObj *in, projectionObj *out, const char *name, int geotransformed)
+{
+  pointObj batched[NUM_POINTS], single[NUM_POINTS];
+  lineObj line;
+
+  setPoints(batched, NUM_POINTS, geotransformed, MS_TRUE);
+  setPoints(single, NUM_POINTS, geotransformed, MS_TRUE);
+  projectEach(in, out, single, NUM_POINTS);
+
+  line.numpoints = NUM_POINTS;
+  line.point = batched;
+  if(geotransformed)
+    msProjectLine(in, out, &line); /* the way mapgraticule.c uses it */
+  else
+    msProjectPoints(in, out, batched, NUM_POINTS);
+  return comparePoints(name, batched, single, NUM_POINTS);
+}
+
+/* a line shorter and one longer than a pj_transform() batch */
+static int checkShape(projectionObj *in, projectionObj *out, const char *name, int count)
+{
+  shapeObj shape;
+  lineObj line;
+  pointObj *single;
+  int failures;
+
+  line.numpoints = count;
+  line.point = (pointObj *) msSmallMalloc(sizeof(pointObj) * count);
+  single = (pointObj *) msSmallMalloc(sizeof(pointObj) * count);
+  setPoints(line.point, count, MS_FALSE, MS_FALSE);
+  setPoints(single, count, MS_FALSE, MS_FALSE);
+  projectEach(in, out, single, count);
+
+  msInitShape(&shape);
+  shape.type = MS_SHAPE_LINE;
+  msAddLine(&shape, &line);
+  if(msProjectShape(in, out, &shape) != MS_SUCCESS || shape.numlines != 1 || shape.line[0].numpoints != count) {
+    printf("%s: msProjectShape() failed or split the line\n", name);
+    failures = 1;
+  } else
+    failures = comparePoints(name, shape.line[0].point, single, count);
+
+  msFreeShape(&shape);
+  free(line.point);
+  free(single);
+  return failures;
+}
+
+static int checkAll(projectionObj *in, projectionObj *out, const char *how)
+{
+  char name[128];
+  int failures = 0;
+
+  snprintf(name, sizeof(name), "points, %s", how);
+  failures += checkPoints(in, out, name, MS_FALSE);
+  snprintf(name, sizeof(name), "short shape, %s", how);
+  failures += checkShape(in, out, name, 10);
+  snprintf(name, sizeof(name), "long shape, %s", how);
+  failures += checkShape(in, out, name, NUM_POINTS);
+
+  in->gt.need_geotransform = MS_TRUE;
+  in->gt.geotransform[0] = -180;
+  in->gt.geotransform[1] = 0.5;
+  in->gt.geotransform[2] = 0;
+  in->gt.geotransform[3] = 80;
+  in->gt.geotransform[4] = 0;
+  in->gt.geotransform[5] = -0.25;
+  out->gt.need_geotransform = MS_TRUE;
+  out->gt.invgeotransform[0] = 10;
+  out->gt.invgeotransform[1] = 1e-3;
+  out->gt.invgeotransform[2] = 0;
+  out->gt.invgeotransform[3] = 20;
+  out->gt.invgeotransform[4] = 0;
+  out->gt.invgeotransform[5] = -1e-3;
+  snprintf(name, sizeof(name), "line with geotransforms, %s", how);
+  failures += checkPoints(in, out, name, MS_TRUE);
+  in->gt.need_geotransform = out->gt.need_geotransform = MS_FALSE;
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  mapObj *map;
+  projectionObj *in, *out;
+  int wkp_in, wkp_out, failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  if((map = msLoadMapFromString(mapfile, NULL)) == NULL) {
+    msWriteError(stderr);
+    msCleanup();
+    return 1;
+  }
+  in = &(map->projection);
+  out = &(GET_LAYER(map, 0)->projection);
+
+  failures += checkAll(in, out, "as loaded");
+
+  /* PROJ for all points, in pj_transform() batches */
+  wkp_in = in->wellknownprojection;
+  wkp_out = out->wellknownprojection;
+  in->wellknownprojection = out->wellknownprojection = wkp_none;
+  failures += checkAll(in, out, "through PROJ");
+  in->wellknownprojection = wkp_in;
+  out->wellknownprojection = wkp_out;
+
+  msFreeMap(map);
+  msCleanup();
+
+  if(failures) {
+    printf("%d case(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("projecttst requires PROJ support\n");
+  return 0;
+}
+
+#endif /* USE_PROJ */
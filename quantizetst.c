@@ -0,0 +1,450 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Commandline equivalence test and benchmark of the PNG8 quantizer.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+/*
+** Quantizes a few synthetic RGBA images, or a PNG given on the command
+** line, with msQuantizeRasterBuffer() and msClassifyRasterBuffer() and
+** with a copy of the chained hash / qsort / linear search code they
+** replace, and reports the time taken by both, whether the palettes and
+** pixels are identical and the PSNR of the results.  Exits with 1 if the
+** full (not sampled) quantization differs from the reference, or if any
+** pixel is not classified to its nearest palette entry.
+*/
+
+/* ==================================================================== */
+/*      Reference implementation.                                       */
+/* ==================================================================== */
+
+#define REF_MAXCOLORS 32767
+#define REF_HASH_SIZE 20023
+#define ref_hash(p) ( ( ( (long) (p).r * 33023 + (long) (p).g * 30013 + \
+    (long) (p).b * 27011 + (long) (p).a * 24007 ) & 0x7fffffff ) % REF_HASH_SIZE )
+#define ref_equal(p,q) ((p).r == (q).r && (p).g == (q).g && (p).b == (q).b && (p).a == (q).a)
+
+typedef struct { rgbaPixel acolor; int value; } ref_item;
+typedef struct ref_list { ref_item ch; struct ref_list *next; } ref_list;
+typedef struct { int ind, colors, sum; } ref_box;
+
+static void ref_freehash(ref_list **acht)
+{
+  int i;
+  for(i=0; i<REF_HASH_SIZE; i++) {
+    ref_list *l = acht[i], *next;
+    for(; l; l = next) {
+      next = l->next;
+      free(l);
+    }
+  }
+  free(acht);
+}
+
+static ref_item *ref_histogram(rasterBufferObj *rb, int *colors)
+{
+  ref_list **acht = (ref_list**)msSmallCalloc(REF_HASH_SIZE, sizeof(ref_list*));
+  ref_item *achv;
+  int row, col, i, j;
+
+  *colors = 0;
+  for(row=0; row<rb->height; row++) {
+    rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + row*rb->data.rgba.row_step);
+    for(col=0; col<rb->width; col++, p++) {
+      int h = ref_hash(*p);
+      ref_list *l;
+      for(l = acht[h]; l; l = l->next)
+        if(ref_equal(l->ch.acolor, *p))
+          break;
+      if(l) {
+        l->ch.value++;
+        continue;
+      }
+      if(++(*colors) > REF_MAXCOLORS) {
+        ref_freehash(acht);
+        return NULL;
+      }
+      l = (ref_list*)msSmallMalloc(sizeof(ref_list));
+      l->ch.acolor = *p;
+      l->ch.value = 1;
+      l->next = acht[h];
+      acht[h] = l;
+    }
+  }
+  achv = (ref_item*)msSmallMalloc(REF_MAXCOLORS*sizeof(ref_item));
+  for(i=0, j=0; i<REF_HASH_SIZE; i++) {
+    ref_list *l;
+    for(l = acht[i]; l; l = l->next)
+      achv[j++] = l->ch;
+  }
+  ref_freehash(acht);
+  return achv;
+}
+
+static int ref_rcmp(const void *a, const void *b) { return (int)((ref_item*)a)->acolor.r - (int)((ref_item*)b)->acolor.r; }
+static int ref_gcmp(const void *a, const void *b) { return (int)((ref_item*)a)->acolor.g - (int)((ref_item*)b)->acolor.g; }
+static int ref_bcmp(const void *a, const void *b) { return (int)((ref_item*)a)->acolor.b - (int)((ref_item*)b)->acolor.b; }
+static int ref_acmp(const void *a, const void *b) { return (int)((ref_item*)a)->acolor.a - (int)((ref_item*)b)->acolor.a; }
+static int ref_sumcmp(const void *a, const void *b) { return ((ref_box*)b)->sum - ((ref_box*)a)->sum; }
+
+static void ref_mediancut(ref_item *achv, int colors, int sum, unsigned char maxval,
+                          int newcolors, rgbaPixel *palette)
+{
+  ref_box *bv = (ref_box*)msSmallMalloc(sizeof(ref_box)*newcolors);
+  int boxes = 1, bi, i;
+
+  bv[0].ind = 0;
+  bv[0].colors = colors;
+  bv[0].sum = sum;
+  while(boxes < newcolors) {
+    int indx, clrs, sm, lowersum, halfsum;
+    int minr, maxr, ming, maxg, minb, maxb, mina, maxa;
+
+    for(bi=0; bi<boxes; bi++)
+      if(bv[bi].colors >= 2)
+        break;
+    if(bi == boxes)
+      break;
+    indx = bv[bi].ind;
+    clrs = bv[bi].colors;
+    sm = bv[bi].sum;
+    minr = maxr = achv[indx].acolor.r;
+    ming = maxg = achv[indx].acolor.g;
+    minb = maxb = achv[indx].acolor.b;
+    mina = maxa = achv[indx].acolor.a;
+    for(i=1; i<clrs; i++) {
+      rgbaPixel *p = &achv[indx+i].acolor;
+      minr = MS_MIN(minr, p->r); maxr = MS_MAX(maxr, p->r);
+      ming = MS_MIN(ming, p->g); maxg = MS_MAX(maxg, p->g);
+      minb = MS_MIN(minb, p->b); maxb = MS_MAX(maxb, p->b);
+      mina = MS_MIN(mina, p->a); maxa = MS_MAX(maxa, p->a);
+    }
+    if(maxa - mina >= maxr - minr && maxa - mina >= maxg - ming && maxa - mina >= maxb - minb)
+      qsort(&achv[indx], clrs, sizeof(ref_item), ref_acmp);
+    else if(maxr - minr >= maxg - ming && maxr - minr >= maxb - minb)
+      qsort(&achv[indx], clrs, sizeof(ref_item), ref_rcmp);
+    else if(maxg - ming >= maxb - minb)
+      qsort(&achv[indx], clrs, sizeof(ref_item), ref_gcmp);
+    else
+      qsort(&achv[indx], clrs, sizeof(ref_item), ref_bcmp);
+
+    lowersum = achv[indx].value;
+    halfsum = sm / 2;
+    for(i=1; i<clrs-1; i++) {
+      if(lowersum >= halfsum)
+        break;
+      lowersum += achv[indx+i].value;
+    }
+    bv[bi].colors = i;
+    bv[bi].sum = lowersum;
+    bv[boxes].ind = indx + i;
+    bv[boxes].colors = clrs - i;
+    bv[boxes].sum = sm - lowersum;
+    boxes++;
+    qsort(bv, boxes, sizeof(ref_box), ref_sumcmp);
+  }
+
+  for(bi=0; bi<newcolors; bi++) {
+    long r = 0, g = 0, b = 0, a = 0, s = 0;
+    memset(palette+bi, 0, sizeof(rgbaPixel));
+    if(bi >= boxes)
+      continue;
+    for(i=0; i<bv[bi].colors; i++) {
+      ref_item *it = &achv[bv[bi].ind+i];
+      r += it->acolor.r * it->value;
+      g += it->acolor.g * it->value;
+      b += it->acolor.b * it->value;
+      a += it->acolor.a * it->value;
+      s += it->value;
+    }
+    if(s > 0) {
+      palette[bi].r = MS_MIN(r/s, maxval);
+      palette[bi].g = MS_MIN(g/s, maxval);
+      palette[bi].b = MS_MIN(b/s, maxval);
+      palette[bi].a = MS_MIN(a/s, maxval);
+    } else {
+      palette[bi].r = palette[bi].g = palette[bi].b = palette[bi].a = maxval;
+    }
+  }
+  free(bv);
+}
+
+static void ref_quantize(rasterBufferObj *rb, unsigned int *reqcolors, rgbaPixel *palette,
+                         unsigned int *maxval)
+{
+  ref_item *achv;
+  int colors;
+
+  *maxval = 255;
+  while((achv = ref_histogram(rb, &colors)) == NULL) {
+    unsigned int newmaxval = *maxval / 2;
+    int row, col;
+    for(row=0; row<rb->height; row++) {
+      rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + row*rb->data.rgba.row_step);
+      for(col=0; col<rb->width; col++, p++) {
+        p->r = (p->r * newmaxval + *maxval/2) / *maxval;
+        p->g = (p->g * newmaxval + *maxval/2) / *maxval;
+        p->b = (p->b * newmaxval + *maxval/2) / *maxval;
+        p->a = (p->a * newmaxval + *maxval/2) / *maxval;
+      }
+    }
+    *maxval = newmaxval;
+  }
+  *reqcolors = MS_MIN(colors, *reqcolors);
+  ref_mediancut(achv, colors, rb->width*rb->height, *maxval, *reqcolors, palette);
+  free(achv);
+}
+
+static void ref_classify(rasterBufferObj *rb, rasterBufferObj *qrb)
+{
+  ref_list **acht = (ref_list**)msSmallCalloc(REF_HASH_SIZE, sizeof(ref_list*));
+  int row, col;
+
+  for(row=0; row<qrb->height; row++) {
+    rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + row*rb->data.rgba.row_step);
+    unsigned char *q = qrb->data.palette.pixels + row*qrb->width;
+    for(col=0; col<rb->width; col++, p++, q++) {
+      int h = ref_hash(*p), ind = -1, i;
+      long dist = 2000000000;
+      ref_list *l;
+      for(l = acht[h]; l; l = l->next)
+        if(ref_equal(l->ch.acolor, *p))
+          break;
+      if(l) {
+        *q = l->ch.value;
+        continue;
+      }
+      for(i=0; i<qrb->data.palette.num_entries; i++) {
+        rgbaPixel *c = qrb->data.palette.palette + i;
+        long d = (p->r-c->r)*(p->r-c->r) + (p->g-c->g)*(p->g-c->g) +
+                 (p->b-c->b)*(p->b-c->b) + (p->a-c->a)*(p->a-c->a);
+        if(d < dist) {
+          ind = i;
+          dist = d;
+        }
+      }
+      l = (ref_list*)msSmallMalloc(sizeof(ref_list));
+      l->ch.acolor = *p;
+      l->ch.value = ind;
+      l->next = acht[h];
+      acht[h] = l;
+      *q = ind;
+    }
+  }
+  ref_freehash(acht);
+}
+
+/* ==================================================================== */
+/*      Test images and measures.                                       */
+/* ==================================================================== */
+
+static void init_rgba(rasterBufferObj *rb, int width, int height)
+{
+  memset(rb, 0, sizeof(rasterBufferObj));
+  rb->type = MS_BUFFER_BYTE_RGBA;
+  rb->width = width;
+  rb->height = height;
+  rb->data.rgba.pixel_step = 4;
+  rb->data.rgba.row_step = width * 4;
+  rb->data.rgba.pixels = (unsigned char*)msSmallCalloc(width*height, 4);
+  rb->data.rgba.b = rb->data.rgba.pixels;
+  rb->data.rgba.g = rb->data.rgba.pixels + 1;
+  rb->data.rgba.r = rb->data.rgba.pixels + 2;
+  rb->data.rgba.a = rb->data.rgba.pixels + 3;
+}
+
+static void init_palette(rasterBufferObj *qrb, int width, int height, rgbaPixel *palette)
+{
+  memset(qrb, 0, sizeof(rasterBufferObj));
+  qrb->type = MS_BUFFER_BYTE_PALETTE;
+  qrb->width = width;
+  qrb->height = height;
+  qrb->data.palette.pixels = (unsigned char*)msSmallMalloc(width*height);
+  qrb->data.palette.palette = palette;
+}
+
+/* a map like image: flat areas, antialiased lines, some transparency */
+static void make_map(rasterBufferObj *rb)
+{
+  int x, y;
+  for(y=0; y<rb->height; y++) {
+    for(x=0; x<rb->width; x++) {
+      rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + y*rb->data.rgba.row_step) + x;
+      int zone = ((x/97) + (y/61)*3) % 9;
+      int road = abs((x + 2*y) % 211 - 105);
+      p->r = 40 + zone*23; p->g = 200 - zone*17; p->b = 90 + zone*11; p->a = 255;
+      if(road < 4) {
+        int v = 255 - road*50;
+        p->r = (p->r*(255-v) + 250*v)/255; p->g = (p->g*(255-v) + 220*v)/255; p->b = (p->b*(255-v) + 60*v)/255;
+      }
+      if((x/128 + y/128) % 5 == 0) {
+        p->a = 0; p->r = p->g = p->b = 0;
+      }
+    }
+  }
+}
+
+/* an aerial photo like image, more colors than the histogram holds */
+static void make_photo(rasterBufferObj *rb)
+{
+  int x, y;
+  srand(2);
+  for(y=0; y<rb->height; y++) {
+    for(x=0; x<rb->width; x++) {
+      rgbaPixel *p = (rgbaPixel*)(rb->data.rgba.pixels + y*rb->data.rgba.row_step) + x;
+      double v = 0.5 + 0.25*sin(x/37.0) * cos(y/23.0) + 0.2*sin((x+y)/71.0);
+      int n = rand() % 24 - 12;
+      p->r = MS_MAX(0, MS_MIN(255, (int)(v*180) + n + x/20));
+      p->g = MS_MAX(0, MS_MIN(255, (int)(v*210) + n));
+      p->b = MS_MAX(0, MS_MIN(255, (int)(v*140) + n + y/25));
+      p->a = 255;
+    }
+  }
+}
+
+static double psnr(rasterBufferObj *orig, rasterBufferObj *qrb, unsigned int maxval)
+{
+  double sumsq = 0;
+  int x, y;
+  for(y=0; y<orig->height; y++) {
+    rgbaPixel *p = (rgbaPixel*)(orig->data.rgba.pixels + y*orig->data.rgba.row_step);
+    unsigned char *q = qrb->data.palette.pixels + y*qrb->width;
+    for(x=0; x<orig->width; x++, p++, q++) {
+      rgbaPixel *c = qrb->data.palette.palette + *q;
+      int dr = p->r - c->r*255/maxval, dg = p->g - c->g*255/maxval;
+      int db = p->b - c->b*255/maxval, da = p->a - c->a*255/maxval;
+      sumsq += dr*dr + dg*dg + db*db + da*da;
+    }
+  }
+  sumsq /= 4.0 * orig->width * orig->height;
+  return sumsq == 0 ? 99.0 : 10 * log10(255.0*255.0 / sumsq);
+}
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+static int run(const char *name, rasterBufferObj *orig, unsigned int ncolors, unsigned int sample)
+{
+  rasterBufferObj rb, qrb, ref_rb, ref_qrb;
+  rgbaPixel palette[256], ref_palette[256];
+  unsigned int maxval, ref_maxval, ref_colors = ncolors;
+  size_t size = (size_t)orig->height * orig->data.rgba.row_step;
+  struct mstimeval start;
+  double t_quant, t_class, t_ref_quant, t_ref_class;
+  int same_palette, same_pixels, nearest = 1;
+
+  init_rgba(&rb, orig->width, orig->height);
+  init_rgba(&ref_rb, orig->width, orig->height);
+  memcpy(rb.data.rgba.pixels, orig->data.rgba.pixels, size);
+  memcpy(ref_rb.data.rgba.pixels, orig->data.rgba.pixels, size);
+  init_palette(&qrb, orig->width, orig->height, palette);
+  init_palette(&ref_qrb, orig->width, orig->height, ref_palette);
+  memset(palette, 0, sizeof(palette));
+  memset(ref_palette, 0, sizeof(ref_palette));
+
+  msGettimeofday(&start, NULL);
+  ref_quantize(&ref_rb, &ref_colors, ref_palette, &ref_maxval);
+  t_ref_quant = elapsed(&start);
+  ref_qrb.data.palette.num_entries = ref_colors;
+  msGettimeofday(&start, NULL);
+  ref_classify(&ref_rb, &ref_qrb);
+  t_ref_class = elapsed(&start);
+
+  qrb.data.palette.num_entries = ncolors;
+  msGettimeofday(&start, NULL);
+  msQuantizeRasterBuffer(&rb, &qrb.data.palette.num_entries, palette, NULL, 0, &maxval, sample);
+  t_quant = elapsed(&start);
+  msGettimeofday(&start, NULL);
+  msClassifyRasterBuffer(&rb, &qrb);
+  t_class = elapsed(&start);
+
+  same_palette = (qrb.data.palette.num_entries == ref_colors && maxval == ref_maxval &&
+                  memcmp(palette, ref_palette, ref_colors*sizeof(rgbaPixel)) == 0);
+  same_pixels = same_palette &&
+                memcmp(qrb.data.palette.pixels, ref_qrb.data.palette.pixels, orig->width*orig->height) == 0;
+
+  printf("%-22s quantize %7.4fs (was %7.4fs)  classify %7.4fs (was %7.4fs)  "
+         "psnr %5.2f (was %5.2f)  %s\n",
+         name, t_quant, t_ref_quant, t_class, t_ref_class,
+         psnr(orig, &qrb, maxval), psnr(orig, &ref_qrb, ref_maxval),
+         same_pixels ? "identical" : same_palette ? "PIXELS DIFFER" : "palette differs");
+
+  /* whatever the palette, the classification must be the nearest color */
+  if(!same_pixels) {
+    ref_qrb.data.palette.palette = palette;
+    ref_qrb.data.palette.num_entries = qrb.data.palette.num_entries;
+    ref_classify(&rb, &ref_qrb);
+    if(memcmp(qrb.data.palette.pixels, ref_qrb.data.palette.pixels, orig->width*orig->height) != 0) {
+      printf("%-22s classification differs from the linear search\n", name);
+      nearest = 0;
+    }
+  }
+
+  free(rb.data.rgba.pixels);
+  free(ref_rb.data.rgba.pixels);
+  free(qrb.data.palette.pixels);
+  free(ref_qrb.data.palette.pixels);
+
+  return ((sample == 0 && !same_pixels) || !nearest) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  rasterBufferObj img;
+  int failed = 0;
+
+  if(argc > 1) {
+    if(msLoadMSRasterBufferFromFile(argv[1], &img) != MS_SUCCESS) {
+      msWriteError(stderr);
+      return 2;
+    }
+    failed |= run(argv[1], &img, 256, 0);
+    run("  sampled 65536", &img, 256, 65536);
+    free(img.data.rgba.pixels);
+    return failed;
+  }
+
+  init_rgba(&img, 1024, 1024);
+  make_map(&img);
+  failed |= run("map 1024x1024", &img, 256, 0);
+  failed |= run("map, 64 colors", &img, 64, 0);
+  run("map, sampled 65536", &img, 256, 65536);
+  free(img.data.rgba.pixels);
+
+  init_rgba(&img, 1024, 1024);
+  make_photo(&img);
+  failed |= run("photo 1024x1024", &img, 256, 0);
+  run("photo, sampled 65536", &img, 256, 65536);
+  free(img.data.rgba.pixels);
+
+  return failed;
+}
@@ -0,0 +1,197 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Checks that threaded raster resampling is bit identical and times it.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+#if defined(USE_GDAL) && defined(USE_PROJ) && defined(USE_THREAD)
+#include "gdal.h"
+#include "cpl_vsi.h"
+
+/*
+** Writes a rotated GeoTIFF to /vsimem/ and draws it with the nearest,
+** bilinear and average resamplers, on one worker thread and on several
+** (WORKER_THREADS processing option), reporting the time per draw.
+** Exits with 1 if the images drawn with different thread counts are not
+** bit identical.
+*/
+
+#define TST_RASTER "/vsimem/resampletst.tif"
+#define TST_SIZE 1024
+#define TST_THREADS 4
+#define NUM_DRAWS 3
+
+static int createRaster(void)
+{
+  GDALDriverH hDriver = GDALGetDriverByName("GTiff");
+  GDALDatasetH hDS;
+  /* rotated, so RESAMPLE has real work to do */
+  double adfGeoTransform[6] = { 0.0, 1.0, 0.1, TST_SIZE, 0.1, -1.0 };
+  GByte *pabyData;
+  int x, y, b;
+
+  if(hDriver == NULL)
+    return MS_FAILURE;
+  hDS = GDALCreate(hDriver, TST_RASTER, TST_SIZE, TST_SIZE, 3, GDT_Byte, NULL);
+  if(hDS == NULL)
+    return MS_FAILURE;
+  GDALSetGeoTransform(hDS, adfGeoTransform);
+
+  /* neighbouring pixels all differ, so any shift or rounding change shows */
+  pabyData = (GByte *) msSmallMalloc(TST_SIZE * TST_SIZE);
+  for(b = 1; b <= 3; b++) {
+    for(y = 0; y < TST_SIZE; y++)
+      for(x = 0; x < TST_SIZE; x++)
+        pabyData[y * TST_SIZE + x] = (GByte) ((x * (5 + b) + y * (29 + b)) & 0xff);
+    if(GDALRasterIO(GDALGetRasterBand(hDS, b), GF_Write, 0, 0, TST_SIZE, TST_SIZE,
+                    pabyData, TST_SIZE, TST_SIZE, GDT_Byte, 0, 0) != CE_None) {
+      free(pabyData);
+      GDALClose(hDS);
+      return MS_FAILURE;
+    }
+  }
+  free(pabyData);
+  GDALClose(hDS);
+
+  return MS_SUCCESS;
+}
+
+/* draws NUM_DRAWS times and returns the last image, *pdfTime is the average */
+static imageObj *drawRaster(const char *mode, int nThreads, mapObj **map, double *pdfTime)
+{
+  char mapfile[1024];
+  struct mstimeval starttime, endtime;
+  imageObj *image = NULL;
+  int i;
+
+  snprintf(mapfile, sizeof(mapfile),
+           "MAP SIZE 800 600 EXTENT 50 50 950 725 "
+           "OUTPUTFORMAT NAME \"png\" DRIVER \"AGG/PNG\" IMAGEMODE RGB END "
+           "LAYER NAME \"r\" TYPE RASTER STATUS ON DATA \"" TST_RASTER "\" "
+           "PROCESSING \"RESAMPLE=%s\" PROCESSING \"WORKER_THREADS=%d\" END END",
+           mode, nThreads);
+
+  *map = msLoadMapFromString(mapfile, NULL);
+  if(*map == NULL)
+    return NULL;
+
+  msGettimeofday(&starttime, NULL);
+  for(i = 0; i < NUM_DRAWS; i++) {
+    if(image)
+      msFreeImage(image);
+    if((image = msDrawMap(*map, MS_FALSE)) == NULL)
+      return NULL;
+  }
+  msGettimeofday(&endtime, NULL);
+  *pdfTime = ((endtime.tv_sec + endtime.tv_usec / 1.0e6) -
+              (starttime.tv_sec + starttime.tv_usec / 1.0e6)) / NUM_DRAWS;
+  return image;
+}
+
+static int comparePixels(imageObj *a, imageObj *b, int *pnDiffering)
+{
+  rasterBufferObj ra, rb;
+  int x, y;
+
+  if(MS_IMAGE_RENDERER(a)->getRasterBufferHandle(a, &ra) != MS_SUCCESS ||
+      MS_IMAGE_RENDERER(b)->getRasterBufferHandle(b, &rb) != MS_SUCCESS)
+    return MS_FAILURE;
+
+  *pnDiffering = 0;
+  for(y = 0; y < (int) ra.height; y++) {
+    for(x = 0; x < (int) ra.width; x++) {
+      int offset = y * ra.data.rgba.row_step + x * ra.data.rgba.pixel_step;
+      if(ra.data.rgba.r[offset] != rb.data.rgba.r[offset] ||
+          ra.data.rgba.g[offset] != rb.data.rgba.g[offset] ||
+          ra.data.rgba.b[offset] != rb.data.rgba.b[offset] ||
+          (ra.data.rgba.a && ra.data.rgba.a[offset] != rb.data.rgba.a[offset]))
+        (*pnDiffering)++;
+    }
+  }
+  return MS_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *modes[] = { "NEAREST", "BILINEAR", "AVERAGE" };
+  int i, failures = 0;
+
+  if(msSetup() != MS_SUCCESS) {
+    msWriteError(stderr);
+    return 1;
+  }
+
+  msGDALInitialize();
+  if(createRaster() != MS_SUCCESS) {
+    printf("could not create %s\n", TST_RASTER);
+    msCleanup();
+    return 1;
+  }
+
+  for(i = 0; i < (int) (sizeof(modes) / sizeof(modes[0])); i++) {
+    imageObj *serial, *threaded;
+    mapObj *map1 = NULL, *map2 = NULL;
+    double dfSerial = 0.0, dfThreaded = 0.0;
+    int nDiffering = -1;
+
+    serial = drawRaster(modes[i], 1, &map1, &dfSerial);
+    threaded = drawRaster(modes[i], TST_THREADS, &map2, &dfThreaded);
+    if(serial == NULL || threaded == NULL || comparePixels(serial, threaded, &nDiffering) != MS_SUCCESS) {
+      msWriteError(stderr);
+      failures++;
+    } else {
+      printf("%s: %.3fs on 1 thread, %.3fs on %d threads, %d pixels differ\n",
+             modes[i], dfSerial, dfThreaded, TST_THREADS, nDiffering);
+      if(nDiffering != 0)
+        failures++;
+    }
+    if(serial) msFreeImage(serial);
+    if(threaded) msFreeImage(threaded);
+    if(map1) msFreeMap(map1);
+    if(map2) msFreeMap(map2);
+  }
+
+  VSIUnlink(TST_RASTER);
+  msCleanup();
+
+  if(failures) {
+    printf("%d resampling mode(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("resampletst requires GDAL, PROJ and thread support\n");
+  return 0;
+}
+
+#endif /* USE_GDAL && USE_PROJ && USE_THREAD */
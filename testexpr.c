@@ -27,45 +27,302 @@
  * DEALINGS IN THE SOFTWARE.
  ****************************************************************************/
 
-#include <time.h>
+/*
+** Differential tester and micro-benchmark of the compiled expression
+** evaluator (mapexpression.c): every expression is evaluated for every
+** sample feature both by msEvalExpression()/msEvalTextExpression() and
+** directly by yyparse(), which is what they used to do, and the results
+** are compared.
+*/
 
 #include "mapserver.h"
-#include "mapparser.h"
-#include "mapfile.h"
+#include "maptime.h"
 
+extern int yyparse(parseObj *);
 
+static char *items[] = { "name", "pop", "code", "date", "note" };
+#define NUMITEMS 5
 
-extern int msyyparse();
-extern int msyylex();
-extern char *msyystring_buffer;
+static char *rows[][NUMITEMS] = {
+  { "Paris", "2200000", "75", "2015-01-12", "capital,city" },
+  { "saint-denis", "110000", "93", "2014-06-30", "" },
+  { "Lyon", "500000.5", "69", "bad date", "a,b,,c" },
+  { "", "0", "0", "2015-01-12T10:00:00", "x" },
+  { "nantes", "-12", "44", "2000", "Lyon" },
+  { "Saint-Malo", "46000", "35abc", "2015", "nantes,Lyon" }
+};
+#define NUMROWS (sizeof(rows)/sizeof(rows[0]))
 
-extern int msyyresult; /* result of parsing, true/false */
-extern int msyystate;
-extern char *msyystring;
+static const char *expressions[] = {
+  /* numbers */
+  "([pop] > 100000)",
+  "([pop] > 100000 and [code] < 80)",
+  "([pop] >= 500000.5 or [code] = 93)",
+  "([pop] != 0 and [code] <= 69 or [code] ge 93)",
+  "([pop] * 2 + 1 > [code] * 10000 - 5)",
+  "([pop] / [code] > 1000)",
+  "([pop] % 7 = 0)",
+  "(2 ^ 3 ^ 2 = 512)",
+  "(-2 ^ 2 = 4)",
+  "(- [pop] = [pop])",
+  "(round([pop], 1000) = 500000)",
+  "([code] in '75,93,69')",
+  "([code] in '75 , 93,')",
+  "([pop] in '[note]')",
+  "([pop] =* 0)",
+  /* logic */
+  "(true)",
+  "(false or [pop])",
+  "([pop] and [code])",
+  "(not [pop] > 1000)",
+  "(not ([pop] > 1000) and [code] != 75)",
+  "(not not [code])",
+  "(not true = false)",
+  "(1 = 1 = true)",
+  "(true = ([pop] > 0))",
+  "(true and false or true)",
+  "([pop] > 1 and not [code] < 80 or '[name]' ~ 'a')",
+  /* strings */
+  "('[name]' = 'Paris')",
+  "('[name]' == 'Paris' or '[name]' eq 'Lyon')",
+  "('[name]' =* 'paris')",
+  "('[name]' < 'M')",
+  "('[name]' >= 'Lyon' and '[name]' ne 'nantes')",
+  "('[name]' ~ '^[A-Z]')",
+  "('[name]' ~* '^s')",
+  "('[name]' ~ '[')",
+  "('[name]' ~ '[note]')",
+  "('[name]' in 'Paris,Lyon,Nantes')",
+  "('[note]' in 'x,,y')",
+  "('' in 'a,,b')",
+  "('[name]' in '[note]')",
+  "(length('[name]') > 4)",
+  "(length('[name]' + '[note]') = 10)",
+  "(upper('[name]') = 'PARIS')",
+  "(lower('[name]') = 'paris')",
+  "(initcap('[name]') = 'Saint-denis')",
+  "(firstcap('[name]') = 'Lyon')",
+  "(commify('[pop]') = '2,200,000')",
+  "(tostring([pop], '%.1f') = '500000.5')",
+  "('[name]')",
+  /* time */
+  "(`[date]` = `2015-01-12`)",
+  "(`[date]` < `2015-01-01`)",
+  "(`[date]` =* `2015-01-12`)",
+  /* evaluation errors, on either side of AND and OR */
+  "([pop] / ([code] - [code]) > 1)",
+  "([code] > 50 or [pop] / 0)",
+  "([code] > 50 and `[date]` > `2000-01-01`)",
+  "(area([shape]) > 0)",
+  "([shape] intersects fromText('POINT(1 1)'))",
+  /* left to yyparse() */
+  "(buffer([shape], 1) intersects [shape])",
+  "(true = not false)",
+  /* syntax errors */
+  "([pop] > )",
+  "(1 < 2 < 3)",
+  "('[name]' = 1)",
+  "([pop] [code])",
+  /* text results */
+  "([pop])",
+  "([pop] + 1)",
+  "('[name]' + ', ' + '[code]')",
+  "(upper('[name]') + ':' + tostring([pop] / 1000, '%.0fk'))",
+  NULL
+};
+
+static int reference_eval(expressionObj *e, shapeObj *shape)
+{
+  parseObj p;
+
+  memset(&p, 0, sizeof(p));
+  p.shape = shape;
+  p.expr = e;
+  p.expr->curtoken = e->tokens;
+  p.type = MS_PARSE_TYPE_BOOLEAN;
+  if(yyparse(&p) != 0) return MS_FALSE;
+  return p.result.intval;
+}
+
+static char *reference_text(expressionObj *e, shapeObj *shape)
+{
+  parseObj p;
+
+  memset(&p, 0, sizeof(p));
+  p.shape = shape;
+  p.expr = e;
+  p.expr->curtoken = e->tokens;
+  p.type = MS_PARSE_TYPE_STRING;
+  if(yyparse(&p) != 0) return NULL;
+  if(p.result.strval && !strlen(p.result.strval)) {
+    free(p.result.strval);
+    return NULL;
+  }
+  return p.result.strval;
+}
+
+static void load_expression(expressionObj *e, const char *string)
+{
+  char **list = (char **) msSmallMalloc(sizeof(char *) * NUMITEMS);
+  int i, numitems = NUMITEMS;
+
+  for(i=0; i<NUMITEMS; i++) list[i] = msStrdup(items[i]);
+  msInitExpression(e);
+  e->string = msStrdup(string);
+  e->type = MS_EXPRESSION;
+  msTokenizeExpression(e, list, &numitems); /* the items are known, the list doesn't grow */
+  msFreeCharArray(list, numitems);
+}
+
+static void init_shapes(shapeObj *shapes)
+{
+  unsigned int i;
+
+  for(i=0; i<NUMROWS; i++) {
+    msInitShape(&shapes[i]);
+    shapes[i].values = rows[i];
+    shapes[i].numvalues = NUMITEMS;
+  }
+}
+
+/* the rows are static, only the number caches belong to the shapes */
+static void free_shapes(shapeObj *shapes)
+{
+  unsigned int i;
+
+  for(i=0; i<NUMROWS; i++) {
+    shapes[i].values = NULL;
+    shapes[i].numvalues = 0;
+    msFreeShape(&shapes[i]);
+  }
+}
+
+static int compare(const char *string, shapeObj *shapes, int verbose)
+{
+  expressionObj e;
+  unsigned int i;
+  int failures = 0;
+
+  load_expression(&e, string);
+  if(verbose)
+    printf("%-60s %s\n", string, e.program ? "compiled" : "yyparse");
+
+  for(i=0; i<NUMROWS; i++) {
+    int expected = reference_eval(&e, &shapes[i]);
+    int result = msEvalExpression(NULL, &shapes[i], &e, -1);
+    char *expected_text = reference_text(&e, &shapes[i]);
+    char *text = msEvalTextExpression(&e, &shapes[i]);
+
+    if(verbose)
+      printf("  row %u: %d \"%s\"\n", i, result, text ? text : "(null)");
+    if(result != expected) {
+      printf("MISMATCH %s row %u: %d, yyparse says %d\n", string, i, result, expected);
+      failures++;
+    }
+    if((text == NULL) != (expected_text == NULL) || (text && strcmp(text, expected_text) != 0)) {
+      printf("MISMATCH %s row %u: \"%s\", yyparse says \"%s\"\n", string, i,
+             text ? text : "(null)", expected_text ? expected_text : "(null)");
+      failures++;
+    }
+    msFree(text);
+    msFree(expected_text);
+    msResetErrorList();
+  }
+
+  msFreeExpression(&e);
+  return failures;
+}
+
+static double elapsed(struct mstimeval *start)
+{
+  struct mstimeval end;
+  msGettimeofday(&end, NULL);
+  return (end.tv_sec+end.tv_usec/1.0e6) - (start->tv_sec+start->tv_usec/1.0e6);
+}
+
+/* a layer with a few typical CLASS EXPRESSIONs, first match wins */
+static const char *classes[] = {
+  "('[name]' = 'Paris')",
+  "([pop] > 1000000)",
+  "([pop] > 100000 and [code] < 80)",
+  "('[name]' in 'Lyon,Marseille,Toulouse,Nice')",
+  "('[name]' ~* '^saint')",
+  "([code] = 44 or [code] = 35)",
+  "(length('[name]') > 10)",
+  "(`[date]` < `2015-01-01`)",
+  NULL
+};
+
+static void benchmark(shapeObj *shapes, int features)
+{
+  expressionObj e[16];
+  struct mstimeval start;
+  double ref_seconds, seconds;
+  int i, j, n, sum = 0, ref_sum = 0;
+
+  for(n=0; classes[n]; n++)
+    load_expression(&e[n], classes[n]);
+
+  msGettimeofday(&start, NULL);
+  for(i=0; i<features; i++)
+    for(j=0; j<n; j++)
+      if(reference_eval(&e[j], &shapes[i % NUMROWS])) {
+        ref_sum += j;
+        break;
+      }
+  ref_seconds = elapsed(&start);
+  msResetErrorList();
+
+  msGettimeofday(&start, NULL);
+  for(i=0; i<features; i++)
+    for(j=0; j<n; j++)
+      if(msEvalExpression(NULL, &shapes[i % NUMROWS], &e[j], -1)) {
+        sum += j;
+        break;
+      }
+  seconds = elapsed(&start);
+  msResetErrorList();
+
+  printf("%d features, %d classes: yyparse %.3fs, compiled %.3fs, x%.1f%s\n",
+         features, n, ref_seconds, seconds, ref_seconds / seconds,
+         (sum == ref_sum) ? "" : " (CLASSIFICATION MISMATCH)");
+
+  for(j=0; j<n; j++)
+    msFreeExpression(&e[j]);
+}
 
 int main(int argc, char *argv[])
 {
-  int status;
+  shapeObj shapes[NUMROWS];
+  int i, failures = 0, features = 200000;
 
   if(argc > 1 && strcmp(argv[1], "-v") == 0) {
     printf("%s\n", msGetVersion());
     exit(0);
   }
-
-  /* ---- check the number of arguments, return syntax if not correct ---- */
-  if( argc < 2) {
-    fprintf(stdout, "Syntax: testexpr [string]\n");
+  if(argc > 1 && strcmp(argv[1], "-h") == 0) {
+    printf("Usage: testexpr [expression | -b features]\n");
     exit(0);
   }
 
-  msyystate = MS_TOKENIZE_EXPRESSION;
-  msyystring = argv[1];
+  init_shapes(shapes);
+
+  /* one expression, evaluated for each sample feature */
+  if(argc > 1 && strcmp(argv[1], "-b") != 0) {
+    failures = compare(argv[1], shapes, MS_TRUE);
+    free_shapes(shapes);
+    exit(failures ? 1 : 0);
+  }
+  if(argc > 2)
+    features = atoi(argv[2]);
+
+  for(i=0; expressions[i]; i++)
+    failures += compare(expressions[i], shapes, MS_FALSE);
+  printf("%d expressions, %d mismatches\n", i, failures);
 
-  status = msyyparse();
-  if(status != 0)
-    printf("Error parsing expression near %s.\n", msyystring_buffer);
-  else
-    printf("Expression evalulated to: %d.\n", msyyresult);
+  benchmark(shapes, features);
 
-  exit(0);
+  free_shapes(shapes);
+  msCleanup();
+  exit(failures ? 1 : 0);
 }
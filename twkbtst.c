@@ -0,0 +1,413 @@
+/******************************************************************************
+ *
+ * Project:  MapServer
+ * Purpose:  Unit test and benchmark of the PostGIS TWKB geometry decoder.
+ * Author:   MapServer team.
+ *
+ ******************************************************************************
+ * Copyright (c) 1996-2005 Regents of the University of Minnesota.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies of this Software or works derived from this Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+
+#include "mapserver.h"
+#include "maptime.h"
+
+#ifdef USE_POSTGIS
+#include "mappostgis.h"
+
+/*
+** Decodes hand encoded TWKB geometries with msPostGISReadTWKB() and checks
+** the resulting lines: precision, bbox, size, extended dimensions, id list
+** and empty flags, multi geometries and collections, and truncated input.
+** Then reports the time taken to decode a long linestring as TWKB and as
+** the equivalent WKB.  Exits with 1 if any geometry is decoded wrongly.
+*/
+
+typedef struct {
+  unsigned char buf[1024];
+  size_t size;
+} twkbBuf;
+
+static void putByte(twkbBuf *b, int c)
+{
+  b->buf[b->size++] = (unsigned char)c;
+}
+
+static void putUVarInt(twkbBuf *b, unsigned long v)
+{
+  while(v >= 0x80) {
+    putByte(b, (int)(v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  putByte(b, (int)v);
+}
+
+static void putVarInt(twkbBuf *b, long v)
+{
+  putUVarInt(b, ((unsigned long)v << 1) ^ (unsigned long)(v >> (sizeof(long) * 8 - 1)));
+}
+
+/* type byte, with the precision zig-zag encoded in the high nibble */
+static void putHeader(twkbBuf *b, int type, int precision, int metabyte)
+{
+  putByte(b, type | (((precision << 1) ^ (precision >> 31)) << 4));
+  putByte(b, metabyte);
+}
+
+/* point array, as deltas from the running point */
+static void putPoints(twkbBuf *b, long *last, const long *xy, int npoints)
+{
+  int i;
+  putUVarInt(b, npoints);
+  for(i = 0; i < npoints; i++) {
+    putVarInt(b, xy[2*i] - last[0]);
+    putVarInt(b, xy[2*i+1] - last[1]);
+    last[0] = xy[2*i];
+    last[1] = xy[2*i+1];
+  }
+}
+
+static int failures = 0;
+
+/*
+** Decode buf into a shape of the given type and compare it with the
+** expected lines, given as a flat x,y list with the point count of each.
+*/
+static void check(const char *name, twkbBuf *b, double step, double originx, double originy,
+                  int shapetype, int expected_rv, int nlines, const int *npoints, const double *xy)
+{
+  shapeObj shape;
+  pointObj origin;
+  int rv, i, j, k = 0, ok = MS_TRUE;
+
+  msInitShape(&shape);
+  shape.type = shapetype;
+  origin.x = originx;
+  origin.y = originy;
+  rv = msPostGISReadTWKB((char*)b->buf, b->size, step, &origin, &shape);
+
+  if(rv != expected_rv || shape.numlines != nlines)
+    ok = MS_FALSE;
+  for(i = 0; ok && i < nlines; i++) {
+    if(shape.line[i].numpoints != npoints[i]) {
+      ok = MS_FALSE;
+      break;
+    }
+    for(j = 0; j < npoints[i]; j++, k += 2) {
+      if(fabs(shape.line[i].point[j].x - xy[k]) > 1e-9 ||
+          fabs(shape.line[i].point[j].y - xy[k+1]) > 1e-9) {
+        ok = MS_FALSE;
+        break;
+      }
+    }
+  }
+
+  printf("%-36s %s (returned %d, %d lines)\n", name, ok ? "ok" : "FAILED", rv, shape.numlines);
+  if(!ok)
+    failures++;
+  msFreeShape(&shape);
+}
+
+static void testTWKB(void)
+{
+  twkbBuf b;
+  long last[2];
+
+  /* ST_AsTWKB('LINESTRING(1 1,5 5)'), from the PostGIS documentation */
+  {
+    static const unsigned char doc[] = { 0x02, 0x00, 0x02, 0x02, 0x02, 0x08, 0x08 };
+    static const int np[] = { 2 };
+    static const double xy[] = { 1, 1, 5, 5 };
+    memcpy(b.buf, doc, sizeof(doc));
+    b.size = sizeof(doc);
+    check("linestring", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 1, 1, np, xy);
+
+    /* grid step and origin */
+    {
+      static const double xy2[] = { 100.5, 200.5, 102.5, 202.5 };
+      check("linestring step and origin", &b, 0.5, 100.0, 200.0, MS_SHAPE_LINE, 1, 1, np, xy2);
+    }
+
+    b.size--;
+    check("truncated linestring", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, -1, 0, NULL, NULL);
+  }
+
+  /* positive and negative precision */
+  {
+    static const long pts[] = { 15, 25, -5, 35 };
+    static const int np[] = { 2 };
+    static const double xy1[] = { 1.5, 2.5, -0.5, 3.5 };
+    static const double xy2[] = { 150, 250, -50, 350 };
+    b.size = 0;
+    last[0] = last[1] = 0;
+    putHeader(&b, WKB_LINESTRING, 1, 0);
+    putPoints(&b, last, pts, 2);
+    check("precision 1", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 1, 1, np, xy1);
+
+    b.size = 0;
+    last[0] = last[1] = 0;
+    putHeader(&b, WKB_LINESTRING, -1, 0);
+    putPoints(&b, last, pts, 2);
+    check("precision -1", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 1, 1, np, xy2);
+  }
+
+  /* bbox and size ahead of a polygon with a hole */
+  {
+    static const long shell[] = { 0, 0, 10, 0, 10, 10, 0, 0 };
+    static const long hole[] = { 2, 2, 4, 2, 4, 4, 2, 2 };
+    static const int np[] = { 4, 4 };
+    static const double xy[] = { 0, 0, 10, 0, 10, 10, 0, 0, 2, 2, 4, 2, 4, 4, 2, 2 };
+    twkbBuf body;
+
+    body.size = 0;
+    last[0] = last[1] = 0;
+    putUVarInt(&body, 2);
+    putPoints(&body, last, shell, 4);
+    putPoints(&body, last, hole, 4);
+
+    b.size = 0;
+    putHeader(&b, WKB_POLYGON, 0, 0x01 | 0x02);
+    putUVarInt(&b, body.size + 4); /* the size counts the bbox too */
+    putVarInt(&b, 0);
+    putVarInt(&b, 10);
+    putVarInt(&b, 0);
+    putVarInt(&b, 10);
+    memcpy(b.buf + b.size, body.buf, body.size);
+    b.size += body.size;
+    check("polygon with bbox and size", &b, 1.0, 0.0, 0.0, MS_SHAPE_POLYGON, 2, 2, np, xy);
+  }
+
+  /* extended dimensions, z is read and dropped */
+  {
+    static const int np[] = { 2 };
+    static const double xy[] = { 1, 2, 4, 6 };
+    b.size = 0;
+    putHeader(&b, WKB_LINESTRING, 0, 0x08);
+    putByte(&b, 0x01 | (3 << 2)); /* has z, z precision */
+    putUVarInt(&b, 2);
+    putVarInt(&b, 1);
+    putVarInt(&b, 2);
+    putVarInt(&b, 1000);
+    putVarInt(&b, 3);
+    putVarInt(&b, 4);
+    putVarInt(&b, -7);
+    check("linestring z", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 1, 1, np, xy);
+  }
+
+  /* multilinestring with an id list, deltas run on across the parts */
+  {
+    static const long l1[] = { 0, 0, 5, 5 };
+    static const long l2[] = { 10, 10, 20, 0, 30, 10 };
+    static const int np[] = { 2, 3 };
+    static const double xy[] = { 0, 0, 5, 5, 10, 10, 20, 0, 30, 10 };
+    b.size = 0;
+    last[0] = last[1] = 0;
+    putHeader(&b, WKB_MULTILINESTRING, 0, 0x04);
+    putUVarInt(&b, 2);
+    putVarInt(&b, 17);
+    putVarInt(&b, -3);
+    putPoints(&b, last, l1, 2);
+    putPoints(&b, last, l2, 3);
+    check("multilinestring with id list", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 2, 2, np, xy);
+  }
+
+  /* multipolygon of a polygon and a polygon with a hole */
+  {
+    static const long p1[] = { 0, 0, 1, 0, 1, 1, 0, 0 };
+    static const long p2[] = { 5, 5, 9, 5, 9, 9, 5, 5 };
+    static const long h2[] = { 6, 6, 7, 6, 7, 7, 6, 6 };
+    static const int np[] = { 4, 4, 4 };
+    static const double xy[] = { 0, 0, 1, 0, 1, 1, 0, 0, 5, 5, 9, 5, 9, 9, 5, 5, 6, 6, 7, 6, 7, 7, 6, 6 };
+    b.size = 0;
+    last[0] = last[1] = 0;
+    putHeader(&b, WKB_MULTIPOLYGON, 0, 0);
+    putUVarInt(&b, 2);
+    putUVarInt(&b, 1);
+    putPoints(&b, last, p1, 4);
+    putUVarInt(&b, 2);
+    putPoints(&b, last, p2, 4);
+    putPoints(&b, last, h2, 4);
+    check("multipolygon", &b, 1.0, 0.0, 0.0, MS_SHAPE_POLYGON, 3, 3, np, xy);
+  }
+
+  /* multipoint, kept by a point shape and dropped by a line shape */
+  {
+    static const long pts[] = { 3, 4, -3, -4 };
+    static const int np[] = { 1, 1 };
+    static const double xy[] = { 3, 4, -3, -4 };
+    int i;
+    b.size = 0;
+    last[0] = last[1] = 0;
+    putHeader(&b, WKB_MULTIPOINT, 0, 0x04);
+    putUVarInt(&b, 2);
+    putVarInt(&b, 1);
+    putVarInt(&b, 2);
+    for(i = 0; i < 2; i++) {
+      putVarInt(&b, pts[2*i] - last[0]);
+      putVarInt(&b, pts[2*i+1] - last[1]);
+      last[0] = pts[2*i];
+      last[1] = pts[2*i+1];
+    }
+    check("multipoint", &b, 1.0, 0.0, 0.0, MS_SHAPE_POINT, 2, 2, np, xy);
+    check("multipoint in a line shape", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 0, 0, NULL, NULL);
+  }
+
+  /* collection of a point, an empty linestring and a linestring, each
+     member has its own header and restarts the deltas */
+  {
+    static const long l[] = { 7, 7, 8, 9 };
+    static const int np[] = { 2 };
+    static const double xy[] = { 7, 7, 8, 9 };
+    b.size = 0;
+    putHeader(&b, WKB_GEOMETRYCOLLECTION, 0, 0);
+    putUVarInt(&b, 3);
+    putHeader(&b, WKB_POINT, 0, 0);
+    putVarInt(&b, 100);
+    putVarInt(&b, 100);
+    putHeader(&b, WKB_LINESTRING, 0, 0x10);
+    putHeader(&b, WKB_LINESTRING, 0, 0);
+    last[0] = last[1] = 0;
+    putPoints(&b, last, l, 2);
+    check("geometry collection", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, 1, 1, np, xy);
+  }
+
+  /* empty geometry */
+  b.size = 0;
+  putHeader(&b, WKB_POLYGON, 0, 0x10);
+  check("empty polygon", &b, 1.0, 0.0, 0.0, MS_SHAPE_POLYGON, 0, 0, NULL, NULL);
+
+  /* a point count larger than the remaining input */
+  b.size = 0;
+  putHeader(&b, WKB_LINESTRING, 0, 0);
+  putUVarInt(&b, 1000000);
+  putVarInt(&b, 1);
+  putVarInt(&b, 1);
+  check("oversized point count", &b, 1.0, 0.0, 0.0, MS_SHAPE_LINE, -1, 0, NULL, NULL);
+}
+
+/*
+** Time the decoding of a linestring of npoints quantized points as TWKB,
+** and as WKB doubles like an unquantized query returns it.
+*/
+static void benchmark(int npoints, int iterations)
+{
+  unsigned char *twkb, *wkb, *p;
+  size_t twkbsize = 0;
+  struct mstimeval start, end;
+  double twkbtime, wkbtime;
+  shapeObj shape;
+  wkbObj w;
+  pointObj origin = {0};
+  long lastx = 0, lasty = 0;
+  int i, n;
+  twkbBuf tb;
+
+  twkb = (unsigned char*)msSmallMalloc(npoints * 8 + 16);
+  wkb = (unsigned char*)msSmallMalloc(npoints * 16 + 9);
+
+  tb.size = 0;
+  putHeader(&tb, WKB_LINESTRING, 0, 0);
+  putUVarInt(&tb, npoints);
+  memcpy(twkb, tb.buf, tb.size);
+  twkbsize = tb.size;
+
+  p = wkb;
+  *p++ = 1; /* little endian, as requested by the layer on x86 */
+  i = WKB_LINESTRING;
+  memcpy(p, &i, 4);
+  p += 4;
+  memcpy(p, &npoints, 4);
+  p += 4;
+
+  for(i = 0; i < npoints; i++) {
+    long x = 1000 + (long)(500 * cos(i * 0.01)) + i / 10;
+    long y = 1000 + (long)(500 * sin(i * 0.013));
+    double d;
+    tb.size = 0;
+    putVarInt(&tb, x - lastx);
+    putVarInt(&tb, y - lasty);
+    memcpy(twkb + twkbsize, tb.buf, tb.size);
+    twkbsize += tb.size;
+    lastx = x;
+    lasty = y;
+    d = x * 0.5;
+    memcpy(p, &d, 8);
+    d = y * 0.5;
+    memcpy(p + 8, &d, 8);
+    p += 16;
+  }
+
+  msGettimeofday(&start, NULL);
+  for(n = 0; n < iterations; n++) {
+    msInitShape(&shape);
+    shape.type = MS_SHAPE_LINE;
+    msPostGISReadTWKB((char*)twkb, twkbsize, 0.5, &origin, &shape);
+    msFreeShape(&shape);
+  }
+  msGettimeofday(&end, NULL);
+  twkbtime = (end.tv_sec + end.tv_usec / 1.0e6) - (start.tv_sec + start.tv_usec / 1.0e6);
+
+  msGettimeofday(&start, NULL);
+  for(n = 0; n < iterations; n++) {
+    msInitShape(&shape);
+    shape.type = MS_SHAPE_LINE;
+    w.wkb = w.ptr = (char*)wkb;
+    w.size = p - wkb;
+    w.typemap = msPostGISWKBTypeMap(20000);
+    wkbConvGeometryToShape(&w, &shape);
+    msFreeShape(&shape);
+  }
+  msGettimeofday(&end, NULL);
+  wkbtime = (end.tv_sec + end.tv_usec / 1.0e6) - (start.tv_sec + start.tv_usec / 1.0e6);
+
+  printf("%d points x %d: twkb %ld bytes %.3fs, wkb %ld bytes %.3fs\n",
+         npoints, iterations, (long)twkbsize, twkbtime, (long)(p - wkb), wkbtime);
+
+  free(twkb);
+  free(wkb);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = 200;
+
+  if(argc > 1)
+    iterations = atoi(argv[1]);
+
+  testTWKB();
+  if(iterations > 0)
+    benchmark(10000, iterations);
+
+  if(failures) {
+    printf("%d TWKB test(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("twkbtst requires PostGIS support\n");
+  return 0;
+}
+
+#endif /* USE_POSTGIS */